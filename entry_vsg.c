@@ -106,6 +106,8 @@ typedef enum SpriteID {
 } SpriteID;
 
 Sprite sprites[SPRITE_MAX];
+// All sprites are packed in one atlas so they can be drawn without switching textures
+Texture_Atlas sprite_atlas;
 
 Sprite* get_sprite(SpriteID id){
     if (id >= 0 && id < SPRITE_MAX){
@@ -387,6 +389,9 @@ typedef struct World{
     float64 time_elapsed;
 } World;
 World* world = 0;
+// Everything that lives for one run of the level goes here, and is dropped all at once when
+// the world is reset instead of going through the heap.
+Arena level_arena = {0};
 
 //:serialisation
 bool world_save_to_disk() {
@@ -549,7 +554,11 @@ void teardown_world(){
 }
 
 World* world_create() {
-    return world;
+    // Drop the previous run. Memory is given back to the OS if the last run grew the arena.
+    arena_reset_and_decommit(&level_arena);
+    World* new_world = arena_push_struct(&level_arena, World);
+    memset(new_world, 0, sizeof(World));
+    return new_world;
 }
 
 void render_sprite_entity(Entity* en){
@@ -834,10 +843,11 @@ int entry(int argc, char **argv) {
 	seed_for_random = rdtsc();
 	
     {
-        sprites[0] = (Sprite){.image = load_image_from_disk(fixed_string("res\\sprites\\undefined.png"), get_heap_allocator()) };
-        sprites[SPRITE_player] = (Sprite){.image = load_image_from_disk(fixed_string("res\\sprites\\player.png"), get_heap_allocator()) };
-        sprites[SPRITE_monster] = (Sprite){.image = load_image_from_disk(fixed_string("res\\sprites\\monster.png"), get_heap_allocator()) };
-        sprites[SPRITE_experience] = (Sprite){.image = load_image_from_disk(fixed_string("res\\sprites\\sword.png"), get_heap_allocator()) };
+        texture_atlas_init(&sprite_atlas, 1024, 1024, 4, get_heap_allocator());
+        sprites[0] = (Sprite){.image = texture_atlas_load_image_from_disk(&sprite_atlas, fixed_string("res\\sprites\\undefined.png")) };
+        sprites[SPRITE_player] = (Sprite){.image = texture_atlas_load_image_from_disk(&sprite_atlas, fixed_string("res\\sprites\\player.png")) };
+        sprites[SPRITE_monster] = (Sprite){.image = texture_atlas_load_image_from_disk(&sprite_atlas, fixed_string("res\\sprites\\monster.png")) };
+        sprites[SPRITE_experience] = (Sprite){.image = texture_atlas_load_image_from_disk(&sprite_atlas, fixed_string("res\\sprites\\sword.png")) };
 		
         for (SpriteID i = 0; i < SPRITE_MAX; i++) {
 			Sprite* sprite = &sprites[i];
@@ -845,8 +855,8 @@ int entry(int argc, char **argv) {
 		}
     }
 
-    world = alloc(get_heap_allocator(), sizeof(World));
-    memset(world, 0, sizeof(World));
+    level_arena = make_arena(MB(64));
+    world = world_create();
     setup_world();
 
     debug_render = true;
@@ -868,6 +878,7 @@ int entry(int argc, char **argv) {
 
         if(reset_world){
             teardown_world();
+            world = world_create();
             setup_world();
             reset_world = false;
         }
@@ -1230,7 +1241,7 @@ int entry(int argc, char **argv) {
 				log("loaded ");
 			}
 			if (is_key_just_pressed('K') && is_key_down(KEY_SHIFT)) {
-				memset(world, 0, sizeof(World));
+				world = world_create();
 				setup_world();
 				log("reset");
 			}
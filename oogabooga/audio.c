@@ -1179,58 +1179,33 @@ typedef struct Audio_Player {
 	Audio_Playback_Config config;
 	
 } Audio_Player;
-#define AUDIO_PLAYERS_PER_BLOCK 128
-typedef struct Audio_Player_Block {
-	Audio_Player players[AUDIO_PLAYERS_PER_BLOCK]; // Players need to be persistent in memory
-	
-	struct Audio_Player_Block *next;
-} Audio_Player_Block;
+#define AUDIO_PLAYERS_PER_CHUNK 128
 
 // #Global
-ogb_instance Audio_Player_Block audio_player_block;
+// Players need to be persistent in memory, pool slots never move.
+// Thread safe because players are released on the audio thread.
+ogb_instance Pool audio_player_pool;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-Audio_Player_Block audio_player_block = {0};
+Pool audio_player_pool = {0};
 #endif
 
 Audio_Player *
 audio_player_get_one() {
 
-	Audio_Player_Block *block = &audio_player_block;
-	Audio_Player_Block *last = 0;
-	
-	while (block) {
-		
-		for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
-			if (!block->players[i].allocated) {
-			
-				memset(&block->players[i], 0, sizeof(block->players[i]));
-				block->players[i].allocated = true;
-				block->players[i].config.volume = 1.0;
-				block->players[i].config.playback_speed = 1.0;
-				
-				return &block->players[i];
-			}
-		}
-		
-		last = block;
-		block = block->next;
+	if (!audio_player_pool.slot_size) {
+		audio_player_pool = make_pool_for(Audio_Player, AUDIO_PLAYERS_PER_CHUNK, get_heap_allocator(), true);
 	}
 	
-	// No free player found, make another block
-	// #Volatile can't assign to last->next before this is zero initialized
-	Audio_Player_Block *new_block = alloc(get_heap_allocator(), sizeof(Audio_Player_Block));
+	Audio_Player *p = pool_alloc_struct(&audio_player_pool, Audio_Player);
 	
-#if !DO_ZERO_INITIALIATION
-	memset(new_block, 0, sizeof(*new_block));
-#endif
-
-	last->next = new_block;
-
-	new_block->players[0].allocated = true;
-	new_block->players[0].config.volume = 1.0;
-	block->players[0].config.playback_speed = 1.0;
-	return &new_block->players[0];
+	memset(p, 0, sizeof(*p));
+	p->config.volume = 1.0;
+	p->config.playback_speed = 1.0;
+	MEMORY_BARRIER;
+	p->allocated = true;
+	
+	return p;
 }
 
 void 
@@ -1668,8 +1643,6 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
     
 	memset(output, 0, output_size);
 	
-	Audio_Player_Block *block = &audio_player_block;
-	
 	// #Cleanup #Memory refactor intermediate buffers
 	local_persist thread_local void *mix_buffer = 0;
 	local_persist thread_local u64 mix_buffer_size;
@@ -1681,21 +1654,21 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 	u64 *started_this_frame;
 	growing_array_init((void**)&started_this_frame, sizeof(u64), get_temporary_allocator());
 	
-	while (block) {
+	Pool_Chunk *chunk = audio_player_pool.chunks;
+	while (chunk) {
 		
-		for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
-			Audio_Player *p = &block->players[i];
-			if (p->release_when_done && (p->frame_index >= p->source.number_of_frames
-										  || !p->has_source)) {
-				p->allocated = false;
-			}
+		for (u64 i = 0; i < chunk->slot_count; i++) {
+			Audio_Player *p = (Audio_Player*)pool_chunk_get_slot(&audio_player_pool, chunk, i);
 			if (!p->allocated) {
 				continue;
 			}
 			
-			if (p->marked_for_release) {
+			bool done = p->release_when_done && (p->frame_index >= p->source.number_of_frames
+			                                     || !p->has_source);
+			if (done || p->marked_for_release) {
 				p->marked_for_release = false;
 				p->allocated = false;
+				pool_free(&audio_player_pool, p);
 				continue;
 			}
 			
@@ -1884,6 +1857,6 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 			mutex_release(&src.mutex_for_destroy);
 		}
 		
-		block = block->next;
+		chunk = chunk->next;
 	}
 }
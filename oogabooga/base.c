@@ -114,6 +114,19 @@ alloc_uninitialized(Allocator allocator, u64 size);
 ogb_instance void 
 dealloc(Allocator allocator, void *p);
 
+#if ENABLE_HEAP_PROFILING
+// alloc & alloc_uninitialized become macros that pass their file & line to these, so the heap
+// profiler knows who allocated what. See Heap profiling in memory.c
+ogb_instance void* 
+alloc_at(Allocator allocator, u64 size, const char *file, u32 line);
+
+ogb_instance void* 
+alloc_uninitialized_at(Allocator allocator, u64 size, const char *file, u32 line);
+
+ogb_instance void 
+heap_profile_set_callsite(const char *file, u32 line);
+#endif
+
 ogb_instance void 
 push_context(Context c);
 
@@ -151,6 +164,24 @@ dealloc(Allocator allocator, void *p) {
 	allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
 }
 
+#if ENABLE_HEAP_PROFILING
+void* 
+alloc_at(Allocator allocator, u64 size, const char *file, u32 line) {
+	heap_profile_set_callsite(file, line);
+	void *p = alloc(allocator, size);
+	heap_profile_set_callsite(0, 0);
+	return p;
+}
+
+void* 
+alloc_uninitialized_at(Allocator allocator, u64 size, const char *file, u32 line) {
+	heap_profile_set_callsite(file, line);
+	void *p = alloc_uninitialized(allocator, size);
+	heap_profile_set_callsite(0, 0);
+	return p;
+}
+#endif
+
 void 
 push_context(Context c) {
 	assert(num_contexts < CONTEXT_STACK_MAX, "Context stack overflow");
@@ -173,6 +204,12 @@ Context get_context() {
 
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+#if ENABLE_HEAP_PROFILING
+	// After the definitions above, so those still refer to the procedures
+	#define alloc(allocator, size) alloc_at((allocator), (size), __FILE__, __LINE__)
+	#define alloc_uninitialized(allocator, size) alloc_uninitialized_at((allocator), (size), __FILE__, __LINE__)
+#endif
+
 u64 
 get_next_power_of_two(u64 x) {
     if (x == 0) {
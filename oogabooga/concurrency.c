@@ -10,6 +10,14 @@ inline bool compare_and_swap_32(volatile uint32_t *a, uint32_t b, uint32_t old);
 inline bool compare_and_swap_64(volatile uint64_t *a, uint64_t b, uint64_t old);
 inline bool compare_and_swap_bool(volatile bool *a, bool b, bool old);
 
+// Returns the value before the add
+inline u64 atomic_add_64(volatile u64 *a, u64 value) {
+	while (true) {
+		u64 old = *a;
+		if (compare_and_swap_64(a, old+value, old)) return old;
+	}
+}
+
 ///
 // Spinlock "primitive"
 // Like a mutex but it eats up the entire core while waiting.
@@ -57,6 +65,25 @@ mutex_acquire_or_wait(Mutex *m);
 void ogb_instance
 mutex_release(Mutex *m);
 
+///
+// Parallel for
+// Splits job_count jobs between a pool of worker threads and the calling thread, and returns
+// when all jobs are done. Each job gets its job_index in [0, job_count).
+// The worker threads are started the first time this is called, one per logical processor
+// (minus the calling thread).
+// Only one parallel_for runs at a time. If the pool is busy (for example if you call this from
+// inside a job) the jobs just run on the calling thread, so this is always safe to call.
+typedef void(*Parallel_For_Proc)(u64 job_index, void *data);
+
+#define PARALLEL_FOR_MAX_WORKERS 32
+
+void ogb_instance
+parallel_for(u64 job_count, Parallel_For_Proc proc, void *data);
+
+// Number of threads that participate in a parallel_for, including the calling thread.
+u64 ogb_instance
+parallel_for_get_thread_count();
+
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
@@ -131,4 +158,117 @@ void mutex_release(Mutex *m) {
 	}
 }
 
-#endif
\ No newline at end of file
+
+///
+// Parallel for
+
+typedef struct Parallel_For_Worker {
+	Thread thread;
+	Binary_Semaphore start_sem;
+} Parallel_For_Worker;
+
+typedef struct Parallel_For_Pool {
+	Parallel_For_Worker workers[PARALLEL_FOR_MAX_WORKERS];
+	u64 worker_count;
+	
+	Spinlock init_lock;
+	volatile bool initted;
+	Spinlock dispatch_lock;
+	
+	Parallel_For_Proc proc;
+	void *data;
+	u64 job_count;
+	volatile u64 next_job;
+	volatile u64 finished_jobs;
+	volatile u64 finished_workers;
+} Parallel_For_Pool;
+
+// #Global
+Parallel_For_Pool parallel_for_pool = {0};
+
+void parallel_for_do_jobs(Parallel_For_Pool *pool) {
+	while (true) {
+		u64 job_index = atomic_add_64(&pool->next_job, 1);
+		if (job_index >= pool->job_count) break;
+		pool->proc(job_index, pool->data);
+		atomic_add_64(&pool->finished_jobs, 1);
+	}
+}
+void parallel_for_worker_proc(Thread *t) {
+	Parallel_For_Worker *worker = (Parallel_For_Worker*)t->data;
+	Parallel_For_Pool *pool = &parallel_for_pool;
+	
+	while (true) {
+		os_binary_semaphore_wait(&worker->start_sem);
+		parallel_for_do_jobs(pool);
+		atomic_add_64(&pool->finished_workers, 1);
+	}
+}
+void parallel_for_init_pool() {
+	Parallel_For_Pool *pool = &parallel_for_pool;
+	
+	spinlock_acquire_or_wait(&pool->init_lock);
+	if (!pool->initted) {
+		u64 logical_processors = os_get_number_of_logical_processors();
+		pool->worker_count = logical_processors > 1 ? logical_processors-1 : 0;
+		pool->worker_count = min(pool->worker_count, PARALLEL_FOR_MAX_WORKERS);
+		
+		spinlock_init(&pool->dispatch_lock);
+		
+		for (u64 i = 0; i < pool->worker_count; i++) {
+			Parallel_For_Worker *worker = &pool->workers[i];
+			os_binary_semaphore_init(&worker->start_sem, false);
+			os_thread_init(&worker->thread, parallel_for_worker_proc);
+			worker->thread.data = worker;
+			os_thread_start(&worker->thread);
+		}
+		
+		MEMORY_BARRIER;
+		pool->initted = true;
+	}
+	spinlock_release(&pool->init_lock);
+}
+
+u64 parallel_for_get_thread_count() {
+	if (!parallel_for_pool.initted) parallel_for_init_pool();
+	return parallel_for_pool.worker_count+1;
+}
+
+void parallel_for(u64 job_count, Parallel_For_Proc proc, void *data) {
+	if (job_count == 0) return;
+	
+	Parallel_For_Pool *pool = &parallel_for_pool;
+	
+	if (job_count > 1 && !pool->initted) parallel_for_init_pool();
+	
+	if (job_count == 1 || pool->worker_count == 0 || !spinlock_acquire_or_wait_timeout(&pool->dispatch_lock, 0)) {
+		for (u64 i = 0; i < job_count; i++) proc(i, data);
+		return;
+	}
+	
+	pool->proc = proc;
+	pool->data = data;
+	pool->job_count = job_count;
+	pool->next_job = 0;
+	pool->finished_jobs = 0;
+	pool->finished_workers = 0;
+	MEMORY_BARRIER;
+	
+	// The calling thread takes one of the jobs
+	u64 workers_to_wake = min(pool->worker_count, job_count-1);
+	for (u64 i = 0; i < workers_to_wake; i++) {
+		os_binary_semaphore_signal(&pool->workers[i].start_sem);
+	}
+	
+	parallel_for_do_jobs(pool);
+	
+	// We need to wait for the workers to be completely done and not just the jobs, otherwise a
+	// late worker might pick up jobs from the next parallel_for with stale proc & data.
+	while (pool->finished_jobs < job_count || pool->finished_workers < workers_to_wake) {
+		// spinny boi
+	}
+	
+	spinlock_release(&pool->dispatch_lock);
+}
+
+#endif
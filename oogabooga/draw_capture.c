@@ -0,0 +1,610 @@
+
+/*
+
+	Draw_Frame capture & replay
+
+	Saves everything that was submitted in a Draw_Frame to a compact binary file, so a slow frame
+	can be loaded again and rendered as many times as you want under the profiler.
+	See examples/draw_capture_replay.c for a replay tool.
+
+	Capturing:
+
+		string draw_frame_capture(Draw_Frame *frame, Draw_Capture_Options options, Allocator allocator);
+		bool draw_frame_capture_to_file(Draw_Frame *frame, string path, Draw_Capture_Options options);
+
+		This needs to happen BEFORE the frame is rendered, since rendering may transform draw lists
+		into the quad buffer.
+
+		The global draw_frame can also be captured automatically by gfx_update. Set up the global
+		draw_capture_config:
+
+			draw_capture_config.hotkey = KEY_F9;              // Capture when F9 is pressed
+			draw_capture_config.frame_time_threshold = 1.0/30; // Capture when a frame takes longer than this
+			draw_capture_config.directory = STR("captures");  // Defaults to the working directory
+
+		Files are named draw_capture_<n>.ogbdraw. Captures from the frame time threshold are at
+		least DRAW_CAPTURE_COOLDOWN_SECONDS apart so a slow section doesn't fill up the disk.
+
+	What is captured:
+		- Projection, camera_xform & z sorting flags
+		- Every quad. Scissor & userdata are only stored for quads that use them.
+		- Draw list submissions, each list only once
+		- Each referenced image as an id with its size. Set Draw_Capture_Options.include_image_pixels
+			to also store the pixels, otherwise images are replayed as white images of the same size.
+		- Draw_Frame.cbuffer, but only if Draw_Capture_Options.cbuffer_size is set since only you
+			know how big it is.
+		- The window size, since scissors & uv's depend on it.
+
+	Replaying:
+
+		Draw_Capture *draw_capture_load(string data, Allocator allocator);
+		Draw_Capture *draw_capture_load_from_file(string path, Allocator allocator);
+		Draw_Frame *draw_capture_prepare_frame(Draw_Capture *capture);
+		void draw_capture_release(Draw_Capture *capture);
+
+		Loading creates images & draw lists for everything the frame referenced.
+		draw_capture_prepare_frame puts the captured quads back in capture->frame so it's exactly
+		like it was when captured, call it before each gfx_render_draw_frame.
+
+		Draw_Capture *capture = draw_capture_load_from_file(STR("draw_capture_0.ogbdraw"), get_heap_allocator());
+		for (...) tm_scope("Replay") {
+			gfx_render_draw_frame(draw_capture_prepare_frame(capture), 0);
+		}
+		draw_capture_release(capture);
+
+*/
+
+#define DRAW_CAPTURE_MAGIC 0x4452424f // "OBRD"
+#define DRAW_CAPTURE_VERSION 1
+#define DRAW_CAPTURE_COOLDOWN_SECONDS 1.0
+
+typedef struct Draw_Capture_Options {
+	// Size of Draw_Frame.cbuffer. The cbuffer is not captured if this is 0.
+	u64 cbuffer_size;
+	// Store the pixels of referenced images, which can make captures a lot bigger.
+	bool include_image_pixels;
+} Draw_Capture_Options;
+
+typedef struct Draw_Capture_Config {
+	// 0 to disable
+	Input_Key_Code hotkey;
+	// Seconds between two gfx_update's. 0 to disable.
+	float64 frame_time_threshold;
+	// Defaults to the working directory if empty
+	string directory;
+	Draw_Capture_Options options;
+} Draw_Capture_Config;
+
+typedef struct Draw_Capture {
+	// The replayable frame, see draw_capture_prepare_frame
+	Draw_Frame frame;
+
+	// What was captured. Image pointers are remapped to the images below.
+	Draw_Quad *quads;
+	u64 quad_count;
+	Draw_List_Submission *submissions;
+	u64 submission_count;
+
+	Gfx_Image **images;
+	u64 image_count;
+	Draw_List *lists;
+	u64 list_count;
+
+	void *cbuffer;
+	u64 cbuffer_size;
+
+	u32 window_width, window_height;
+	u32 window_pixel_width, window_pixel_height;
+
+	Allocator allocator;
+} Draw_Capture;
+
+ogb_instance Draw_Capture_Config draw_capture_config;
+ogb_instance float64 draw_capture_last_update_seconds;
+ogb_instance float64 draw_capture_last_automatic_seconds;
+ogb_instance u64 draw_capture_file_index;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+// #Global
+Draw_Capture_Config draw_capture_config = {0};
+float64 draw_capture_last_update_seconds = 0;
+float64 draw_capture_last_automatic_seconds = 0;
+u64 draw_capture_file_index = 0;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+typedef enum Draw_Capture_Quad_Flags {
+	DRAW_CAPTURE_QUAD_HAS_IMAGE    = 1 << 0,
+	DRAW_CAPTURE_QUAD_HAS_SCISSOR  = 1 << 1,
+	DRAW_CAPTURE_QUAD_HAS_USERDATA = 1 << 2,
+} Draw_Capture_Quad_Flags;
+
+///
+// Writing
+
+// Gfx_Image* -> image id. Open addressing, capacity is a power of two.
+typedef struct Draw_Capture_Image_Map {
+	Gfx_Image **keys;
+	u32 *ids;
+	u64 capacity;
+	Gfx_Image **images; // Growing array, index is the id
+} Draw_Capture_Image_Map;
+
+void draw_capture_image_map_grow(Draw_Capture_Image_Map *map, Allocator allocator) {
+	u64 old_capacity = map->capacity;
+	Gfx_Image **old_keys = map->keys;
+	u32 *old_ids = map->ids;
+
+	map->capacity = old_capacity ? old_capacity*2 : 64;
+	map->keys = alloc(allocator, map->capacity*sizeof(Gfx_Image*));
+	map->ids  = alloc(allocator, map->capacity*sizeof(u32));
+	memset(map->keys, 0, map->capacity*sizeof(Gfx_Image*));
+
+	for (u64 i = 0; i < old_capacity; i++) {
+		if (!old_keys[i]) continue;
+		u64 slot = pointer_get_hash(old_keys[i]) & (map->capacity-1);
+		while (map->keys[slot]) slot = (slot+1) & (map->capacity-1);
+		map->keys[slot] = old_keys[i];
+		map->ids[slot] = old_ids[i];
+	}
+
+	if (old_keys) {
+		dealloc(allocator, old_keys);
+		dealloc(allocator, old_ids);
+	}
+}
+
+// 0 means no image, so ids start at 1
+u32 draw_capture_get_image_id(Draw_Capture_Image_Map *map, Gfx_Image *image, Allocator allocator) {
+	if (!image) return 0;
+
+	u64 image_count = growing_array_get_valid_count(map->images);
+	if ((image_count+1)*2 > map->capacity) draw_capture_image_map_grow(map, allocator);
+
+	u64 slot = pointer_get_hash(image) & (map->capacity-1);
+	while (map->keys[slot]) {
+		if (map->keys[slot] == image) return map->ids[slot];
+		slot = (slot+1) & (map->capacity-1);
+	}
+
+	growing_array_add((void**)&map->images, &image);
+	map->keys[slot] = image;
+	map->ids[slot] = (u32)image_count+1;
+	return map->ids[slot];
+}
+
+inline void draw_capture_write(String_Builder *b, void *data, u64 size) {
+	string s = {size, (u8*)data};
+	string_builder_append(b, s);
+}
+#define draw_capture_write_value(b, value) draw_capture_write(b, &(value), sizeof(value))
+
+void draw_capture_write_quads(String_Builder *b, Draw_Quad *quads, u64 count, Draw_Capture_Image_Map *map, Allocator allocator) {
+	local_persist const Vector4 zero_userdata[VERTEX_2D_USER_DATA_COUNT] = {0};
+
+	u32 last_image_id = 0;
+	Gfx_Image *last_image = 0;
+
+	draw_capture_write_value(b, count);
+	for (u64 i = 0; i < count; i++) {
+		Draw_Quad *q = &quads[i];
+
+		u8 flags = 0;
+		if (q->image)       flags |= DRAW_CAPTURE_QUAD_HAS_IMAGE;
+		if (q->has_scissor) flags |= DRAW_CAPTURE_QUAD_HAS_SCISSOR;
+		if (!bytes_match(q->userdata, (void*)zero_userdata, sizeof(q->userdata))) flags |= DRAW_CAPTURE_QUAD_HAS_USERDATA;
+
+		draw_capture_write_value(b, flags);
+		draw_capture_write_value(b, q->type);
+		draw_capture_write_value(b, q->z);
+		draw_capture_write_value(b, q->bottom_left);
+		draw_capture_write_value(b, q->top_left);
+		draw_capture_write_value(b, q->top_right);
+		draw_capture_write_value(b, q->bottom_right);
+		draw_capture_write_value(b, q->color);
+
+		if (q->image) {
+			// Most quads in a row use the same image
+			if (q->image != last_image) {
+				last_image = q->image;
+				last_image_id = draw_capture_get_image_id(map, q->image, allocator);
+			}
+			u8 filters = (u8)q->image_min_filter | ((u8)q->image_mag_filter << 4);
+			draw_capture_write_value(b, last_image_id);
+			draw_capture_write_value(b, filters);
+			draw_capture_write_value(b, q->uv);
+		}
+		if (q->has_scissor) draw_capture_write_value(b, q->scissor);
+		if (flags & DRAW_CAPTURE_QUAD_HAS_USERDATA) draw_capture_write_value(b, q->userdata);
+	}
+}
+
+string draw_frame_capture(Draw_Frame *frame, Draw_Capture_Options options, Allocator allocator) {
+
+	Draw_Capture_Image_Map map = ZERO(Draw_Capture_Image_Map);
+	growing_array_init((void**)&map.images, sizeof(Gfx_Image*), get_heap_allocator());
+
+	// Quads & lists go in the body first, since that's where we find the images to put in
+	// the header.
+	String_Builder body;
+	string_builder_init_reserve(&body, frame->quad_count*64, get_heap_allocator());
+
+	// Each list once, submissions refer to them by index
+	Draw_List **lists = 0;
+	growing_array_init((void**)&lists, sizeof(Draw_List*), get_heap_allocator());
+	u32 *list_indices = alloc(get_heap_allocator(), max(frame->draw_list_count, 1)*sizeof(u32));
+	for (u64 i = 0; i < frame->draw_list_count; i++) {
+		Draw_List *list = frame->draw_lists[i].list;
+
+		s64 index = growing_array_find_index_from_left_by_value((void**)&lists, &list);
+		if (index < 0) {
+			index = growing_array_get_valid_count(lists);
+			growing_array_add((void**)&lists, &list);
+		}
+		list_indices[i] = (u32)index;
+	}
+
+	u64 list_count = growing_array_get_valid_count(lists);
+	draw_capture_write_value(&body, list_count);
+	for (u64 i = 0; i < list_count; i++) {
+		draw_capture_write_quads(&body, lists[i]->quads, growing_array_get_valid_count(lists[i]->quads), &map, get_heap_allocator());
+	}
+
+	draw_capture_write_value(&body, frame->draw_list_count);
+	for (u64 i = 0; i < frame->draw_list_count; i++) {
+		Draw_List_Submission *sub = &frame->draw_lists[i];
+		draw_capture_write_value(&body, list_indices[i]);
+		draw_capture_write_value(&body, sub->quad_index);
+		draw_capture_write_value(&body, sub->world_to_clip);
+	}
+
+	draw_capture_write_quads(&body, frame->quad_buffer, frame->quad_count, &map, get_heap_allocator());
+
+	///
+	// Header
+	String_Builder b;
+	string_builder_init_reserve(&b, body.count + 1024, allocator);
+
+	u32 magic = DRAW_CAPTURE_MAGIC;
+	u32 version = DRAW_CAPTURE_VERSION;
+	u32 userdata_count = VERTEX_2D_USER_DATA_COUNT;
+	draw_capture_write_value(&b, magic);
+	draw_capture_write_value(&b, version);
+	draw_capture_write_value(&b, userdata_count);
+
+	u32 window_size[4] = {window.width, window.height, window.pixel_width, window.pixel_height};
+	draw_capture_write_value(&b, window_size);
+
+	draw_capture_write_value(&b, frame->projection);
+	draw_capture_write_value(&b, frame->camera_xform);
+	u8 sort_flags = (frame->enable_z_sorting ? 1 : 0) | (frame->enable_z_sorting_texture_batching ? 2 : 0);
+	draw_capture_write_value(&b, sort_flags);
+
+	u64 cbuffer_size = frame->cbuffer ? options.cbuffer_size : 0;
+	draw_capture_write_value(&b, cbuffer_size);
+	if (cbuffer_size) draw_capture_write(&b, frame->cbuffer, cbuffer_size);
+
+	u64 image_count = growing_array_get_valid_count(map.images);
+	draw_capture_write_value(&b, image_count);
+	for (u64 i = 0; i < image_count; i++) {
+		Gfx_Image *image = map.images[i];
+		u32 image_info[3] = {image->width, image->height, image->channels};
+		u8 has_pixels = options.include_image_pixels ? 1 : 0;
+		draw_capture_write_value(&b, image_info);
+		draw_capture_write_value(&b, has_pixels);
+		if (has_pixels) {
+			u64 size = (u64)image->width*image->height*image->channels;
+			string_builder_reserve(&b, b.count+size);
+			gfx_read_image_data(image, 0, 0, image->width, image->height, b.buffer+b.count);
+			b.count += size;
+		}
+	}
+
+	string_builder_append(&b, body.result);
+
+	string_builder_deinit(&body);
+	growing_array_deinit((void**)&lists);
+	dealloc(get_heap_allocator(), list_indices);
+	growing_array_deinit((void**)&map.images);
+	if (map.keys) {
+		dealloc(get_heap_allocator(), map.keys);
+		dealloc(get_heap_allocator(), map.ids);
+	}
+
+	return b.result;
+}
+
+bool draw_frame_capture_to_file(Draw_Frame *frame, string path, Draw_Capture_Options options) {
+	string data = draw_frame_capture(frame, options, get_heap_allocator());
+	bool ok = os_write_entire_file(path, data);
+	if (ok) log_info("Captured %llu quads to '%s' (%llu bytes)", frame->quad_count, path, data.count);
+	else    log_error("Failed writing draw capture to '%s'", path);
+	dealloc_string(get_heap_allocator(), data);
+	return ok;
+}
+
+// Called by gfx_update with the global draw frame before it's rendered
+void draw_capture_update(Draw_Frame *frame) {
+	float64 now = os_get_elapsed_seconds();
+	float64 frame_time = draw_capture_last_update_seconds > 0 ? now-draw_capture_last_update_seconds : 0;
+	draw_capture_last_update_seconds = now;
+
+	Draw_Capture_Config *config = &draw_capture_config;
+
+	bool capture = false;
+	if (config->hotkey && is_key_just_pressed(config->hotkey)) {
+		capture = true;
+	}
+	if (config->frame_time_threshold > 0 && frame_time > config->frame_time_threshold
+			&& now-draw_capture_last_automatic_seconds >= DRAW_CAPTURE_COOLDOWN_SECONDS) {
+		log_info("Frame took %.2fms, capturing", frame_time*1000.0);
+		draw_capture_last_automatic_seconds = now;
+		capture = true;
+	}
+	if (!capture) return;
+
+	string directory = config->directory.count ? config->directory : STR(".");
+	string path = tprint("%s/draw_capture_%llu.ogbdraw", directory, draw_capture_file_index);
+	draw_capture_file_index += 1;
+
+	draw_frame_capture_to_file(frame, path, config->options);
+}
+
+///
+// Reading
+
+typedef struct Draw_Capture_Reader {
+	u8 *at;
+	u8 *end;
+	bool failed;
+} Draw_Capture_Reader;
+
+bool draw_capture_read(Draw_Capture_Reader *r, void *output, u64 size) {
+	if (r->failed || (u64)(r->end-r->at) < size) {
+		r->failed = true;
+		memset(output, 0, size);
+		return false;
+	}
+	memcpy(output, r->at, size);
+	r->at += size;
+	return true;
+}
+#define draw_capture_read_value(r, value) draw_capture_read(r, &(value), sizeof(value))
+
+// Count has been read already
+void draw_capture_read_quads(Draw_Capture_Reader *r, Draw_Quad *quads, u64 count, Draw_Capture *capture) {
+	for (u64 i = 0; i < count && !r->failed; i++) {
+		Draw_Quad *q = &quads[i];
+		*q = ZERO(Draw_Quad);
+
+		u8 flags;
+		draw_capture_read_value(r, flags);
+		draw_capture_read_value(r, q->type);
+		draw_capture_read_value(r, q->z);
+		draw_capture_read_value(r, q->bottom_left);
+		draw_capture_read_value(r, q->top_left);
+		draw_capture_read_value(r, q->top_right);
+		draw_capture_read_value(r, q->bottom_right);
+		draw_capture_read_value(r, q->color);
+
+		if (flags & DRAW_CAPTURE_QUAD_HAS_IMAGE) {
+			u32 image_id;
+			u8 filters;
+			draw_capture_read_value(r, image_id);
+			draw_capture_read_value(r, filters);
+			draw_capture_read_value(r, q->uv);
+
+			if (image_id == 0 || image_id > capture->image_count) {
+				r->failed = true;
+				return;
+			}
+			q->image = capture->images[image_id-1];
+			q->image_min_filter = (Gfx_Filter_Mode)(filters & 0xF);
+			q->image_mag_filter = (Gfx_Filter_Mode)(filters >> 4);
+		}
+		if (flags & DRAW_CAPTURE_QUAD_HAS_SCISSOR) {
+			q->has_scissor = true;
+			draw_capture_read_value(r, q->scissor);
+		}
+		if (flags & DRAW_CAPTURE_QUAD_HAS_USERDATA) draw_capture_read_value(r, q->userdata);
+	}
+}
+
+void draw_capture_release(Draw_Capture *capture) {
+	for (u64 i = 0; i < capture->list_count; i++) draw_list_destroy(&capture->lists[i]);
+	for (u64 i = 0; i < capture->image_count; i++) {
+		if (capture->images[i]) delete_image(capture->images[i]);
+	}
+	if (capture->lists)       dealloc(capture->allocator, capture->lists);
+	if (capture->images)      dealloc(capture->allocator, capture->images);
+	if (capture->quads)       dealloc(capture->allocator, capture->quads);
+	if (capture->submissions) dealloc(capture->allocator, capture->submissions);
+	if (capture->cbuffer)     dealloc(capture->allocator, capture->cbuffer);
+	if (capture->frame.quad_buffer) draw_frame_destroy(&capture->frame);
+	dealloc(capture->allocator, capture);
+}
+
+// Puts capture->frame back to how it was captured. Rendering a frame may change it (for example
+// by transforming draw lists into the quad buffer), so do this before each render.
+Draw_Frame *draw_capture_prepare_frame(Draw_Capture *capture) {
+	Draw_Frame *frame = &capture->frame;
+
+	draw_frame_commit_quad_bytes(frame, capture->quad_count*sizeof(Draw_Quad));
+	memcpy(frame->quad_buffer, capture->quads, capture->quad_count*sizeof(Draw_Quad));
+	frame->quad_count = capture->quad_count;
+
+	while (frame->draw_list_capacity < capture->submission_count) {
+		draw_frame_grow_stack((void**)&frame->draw_lists, &frame->draw_list_capacity, sizeof(Draw_List_Submission));
+	}
+	memcpy(frame->draw_lists, capture->submissions, capture->submission_count*sizeof(Draw_List_Submission));
+	frame->draw_list_count = capture->submission_count;
+
+	frame->cbuffer = capture->cbuffer;
+
+	return frame;
+}
+
+// Returns 0 if the data is not a valid capture
+Draw_Capture *draw_capture_load(string data, Allocator allocator) {
+	Draw_Capture_Reader reader = {data.data, data.data+data.count, false};
+	Draw_Capture_Reader *r = &reader;
+
+	u32 magic, version, userdata_count;
+	draw_capture_read_value(r, magic);
+	draw_capture_read_value(r, version);
+	draw_capture_read_value(r, userdata_count);
+	if (r->failed || magic != DRAW_CAPTURE_MAGIC) {
+		log_error("Not a draw capture");
+		return 0;
+	}
+	if (version != DRAW_CAPTURE_VERSION) {
+		log_error("Draw capture is version %llu, expected version %llu", (u64)version, (u64)DRAW_CAPTURE_VERSION);
+		return 0;
+	}
+	if (userdata_count != VERTEX_2D_USER_DATA_COUNT) {
+		log_error("Draw capture has %llu userdata per quad, but VERTEX_2D_USER_DATA_COUNT is %llu", (u64)userdata_count, (u64)VERTEX_2D_USER_DATA_COUNT);
+		return 0;
+	}
+
+	Draw_Capture *capture = alloc(allocator, sizeof(Draw_Capture));
+	*capture = ZERO(Draw_Capture);
+	capture->allocator = allocator;
+
+	u32 window_size[4];
+	draw_capture_read_value(r, window_size);
+	capture->window_width        = window_size[0];
+	capture->window_height       = window_size[1];
+	capture->window_pixel_width  = window_size[2];
+	capture->window_pixel_height = window_size[3];
+
+	draw_frame_init(&capture->frame);
+	draw_capture_read_value(r, capture->frame.projection);
+	draw_capture_read_value(r, capture->frame.camera_xform);
+	u8 sort_flags;
+	draw_capture_read_value(r, sort_flags);
+	capture->frame.enable_z_sorting                  = (sort_flags & 1) != 0;
+	capture->frame.enable_z_sorting_texture_batching = (sort_flags & 2) != 0;
+
+	draw_capture_read_value(r, capture->cbuffer_size);
+	if (capture->cbuffer_size && capture->cbuffer_size <= (u64)(r->end-r->at)) {
+		capture->cbuffer = alloc(allocator, capture->cbuffer_size);
+		draw_capture_read(r, capture->cbuffer, capture->cbuffer_size);
+	} else if (capture->cbuffer_size) {
+		r->failed = true;
+	}
+
+	///
+	// Images
+	u64 image_count = 0;
+	draw_capture_read_value(r, image_count);
+	// At least 13 bytes per image, so a broken count doesn't make us allocate forever
+	if (image_count > (u64)(r->end-r->at)/13) r->failed = true;
+	if (!r->failed && image_count) {
+		capture->images = alloc(allocator, image_count*sizeof(Gfx_Image*));
+		memset(capture->images, 0, image_count*sizeof(Gfx_Image*));
+	}
+	for (u64 i = 0; i < image_count && !r->failed; i++) {
+		u32 image_info[3];
+		u8 has_pixels;
+		draw_capture_read_value(r, image_info);
+		draw_capture_read_value(r, has_pixels);
+
+		u32 width = image_info[0], height = image_info[1], channels = image_info[2];
+		u64 size = (u64)width*height*channels;
+		if (r->failed || !width || !height || width > 16384 || height > 16384 || channels == 0 || channels > 4 || channels == 3) {
+			r->failed = true;
+			break;
+		}
+		if (has_pixels) {
+			if (size > (u64)(r->end-r->at)) {
+				r->failed = true;
+				break;
+			}
+			capture->images[i] = make_image(width, height, channels, r->at, allocator);
+			r->at += size;
+		} else {
+			Scratch scratch = scratch_begin_avoiding(allocator);
+			u8 *white = alloc(scratch.allocator, size);
+			memset(white, 255, size);
+			capture->images[i] = make_image(width, height, channels, white, allocator);
+			scratch_end(scratch);
+		}
+		capture->image_count = i+1;
+	}
+
+	///
+	// Draw lists
+	u64 list_count = 0;
+	draw_capture_read_value(r, list_count);
+	if (list_count > (u64)(r->end-r->at)/sizeof(u64)) r->failed = true;
+	if (!r->failed && list_count) {
+		capture->lists = alloc(allocator, list_count*sizeof(Draw_List));
+	}
+	for (u64 i = 0; i < list_count && !r->failed; i++) {
+		Draw_List *list = &capture->lists[i];
+		draw_list_init(list);
+		capture->list_count = i+1;
+
+		u64 quad_count = 0;
+		draw_capture_read_value(r, quad_count);
+		// At least 54 bytes per quad
+		if (quad_count > (u64)(r->end-r->at)/54) {
+			r->failed = true;
+			break;
+		}
+		growing_array_resize((void**)&list->quads, quad_count);
+		draw_capture_read_quads(r, list->quads, quad_count, capture);
+		list->version += 1;
+	}
+
+	draw_capture_read_value(r, capture->submission_count);
+	if (capture->submission_count > (u64)(r->end-r->at)/(sizeof(u32)+sizeof(u64)+sizeof(Matrix4))) r->failed = true;
+	if (!r->failed && capture->submission_count) {
+		capture->submissions = alloc(allocator, capture->submission_count*sizeof(Draw_List_Submission));
+	}
+	for (u64 i = 0; i < capture->submission_count && !r->failed; i++) {
+		Draw_List_Submission *sub = &capture->submissions[i];
+		u32 list_index;
+		draw_capture_read_value(r, list_index);
+		draw_capture_read_value(r, sub->quad_index);
+		draw_capture_read_value(r, sub->world_to_clip);
+		if (list_index >= capture->list_count) r->failed = true;
+		else sub->list = &capture->lists[list_index];
+	}
+
+	///
+	// Quads
+	draw_capture_read_value(r, capture->quad_count);
+	if (capture->quad_count > (u64)(r->end-r->at)/54) r->failed = true;
+	if (!r->failed && capture->quad_count) {
+		capture->quads = alloc(allocator, capture->quad_count*sizeof(Draw_Quad));
+		draw_capture_read_quads(r, capture->quads, capture->quad_count, capture);
+	}
+	for (u64 i = 0; i < capture->submission_count && !r->failed; i++) {
+		if (capture->submissions[i].quad_index > capture->quad_count) r->failed = true;
+	}
+
+	if (r->failed) {
+		log_error("Draw capture is corrupt or truncated");
+		draw_capture_release(capture);
+		return 0;
+	}
+
+	if (capture->window_pixel_width != window.pixel_width || capture->window_pixel_height != window.pixel_height) {
+		log_warning("Draw capture was made with a %llux%llu window but the window is %dx%d. Scissors will be off.", (u64)capture->window_pixel_width, (u64)capture->window_pixel_height, window.pixel_width, window.pixel_height);
+	}
+
+	draw_capture_prepare_frame(capture);
+
+	return capture;
+}
+
+Draw_Capture *draw_capture_load_from_file(string path, Allocator allocator) {
+	string data;
+	if (!os_read_entire_file(path, &data, get_heap_allocator())) {
+		log_error("Could not read draw capture '%s'", path);
+		return 0;
+	}
+	Draw_Capture *capture = draw_capture_load(data, allocator);
+	dealloc_string(get_heap_allocator(), data);
+	return capture;
+}
@@ -50,6 +50,13 @@
 			void draw_text_xform(Gfx_Font *font, string text, u32 raster_height, Matrix4 xform, Vector2 scale, Vector4 color);
 			void draw_text(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color);
 			Gfx_Text_Metrics draw_text_and_measure(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color);	
+			
+			void draw_glyph_run_xform(Gfx_Glyph_Run *run, Matrix4 xform, Vector4 color);
+			void draw_glyph_run(Gfx_Glyph_Run *run, Vector2 position, Vector4 color);
+			
+			- Text layouts are cached (see get_text_layout in font.c), so drawing the same text
+				again is mostly just transforming the glyphs. You can also lay out text once into your
+				own Gfx_Glyph_Run with glyph_run_layout and draw that.
 	
 			- For loading and dealing with fonts see font.c, or for a practical example see examples/text_rendering.c
 			
@@ -107,14 +114,24 @@
 		
 			void draw_frame_init(Draw_Frame *frame);
 			void draw_frame_init_reserve(Draw_Frame *frame, u64 number_of_quads_to_reserve);
+			void draw_frame_init_with_quad_reserve_size(Draw_Frame *frame, u64 quad_reserve_size);
 			void draw_frame_reset(Draw_Frame *frame);
+			void draw_frame_destroy(Draw_Frame *frame);
+			Draw_Frame_Quad_Memory_Stats draw_frame_get_quad_memory_stats(Draw_Frame *frame);
 			
 			- draw_frame_init needs to be called once to set up some initial stuff. I don't like this so it
 				might change.
 			- draw_frame_init_reserve does the same as draw_frame_init, but you can pre-allocate for a certain
 				amount of quads.
-			- draw_frame_reset will, in short, clear the array of computed Draw_Quad's and zero everything
-				out.	
+			- draw_frame_reset will, in short, clear the array of computed Draw_Quad's, pop all z layers &
+				scissors and reset the projection & camera. It only resets counts so it's cheap.
+			- Quads are stored in a per-frame virtual memory range which is reserved once and committed
+				as needed, so the quad buffer never moves or gets copied. If a frame uses much less
+				than what's committed for a while, the unused memory is given back to the OS.
+				draw_frame_get_quad_memory_stats tells you the peak bytes used by quads in a frame.
+				The reserved range is DRAW_FRAME_QUAD_RESERVE_SIZE, draw_frame_init_with_quad_reserve_size
+				lets you pick another size.
+			- draw_frame_destroy releases the quad memory of a Draw_Frame you don't need anymore.
 				
 			- A practical example for using Draw_Frame's can be found in examples/threaded_drawing.c	
 		
@@ -138,6 +155,9 @@
 			void draw_text_xform_in_frame(Gfx_Font *font, string text, u32 raster_height, Matrix4 xform, Vector2 scale, Vector4 color, Draw_Frame *frame);
 			void draw_text_in_frame(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color, Draw_Frame *frame);
 			Gfx_Text_Metrics draw_text_and_measure_in_frame(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color, Draw_Frame *frame);
+			void draw_glyph_run_projected_in_frame(Gfx_Glyph_Run *run, Matrix4 world_to_clip, Vector4 color, Draw_Frame *frame);
+			void draw_glyph_run_xform_in_frame(Gfx_Glyph_Run *run, Matrix4 xform, Vector4 color, Draw_Frame *frame);
+			void draw_glyph_run_in_frame(Gfx_Glyph_Run *run, Vector2 position, Vector4 color, Draw_Frame *frame);
 			
 			void push_z_layer_in_frame(s32 z, Draw_Frame *frame);
 			void pop_z_layer_in_frame(Draw_Frame *frame);
@@ -145,6 +165,66 @@
 			void pop_window_scissor_in_frame(Draw_Frame *frame);
 			
 			
+	- Retained draw lists
+	
+		Things that look the same every frame (level geometry, HUD frames, background props) can be
+		recorded once into a Draw_List, in world space, and then replayed each frame with one call.
+		Replaying only applies the camera & projection of the frame, instead of building every quad
+		from scratch.
+		
+			void draw_list_init(Draw_List *list);
+			void draw_list_destroy(Draw_List *list);
+			void draw_list_clear(Draw_List *list);
+			void draw_list_invalidate(Draw_List *list);
+			
+			Draw_Quad *draw_list_add_quad(Draw_List *list, Draw_Quad quad);
+			Draw_Quad *draw_list_add_quad_xform(Draw_List *list, Draw_Quad quad, Matrix4 xform);
+			Draw_Quad *draw_list_add_rect(Draw_List *list, Vector2 position, Vector2 size, Vector4 color);
+			Draw_Quad *draw_list_add_rect_xform(Draw_List *list, Matrix4 xform, Vector2 size, Vector4 color);
+			Draw_Quad *draw_list_add_image(Draw_List *list, Gfx_Image *image, Vector2 position, Vector2 size, Vector4 color);
+			Draw_Quad *draw_list_add_image_xform(Draw_List *list, Gfx_Image *image, Matrix4 xform, Vector2 size, Vector4 color);
+			
+			void draw_list_in_frame(Draw_List *list, Draw_Frame *frame);
+			void draw_list_xform_in_frame(Draw_List *list, Matrix4 xform, Draw_Frame *frame);
+			void draw_list(Draw_List *list);
+			void draw_list_xform(Draw_List *list, Matrix4 xform);
+			
+			- Recorded quads keep their own z, scissor, uv, filters & userdata. The z stack & scissor
+				stack of the frame are NOT applied when replaying.
+			- The returned Draw_Quad* can be modified right away like with draw_xxx. If you modify quads
+				in list->quads later, call draw_list_invalidate so the renderer knows to rebuild its cache.
+			- The list must stay alive and unchanged until the frame it was drawn to is rendered.
+			- The D3D11 renderer keeps a vertex buffer on the gpu per list, so replaying costs no upload
+				unless the list changed. If the frame has z sorting enabled, the list quads are
+				transformed on the cpu instead and sorted by z like everything else (after quads with
+				the same z that were drawn directly).
+	
+	- Recording on multiple threads
+	
+		A Draw_Frame_Group has one Draw_Frame per job, which are recorded in parallel and then merged
+		into group.merged, so everything is z sorted together and rendered with a single upload.
+		
+			void draw_frame_group_init(Draw_Frame_Group *group, u64 frame_count);
+			void draw_frame_group_init_with_quad_reserve_size(Draw_Frame_Group *group, u64 frame_count, u64 quad_reserve_size_per_frame);
+			void draw_frame_group_destroy(Draw_Frame_Group *group);
+			void draw_frame_group_reset(Draw_Frame_Group *group);
+			Draw_Frame *draw_frame_group_get_frame(Draw_Frame_Group *group, u64 frame_index);
+			void draw_frame_group_record(Draw_Frame_Group *group, Draw_Frame_Group_Record_Proc proc, void *data);
+			void draw_frame_group_merge(Draw_Frame_Group *group);
+			void draw_frame_group_render(Draw_Frame_Group *group, Gfx_Image *render_target);
+			void draw_frame_group_render_to_window(Draw_Frame_Group *group);
+			
+			- draw_frame_group_record calls proc(frame, frame_index, data) once per frame on the
+				parallel_for thread pool. Only draw to the frame you are given in there.
+			- Each frame has its own z & scissor stacks, so they start out empty in each call to proc,
+				and everything pushed must be popped before proc returns.
+			- Set projection, camera_xform & enable_z_sorting on group.merged. The projection and camera
+				are copied to each frame before recording.
+			- Quads with the same z are rendered in frame order: group.merged first, then frame 0, 1, ...
+			- Text can be drawn in the record proc, but only with glyphs that were already rasterized on
+				the main thread (font_prewarm / font_prewarm_text), see Text layout cache in font.c.
+			- A practical example can be found in examples/threaded_drawing.c
+	
 	- Retroactively modifying quads
 		
 		All draw_xxx functions (except text) returns a Draw_Quad*. This can be used to either slightly modify
@@ -155,6 +235,10 @@
 											sampled.
 			- s32             Draw_Quad.z: A value used for sorting. To enable this you must set 
 										   draw_frame.enable_z_sorting to true each frame.
+										   Quads with the same z keep the order they were drawn in,
+										   unless draw_frame.enable_z_sorting_texture_batching is also
+										   set, in which case quads with the same z are grouped by
+										   texture to reduce texture switches & draw calls.
 			- Gfx_Filter_Mode Draw_Quad.image_min_filter
 			- Gfx_Filter_Mode Draw_Quad.image_mag_filter
 				
@@ -185,6 +269,55 @@ typedef struct Draw_Quad {
 	
 } Draw_Quad;
 
+// Address space reserved for the quads of each Draw_Frame. This only costs address space,
+// memory is committed as quads are drawn. GB(1) is about 8 million quads.
+#ifndef DRAW_FRAME_QUAD_RESERVE_SIZE
+	#define DRAW_FRAME_QUAD_RESERVE_SIZE GB(1)
+#endif
+// Same for each recording frame of a Draw_Frame_Group, which can have many frames. Only the
+// merged frame needs room for all of them, see draw_frame_group_init_with_quad_reserve_size.
+#ifndef DRAW_FRAME_GROUP_QUAD_RESERVE_SIZE
+	#define DRAW_FRAME_GROUP_QUAD_RESERVE_SIZE MB(128)
+#endif
+// Quad memory is committed in chunks of this size
+#define DRAW_FRAME_QUAD_COMMIT_CHUNK MB(1)
+// If this many frames in a row use less than a quarter of the committed quad memory, we
+// decommit down to the highest usage in those frames.
+#define DRAW_FRAME_QUAD_DECOMMIT_FRAMES 300
+
+typedef struct Draw_List {
+	// Corners are in world space
+	Draw_Quad *quads; // Growing array
+	// Bumped each time the list changes so renderers know to rebuild what they cached
+	u64 version;
+	// Owned by the renderer
+	void *gfx_cache;
+} Draw_List;
+
+typedef struct Draw_List_Submission {
+	Draw_List *list;
+	Matrix4 world_to_clip;
+	// Number of quads in the frame when the list was drawn, so the list goes in between them
+	u64 quad_index;
+} Draw_List_Submission;
+
+typedef struct Draw_Frame_Quad_Arena {
+	u8 *base;
+	u64 reserved_bytes;
+	u64 committed_bytes;
+	u64 peak_bytes;
+	u64 last_frame_bytes;
+	u64 low_usage_frames;
+	u64 low_usage_peak_bytes;
+} Draw_Frame_Quad_Arena;
+
+typedef struct Draw_Frame_Quad_Memory_Stats {
+	u64 last_frame_bytes; // Bytes used by quads in the last frame that was reset
+	u64 peak_bytes;       // Highest bytes used by quads in any frame
+	u64 committed_bytes;
+	u64 reserved_bytes;
+} Draw_Frame_Quad_Memory_Stats;
+
 typedef struct Draw_Frame {
 	Matrix4 projection;
 	// #Cleanup
@@ -195,48 +328,184 @@ typedef struct Draw_Frame {
 	
 	void *cbuffer;
 	
+	// The z & scissor stacks are grown on the heap as needed and kept across resets, so
+	// resetting a frame only resets the counts.
+	// #Volatile draw_frame_reset resets fields one by one, so remember to add new fields there.
 	u64 scissor_count;
-	Vector4 scissor_stack[SCISSOR_STACK_MAX];
+	u64 scissor_capacity;
+	Vector4 *scissor_stack;
 	
+	// Points to the start of quad_arena and never moves
 	Draw_Quad *quad_buffer;
+	u64 quad_count;
+	Draw_Frame_Quad_Arena quad_arena;
 	
 	u64 z_count;
-	s32 z_stack[Z_STACK_MAX];
+	u64 z_capacity;
+	s32 *z_stack;
+	
+	// Draw lists are only transformed when rendering, see draw_frame_expand_draw_lists
+	u64 draw_list_count;
+	u64 draw_list_capacity;
+	Draw_List_Submission *draw_lists;
+	
 	bool enable_z_sorting;
+	// Lets the z sort reorder quads with the same z to group them by texture.
+	bool enable_z_sorting_texture_batching;
 	
 } Draw_Frame;
 
-void draw_frame_init(Draw_Frame *frame) {
+void draw_frame_commit_quad_bytes(Draw_Frame *frame, u64 bytes) {
+	Draw_Frame_Quad_Arena *arena = &frame->quad_arena;
+	
+	if (bytes <= arena->committed_bytes) return;
+	
+	assert(bytes <= arena->reserved_bytes, "Draw_Frame ran out of reserved quad memory (%llu bytes). Define DRAW_FRAME_QUAD_RESERVE_SIZE (or DRAW_FRAME_GROUP_QUAD_RESERVE_SIZE) to reserve more.", arena->reserved_bytes);
+	
+	u64 new_committed = min(align_next(bytes, DRAW_FRAME_QUAD_COMMIT_CHUNK), arena->reserved_bytes);
+	
+	bool ok = os_commit_virtual_memory(arena->base+arena->committed_bytes, new_committed-arena->committed_bytes);
+	assert(ok, "Failed committing %llu bytes of quad memory", new_committed-arena->committed_bytes);
+	
+	arena->committed_bytes = new_committed;
+}
+
+// quad_reserve_size is how much address space to reserve for quads, which is the most quad
+// memory the frame can ever use.
+void draw_frame_init_with_quad_reserve_size(Draw_Frame *frame, u64 quad_reserve_size) {
 	*frame = ZERO(Draw_Frame);
 	
-	growing_array_init((void**)&frame->quad_buffer, sizeof(Draw_Quad), get_heap_allocator());
+	Draw_Frame_Quad_Arena *arena = &frame->quad_arena;
+	arena->reserved_bytes = align_next(quad_reserve_size, os.page_size);
+	arena->base = (u8*)os_reserve_virtual_memory(arena->reserved_bytes);
+	assert(arena->base, "Failed reserving %llu bytes of address space for Draw_Frame quads", arena->reserved_bytes);
+	
+	frame->quad_buffer = (Draw_Quad*)arena->base;
+}
+void draw_frame_init(Draw_Frame *frame) {
+	draw_frame_init_with_quad_reserve_size(frame, DRAW_FRAME_QUAD_RESERVE_SIZE);
 }
 void draw_frame_init_reserve(Draw_Frame *frame, u64 number_of_quads_to_reserve) {
-	*frame = ZERO(Draw_Frame);
+	draw_frame_init(frame);
 	
-	growing_array_init_reserve((void**)&frame->quad_buffer, sizeof(Draw_Quad), number_of_quads_to_reserve, get_heap_allocator());
+	draw_frame_commit_quad_bytes(frame, number_of_quads_to_reserve*sizeof(Draw_Quad));
 }
 
-void draw_frame_reset(Draw_Frame *frame) {
+void draw_frame_destroy(Draw_Frame *frame) {
+	if (frame->quad_arena.base) {
+		os_release_virtual_memory(frame->quad_arena.base, frame->quad_arena.reserved_bytes);
+	}
+	if (frame->z_stack)       dealloc(get_heap_allocator(), frame->z_stack);
+	if (frame->scissor_stack) dealloc(get_heap_allocator(), frame->scissor_stack);
+	if (frame->draw_lists)    dealloc(get_heap_allocator(), frame->draw_lists);
+	*frame = ZERO(Draw_Frame);
+}
 
-	// #Memory
-	// I would like to try to have the quad buffer to be allocated in a growing arena
-	// which is reset every frames, like temp allocator but large enough to fit the
-	// highest number of quads the program submits in a frame.
-	// For now, we just reset the count in the heap allocated buffer
+Draw_Frame_Quad_Memory_Stats draw_frame_get_quad_memory_stats(Draw_Frame *frame) {
+	Draw_Frame_Quad_Memory_Stats stats;
+	stats.last_frame_bytes = frame->quad_arena.last_frame_bytes;
+	stats.peak_bytes       = frame->quad_arena.peak_bytes;
+	stats.committed_bytes  = frame->quad_arena.committed_bytes;
+	stats.reserved_bytes   = frame->quad_arena.reserved_bytes;
+	return stats;
+}
 
-	Draw_Quad *quad_buffer = frame->quad_buffer;
-	if (quad_buffer) growing_array_clear((void**)&quad_buffer);
+void draw_frame_reset(Draw_Frame *frame) {
 
-	*frame = (Draw_Frame){0};
+	Draw_Frame_Quad_Arena *arena = &frame->quad_arena;
 	
-	frame->quad_buffer = quad_buffer;
+	u64 used_bytes = frame->quad_count*sizeof(Draw_Quad);
+	arena->last_frame_bytes = used_bytes;
+	arena->peak_bytes = max(arena->peak_bytes, used_bytes);
+	
+	// Give memory back to the OS if we have been using a lot less than what's committed for
+	// a while, but keep enough for the busiest of those frames so we don't commit again right away.
+	if (arena->committed_bytes > DRAW_FRAME_QUAD_COMMIT_CHUNK && used_bytes < arena->committed_bytes/4) {
+		arena->low_usage_frames += 1;
+		arena->low_usage_peak_bytes = max(arena->low_usage_peak_bytes, used_bytes);
+		
+		if (arena->low_usage_frames >= DRAW_FRAME_QUAD_DECOMMIT_FRAMES) {
+			u64 keep_bytes = max(align_next(arena->low_usage_peak_bytes, DRAW_FRAME_QUAD_COMMIT_CHUNK), DRAW_FRAME_QUAD_COMMIT_CHUNK);
+			if (keep_bytes < arena->committed_bytes) {
+				os_decommit_virtual_memory(arena->base+keep_bytes, arena->committed_bytes-keep_bytes);
+				arena->committed_bytes = keep_bytes;
+			}
+			arena->low_usage_frames = 0;
+			arena->low_usage_peak_bytes = 0;
+		}
+	} else {
+		arena->low_usage_frames = 0;
+		arena->low_usage_peak_bytes = 0;
+	}
+
+	// No zeroing of the whole frame, just reset what the user could have changed.
+	frame->quad_count = 0;
+	frame->z_count = 0;
+	frame->scissor_count = 0;
+	frame->draw_list_count = 0;
+	frame->cbuffer = 0;
+	frame->enable_z_sorting = false;
+	frame->enable_z_sorting_texture_batching = false;
 	
 	frame->projection 
 		= m4_make_orthographic_projection(-window.width/2, window.width/2, -window.height/2, window.height/2, -1, 10);
 	frame->camera_xform = m4_scalar(1.0);
 }
 
+///
+// Z sorting
+//
+// Rather than moving whole Draw_Quad's around (which are huge) we radix sort a compact 64 bit key
+// per quad and then let the renderer read the quads in the order of the sorted keys.
+//
+//    [63 ...   z   ... 43][42 ... texture ... 32][31 ... quad index ... 0]
+//
+// The quad index in the low bits makes each key unique and keeps the sort stable, so quads with the
+// same z (and texture) are rendered in the order they were drawn.
+// The texture bits are only filled in when frame->enable_z_sorting_texture_batching is set. It's a
+// hash of the gpu handle, so two textures might end up in the same group, which is fine.
+#define Z_SORT_KEY_INDEX_BITS   32
+#define Z_SORT_KEY_TEXTURE_BITS (64-MAX_Z_BITS-Z_SORT_KEY_INDEX_BITS)
+#define Z_SORT_KEY_INDEX_MASK   ((1ULL << Z_SORT_KEY_INDEX_BITS)-1)
+#define Z_SORT_KEY_TEXTURE_MASK ((1ULL << Z_SORT_KEY_TEXTURE_BITS)-1)
+#define Z_SORT_KEY_Z_SHIFT      (Z_SORT_KEY_INDEX_BITS+Z_SORT_KEY_TEXTURE_BITS)
+
+inline u64 
+make_z_sort_key(s32 z, u64 texture_bits, u64 quad_index) {
+	// Z is in range [-MAX_Z+1, MAX_Z] so this maps it to [0, 2^MAX_Z_BITS-1]
+	u64 z_bits = (u64)((s64)z + (s64)MAX_Z - 1);
+	return (z_bits << Z_SORT_KEY_Z_SHIFT) 
+	     | ((texture_bits & Z_SORT_KEY_TEXTURE_MASK) << Z_SORT_KEY_INDEX_BITS) 
+	     | (quad_index & Z_SORT_KEY_INDEX_MASK);
+}
+inline u64 
+get_z_sort_key_texture_bits(Draw_Quad *q) {
+	if (!q->image) return 0;
+	// 0 is reserved for quads without image
+	return (pointer_get_hash((void*)q->image->gfx_handle) % Z_SORT_KEY_TEXTURE_MASK) + 1;
+}
+
+// Fills keys with one key per quad in the frame, sorted by z (and texture if enabled).
+// Read the quads in sorted order with frame->quad_buffer[keys[i] & Z_SORT_KEY_INDEX_MASK].
+// keys and help_buffer both need room for the number of quads in the frame.
+void draw_frame_sort_quad_keys(Draw_Frame *frame, u64 *keys, u64 *help_buffer) {
+	u64 number_of_quads = frame->quad_count;
+	assert(number_of_quads <= Z_SORT_KEY_INDEX_MASK, "Too many quads to z sort");
+	
+	bool batch_textures = frame->enable_z_sorting_texture_batching;
+	
+	for (u64 i = 0; i < number_of_quads; i++) {
+		Draw_Quad *q = &frame->quad_buffer[i];
+		u64 texture_bits = batch_textures ? get_z_sort_key_texture_bits(q) : 0;
+		keys[i] = make_z_sort_key(q->z, texture_bits, i);
+	}
+	
+	// Keys are generated in quad index order, so we only need to sort the bits above the index.
+	// Skip the texture bits too if they are all zero.
+	u64 first_bit = batch_textures ? Z_SORT_KEY_INDEX_BITS : Z_SORT_KEY_Z_SHIFT;
+	radix_sort_u64(keys, help_buffer, number_of_quads, first_bit, 64-first_bit);
+}
+
 // This is the global draw frame which is rendered and reset each time you call gfx_update();
 ogb_instance Draw_Frame draw_frame;
 
@@ -246,19 +515,57 @@ Draw_Frame draw_frame;
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
 Draw_Quad _nil_quad = {0};
+
+inline bool draw_quad_is_outside_clip(Draw_Quad *q) {
+	return
+	    (q->bottom_left.x < -1 && q->top_left.x < -1 && q->top_right.x < -1 && q->bottom_right.x < -1) ||
+	    (q->bottom_left.x > 1 && q->top_left.x > 1 && q->top_right.x > 1 && q->bottom_right.x > 1) ||
+	    (q->bottom_left.y < -1 && q->top_left.y < -1 && q->top_right.y < -1 && q->bottom_right.y < -1) ||
+	    (q->bottom_left.y > 1 && q->top_left.y > 1 && q->top_right.y > 1 && q->bottom_right.y > 1);
+}
+
+inline void draw_quad_transform_corners(Draw_Quad *q, Matrix4 m) {
+	q->bottom_left  = m4_transform(m, v4(v2_expand(q->bottom_left), 0, 1)).xy;
+	q->top_left     = m4_transform(m, v4(v2_expand(q->top_left), 0, 1)).xy;
+	q->top_right    = m4_transform(m, v4(v2_expand(q->top_right), 0, 1)).xy;
+	q->bottom_right = m4_transform(m, v4(v2_expand(q->bottom_right), 0, 1)).xy;
+}
+
+inline void draw_quad_snap_to_pixels(Draw_Quad *q) {
+	// This is meant to fix the annoying artifacts that shows up when sampling from a large atlas
+    // presumably for floating point precision issues or something.
+
+    // #Incomplete
+    // If we want to animate text with small movements then it will look wonky.
+    // This should be optional probably.
+
+	float pixel_width = 2.0/(float)window.width;
+	float pixel_height = 2.0/(float)window.height;
+	
+	q->bottom_left.x  = round(q->bottom_left.x  / pixel_width)  * pixel_width;
+    q->bottom_left.y  = round(q->bottom_left.y  / pixel_height) * pixel_height;
+    q->top_left.x     = round(q->top_left.x     / pixel_width)  * pixel_width;
+    q->top_left.y     = round(q->top_left.y     / pixel_height) * pixel_height;
+    q->top_right.x    = round(q->top_right.x    / pixel_width)  * pixel_width;
+    q->top_right.y    = round(q->top_right.y    / pixel_height) * pixel_height;
+    q->bottom_right.x = round(q->bottom_right.x / pixel_width)  * pixel_width;
+    q->bottom_right.y = round(q->bottom_right.y / pixel_height) * pixel_height;
+}
+
+// Returns a pointer to a new uninitialized quad at the end of the frame
+inline Draw_Quad *draw_frame_push_quad(Draw_Frame *frame) {
+	u64 needed_bytes = (frame->quad_count+1)*sizeof(Draw_Quad);
+	if (needed_bytes > frame->quad_arena.committed_bytes) draw_frame_commit_quad_bytes(frame, needed_bytes);
+	
+	Draw_Quad *q = &frame->quad_buffer[frame->quad_count];
+	frame->quad_count += 1;
+	return q;
+}
+
 Draw_Quad *draw_quad_projected_in_frame(Draw_Quad quad, Matrix4 world_to_clip, Draw_Frame *frame) {
-	quad.bottom_left  = m4_transform(world_to_clip, v4(v2_expand(quad.bottom_left), 0, 1)).xy;
-	quad.top_left     = m4_transform(world_to_clip, v4(v2_expand(quad.top_left), 0, 1)).xy;
-	quad.top_right    = m4_transform(world_to_clip, v4(v2_expand(quad.top_right), 0, 1)).xy;
-	quad.bottom_right = m4_transform(world_to_clip, v4(v2_expand(quad.bottom_right), 0, 1)).xy;
-	
-	bool should_cull = 
-	    (quad.bottom_left.x < -1 && quad.top_left.x < -1 && quad.top_right.x < -1 && quad.bottom_right.x < -1) ||
-	    (quad.bottom_left.x > 1 && quad.top_left.x > 1 && quad.top_right.x > 1 && quad.bottom_right.x > 1) ||
-	    (quad.bottom_left.y < -1 && quad.top_left.y < -1 && quad.top_right.y < -1 && quad.bottom_right.y < -1) ||
-	    (quad.bottom_left.y > 1 && quad.top_left.y > 1 && quad.top_right.y > 1 && quad.bottom_right.y > 1);
-
-	if (should_cull) {
+	draw_quad_transform_corners(&quad, world_to_clip);
+
+	if (draw_quad_is_outside_clip(&quad)) {
 		return &_nil_quad;
 	}
 	
@@ -277,30 +584,10 @@ Draw_Quad *draw_quad_projected_in_frame(Draw_Quad quad, Matrix4 world_to_clip, D
 	
 	memset(quad.userdata, 0, sizeof(quad.userdata));
 	
-	Draw_Quad **target_buffer = &frame->quad_buffer;
-	
-	growing_array_add((void**)target_buffer, &quad);
-	
-	Draw_Quad *q = &(*target_buffer)[growing_array_get_valid_count(*target_buffer)-1];
-	
-	// This is meant to fix the annoying artifacts that shows up when sampling from a large atlas
-    // presumably for floating point precision issues or something.
-
-    // #Incomplete
-    // If we want to animate text with small movements then it will look wonky.
-    // This should be optional probably.
-
-	float pixel_width = 2.0/(float)window.width;
-	float pixel_height = 2.0/(float)window.height;
+	Draw_Quad *q = draw_frame_push_quad(frame);
+	*q = quad;
 	
-	q->bottom_left.x  = round(q->bottom_left.x  / pixel_width)  * pixel_width;
-    q->bottom_left.y  = round(q->bottom_left.y  / pixel_height) * pixel_height;
-    q->top_left.x     = round(q->top_left.x     / pixel_width)  * pixel_width;
-    q->top_left.y     = round(q->top_left.y     / pixel_height) * pixel_height;
-    q->top_right.x    = round(q->top_right.x    / pixel_width)  * pixel_width;
-    q->top_right.y    = round(q->top_right.y    / pixel_height) * pixel_height;
-    q->bottom_right.x = round(q->bottom_right.x / pixel_width)  * pixel_width;
-    q->bottom_right.y = round(q->bottom_right.y / pixel_height) * pixel_height;
+	draw_quad_snap_to_pixels(q);
 	
 	return q;
 }
@@ -378,63 +665,98 @@ Draw_Quad *draw_circle_xform_in_frame(Matrix4 xform, Vector2 size, Vector4 color
 	
 	return draw_quad_xform_in_frame(q, xform, frame);
 }
+// Images packed in a Texture_Atlas are drawn as their rect of the atlas page
+inline void draw_quad_set_image(Draw_Quad *q, Gfx_Image *image) {
+	if (image && image->atlas_page) {
+		q->image = image->atlas_page;
+		q->uv = image->atlas_uv;
+	} else {
+		q->image = image;
+		q->uv = v4(0, 0, 1, 1);
+	}
+}
 Draw_Quad *draw_image_in_frame(Gfx_Image *image, Vector2 position, Vector2 size, Vector4 color, Draw_Frame *frame) {
 	Draw_Quad *q = draw_rect_in_frame(position, size, color, frame);
 	
-	q->image = image;
-	q->uv = v4(0, 0, 1, 1);
+	draw_quad_set_image(q, image);
 	
 	return q;
 }
 Draw_Quad *draw_image_xform_in_frame(Gfx_Image *image, Matrix4 xform, Vector2 size, Vector4 color, Draw_Frame *frame) {
 	Draw_Quad *q = draw_rect_xform_in_frame(xform, size, color, frame);
 	
-	q->image = image;
-	q->uv = v4(0, 0, 1, 1);
+	draw_quad_set_image(q, image);
 	
 	return q;
 }
 
-typedef struct {
-	Gfx_Font *font;
-	string text;
-	u32 raster_height;
-	Matrix4 xform;
-	Vector2 scale;
-	Vector4 color;
-	Draw_Frame *frame;
-} Draw_Text_Callback_Params;
-bool draw_text_callback(Gfx_Glyph glyph, Gfx_Font_Atlas *atlas, float glyph_x, float glyph_y, void *ud) {
-
-	u32 codepoint = glyph.codepoint;
-
-	Draw_Text_Callback_Params *params = (Draw_Text_Callback_Params*)ud;
+// Emits the quads of all glyphs in a run, with world_to_clip applied to the run's local space.
+// Since the transform is only 2D affine for text, we pull the axes & origin out of the matrix
+// once and place each glyph with a couple of multiply-adds instead of a matrix per glyph.
+void draw_glyph_run_projected_in_frame(Gfx_Glyph_Run *run, Matrix4 world_to_clip, Vector4 color, Draw_Frame *frame) {
+	u64 glyph_count = glyph_run_get_glyph_count(run);
+	if (glyph_count == 0) return;
 	
-	Vector2 size = v2(glyph.width*params->scale.x, glyph.height*params->scale.y);
+	glyph_run_prepare_for_drawing(run);
 	
-	Matrix4 glyph_xform = m4_translate(params->xform, v3(glyph_x, glyph_y, 0));
+	Draw_Quad template = ZERO(Draw_Quad);
+	template.color = color;
+	template.type = run->sdf ? QUAD_TYPE_TEXT_SDF : QUAD_TYPE_TEXT;
+	template.image_min_filter = GFX_FILTER_MODE_LINEAR;
+	template.image_mag_filter = GFX_FILTER_MODE_LINEAR;
+	
+	template.z = 0;
+	if (frame->z_count > 0)  template.z = frame->z_stack[frame->z_count-1];
+	
+	template.has_scissor = false;
+	if (frame->scissor_count > 0) {
+		template.scissor = frame->scissor_stack[frame->scissor_count-1];
+		template.has_scissor = true;
+	}
 	
-	Draw_Quad *q = draw_image_xform_in_frame(atlas->image, glyph_xform, size, params->color, params->frame);
-	q->uv = glyph.uv;
-	q->type = QUAD_TYPE_TEXT;
-	q->image_min_filter = GFX_FILTER_MODE_LINEAR;
-	q->image_mag_filter = GFX_FILTER_MODE_LINEAR;
+	Vector2 x_axis = v2(world_to_clip.m[0][0], world_to_clip.m[1][0]);
+	Vector2 y_axis = v2(world_to_clip.m[0][1], world_to_clip.m[1][1]);
+	Vector2 origin = v2(world_to_clip.m[0][3], world_to_clip.m[1][3]);
 	
-	return true;
+	for (u64 i = 0; i < glyph_count; i++) {
+		Gfx_Glyph_Run_Glyph *g = &run->glyphs[i];
+		
+		Vector2 bl    = v2(origin.x + x_axis.x*g->position.x + y_axis.x*g->position.y,
+		                   origin.y + x_axis.y*g->position.x + y_axis.y*g->position.y);
+		Vector2 right = v2(x_axis.x*g->size.x, x_axis.y*g->size.x);
+		Vector2 up    = v2(y_axis.x*g->size.y, y_axis.y*g->size.y);
+		
+		Draw_Quad quad = template;
+		quad.bottom_left  = bl;
+		quad.top_left     = v2(bl.x+up.x,         bl.y+up.y);
+		quad.top_right    = v2(bl.x+up.x+right.x, bl.y+up.y+right.y);
+		quad.bottom_right = v2(bl.x+right.x,      bl.y+right.y);
+		
+		if (draw_quad_is_outside_clip(&quad)) continue;
+		
+		draw_quad_snap_to_pixels(&quad);
+		
+		quad.image = g->image;
+		quad.uv = g->uv;
+		
+		*draw_frame_push_quad(frame) = quad;
+	}
+}
+void draw_glyph_run_xform_in_frame(Gfx_Glyph_Run *run, Matrix4 xform, Vector4 color, Draw_Frame *frame) {
+	Matrix4 world_to_clip = m4_scalar(1.0);
+	world_to_clip         = m4_mul(world_to_clip, frame->projection);
+	world_to_clip         = m4_mul(world_to_clip, m4_inverse(frame->camera_xform));
+	world_to_clip         = m4_mul(world_to_clip, xform);
+	draw_glyph_run_projected_in_frame(run, world_to_clip, color, frame);
+}
+void draw_glyph_run_in_frame(Gfx_Glyph_Run *run, Vector2 position, Vector4 color, Draw_Frame *frame) {
+	draw_glyph_run_xform_in_frame(run, m4_make_translation(v3(position.x, position.y, 0)), color, frame);
 }
 
 void draw_text_xform_in_frame(Gfx_Font *font, string text, u32 raster_height, Matrix4 xform, Vector2 scale, Vector4 color, Draw_Frame *frame) {
 	
-	Draw_Text_Callback_Params p;
-	p.font = font;
-	p.text = text;
-	p.raster_height = raster_height;
-	p.xform = xform;
-	p.scale = scale;
-	p.color = color;
-	p.frame = frame;
-	
-	walk_glyphs((Walk_Glyphs_Spec){font, text, raster_height, scale, true, &p}, draw_text_callback);
+	Gfx_Text_Layout *layout = get_text_layout(font, text, raster_height, scale, 0);
+	draw_glyph_run_xform_in_frame(&layout->run, xform, color, frame);
 }
 void draw_text_in_frame(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color, Draw_Frame *frame) {
 	Matrix4 xform = m4_scalar(1.0);
@@ -462,9 +784,25 @@ void draw_line_in_frame(Vector2 p0, Vector2 p1, float line_width, Vector4 color,
 	draw_rect_xform_in_frame(line_xform, v2(length, line_width), color, frame);
 }
 
+// Used for the z, scissor & draw list stacks
+void draw_frame_grow_stack(void **stack, u64 *capacity, u64 item_size) {
+	u64 new_capacity = *capacity ? *capacity*2 : 16;
+	void *new_stack = alloc(get_heap_allocator(), new_capacity*item_size);
+	if (*stack) {
+		memcpy(new_stack, *stack, *capacity*item_size);
+		dealloc(get_heap_allocator(), *stack);
+	}
+	*stack = new_stack;
+	*capacity = new_capacity;
+}
+
 void push_z_layer_in_frame(s32 z, Draw_Frame *frame) {
 	assert(frame->z_count < Z_STACK_MAX, "Too many z layers pushed. You can pop with pop_z_layer() when you are done drawing to it.");
 	
+	if (frame->z_count >= frame->z_capacity) {
+		draw_frame_grow_stack((void**)&frame->z_stack, &frame->z_capacity, sizeof(s32));
+	}
+	
 	frame->z_stack[frame->z_count] = z;
 	frame->z_count += 1;
 }
@@ -476,6 +814,10 @@ void pop_z_layer_in_frame(Draw_Frame *frame) {
 void push_window_scissor_in_frame(Vector2 min, Vector2 max, Draw_Frame *frame) {
 	assert(frame->scissor_count < SCISSOR_STACK_MAX, "Too many scissors pushed. You can pop with pop_window_scissor() when you are done drawing to it.");
 	
+	if (frame->scissor_count >= frame->scissor_capacity) {
+		draw_frame_grow_stack((void**)&frame->scissor_stack, &frame->scissor_capacity, sizeof(Vector4));
+	}
+	
 	frame->scissor_stack[frame->scissor_count] = v4(min.x, min.y, max.x, max.y);
 	frame->scissor_count += 1;
 }
@@ -485,6 +827,309 @@ void pop_window_scissor_in_frame(Draw_Frame *frame) {
 }
 
 
+///
+// Draw lists
+//
+
+void draw_list_init(Draw_List *list) {
+	*list = ZERO(Draw_List);
+	growing_array_init((void**)&list->quads, sizeof(Draw_Quad), get_heap_allocator());
+	list->version = 1;
+}
+void draw_list_destroy(Draw_List *list) {
+	if (list->gfx_cache) gfx_release_draw_list_cache(list);
+	if (list->quads) growing_array_deinit((void**)&list->quads);
+	*list = ZERO(Draw_List);
+}
+// Removes all quads, but keeps the memory
+void draw_list_clear(Draw_List *list) {
+	growing_array_clear((void**)&list->quads);
+	list->version += 1;
+}
+// Call this if you changed list->quads directly
+void draw_list_invalidate(Draw_List *list) {
+	list->version += 1;
+}
+
+Draw_Quad *draw_list_add_quad(Draw_List *list, Draw_Quad quad) {
+	list->version += 1;
+	
+	growing_array_add((void**)&list->quads, &quad);
+	return &list->quads[growing_array_get_valid_count(list->quads)-1];
+}
+Draw_Quad *draw_list_add_quad_xform(Draw_List *list, Draw_Quad quad, Matrix4 xform) {
+	draw_quad_transform_corners(&quad, xform);
+	return draw_list_add_quad(list, quad);
+}
+Draw_Quad *draw_list_add_rect_xform(Draw_List *list, Matrix4 xform, Vector2 size, Vector4 color) {
+	// #Copypaste #Volatile	
+	Draw_Quad q = ZERO(Draw_Quad);
+	q.bottom_left  = v2(0,  0);
+	q.top_left     = v2(0,  size.y);
+	q.top_right    = v2(size.x, size.y);
+	q.bottom_right = v2(size.x, 0);
+	q.color = color;
+	q.image = 0;
+	q.type = QUAD_TYPE_REGULAR;
+	q.uv = v4(0, 0, 1, 1);
+	q.image_min_filter = GFX_FILTER_MODE_NEAREST;
+	q.image_mag_filter = GFX_FILTER_MODE_NEAREST;
+	
+	return draw_list_add_quad_xform(list, q, xform);
+}
+Draw_Quad *draw_list_add_rect(Draw_List *list, Vector2 position, Vector2 size, Vector4 color) {
+	return draw_list_add_rect_xform(list, m4_make_translation(v3(position.x, position.y, 0)), size, color);
+}
+Draw_Quad *draw_list_add_image_xform(Draw_List *list, Gfx_Image *image, Matrix4 xform, Vector2 size, Vector4 color) {
+	Draw_Quad *q = draw_list_add_rect_xform(list, xform, size, color);
+	draw_quad_set_image(q, image);
+	return q;
+}
+Draw_Quad *draw_list_add_image(Draw_List *list, Gfx_Image *image, Vector2 position, Vector2 size, Vector4 color) {
+	Draw_Quad *q = draw_list_add_rect(list, position, size, color);
+	draw_quad_set_image(q, image);
+	return q;
+}
+
+void draw_list_projected_in_frame(Draw_List *list, Matrix4 world_to_clip, Draw_Frame *frame) {
+	if (!list->quads || growing_array_get_valid_count(list->quads) == 0) return;
+	
+	if (frame->draw_list_count >= frame->draw_list_capacity) {
+		draw_frame_grow_stack((void**)&frame->draw_lists, &frame->draw_list_capacity, sizeof(Draw_List_Submission));
+	}
+	
+	Draw_List_Submission *sub = &frame->draw_lists[frame->draw_list_count];
+	frame->draw_list_count += 1;
+	
+	sub->list = list;
+	sub->world_to_clip = world_to_clip;
+	sub->quad_index = frame->quad_count;
+}
+void draw_list_xform_in_frame(Draw_List *list, Matrix4 xform, Draw_Frame *frame) {
+	Matrix4 world_to_clip = m4_scalar(1.0);
+	world_to_clip         = m4_mul(world_to_clip, frame->projection);
+	world_to_clip         = m4_mul(world_to_clip, m4_inverse(frame->camera_xform));
+	world_to_clip         = m4_mul(world_to_clip, xform);
+	draw_list_projected_in_frame(list, world_to_clip, frame);
+}
+void draw_list_in_frame(Draw_List *list, Draw_Frame *frame) {
+	draw_list_projected_in_frame(list, m4_mul(frame->projection, m4_inverse(frame->camera_xform)), frame);
+}
+
+// For renderers (or render paths) that don't cache draw lists.
+// Transforms the quads of all drawn lists and puts them in the quad buffer where the lists were
+// drawn, so the frame ends up the same as if each quad was drawn directly.
+void draw_frame_expand_draw_lists(Draw_Frame *frame) {
+	if (frame->draw_list_count == 0) return;
+	
+	u64 list_quad_count = 0;
+	for (u64 i = 0; i < frame->draw_list_count; i++) {
+		list_quad_count += growing_array_get_valid_count(frame->draw_lists[i].list->quads);
+	}
+	
+	u64 immediate_count = frame->quad_count;
+	u64 max_count = immediate_count + list_quad_count;
+	draw_frame_commit_quad_bytes(frame, max_count*sizeof(Draw_Quad));
+	
+	Draw_Quad *quads = frame->quad_buffer;
+	
+	// We don't know how many list quads survive culling, so fill from the back: the
+	// directly drawn quads after each list get moved towards the end, and the list quads are
+	// written backwards in front of them. Then everything is moved down to the start.
+	u64 write = max_count;
+	u64 read_end = immediate_count;
+	for (s64 i = (s64)frame->draw_list_count-1; i >= 0; i--) {
+		Draw_List_Submission *sub = &frame->draw_lists[i];
+		
+		u64 segment_count = read_end-sub->quad_index;
+		write -= segment_count;
+		memmove(quads+write, quads+sub->quad_index, segment_count*sizeof(Draw_Quad));
+		read_end = sub->quad_index;
+		
+		Draw_Quad *list_quads = sub->list->quads;
+		for (s64 j = (s64)growing_array_get_valid_count(list_quads)-1; j >= 0; j--) {
+			Draw_Quad q = list_quads[j];
+			draw_quad_transform_corners(&q, sub->world_to_clip);
+			if (draw_quad_is_outside_clip(&q)) continue;
+			draw_quad_snap_to_pixels(&q);
+			write -= 1;
+			quads[write] = q;
+		}
+	}
+	
+	write -= read_end;
+	memmove(quads+write, quads, read_end*sizeof(Draw_Quad));
+	
+	frame->quad_count = max_count-write;
+	memmove(quads, quads+write, frame->quad_count*sizeof(Draw_Quad));
+	
+	frame->draw_list_count = 0;
+}
+
+///
+// Draw frame groups
+//
+// Records one Draw_Frame per job on the parallel_for thread pool, then merges all of them into
+// one frame so they are z sorted together and uploaded & drawn at once.
+// Each job only ever touches its own Draw_Frame, so the z & scissor stacks need no locking. They
+// start out empty in each job, so push what you need inside the record proc.
+//
+
+typedef void(*Draw_Frame_Group_Record_Proc)(Draw_Frame *frame, u64 frame_index, void *data);
+
+typedef struct Draw_Frame_Group_Slot {
+	Draw_Frame frame;
+	// How much of the frame has already been moved to the merged frame
+	u64 merged_quad_count;
+	u64 merged_draw_list_count;
+	// Where the unmerged quads of this frame go in the merged frame
+	u64 merge_offset;
+} Draw_Frame_Group_Slot;
+
+typedef struct Draw_Frame_Group {
+	// This is the frame that gets rendered. Set the projection, camera & z sorting here, the
+	// projection & camera are copied to each recording frame. You can also draw to it directly
+	// from the calling thread, those quads go before the quads recorded after it.
+	Draw_Frame merged;
+	
+	Draw_Frame_Group_Slot *slots;
+	u64 frame_count;
+	
+	Draw_Frame_Group_Record_Proc record_proc;
+	void *record_data;
+} Draw_Frame_Group;
+
+// quad_reserve_size_per_frame is the address space reserved for the quads of each recording
+// frame. The merged frame reserves DRAW_FRAME_QUAD_RESERVE_SIZE, or the sum of all recording
+// frames if that's more.
+void draw_frame_group_init_with_quad_reserve_size(Draw_Frame_Group *group, u64 frame_count, u64 quad_reserve_size_per_frame) {
+	assert(frame_count > 0, "A Draw_Frame_Group needs at least one frame");
+	
+	*group = ZERO(Draw_Frame_Group);
+	
+	draw_frame_init_with_quad_reserve_size(&group->merged, max(DRAW_FRAME_QUAD_RESERVE_SIZE, quad_reserve_size_per_frame*frame_count));
+	draw_frame_reset(&group->merged);
+	
+	group->frame_count = frame_count;
+	group->slots = (Draw_Frame_Group_Slot*)alloc(get_heap_allocator(), frame_count*sizeof(Draw_Frame_Group_Slot));
+	for (u64 i = 0; i < frame_count; i++) {
+		group->slots[i] = ZERO(Draw_Frame_Group_Slot);
+		draw_frame_init_with_quad_reserve_size(&group->slots[i].frame, quad_reserve_size_per_frame);
+		draw_frame_reset(&group->slots[i].frame);
+	}
+}
+void draw_frame_group_init(Draw_Frame_Group *group, u64 frame_count) {
+	draw_frame_group_init_with_quad_reserve_size(group, frame_count, DRAW_FRAME_GROUP_QUAD_RESERVE_SIZE);
+}
+void draw_frame_group_destroy(Draw_Frame_Group *group) {
+	for (u64 i = 0; i < group->frame_count; i++) {
+		draw_frame_destroy(&group->slots[i].frame);
+	}
+	draw_frame_destroy(&group->merged);
+	dealloc(get_heap_allocator(), group->slots);
+	*group = ZERO(Draw_Frame_Group);
+}
+void draw_frame_group_reset(Draw_Frame_Group *group) {
+	for (u64 i = 0; i < group->frame_count; i++) {
+		Draw_Frame_Group_Slot *slot = &group->slots[i];
+		draw_frame_reset(&slot->frame);
+		slot->merged_quad_count = 0;
+		slot->merged_draw_list_count = 0;
+	}
+	draw_frame_reset(&group->merged);
+}
+Draw_Frame *draw_frame_group_get_frame(Draw_Frame_Group *group, u64 frame_index) {
+	assert(frame_index < group->frame_count, "Draw_Frame_Group frame index %i out of range (%i frames)", frame_index, group->frame_count);
+	return &group->slots[frame_index].frame;
+}
+
+void draw_frame_group_record_job(u64 job_index, void *data) {
+	Draw_Frame_Group *group = (Draw_Frame_Group*)data;
+	Draw_Frame *frame = &group->slots[job_index].frame;
+	
+	frame->projection   = group->merged.projection;
+	frame->camera_xform = group->merged.camera_xform;
+	
+	group->record_proc(frame, job_index, group->record_data);
+	
+	assert(frame->z_count == 0 && frame->scissor_count == 0, "Z layers or scissors were left pushed in Draw_Frame_Group frame %i", job_index);
+}
+// Calls proc once for each frame in the group, in parallel, and returns when all are done.
+// Can be called multiple times per frame, each call appends to the frames.
+void draw_frame_group_record(Draw_Frame_Group *group, Draw_Frame_Group_Record_Proc proc, void *data) {
+	group->record_proc = proc;
+	group->record_data = data;
+	
+	parallel_for(group->frame_count, draw_frame_group_record_job, group);
+	
+	group->record_proc = 0;
+	group->record_data = 0;
+}
+
+void draw_frame_group_merge_job(u64 job_index, void *data) {
+	Draw_Frame_Group *group = (Draw_Frame_Group*)data;
+	Draw_Frame_Group_Slot *slot = &group->slots[job_index];
+	
+	memcpy(
+		group->merged.quad_buffer+slot->merge_offset, 
+		slot->frame.quad_buffer+slot->merged_quad_count, 
+		(slot->frame.quad_count-slot->merged_quad_count)*sizeof(Draw_Quad)
+	);
+}
+// Appends everything recorded since the last merge to group->merged, in frame order, so quads
+// with the same z keep the frame order when z sorted. draw_frame_group_render calls this for you.
+void draw_frame_group_merge(Draw_Frame_Group *group) {
+	Draw_Frame *merged = &group->merged;
+	
+	u64 total_count = merged->quad_count;
+	for (u64 i = 0; i < group->frame_count; i++) {
+		Draw_Frame_Group_Slot *slot = &group->slots[i];
+		slot->merge_offset = total_count;
+		total_count += slot->frame.quad_count-slot->merged_quad_count;
+	}
+	
+	if (total_count > merged->quad_count) {
+		// Commit up front, the copy jobs can't commit concurrently
+		draw_frame_commit_quad_bytes(merged, total_count*sizeof(Draw_Quad));
+		
+		tm_scope("Draw_Frame_Group merge copy") {
+			parallel_for(group->frame_count, draw_frame_group_merge_job, group);
+		}
+	}
+	
+	for (u64 i = 0; i < group->frame_count; i++) {
+		Draw_Frame_Group_Slot *slot = &group->slots[i];
+		Draw_Frame *frame = &slot->frame;
+		
+		for (u64 j = slot->merged_draw_list_count; j < frame->draw_list_count; j++) {
+			if (merged->draw_list_count >= merged->draw_list_capacity) {
+				draw_frame_grow_stack((void**)&merged->draw_lists, &merged->draw_list_capacity, sizeof(Draw_List_Submission));
+			}
+			Draw_List_Submission *sub = &merged->draw_lists[merged->draw_list_count];
+			merged->draw_list_count += 1;
+			
+			*sub = frame->draw_lists[j];
+			sub->quad_index = sub->quad_index-slot->merged_quad_count+slot->merge_offset;
+		}
+		
+		// The frames keep their quads until reset so their quad memory stats stay right
+		slot->merged_quad_count = frame->quad_count;
+		slot->merged_draw_list_count = frame->draw_list_count;
+	}
+	
+	merged->quad_count = total_count;
+}
+
+// Merges and renders the whole group with one upload. Don't forget draw_frame_group_reset before
+// recording the next frame.
+void draw_frame_group_render(Draw_Frame_Group *group, Gfx_Image *render_target) {
+	draw_frame_group_merge(group);
+	gfx_render_draw_frame(&group->merged, render_target);
+}
+void draw_frame_group_render_to_window(Draw_Frame_Group *group) {
+	draw_frame_group_render(group, 0);
+}
+
 ///
 // Global draw api (draw to global draw_frame)
 //
@@ -539,12 +1184,25 @@ void draw_text(Gfx_Font *font, string text, u32 raster_height, Vector2 position,
 Gfx_Text_Metrics draw_text_and_measure(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color) {
 	return draw_text_and_measure_in_frame(font, text, raster_height, position, scale, color, &draw_frame);
 }
+inline
+void draw_glyph_run_xform(Gfx_Glyph_Run *run, Matrix4 xform, Vector4 color) {
+	draw_glyph_run_xform_in_frame(run, xform, color, &draw_frame);
+}
+inline
+void draw_glyph_run(Gfx_Glyph_Run *run, Vector2 position, Vector4 color) {
+	draw_glyph_run_in_frame(run, position, color, &draw_frame);
+}
 
 inline
 void draw_line(Vector2 p0, Vector2 p1, float line_width, Vector4 color) {
 	draw_line_in_frame(p0, p1, line_width, color, &draw_frame);
 }
 
+inline
+void draw_list(Draw_List *list) { draw_list_in_frame(list, &draw_frame); }
+inline
+void draw_list_xform(Draw_List *list, Matrix4 xform) { draw_list_xform_in_frame(list, xform, &draw_frame); }
+
 inline
 void push_z_layer(s32 z) { push_z_layer_in_frame(z, &draw_frame); }
 inline
@@ -0,0 +1,79 @@
+/*
+
+	Replays a Draw_Frame that was captured to disk, see draw_capture.c.
+
+	Turn on capturing in your game, for example:
+
+		draw_capture_config.hotkey = KEY_F9;
+		draw_capture_config.frame_time_threshold = 1.0/30.0;
+		draw_capture_config.options.include_image_pixels = true;
+
+	and then run this with the path to the capture as the first argument (defaults to
+	draw_capture_0.ogbdraw in the working directory).
+
+	The captured frame is rendered to the window replays_per_frame times each frame, each one in
+	a "Replay" tm_scope so it shows up in the profiler if ENABLE_PROFILING is on.
+	The average time per replay is logged once per second.
+
+	Up/down arrow to change replays_per_frame.
+
+	With GFX_RENDERER_NULL this can run without a gpu, to look at what the quad processing costs
+	and how many draw calls & uploads the frame makes.
+
+*/
+
+int entry(int argc, char **argv) {
+	window.title = STR("Draw Capture Replay");
+
+	string path = STR("draw_capture_0.ogbdraw");
+	if (argc > 1) path = STR(argv[1]);
+
+	Draw_Capture *capture = draw_capture_load_from_file(path, get_heap_allocator());
+	assert(capture, "Could not load draw capture '%s'", path);
+
+	log("Loaded '%s': %i quads, %i draw list submissions, %i images", path, capture->quad_count, capture->submission_count, capture->image_count);
+
+	u64 replays_per_frame = 1;
+
+	float64 replay_seconds = 0;
+	u64 replay_count = 0;
+
+	float64 last_time = os_get_elapsed_seconds();
+	while (!window.should_close) tm_scope("Update") {
+		reset_temporary_storage();
+
+		float64 now = os_get_elapsed_seconds();
+		if ((int)now != (int)last_time && replay_count) {
+			log("%i replays per frame: %.3fms per replay", replays_per_frame, replay_seconds/(float64)replay_count*1000.0);
+#if GFX_RENDERER == GFX_RENDERER_NULL
+			Gfx_Null_Frame_Stats stats = gfx_null_get_frame_stats();
+			log("Last frame: %i draw calls, %i texture binds, %i texture limit flushes, %i bytes uploaded", stats.draw_calls, stats.texture_binds, stats.texture_limit_flushes, stats.bytes_uploaded);
+#endif
+			replay_seconds = 0;
+			replay_count = 0;
+		}
+		last_time = now;
+
+		if (is_key_just_pressed(KEY_ARROW_UP))   replays_per_frame += 1;
+		if (is_key_just_pressed(KEY_ARROW_DOWN)) replays_per_frame = max(replays_per_frame-1, 1);
+
+		for (u64 i = 0; i < replays_per_frame; i++) {
+			// Put the frame back to how it was captured, rendering may have changed it.
+			Draw_Frame *frame = draw_capture_prepare_frame(capture);
+
+			float64 start = os_get_elapsed_seconds();
+			tm_scope("Replay") {
+				gfx_render_draw_frame_to_window(frame);
+			}
+			replay_seconds += os_get_elapsed_seconds()-start;
+			replay_count += 1;
+		}
+
+		os_update();
+		gfx_update();
+	}
+
+	draw_capture_release(capture);
+
+	return 0;
+}
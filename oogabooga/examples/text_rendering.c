@@ -14,6 +14,9 @@ int entry(int argc, char **argv) {
 	
 	const u32 font_height = 48;
 	
+	// Render the atlases for the glyphs we draw now rather than in the first frame
+	font_prewarm_text(font, font_height, STR("I am text Time: 0123456789. Привет"));
+	
 	seed_for_random = rdtsc();
 	u64 gunk_seed = get_random();
 	
@@ -7,6 +7,18 @@
 	
 	Gfx_Font *font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), get_heap_allocator());
 	assert(font, "Failed loading arial.ttf");
+	
+	// Optional: rasterize distance fields once and draw every raster_height from them.
+	// Less atlas memory when drawing many sizes, and big text stays sharp.
+	font_enable_sdf(font, 0);
+	
+	// Optional: keep baked atlases on disk, so next launch just loads them
+	font_set_disk_cache_directory(font, STR("font_cache"));
+	
+	// Optional: render the glyphs you know you'll need at load time instead of in the
+	// first frame that draws them.
+	font_prewarm(font, raster_height, 32, 255);
+	font_prewarm_text(font, raster_height, STR("Привет"));
 
 	while (...) {
 		...
@@ -18,13 +30,25 @@
 
 */
 
-// #Memory #Speed
-// This is terruble  and huge waste of video memory. We should have a constant codepoint range
-// with arbitrary atlas sizes instead.
 #define FONT_ATLAS_WIDTH  2048
 #define FONT_ATLAS_HEIGHT 2048
 #define MAX_FONT_HEIGHT 512
 
+// Atlases a font fills before it starts evicting the least recently used one (Gfx_Font.max_atlases)
+#ifndef FONT_DEFAULT_MAX_ATLASES
+	#define FONT_DEFAULT_MAX_ATLASES 4
+#endif
+// Empty pixels around each glyph in the atlas
+#define FONT_ATLAS_GLYPH_SPACING 1
+
+// SDF fonts (see font_enable_sdf)
+#define FONT_SDF_DEFAULT_REFERENCE_HEIGHT 64
+// Distance field pixels around each glyph. The field covers this many pixels outside
+// the edge and this many pixels inside it.
+#define FONT_SDF_PADDING 6
+#define FONT_SDF_ON_EDGE_VALUE 128
+#define FONT_SDF_PIXEL_DIST_SCALE ((float)FONT_SDF_ON_EDGE_VALUE/(float)FONT_SDF_PADDING)
+
 typedef struct Gfx_Font Gfx_Font;
 typedef struct Gfx_Text_Metrics {
 	
@@ -94,18 +118,39 @@ typedef struct Gfx_Glyph {
 	float width, height;
 	Vector4 uv;
 } Gfx_Glyph;
+typedef struct Gfx_Font_Variation Gfx_Font_Variation;
+typedef struct Gfx_Font_Atlas_Shelf {
+	u32 y, height;
+	u32 x; // Where the next glyph goes
+} Gfx_Font_Atlas_Shelf;
+typedef struct Gfx_Font_Atlas_Glyph_Key {
+	Gfx_Font_Variation *variation;
+	u32 codepoint;
+} Gfx_Font_Atlas_Glyph_Key;
+// One page of glyphs. Glyphs of all heights of a font go in the same pages, on shelves of
+// similar height, the first time they are used.
 typedef struct Gfx_Font_Atlas {
 	Gfx_Image *image;
-	u32 first_codepoint;
-	Gfx_Glyph *glyphs; // first_codepoint + index == the codepoint
+	Gfx_Font_Atlas_Shelf *shelves; // Growing array
+	u32 shelf_end_y; // Where the next shelf starts
+	Gfx_Font_Atlas_Glyph_Key *glyph_keys; // Growing array, the glyphs on this page
+	u64 used_pixels;
+	u64 last_used_frame;
 } Gfx_Font_Atlas;
+typedef struct Gfx_Font_Glyph_Slot {
+	Gfx_Glyph glyph;
+	Gfx_Font_Atlas *atlas; // 0 for glyphs with nothing to draw
+	bool used;
+} Gfx_Font_Glyph_Slot;
 typedef struct Gfx_Font_Variation {
 	Gfx_Font *font;
 	u32 height;
 	Gfx_Font_Metrics metrics;
 	float scale;
-	u32 codepoint_range_per_atlas;
-	Hash_Table atlases; // u32 atlas_index, Gfx_Font_Atlas
+	// Codepoint -> glyph, open addressing on the codepoint hash
+	Gfx_Font_Glyph_Slot *glyph_slots;
+	u64 glyph_slot_mask;
+	u64 glyph_count;
 	bool initted;
 } Gfx_Font_Variation;
 typedef struct Gfx_Font {
@@ -113,8 +158,43 @@ typedef struct Gfx_Font {
 	string raw_font_data;
 	Gfx_Font_Variation variations[MAX_FONT_HEIGHT]; // Variation per font height
 	Allocator allocator;
+	u64 id; // Unique for each loaded font, so caches don't mix up a font with one loaded at the same address
+	
+	Gfx_Font_Atlas **atlases; // Growing array
+	// When all atlases are full and there are this many, the least recently used one is
+	// evicted to make space. Defaults to FONT_DEFAULT_MAX_ATLASES, 0 for no limit.
+	u32 max_atlases;
+	// Bumped when an atlas is evicted. Glyph runs laid out before that look their glyphs up again.
+	u64 atlas_generation;
+	u64 glyphs_rasterized;
+	
+	// Batches of glyphs (font_prewarm) are rasterized on the parallel_for workers. Defaults to true.
+	bool rasterize_on_worker_threads;
+	
+	// The glyph maps have no lock and atlases are images (made on the main thread on d3d11), so
+	// glyphs are only added on the thread that loaded the font. Other threads can lay out text
+	// whose glyphs are already there, see font_prewarm & font_prewarm_text.
+	u64 owner_thread_id;
+	
+	// Set with font_set_disk_cache_directory
+	string disk_cache_directory;
+	u64 data_hash;
+	
+	// Set with font_enable_sdf
+	bool sdf;
+	Gfx_Font_Variation sdf_variation; // Has the actual glyphs, rasterized at the reference height
 } Gfx_Font;
 
+// #Global
+ogb_instance u64 next_font_id;
+// Counted by gfx_update (text_layout_cache_end_frame), for the LRU of the font caches
+ogb_instance u64 text_layout_cache_frame;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+u64 next_font_id = 1;
+u64 text_layout_cache_frame = 0;
+#endif
+
 Gfx_Font *load_font_from_disk(string path, Allocator allocator) {
 	
 	string font_data;
@@ -134,29 +214,37 @@ Gfx_Font *load_font_from_disk(string path, Allocator allocator) {
 	font->stbtt_handle = stbtt_handle;
 	font->raw_font_data = font_data;
 	font->allocator = allocator;
+	font->id = atomic_add_64(&next_font_id, 1);
+	font->rasterize_on_worker_threads = true;
+	font->owner_thread_id = context.thread_id;
+	font->max_atlases = FONT_DEFAULT_MAX_ATLASES;
+	growing_array_init((void**)&font->atlases, sizeof(Gfx_Font_Atlas*), allocator);
 	
 	third_party_allocator = ZERO(Allocator);
 	
 	return font;
 }
 void destroy_font(Gfx_Font *font) {
-
+	
 	third_party_allocator = font->allocator;
-
-	for (u64 i = 0; i < MAX_FONT_HEIGHT; i++) {
-		Gfx_Font_Variation *variation = &font->variations[i];
+	
+	for (u64 i = 0; i < MAX_FONT_HEIGHT+1; i++) {
+		Gfx_Font_Variation *variation = i < MAX_FONT_HEIGHT ? &font->variations[i] : &font->sdf_variation;
 		if (!variation->initted) continue;
 		
-		for (u64 j = 0; j < variation->atlases.count; j++) {
-			Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)hash_table_get_nth_value(&variation->atlases, j);
-			delete_image(atlas->image);
-			dealloc(font->allocator, atlas->glyphs);
-		}
-		
-		hash_table_destroy(&variation->atlases);
-		
+		dealloc(font->allocator, variation->glyph_slots);
 	}
-
+	
+	for (u64 i = 0; i < growing_array_get_valid_count(font->atlases); i++) {
+		Gfx_Font_Atlas *atlas = font->atlases[i];
+		delete_image(atlas->image);
+		growing_array_deinit((void**)&atlas->shelves);
+		growing_array_deinit((void**)&atlas->glyph_keys);
+		dealloc(font->allocator, atlas);
+	}
+	growing_array_deinit((void**)&font->atlases);
+	
+	if (font->disk_cache_directory.count) dealloc_string(font->allocator, font->disk_cache_directory);
 	dealloc_string(font->allocator, font->raw_font_data);
 	dealloc(font->allocator, font);
 	
@@ -164,16 +252,15 @@ void destroy_font(Gfx_Font *font) {
 }
 
 void font_variation_init(Gfx_Font_Variation *variation, Gfx_Font *font, u32 font_height) {
-
+	assert(context.thread_id == font->owner_thread_id, "Font height %d was first used on another thread than the one that loaded the font. Prewarm the glyphs you draw on other threads with font_prewarm or font_prewarm_text first.", font_height);
+	
 	variation->font = font;
 	variation->height = font_height;
 	
-	u32 x_range = FONT_ATLAS_WIDTH / font_height;
-	u32 y_range = FONT_ATLAS_HEIGHT / font_height;
-	
-	variation->codepoint_range_per_atlas = x_range*y_range;
-	
-	variation->atlases = make_hash_table(u32, Gfx_Font_Atlas, font->allocator);
+	variation->glyph_slot_mask = 63;
+	variation->glyph_slots = alloc(font->allocator, (variation->glyph_slot_mask+1)*sizeof(Gfx_Font_Glyph_Slot));
+	memset(variation->glyph_slots, 0, (variation->glyph_slot_mask+1)*sizeof(Gfx_Font_Glyph_Slot));
+	variation->glyph_count = 0;
 	
 	variation->scale = stbtt_ScaleForPixelHeight(&font->stbtt_handle, (float)font_height);
 	
@@ -203,86 +290,713 @@ void font_variation_init(Gfx_Font_Variation *variation, Gfx_Font *font, u32 font
 		int x0, y0, x1, y1;
 		stbtt_GetCodepointBitmapBox(&font->stbtt_handle, (int)c, variation->scale, variation->scale, &x0, &y0, &x1, &y1);
 		float c_ascent = (float)abs(y0);
-		if (c_ascent > variation->metrics.latin_ascent) 
+		if (c_ascent > variation->metrics.latin_ascent)
 			variation->metrics.latin_ascent = c_ascent;
 	}
 	
-	variation->metrics.new_line_offset 
+	variation->metrics.new_line_offset
 		= (variation->metrics.latin_ascent-variation->metrics.latin_descent+variation->metrics.line_spacing);
 	
 	variation->initted = true;
 }
 
-void font_atlas_init(Gfx_Font_Atlas *atlas, Gfx_Font_Variation *variation, u32 first_codepoint) {
-	stbtt_fontinfo stbtt_handle = variation->font->stbtt_handle;
-	atlas->first_codepoint = first_codepoint;
+///
+// Glyph map
+
+Gfx_Font_Glyph_Slot *font_variation_find_glyph(Gfx_Font_Variation *variation, u32 codepoint) {
+	u64 slot = xx_hash(codepoint) & variation->glyph_slot_mask;
+	while (variation->glyph_slots[slot].used) {
+		if (variation->glyph_slots[slot].glyph.codepoint == codepoint) return &variation->glyph_slots[slot];
+		slot = (slot+1) & variation->glyph_slot_mask;
+	}
+	return 0;
+}
+
+Gfx_Font_Glyph_Slot *font_variation_insert_glyph(Gfx_Font_Variation *variation, Gfx_Glyph glyph, Gfx_Font_Atlas *atlas) {
+	Allocator allocator = variation->font->allocator;
+	
+	// Keep the load under 1/2 so probe sequences stay short
+	if ((variation->glyph_count+1)*2 > variation->glyph_slot_mask+1) {
+		Gfx_Font_Glyph_Slot *old_slots = variation->glyph_slots;
+		u64 old_slot_count = variation->glyph_slot_mask+1;
+		
+		variation->glyph_slot_mask = old_slot_count*2-1;
+		variation->glyph_slots = alloc(allocator, old_slot_count*2*sizeof(Gfx_Font_Glyph_Slot));
+		memset(variation->glyph_slots, 0, old_slot_count*2*sizeof(Gfx_Font_Glyph_Slot));
+		
+		for (u64 i = 0; i < old_slot_count; i++) {
+			if (!old_slots[i].used) continue;
+			u64 slot = xx_hash(old_slots[i].glyph.codepoint) & variation->glyph_slot_mask;
+			while (variation->glyph_slots[slot].used) slot = (slot+1) & variation->glyph_slot_mask;
+			variation->glyph_slots[slot] = old_slots[i];
+		}
+		dealloc(allocator, old_slots);
+	}
+	
+	u64 slot = xx_hash(glyph.codepoint) & variation->glyph_slot_mask;
+	while (variation->glyph_slots[slot].used) slot = (slot+1) & variation->glyph_slot_mask;
+	
+	Gfx_Font_Glyph_Slot *s = &variation->glyph_slots[slot];
+	s->glyph = glyph;
+	s->atlas = atlas;
+	s->used = true;
+	variation->glyph_count += 1;
+	
+	return s;
+}
+
+void font_variation_remove_glyph(Gfx_Font_Variation *variation, u32 codepoint) {
+	Gfx_Font_Glyph_Slot *s = font_variation_find_glyph(variation, codepoint);
+	if (!s) return;
+	
+	// Backward shift the following slots in the probe sequence into the hole
+	u64 slot = (u64)(s-variation->glyph_slots);
+	u64 next = slot;
+	while (true) {
+		next = (next+1) & variation->glyph_slot_mask;
+		if (!variation->glyph_slots[next].used) break;
+		
+		u64 home = xx_hash(variation->glyph_slots[next].glyph.codepoint) & variation->glyph_slot_mask;
+		// Can the glyph in next move to slot without ending up before its home slot?
+		bool can_move = (slot <= next) ? (home <= slot || home > next) : (home <= slot && home > next);
+		if (can_move) {
+			variation->glyph_slots[slot] = variation->glyph_slots[next];
+			slot = next;
+		}
+	}
+	variation->glyph_slots[slot] = ZERO(Gfx_Font_Glyph_Slot);
+	variation->glyph_count -= 1;
+}
+
+///
+// Atlas packing
+// Glyphs are packed on shelves: rows as tall as the first glyph put in them (rounded up a
+// bit), filled left to right. Glyphs of one height are mostly about as tall, so a shelf wastes
+// little space. There are FONT_ATLAS_GLYPH_SPACING empty pixels around each glyph so linear
+// filtering doesn't bleed in the neighbours.
+//
+// When all atlases are full and there are font->max_atlases of them, the least recently used
+// atlas (by frame, see text_layout_cache_frame) is evicted: its glyphs are removed and the page
+// is packed from scratch. Atlases used in the current frame are never evicted because their
+// quads may still be waiting to be drawn, so a frame that uses more glyphs than fit adds an
+// atlas over the limit instead.
+
+Gfx_Font_Atlas *font_add_atlas(Gfx_Font *font) {
+	Gfx_Font_Atlas *atlas = alloc(font->allocator, sizeof(Gfx_Font_Atlas));
+	*atlas = ZERO(Gfx_Font_Atlas);
+	atlas->image = make_image(FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, 1, 0, font->allocator);
+	growing_array_init((void**)&atlas->shelves, sizeof(Gfx_Font_Atlas_Shelf), font->allocator);
+	growing_array_init((void**)&atlas->glyph_keys, sizeof(Gfx_Font_Atlas_Glyph_Key), font->allocator);
+	atlas->shelf_end_y = FONT_ATLAS_GLYPH_SPACING;
+	atlas->last_used_frame = text_layout_cache_frame;
+	growing_array_add((void**)&font->atlases, &atlas);
+	return atlas;
+}
+
+void font_atlas_evict(Gfx_Font *font, Gfx_Font_Atlas *atlas) {
+	for (u64 i = 0; i < growing_array_get_valid_count(atlas->glyph_keys); i++) {
+		font_variation_remove_glyph(atlas->glyph_keys[i].variation, atlas->glyph_keys[i].codepoint);
+	}
+	
+	// The old pixels stay in the image. New glyphs are uploaded with their spacing, so they
+	// never sample them.
+	growing_array_clear((void**)&atlas->shelves);
+	growing_array_clear((void**)&atlas->glyph_keys);
+	atlas->shelf_end_y = FONT_ATLAS_GLYPH_SPACING;
+	atlas->used_pixels = 0;
+	
+	font->atlas_generation += 1;
+}
+
+bool font_atlas_find_space(Gfx_Font_Atlas *atlas, u32 w, u32 h, u32 *out_shelf, u32 *out_x) {
+	const u32 spacing = FONT_ATLAS_GLYPH_SPACING;
+	
+	// Best fit: the lowest shelf that the glyph fits in without wasting too much height
+	s64 best = -1;
+	for (u64 i = 0; i < growing_array_get_valid_count(atlas->shelves); i++) {
+		Gfx_Font_Atlas_Shelf *s = &atlas->shelves[i];
+		if (s->height < h || s->height > h + h/4 + 4) continue;
+		if (s->x + w + spacing > FONT_ATLAS_WIDTH) continue;
+		if (best == -1 || s->height < atlas->shelves[best].height) best = (s64)i;
+	}
+	
+	if (best == -1) {
+		u32 shelf_height = (h+3) & ~3u;
+		if (atlas->shelf_end_y + shelf_height + spacing > FONT_ATLAS_HEIGHT) return false;
+		
+		Gfx_Font_Atlas_Shelf *s = growing_array_add_empty((void**)&atlas->shelves);
+		s->y = atlas->shelf_end_y;
+		s->height = shelf_height;
+		s->x = spacing;
+		atlas->shelf_end_y += shelf_height + spacing;
+		best = (s64)growing_array_get_valid_count(atlas->shelves)-1;
+	}
+	
+	Gfx_Font_Atlas_Shelf *s = &atlas->shelves[best];
+	*out_shelf = (u32)best;
+	*out_x = s->x;
+	s->x += w + spacing;
+	atlas->used_pixels += (u64)(w+spacing)*(h+spacing);
+	
+	return true;
+}
+
+Gfx_Font_Atlas *font_find_glyph_space(Gfx_Font *font, u32 w, u32 h, u32 *out_shelf, u32 *out_x) {
+	for (u64 i = 0; i < growing_array_get_valid_count(font->atlases); i++) {
+		if (font_atlas_find_space(font->atlases[i], w, h, out_shelf, out_x)) return font->atlases[i];
+	}
+	
+	u64 atlas_count = growing_array_get_valid_count(font->atlases);
+	if (font->max_atlases == 0 || atlas_count < font->max_atlases) {
+		Gfx_Font_Atlas *atlas = font_add_atlas(font);
+		bool fits = font_atlas_find_space(atlas, w, h, out_shelf, out_x);
+		assert(fits, "Glyph of %ux%u does not fit in an empty font atlas", w, h);
+		return atlas;
+	}
+	
+	Gfx_Font_Atlas *lru = 0;
+	for (u64 i = 0; i < atlas_count; i++) {
+		Gfx_Font_Atlas *atlas = font->atlases[i];
+		if (atlas->last_used_frame >= text_layout_cache_frame) continue;
+		if (!lru || atlas->last_used_frame < lru->last_used_frame) lru = atlas;
+	}
+	
+	if (!lru) {
+		log_verbose("All %llu font atlases are used this frame, adding one over font->max_atlases", atlas_count);
+		lru = font_add_atlas(font);
+	} else {
+		font_atlas_evict(font, lru);
+	}
+	
+	bool fits = font_atlas_find_space(lru, w, h, out_shelf, out_x);
+	assert(fits, "Glyph of %ux%u does not fit in an empty font atlas", w, h);
+	return lru;
+}
+
+///
+// Rasterizing
+
+typedef struct Font_Rasterized_Glyph {
+	u32 codepoint;
+	int w, h, x, y;
+	u8 *bitmap; // 0 if there is nothing to draw
+} Font_Rasterized_Glyph;
+
+typedef struct {
+	Gfx_Font_Variation *variation;
+	bool sdf;
+	u32 glyph_count;
+	Font_Rasterized_Glyph *glyphs;
+} Font_Rasterize_Job;
+
+#define FONT_GLYPHS_PER_RASTERIZE_JOB 64
+
+void font_rasterize_job(u64 job_index, void *data) {
+	Font_Rasterize_Job *job = (Font_Rasterize_Job*)data;
+	Gfx_Font_Variation *variation = job->variation;
+	
+	// third_party_allocator is thread local. The font's allocator might not be thread safe, but
+	// these allocations are only temporary so we can just use the heap.
+	third_party_allocator = get_heap_allocator();
+	
+	u32 first = (u32)job_index*FONT_GLYPHS_PER_RASTERIZE_JOB;
+	u32 last = min(first+FONT_GLYPHS_PER_RASTERIZE_JOB, job->glyph_count);
+	for (u32 i = first; i < last; i++) {
+		Font_Rasterized_Glyph *g = &job->glyphs[i];
+		// Not set for empty glyphs
+		g->w = g->h = g->x = g->y = 0;
+		if (job->sdf) {
+			g->bitmap = stbtt_GetCodepointSDF(&variation->font->stbtt_handle, variation->scale, (int)g->codepoint, FONT_SDF_PADDING, FONT_SDF_ON_EDGE_VALUE, FONT_SDF_PIXEL_DIST_SCALE, &g->w, &g->h, &g->x, &g->y);
+		} else {
+			g->bitmap = stbtt_GetCodepointBitmap(&variation->font->stbtt_handle, variation->scale, variation->scale, (int)g->codepoint, &g->w, &g->h, &g->x, &g->y);
+		}
+		if (!g->bitmap) g->w = g->h = 0;
+	}
+	
+	third_party_allocator = ZERO(Allocator);
+}
+
+// Returns a heap allocated array, free it with font_free_rasterized_glyphs
+Font_Rasterized_Glyph *font_rasterize_glyphs(Gfx_Font_Variation *variation, u32 *codepoints, u32 count) {
+	Gfx_Font *font = variation->font;
+	
+	Font_Rasterize_Job job;
+	job.variation = variation;
+	job.sdf = variation == &font->sdf_variation;
+	job.glyph_count = count;
+	job.glyphs = alloc(get_heap_allocator(), count*sizeof(Font_Rasterized_Glyph));
+	for (u32 i = 0; i < count; i++) job.glyphs[i].codepoint = codepoints[i];
+	
+	u64 job_count = (count+FONT_GLYPHS_PER_RASTERIZE_JOB-1)/FONT_GLYPHS_PER_RASTERIZE_JOB;
+	tm_scope("Font rasterize") {
+		if (font->rasterize_on_worker_threads && job_count > 1) {
+			parallel_for(job_count, font_rasterize_job, &job);
+		} else {
+			for (u64 i = 0; i < job_count; i++) font_rasterize_job(i, &job);
+		}
+	}
+	
+	font->glyphs_rasterized += count;
+	
+	return job.glyphs;
+}
+void font_free_rasterized_glyphs(Font_Rasterized_Glyph *glyphs, u32 count) {
+	third_party_allocator = get_heap_allocator();
+	for (u32 i = 0; i < count; i++) {
+		if (glyphs[i].bitmap) stbtt_FreeBitmap(glyphs[i].bitmap, 0);
+	}
+	third_party_allocator = ZERO(Allocator);
+	dealloc(get_heap_allocator(), glyphs);
+}
+
+typedef struct {
+	Gfx_Font_Atlas *atlas;
+	u32 shelf;
+	u32 x;
+} Font_Glyph_Placement;
+
+// Packs rasterized glyphs into the font atlases and adds them to the glyph map. Glyphs that
+// are already in the map are skipped. Glyphs that end up next to each other on a shelf are
+// uploaded together.
+void font_variation_add_glyphs(Gfx_Font_Variation *variation, Font_Rasterized_Glyph *glyphs, u32 count) {
+	Gfx_Font *font = variation->font;
+	assert(context.thread_id == font->owner_thread_id, "Glyphs can only be added on the thread that loaded the font. Text drawn on other threads needs its glyphs prewarmed with font_prewarm or font_prewarm_text first.");
+	Allocator heap = get_heap_allocator();
+	const u32 spacing = FONT_ATLAS_GLYPH_SPACING;
 	
-	atlas->image = make_image(FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, 1, 0, variation->font->allocator);
-	atlas->glyphs = alloc(variation->font->allocator, variation->codepoint_range_per_atlas*sizeof(Gfx_Glyph));
+	// SDF glyph bitmaps have padding around them, the glyph itself is the rect inside it
+	u32 padding = variation == &font->sdf_variation ? FONT_SDF_PADDING : 0;
 	
-	u32 cursor_x = 0;
-	u32 cursor_y = 0;
+	Font_Glyph_Placement *placements = alloc(heap, count*sizeof(Font_Glyph_Placement));
+	memset(placements, 0, count*sizeof(Font_Glyph_Placement));
 	
-	third_party_allocator = variation->font->allocator;
-	// Used for flipping bitmaps
-	u8 *temp_row = (u8 *)talloc(variation->height);
-	for (u32 c = first_codepoint; c < first_codepoint + variation->codepoint_range_per_atlas; c++) {
-		u32 i = c-first_codepoint;
-		Gfx_Glyph *glyph = &atlas->glyphs[i];
-		glyph->codepoint = c;
+	for (u32 i = 0; i < count; i++) {
+		Font_Rasterized_Glyph *r = &glyphs[i];
+		if (font_variation_find_glyph(variation, r->codepoint)) continue;
 		
-		int w, h, x, y;
-		void *bitmap = stbtt_GetCodepointBitmap(&stbtt_handle, variation->scale, variation->scale, (int)c, &w, &h, &x, &y);
+		// A giant glyph is cropped to the atlas
+		u32 w = min((u32)r->w, FONT_ATLAS_WIDTH-spacing*2);
+		u32 h = min((u32)r->h, FONT_ATLAS_HEIGHT-spacing*2);
 		
-		if (cursor_x+w > FONT_ATLAS_WIDTH) {
-			cursor_x = 0;
-			cursor_y += variation->height;
+		Gfx_Font_Atlas *atlas = 0;
+		u32 bitmap_x = 0;
+		u32 bitmap_y = 0;
+		if (r->bitmap && w > 0 && h > 0) {
+			Font_Glyph_Placement *p = &placements[i];
+			atlas = font_find_glyph_space(font, w, h, &p->shelf, &p->x);
+			atlas->last_used_frame = text_layout_cache_frame;
+			p->atlas = atlas;
+			bitmap_x = p->x;
+			bitmap_y = atlas->shelves[p->shelf].y;
+			
+			Gfx_Font_Atlas_Glyph_Key key = {variation, r->codepoint};
+			growing_array_add((void**)&atlas->glyph_keys, &key);
 		}
 		
-		if (bitmap) {
-			// #Speed #Loadtimes
-			for (int row = 0; row < h; ++row) {
-                gfx_set_image_data(atlas->image, cursor_x, cursor_y + (h - 1 - row), w, 1, bitmap + (row * w));
-            }
-			stbtt_FreeBitmap(bitmap, 0);
+		int x = r->x;
+		int y = r->y;
+		int gw = (int)w;
+		int gh = (int)h;
+		if (atlas && padding) {
+			x += padding;
+			y += padding;
+			gw -= padding*2;
+			gh -= padding*2;
+			bitmap_x += padding;
+			bitmap_y += padding;
 		}
 		
-		glyph->xoffset = (float)x;
-		glyph->yoffset = variation->height - (float)y - (float)h - variation->metrics.max_ascent+variation->metrics.max_descent;  // Adjusted yoffset for bottom-up rendering
-		glyph->width   = (float)w;
-		glyph->height  = (float)h;
+		Gfx_Glyph glyph = ZERO(Gfx_Glyph);
+		glyph.codepoint = r->codepoint;
+		glyph.xoffset = (float)x;
+		glyph.yoffset = variation->height - (float)y - (float)gh - variation->metrics.max_ascent+variation->metrics.max_descent;  // Adjusted yoffset for bottom-up rendering
+		glyph.width   = (float)gw;
+		glyph.height  = (float)gh;
 		
 		int advance, left_side_bearing;
-		stbtt_GetCodepointHMetrics(&stbtt_handle, c, &advance, &left_side_bearing);
+		stbtt_GetCodepointHMetrics(&font->stbtt_handle, r->codepoint, &advance, &left_side_bearing);
+		glyph.advance = (float)advance*variation->scale;
+		
+		if (atlas) {
+			glyph.uv.x1 = ((float)bitmap_x)/(float)FONT_ATLAS_WIDTH;
+			glyph.uv.y1 = ((float)bitmap_y)/(float)FONT_ATLAS_HEIGHT;
+			glyph.uv.x2 = ((float)bitmap_x+glyph.width)/(float)FONT_ATLAS_WIDTH;
+			glyph.uv.y2 = ((float)bitmap_y+glyph.height)/(float)FONT_ATLAS_HEIGHT;
+		}
+		
+		font_variation_insert_glyph(variation, glyph, atlas);
+	}
+	
+	// Upload runs of glyphs that are next to each other on the same shelf, together with
+	// the spacing around them
+	u32 run_start = 0;
+	while (run_start < count) {
+		Font_Glyph_Placement *first = &placements[run_start];
+		if (!first->atlas) {
+			run_start += 1;
+			continue;
+		}
+		
+		u32 run_end = run_start+1;
+		u32 next_x = first->x + min((u32)glyphs[run_start].w, FONT_ATLAS_WIDTH-spacing*2) + spacing;
+		while (run_end < count) {
+			Font_Glyph_Placement *p = &placements[run_end];
+			if (!p->atlas) {
+				run_end += 1;
+				continue;
+			}
+			if (p->atlas != first->atlas || p->shelf != first->shelf || p->x != next_x) break;
+			next_x = p->x + min((u32)glyphs[run_end].w, FONT_ATLAS_WIDTH-spacing*2) + spacing;
+			run_end += 1;
+		}
 		
-		glyph->advance = (float)advance*variation->scale;
-		//glyph->xoffset += (float)left_side_bearing*variation->scale;
+		Gfx_Font_Atlas_Shelf shelf = first->atlas->shelves[first->shelf];
+		u32 strip_x = first->x - spacing;
+		u32 strip_y = shelf.y - spacing;
+		u32 strip_w = next_x - strip_x;
+		u32 strip_h = shelf.height + spacing*2;
+		
+		u8 *strip = alloc(heap, (u64)strip_w*strip_h);
+		memset(strip, 0, (u64)strip_w*strip_h);
+		
+		for (u32 i = run_start; i < run_end; i++) {
+			Font_Glyph_Placement *p = &placements[i];
+			Font_Rasterized_Glyph *r = &glyphs[i];
+			if (!p->atlas) continue;
+			
+			u32 w = min((u32)r->w, FONT_ATLAS_WIDTH-spacing*2);
+			u32 h = min((u32)r->h, FONT_ATLAS_HEIGHT-spacing*2);
+			u32 local_x = p->x - strip_x;
+			
+			// Flipped
+			for (u32 row = 0; row < h; row++) {
+				u32 local_y = spacing + (h - 1 - row);
+				memcpy(strip + (u64)local_y*strip_w + local_x, r->bitmap + (u64)row*r->w, w);
+			}
+		}
 		
-		glyph->uv.x1 = ((float)cursor_x)/(float)FONT_ATLAS_WIDTH;
-		glyph->uv.y1 = ((float)cursor_y)/(float)FONT_ATLAS_HEIGHT;
-		glyph->uv.x2 = ((float)cursor_x+glyph->width)/(float)FONT_ATLAS_WIDTH;
-		glyph->uv.y2 = ((float)cursor_y+glyph->height)/(float)FONT_ATLAS_HEIGHT;
+		gfx_set_image_data(first->atlas->image, strip_x, strip_y, strip_w, strip_h, strip);
+		dealloc(heap, strip);
 		
-		cursor_x += w;
+		run_start = run_end;
 	}
 	
-	third_party_allocator = ZERO(Allocator);
+	dealloc(heap, placements);
 }
 
-void render_atlas_if_not_yet_rendered(Gfx_Font *font, u32 font_height, u32 codepoint) {
-	assert(font_height <= MAX_FONT_HEIGHT, "Font height too large; maximum of %d is allowed.", MAX_FONT_HEIGHT);
-	Gfx_Font_Variation *variation = &font->variations[font_height];
+///
+// Glyph disk cache
+// Glyphs prewarmed with font_prewarm are saved as one file per (font data hash, height,
+// codepoint range) in font->disk_cache_directory, and loaded from there with a single read
+// next time instead of being rasterized. If the font file changes, its hash changes, so old
+// files are just never read again.
+
+#define FONT_GLYPH_DISK_CACHE_MAGIC 0x534c4746 // "FGLS"
+#define FONT_GLYPH_DISK_CACHE_VERSION 3
+
+typedef struct Font_Glyph_Disk_Cache_Header {
+	u32 magic;
+	u32 version;
+	u64 font_hash;
+	u32 height;
+	u32 first_codepoint;
+	u32 last_codepoint;
+	u32 sdf;
+	// Followed by a Font_Glyph_Disk_Cache_Record per codepoint, and then the w*h bitmap of
+	// each of them
+} Font_Glyph_Disk_Cache_Header;
+typedef struct Font_Glyph_Disk_Cache_Record {
+	u32 codepoint;
+	s32 w, h, x, y;
+} Font_Glyph_Disk_Cache_Record;
+
+// Enables the glyph disk cache for a font. The directory is created if it doesn't exist.
+void font_set_disk_cache_directory(Gfx_Font *font, string directory) {
+	if (font->disk_cache_directory.count) dealloc_string(font->allocator, font->disk_cache_directory);
+	font->disk_cache_directory = ZERO(string);
+	
+	if (directory.count == 0) return;
+	
+	if (!os_is_directory(directory) && !os_make_directory(directory, true)) {
+		log_error("Could not create font cache directory '%s'", directory);
+		return;
+	}
+	
+	font->disk_cache_directory = string_copy(directory, font->allocator);
+	font->data_hash = string_get_hash(font->raw_font_data) ^ (u64)font->raw_font_data.count;
+}
+
+string font_glyph_disk_cache_path(Gfx_Font_Variation *variation, u32 first_codepoint, u32 last_codepoint) {
+	Gfx_Font *font = variation->font;
+	if (variation == &font->sdf_variation) {
+		return tprint("%s/%llx_%u_%x_%x_sdf.ogbglyphs", font->disk_cache_directory, font->data_hash, variation->height, first_codepoint, last_codepoint);
+	}
+	return tprint("%s/%llx_%u_%x_%x.ogbglyphs", font->disk_cache_directory, font->data_hash, variation->height, first_codepoint, last_codepoint);
+}
+
+void font_glyph_disk_cache_save(Gfx_Font_Variation *variation, u32 first_codepoint, u32 last_codepoint, Font_Rasterized_Glyph *glyphs) {
+	Gfx_Font *font = variation->font;
+	u32 count = last_codepoint-first_codepoint+1;
+	
+	Font_Glyph_Disk_Cache_Header header = ZERO(Font_Glyph_Disk_Cache_Header);
+	header.magic = FONT_GLYPH_DISK_CACHE_MAGIC;
+	header.version = FONT_GLYPH_DISK_CACHE_VERSION;
+	header.font_hash = font->data_hash;
+	header.height = variation->height;
+	header.first_codepoint = first_codepoint;
+	header.last_codepoint = last_codepoint;
+	header.sdf = variation == &font->sdf_variation;
+	
+	u64 pixels_size = 0;
+	for (u32 i = 0; i < count; i++) pixels_size += (u64)glyphs[i].w*glyphs[i].h;
+	
+	string data;
+	data.count = sizeof(header) + count*sizeof(Font_Glyph_Disk_Cache_Record) + pixels_size;
+	data.data = alloc(get_heap_allocator(), data.count);
+	memcpy(data.data, &header, sizeof(header));
+	
+	Font_Glyph_Disk_Cache_Record *records = (Font_Glyph_Disk_Cache_Record*)(data.data+sizeof(header));
+	u8 *pixels = (u8*)(records+count);
+	for (u32 i = 0; i < count; i++) {
+		Font_Rasterized_Glyph *g = &glyphs[i];
+		records[i] = (Font_Glyph_Disk_Cache_Record){g->codepoint, g->w, g->h, g->x, g->y};
+		u64 size = (u64)g->w*g->h;
+		if (size) memcpy(pixels, g->bitmap, size);
+		pixels += size;
+	}
+	
+	string path = font_glyph_disk_cache_path(variation, first_codepoint, last_codepoint);
+	if (!os_write_entire_file(path, data)) {
+		log_warning("Could not write font glyph cache '%s'", path);
+	}
+	
+	dealloc_string(get_heap_allocator(), data);
+}
+
+// Adds the cached glyphs of the range to the variation. Returns false if there is no valid cache file.
+bool font_glyph_disk_cache_load(Gfx_Font_Variation *variation, u32 first_codepoint, u32 last_codepoint) {
+	Gfx_Font *font = variation->font;
+	u32 count = last_codepoint-first_codepoint+1;
+	
+	string path = font_glyph_disk_cache_path(variation, first_codepoint, last_codepoint);
+	string data;
+	if (!os_read_entire_file(path, &data, get_heap_allocator())) return false;
+	
+	Font_Glyph_Disk_Cache_Header *header = (Font_Glyph_Disk_Cache_Header*)data.data;
+	u64 records_end = sizeof(*header) + (u64)count*sizeof(Font_Glyph_Disk_Cache_Record);
+	bool valid = (u64)data.count >= records_end
+	          && header->magic == FONT_GLYPH_DISK_CACHE_MAGIC
+	          && header->version == FONT_GLYPH_DISK_CACHE_VERSION
+	          && header->font_hash == font->data_hash
+	          && header->height == variation->height
+	          && header->first_codepoint == first_codepoint
+	          && header->last_codepoint == last_codepoint
+	          && header->sdf == (u32)(variation == &font->sdf_variation);
+	
+	Font_Glyph_Disk_Cache_Record *records = (Font_Glyph_Disk_Cache_Record*)(data.data+sizeof(*header));
+	if (valid) {
+		u64 pixels_size = 0;
+		for (u32 i = 0; i < count; i++) {
+			if (records[i].w < 0 || records[i].h < 0 || records[i].codepoint != first_codepoint+i) {
+				valid = false;
+				break;
+			}
+			pixels_size += (u64)records[i].w*records[i].h;
+		}
+		valid = valid && (u64)data.count == records_end+pixels_size;
+	}
+	
+	if (!valid) {
+		log_verbose("Ignoring stale or invalid font glyph cache '%s'", path);
+		dealloc_string(get_heap_allocator(), data);
+		return false;
+	}
+	
+	Font_Rasterized_Glyph *glyphs = alloc(get_heap_allocator(), count*sizeof(Font_Rasterized_Glyph));
+	u8 *pixels = (u8*)(records+count);
+	for (u32 i = 0; i < count; i++) {
+		Font_Glyph_Disk_Cache_Record *r = &records[i];
+		glyphs[i] = (Font_Rasterized_Glyph){r->codepoint, r->w, r->h, r->x, r->y, 0};
+		if (r->w && r->h) glyphs[i].bitmap = pixels;
+		pixels += (u64)r->w*r->h;
+	}
+	
+	font_variation_add_glyphs(variation, glyphs, count);
+	
+	dealloc(get_heap_allocator(), glyphs);
+	dealloc_string(get_heap_allocator(), data);
+	
+	log_verbose("Loaded font glyphs from cache '%s'", path);
+	
+	return true;
+}
+
+///
+// Glyph lookup
+
+// The variation that has the glyphs for a raster height. For SDF fonts all heights use the
+// glyphs of the reference height.
+Gfx_Font_Variation *font_get_glyph_variation(Gfx_Font *font, u32 raster_height) {
+	assert(raster_height <= MAX_FONT_HEIGHT, "Font height too large; maximum of %d is allowed.", MAX_FONT_HEIGHT);
+	Gfx_Font_Variation *variation = &font->variations[raster_height];
 	
 	if (!variation->initted) {
-		font_variation_init(variation, font, font_height);
+		font_variation_init(variation, font, raster_height);
 	}
 	
-	u32 atlas_index = codepoint / variation->codepoint_range_per_atlas;
+	return font->sdf ? &font->sdf_variation : variation;
+}
+
+// Looks up a glyph, and rasterizes it into an atlas first if it isn't in one yet. atlas is
+// set to 0 for glyphs that have nothing to draw.
+Gfx_Glyph font_get_glyph(Gfx_Font *font, u32 raster_height, u32 codepoint, Gfx_Font_Atlas **atlas) {
+	Gfx_Font_Variation *variation = font_get_glyph_variation(font, raster_height);
 	
-	if (!hash_table_contains(&variation->atlases, atlas_index)) {
-		Gfx_Font_Atlas atlas = ZERO(Gfx_Font_Atlas);
-		font_atlas_init(&atlas, variation, atlas_index*variation->codepoint_range_per_atlas);
-		hash_table_add(&variation->atlases, atlas_index, atlas);
+	Gfx_Font_Glyph_Slot *slot = font_variation_find_glyph(variation, codepoint);
+	if (!slot) {
+		Font_Rasterized_Glyph *rasterized = font_rasterize_glyphs(variation, &codepoint, 1);
+		font_variation_add_glyphs(variation, rasterized, 1);
+		font_free_rasterized_glyphs(rasterized, 1);
+		slot = font_variation_find_glyph(variation, codepoint);
+	}
+	
+	if (slot->atlas) slot->atlas->last_used_frame = text_layout_cache_frame;
+	if (atlas) *atlas = slot->atlas;
+	
+	Gfx_Glyph glyph = slot->glyph;
+	if (variation->height != raster_height) {
+		// SDF glyph scaled from the reference height, the uv's stay the same
+		float k = (float)raster_height/(float)variation->height;
+		glyph.xoffset *= k;
+		glyph.yoffset *= k;
+		glyph.advance *= k;
+		glyph.width   *= k;
+		glyph.height  *= k;
+	}
+	return glyph;
+}
+
+// Kept for old code, glyphs are now rasterized one by one when they are first used
+void render_atlas_if_not_yet_rendered(Gfx_Font *font, u32 font_height, u32 codepoint) {
+	font_get_glyph(font, font_height, codepoint, 0);
+}
+
+// Opt-in signed distance field mode. Call it right after loading the font.
+// Glyphs are rasterized once as distance fields at reference_height (0 for
+// FONT_SDF_DEFAULT_REFERENCE_HEIGHT) and every raster_height is drawn from those,
+// instead of each height rasterizing its own. Text is drawn as QUAD_TYPE_TEXT_SDF.
+// Small sizes look a bit softer than normal rasterization, and big sizes stay sharp.
+void font_enable_sdf(Gfx_Font *font, u32 reference_height) {
+	for (u64 i = 0; i < MAX_FONT_HEIGHT; i++) {
+		assert(!font->variations[i].initted, "font_enable_sdf must be called before the font is used");
+	}
+	if (reference_height == 0) reference_height = FONT_SDF_DEFAULT_REFERENCE_HEIGHT;
+	assert(reference_height <= MAX_FONT_HEIGHT, "SDF reference height too large; maximum of %d is allowed.", MAX_FONT_HEIGHT);
+	
+	font->sdf = true;
+	font_variation_init(&font->sdf_variation, font, reference_height);
+}
+
+typedef struct Gfx_Font_Atlas_Stats {
+	u64 atlas_count;
+	u64 atlas_bytes;
+	u64 glyph_count; // Glyphs in the atlases now
+	u64 used_bytes; // Atlas space taken by glyphs, spacing included
+	u64 glyphs_rasterized; // All time, glyphs that were evicted and used again count twice
+	u64 evictions;
+	// For SDF fonts: estimate of how much less atlas space this takes than rasterizing the same
+	// glyphs at each height that was used
+	u64 sdf_bytes_saved;
+} Gfx_Font_Atlas_Stats;
+
+Gfx_Font_Atlas_Stats font_get_atlas_stats(Gfx_Font *font) {
+	Gfx_Font_Atlas_Stats stats = ZERO(Gfx_Font_Atlas_Stats);
+	
+	stats.atlas_count = growing_array_get_valid_count(font->atlases);
+	stats.atlas_bytes = stats.atlas_count*FONT_ATLAS_WIDTH*FONT_ATLAS_HEIGHT;
+	for (u64 i = 0; i < stats.atlas_count; i++) {
+		stats.used_bytes += font->atlases[i]->used_pixels;
+	}
+	stats.glyphs_rasterized = font->glyphs_rasterized;
+	stats.evictions = font->atlas_generation;
+	
+	for (u64 i = 0; i < MAX_FONT_HEIGHT+1; i++) {
+		Gfx_Font_Variation *variation = i < MAX_FONT_HEIGHT ? &font->variations[i] : &font->sdf_variation;
+		if (variation->initted) stats.glyph_count += variation->glyph_count;
+	}
+	
+	if (font->sdf && font->sdf_variation.initted) {
+		// Area of the glyphs without their distance field padding, at each used height
+		u64 glyph_pixels = 0;
+		Gfx_Font_Variation *reference = &font->sdf_variation;
+		for (u64 i = 0; i <= reference->glyph_slot_mask; i++) {
+			Gfx_Font_Glyph_Slot *s = &reference->glyph_slots[i];
+			if (s->used && s->atlas) glyph_pixels += (u64)(s->glyph.width*s->glyph.height);
+		}
+		
+		float64 without_sdf = 0;
+		for (u64 i = 0; i < MAX_FONT_HEIGHT; i++) {
+			if (!font->variations[i].initted) continue;
+			float64 k = (float64)i/(float64)reference->height;
+			without_sdf += (float64)glyph_pixels*k*k;
+		}
+		
+		if ((u64)without_sdf > stats.used_bytes) stats.sdf_bytes_saved = (u64)without_sdf - stats.used_bytes;
+	}
+	
+	return stats;
+}
+
+// Rasterizes a range of codepoints (inclusive) up front, in parallel, so the first frame that
+// draws them doesn't have to. With font_set_disk_cache_directory the range is saved to &
+// loaded from disk.
+void font_prewarm(Gfx_Font *font, u32 raster_height, u32 first_codepoint, u32 last_codepoint) {
+	assert(first_codepoint <= last_codepoint, "font_prewarm: first_codepoint is after last_codepoint");
+	
+	Gfx_Font_Variation *variation = font_get_glyph_variation(font, raster_height);
+	bool use_disk_cache = font->disk_cache_directory.count > 0;
+	
+	if (use_disk_cache && font_glyph_disk_cache_load(variation, first_codepoint, last_codepoint)) return;
+	
+	// The cache file has the whole range, otherwise only rasterize what's missing
+	u32 *codepoints;
+	growing_array_init((void**)&codepoints, sizeof(u32), get_heap_allocator());
+	for (u32 c = first_codepoint; c <= last_codepoint; c++) {
+		if (use_disk_cache || !font_variation_find_glyph(variation, c)) growing_array_add((void**)&codepoints, &c);
+		if (c == UINT32_MAX) break;
+	}
+	
+	u32 count = (u32)growing_array_get_valid_count(codepoints);
+	if (count) {
+		Font_Rasterized_Glyph *glyphs = font_rasterize_glyphs(variation, codepoints, count);
+		if (use_disk_cache) font_glyph_disk_cache_save(variation, first_codepoint, last_codepoint, glyphs);
+		font_variation_add_glyphs(variation, glyphs, count);
+		font_free_rasterized_glyphs(glyphs, count);
+	}
+	
+	growing_array_deinit((void**)&codepoints);
+}
+// Rasterizes the glyphs for all codepoints in a text that aren't rasterized yet
+void font_prewarm_text(Gfx_Font *font, u32 raster_height, string text) {
+	Gfx_Font_Variation *variation = font_get_glyph_variation(font, raster_height);
+	
+	u32 *codepoints;
+	growing_array_init((void**)&codepoints, sizeof(u32), get_temporary_allocator());
+	
+	u32 c = next_utf8(&text);
+	while (c != 0) {
+		if (!font_variation_find_glyph(variation, c)
+		 && growing_array_find_index_from_left_by_value((void**)&codepoints, &c) == -1) {
+			growing_array_add((void**)&codepoints, &c);
+		}
+		c = next_utf8(&text);
+	}
+	
+	u32 count = (u32)growing_array_get_valid_count(codepoints);
+	if (count) {
+		Font_Rasterized_Glyph *glyphs = font_rasterize_glyphs(variation, codepoints, count);
+		font_variation_add_glyphs(variation, glyphs, count);
+		font_free_rasterized_glyphs(glyphs, count);
 	}
 }
 
@@ -300,17 +1014,17 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 	
 	if (spec.text.data == 0 || spec.text.count <= 0) return;
 	
+	font_get_glyph_variation(spec.font, spec.raster_height); // Inits the variation
 	Gfx_Font_Variation *variation = &spec.font->variations[spec.raster_height];
 	
 	float x = 0;
 	float y = 0;
 	
 	u32 last_c = 0;
+	
 	u32 c = next_utf8(&spec.text);
 	while (c != 0) {
 		
-		render_atlas_if_not_yet_rendered(spec.font, spec.raster_height, c);
-		
 		if (c == '\n') {
 			x = 0;
 			y -= variation->metrics.new_line_offset*spec.scale.y;
@@ -322,10 +1036,8 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 			continue;
 		}
 		
-		u32 atlas_index = c/variation->codepoint_range_per_atlas;
-		
-		Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)hash_table_find(&variation->atlases, atlas_index);
-		Gfx_Glyph glyph = atlas->glyphs[c-atlas->first_codepoint];
+		Gfx_Font_Atlas *atlas;
+		Gfx_Glyph glyph = font_get_glyph(spec.font, spec.raster_height, c, &atlas);
 		
 		float glyph_x = x+glyph.xoffset*spec.scale.x;
 		float glyph_y = y+(glyph.yoffset)*spec.scale.y;
@@ -346,6 +1058,116 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 	}
 }
 
+// Glyph runs are text that is laid out once and can then be drawn many times with
+// draw_glyph_run*, which emits all the glyph quads in one loop with one transform.
+// draw_text* also goes through a glyph run, but lays out the text every time.
+//
+//     Gfx_Glyph_Run run;
+//     glyph_run_init(&run, get_heap_allocator());
+//     glyph_run_layout(&run, font, STR("Score: 100"), 32, v2(1, 1));
+//     ...
+//     draw_glyph_run(&run, v2(x, y), COLOR_WHITE);
+//     ...
+//     glyph_run_destroy(&run);
+typedef struct Gfx_Glyph_Run_Glyph {
+	// Bottom left & size, relative to the baseline start of the first line. Already scaled.
+	Vector2 position;
+	Vector2 size;
+	Vector4 uv;
+	Gfx_Image *image; // The font atlas
+	Gfx_Font_Atlas *atlas;
+	u32 codepoint;
+} Gfx_Glyph_Run_Glyph;
+typedef struct Gfx_Glyph_Run {
+	Gfx_Glyph_Run_Glyph *glyphs; // Growing array
+	bool sdf; // Atlases are distance fields, drawn with QUAD_TYPE_TEXT_SDF
+	
+	// What the run was laid out with, to look the glyphs up again if their atlas was evicted
+	Gfx_Font *font;
+	u32 raster_height;
+	u64 atlas_generation;
+	u64 last_used_frame;
+} Gfx_Glyph_Run;
+
+void glyph_run_init(Gfx_Glyph_Run *run, Allocator allocator) {
+	growing_array_init((void**)&run->glyphs, sizeof(Gfx_Glyph_Run_Glyph), allocator);
+}
+void glyph_run_destroy(Gfx_Glyph_Run *run) {
+	growing_array_deinit((void**)&run->glyphs);
+}
+u64 glyph_run_get_glyph_count(Gfx_Glyph_Run *run) {
+	return growing_array_get_valid_count(run->glyphs);
+}
+
+typedef struct {
+	Gfx_Glyph_Run *run;
+	Vector2 scale;
+} Glyph_Run_Layout_Context;
+
+bool glyph_run_layout_callback(Gfx_Glyph glyph, Gfx_Font_Atlas *atlas, float glyph_x, float glyph_y, void *ud) {
+	Glyph_Run_Layout_Context *c = (Glyph_Run_Layout_Context*)ud;
+	
+	// Spaces and such have nothing to draw
+	if (glyph.width <= 0 || glyph.height <= 0) return true;
+	
+	Gfx_Glyph_Run_Glyph *g = growing_array_add_empty((void**)&c->run->glyphs);
+	g->position = v2(glyph_x, glyph_y);
+	g->size = v2(glyph.width*c->scale.x, glyph.height*c->scale.y);
+	g->uv = glyph.uv;
+	g->image = atlas->image;
+	g->atlas = atlas;
+	g->codepoint = glyph.codepoint;
+	
+	return true;
+}
+
+void glyph_run_begin_layout(Gfx_Glyph_Run *run, Gfx_Font *font, u32 raster_height) {
+	growing_array_clear((void**)&run->glyphs);
+	run->sdf = font->sdf;
+	run->font = font;
+	run->raster_height = raster_height;
+}
+void glyph_run_end_layout(Gfx_Glyph_Run *run) {
+	// Atlases used by the layout are not evicted in this frame, so this is the generation
+	// all the glyphs are valid in.
+	run->atlas_generation = run->font->atlas_generation;
+	run->last_used_frame = text_layout_cache_frame;
+}
+
+// Replaces what was in the run
+void glyph_run_layout(Gfx_Glyph_Run *run, Gfx_Font *font, string text, u32 raster_height, Vector2 scale) {
+	glyph_run_begin_layout(run, font, raster_height);
+	
+	Glyph_Run_Layout_Context c = {run, scale};
+	walk_glyphs((Walk_Glyphs_Spec){font, text, raster_height, scale, true, &c}, glyph_run_layout_callback);
+	
+	glyph_run_end_layout(run);
+}
+
+// Called by draw_glyph_run*. Marks the atlases of the run as used this frame, so they aren't
+// evicted while its quads wait to be drawn. If an atlas was evicted since the run was laid
+// out, the glyphs are looked up (and rasterized) again.
+void glyph_run_prepare_for_drawing(Gfx_Glyph_Run *run) {
+	if (!run->font) return;
+	
+	bool stale = run->atlas_generation != run->font->atlas_generation;
+	if (!stale && run->last_used_frame == text_layout_cache_frame) return;
+	
+	u64 glyph_count = glyph_run_get_glyph_count(run);
+	for (u64 i = 0; i < glyph_count; i++) {
+		Gfx_Glyph_Run_Glyph *g = &run->glyphs[i];
+		if (stale) {
+			Gfx_Glyph glyph = font_get_glyph(run->font, run->raster_height, g->codepoint, &g->atlas);
+			g->uv = glyph.uv;
+			g->image = g->atlas->image;
+		} else {
+			g->atlas->last_used_frame = text_layout_cache_frame;
+		}
+	}
+	
+	glyph_run_end_layout(run);
+}
+
 Gfx_Font_Metrics get_font_metrics(Gfx_Font *font, u32 raster_height) {
 	Gfx_Font_Variation *variation = &font->variations[raster_height];
 	
@@ -404,22 +1226,6 @@ bool measure_text_glyph_callback(Gfx_Glyph glyph, Gfx_Font_Atlas *atlas, float g
 	
 	return true;
 }
-Gfx_Text_Metrics measure_text(Gfx_Font *font, string text, u32 raster_height, Vector2 scale) {
-
-	Measure_Text_Walk_Glyphs_Context c = ZERO(Measure_Text_Walk_Glyphs_Context);
-	
-	c.scale = scale;
-	c.font = font;
-	c.raster_height = raster_height;
-	
-	walk_glyphs((Walk_Glyphs_Spec){font, text, raster_height, scale, true, &c}, measure_text_glyph_callback);
-	
-	c.m.functional_size = v2_sub(c.m.functional_pos_max, c.m.functional_pos_min);
-	c.m.visual_size = v2_sub(c.m.visual_pos_max, c.m.visual_pos_min);
-	
-	return c.m;
-}
-
 typedef struct State_For_Glyph_Line_Break_Search {
 	u64 *line_break_indices;
 	u64 *glyph_count_per_line;
@@ -521,4 +1327,321 @@ string *split_text_to_lines_with_wrapping(string str, float32 width, Gfx_Font *f
 	}
 
 	return lines;
-}
\ No newline at end of file
+}
+
+/*
+
+	Text layout cache
+	
+	Laying out text walks every glyph, looks up kerning and builds the metrics, which adds up
+	when the same strings ("FPS: 60", "100/100") are drawn and measured every frame.
+	get_text_layout returns the glyph run & metrics for a piece of text and keeps it in a
+	per-thread LRU cache keyed by the text, font, raster height, scale and wrap width.
+	draw_text* and measure_text go through this cache, so you mostly don't need to use it directly.
+	
+		Gfx_Text_Layout *layout = get_text_layout(font, STR("Score: 100"), 32, v2(1, 1), 0);
+		draw_glyph_run(&layout->run, v2(x, y), COLOR_WHITE);
+		Vector2 size = layout->metrics.functional_size;
+		
+	- The returned pointer is only guaranteed to be valid until the next call to get_text_layout
+		on the same thread (or draw_text/measure_text, which call it).
+	- With wrap_width > 0 the text is split with split_text_to_lines_with_wrapping (trimmed lines)
+		and the lines are laid out downwards, new_line_offset apart.
+	- Layouts that have not been used for TEXT_LAYOUT_CACHE_MAX_UNUSED_FRAMES frames are evicted.
+		Frames are counted by gfx_update.
+	- text_layout_cache_get_stats gives the hit & miss counts of the calling thread's cache.
+	- Each thread has its own cache, but a miss still looks up the glyphs in the font, and glyphs
+		that aren't rasterized yet are rasterized into the font atlases. That's only allowed on the
+		thread that loaded the font (asserted), since the glyph maps have no lock and atlases are
+		images. Before laying out text on other threads (like in Draw_Frame_Group jobs), prewarm
+		its glyphs and font heights on the main thread with font_prewarm or font_prewarm_text.
+
+*/
+
+#ifndef TEXT_LAYOUT_CACHE_CAPACITY
+	#define TEXT_LAYOUT_CACHE_CAPACITY 512
+#endif
+#ifndef TEXT_LAYOUT_CACHE_MAX_UNUSED_FRAMES
+	#define TEXT_LAYOUT_CACHE_MAX_UNUSED_FRAMES 120
+#endif
+
+typedef struct Gfx_Text_Layout {
+	Gfx_Glyph_Run run;
+	Gfx_Text_Metrics metrics;
+	u64 line_count;
+} Gfx_Text_Layout;
+
+typedef struct Text_Layout_Cache_Entry {
+	Gfx_Text_Layout layout;
+	
+	u64 hash;
+	u64 font_id;
+	u32 raster_height;
+	Vector2 scale;
+	float32 wrap_width;
+	string text; // Copy of the text, text_capacity bytes are allocated
+	u64 text_capacity;
+	
+	u64 last_used_frame;
+	u32 lru_prev, lru_next; // Entry indices, UINT32_MAX for none. Free entries are linked with lru_next.
+} Text_Layout_Cache_Entry;
+
+typedef struct Text_Layout_Cache_Stats {
+	u64 hits;
+	u64 misses;
+	u64 evictions;
+	u64 entry_count;
+} Text_Layout_Cache_Stats;
+
+typedef struct Text_Layout_Cache {
+	Text_Layout_Cache_Entry *entries; // TEXT_LAYOUT_CACHE_CAPACITY
+	u32 *slots; // Open addressing on the key hash, entry index + 1, 0 if empty
+	u64 slot_mask;
+	u32 lru_head, lru_tail; // Most & least recently used
+	u32 free_head;
+	u64 last_swept_frame;
+	Text_Layout_Cache_Stats stats;
+	bool initted;
+} Text_Layout_Cache;
+
+// #Global
+ogb_instance thread_local Text_Layout_Cache text_layout_cache;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+thread_local Text_Layout_Cache text_layout_cache = {0};
+#endif
+
+// Called by gfx_update
+void text_layout_cache_end_frame() {
+	text_layout_cache_frame += 1;
+}
+
+void text_layout_cache_init(Text_Layout_Cache *cache) {
+	Allocator allocator = get_heap_allocator();
+	
+	*cache = ZERO(Text_Layout_Cache);
+	
+	cache->entries = alloc(allocator, TEXT_LAYOUT_CACHE_CAPACITY*sizeof(Text_Layout_Cache_Entry));
+	memset(cache->entries, 0, TEXT_LAYOUT_CACHE_CAPACITY*sizeof(Text_Layout_Cache_Entry));
+	
+	u64 slot_count = get_next_power_of_two(TEXT_LAYOUT_CACHE_CAPACITY*2);
+	cache->slots = alloc(allocator, slot_count*sizeof(u32));
+	memset(cache->slots, 0, slot_count*sizeof(u32));
+	cache->slot_mask = slot_count-1;
+	
+	for (u32 i = 0; i < TEXT_LAYOUT_CACHE_CAPACITY; i++) {
+		glyph_run_init(&cache->entries[i].layout.run, allocator);
+		cache->entries[i].lru_next = i+1 < TEXT_LAYOUT_CACHE_CAPACITY ? i+1 : UINT32_MAX;
+	}
+	cache->free_head = 0;
+	cache->lru_head = UINT32_MAX;
+	cache->lru_tail = UINT32_MAX;
+	cache->last_swept_frame = text_layout_cache_frame;
+	
+	cache->initted = true;
+}
+
+// Frees the text layout cache of the calling thread
+void text_layout_cache_destroy() {
+	Text_Layout_Cache *cache = &text_layout_cache;
+	if (!cache->initted) return;
+	
+	Allocator allocator = get_heap_allocator();
+	for (u32 i = 0; i < TEXT_LAYOUT_CACHE_CAPACITY; i++) {
+		Text_Layout_Cache_Entry *e = &cache->entries[i];
+		glyph_run_destroy(&e->layout.run);
+		if (e->text_capacity) dealloc(allocator, e->text.data);
+	}
+	dealloc(allocator, cache->entries);
+	dealloc(allocator, cache->slots);
+	
+	*cache = ZERO(Text_Layout_Cache);
+}
+
+Text_Layout_Cache_Stats text_layout_cache_get_stats() {
+	return text_layout_cache.stats;
+}
+
+inline void text_layout_cache_lru_unlink(Text_Layout_Cache *cache, u32 index) {
+	Text_Layout_Cache_Entry *e = &cache->entries[index];
+	if (e->lru_prev != UINT32_MAX) cache->entries[e->lru_prev].lru_next = e->lru_next;
+	else                           cache->lru_head = e->lru_next;
+	if (e->lru_next != UINT32_MAX) cache->entries[e->lru_next].lru_prev = e->lru_prev;
+	else                           cache->lru_tail = e->lru_prev;
+}
+inline void text_layout_cache_lru_push_head(Text_Layout_Cache *cache, u32 index) {
+	Text_Layout_Cache_Entry *e = &cache->entries[index];
+	e->lru_prev = UINT32_MAX;
+	e->lru_next = cache->lru_head;
+	if (cache->lru_head != UINT32_MAX) cache->entries[cache->lru_head].lru_prev = index;
+	cache->lru_head = index;
+	if (cache->lru_tail == UINT32_MAX) cache->lru_tail = index;
+}
+
+void text_layout_cache_evict(Text_Layout_Cache *cache, u32 index) {
+	Text_Layout_Cache_Entry *e = &cache->entries[index];
+	
+	// Find the slot and backward shift the following slots in the probe sequence into it
+	u64 slot = e->hash & cache->slot_mask;
+	while (cache->slots[slot] != index+1) slot = (slot+1) & cache->slot_mask;
+	
+	u64 next = slot;
+	while (true) {
+		next = (next+1) & cache->slot_mask;
+		if (cache->slots[next] == 0) break;
+		
+		u64 home = cache->entries[cache->slots[next]-1].hash & cache->slot_mask;
+		// Can the entry in next move to slot without ending up before its home slot?
+		bool can_move = (slot <= next) ? (home <= slot || home > next) : (home <= slot && home > next);
+		if (can_move) {
+			cache->slots[slot] = cache->slots[next];
+			slot = next;
+		}
+	}
+	cache->slots[slot] = 0;
+	
+	text_layout_cache_lru_unlink(cache, index);
+	e->lru_next = cache->free_head;
+	cache->free_head = index;
+	
+	cache->stats.evictions += 1;
+	cache->stats.entry_count -= 1;
+}
+
+typedef struct {
+	Glyph_Run_Layout_Context run;
+	Measure_Text_Walk_Glyphs_Context measure;
+	Vector2 offset;
+} Text_Layout_Walk_Glyphs_Context;
+
+bool text_layout_glyph_callback(Gfx_Glyph glyph, Gfx_Font_Atlas *atlas, float glyph_x, float glyph_y, void *ud) {
+	Text_Layout_Walk_Glyphs_Context *c = (Text_Layout_Walk_Glyphs_Context*)ud;
+	
+	glyph_x += c->offset.x;
+	glyph_y += c->offset.y;
+	
+	measure_text_glyph_callback(glyph, atlas, glyph_x, glyph_y, &c->measure);
+	glyph_run_layout_callback(glyph, atlas, glyph_x, glyph_y, &c->run);
+	
+	return true;
+}
+
+void text_layout_build(Gfx_Text_Layout *layout, Gfx_Font *font, string text, u32 raster_height, Vector2 scale, float32 wrap_width) {
+	glyph_run_begin_layout(&layout->run, font, raster_height);
+	
+	Text_Layout_Walk_Glyphs_Context c = ZERO(Text_Layout_Walk_Glyphs_Context);
+	c.run.run = &layout->run;
+	c.run.scale = scale;
+	c.measure.font = font;
+	c.measure.raster_height = raster_height;
+	c.measure.scale = scale;
+	
+	if (wrap_width > 0) {
+		string *lines = split_text_to_lines_with_wrapping(text, wrap_width, font, raster_height, scale, true);
+		Gfx_Font_Metrics metrics = get_font_metrics_scaled(font, raster_height, scale);
+		
+		layout->line_count = growing_array_get_valid_count(lines);
+		for (u64 i = 0; i < layout->line_count; i++) {
+			c.offset = v2(0, -metrics.new_line_offset*(float32)i);
+			walk_glyphs((Walk_Glyphs_Spec){font, lines[i], raster_height, scale, true, &c}, text_layout_glyph_callback);
+		}
+	} else {
+		layout->line_count = 1;
+		for (u64 i = 0; i < text.count; i++) {
+			if (text.data[i] == '\n') layout->line_count += 1;
+		}
+		walk_glyphs((Walk_Glyphs_Spec){font, text, raster_height, scale, true, &c}, text_layout_glyph_callback);
+	}
+	
+	glyph_run_end_layout(&layout->run);
+	
+	layout->metrics = c.measure.m;
+	layout->metrics.functional_size = v2_sub(layout->metrics.functional_pos_max, layout->metrics.functional_pos_min);
+	layout->metrics.visual_size = v2_sub(layout->metrics.visual_pos_max, layout->metrics.visual_pos_min);
+}
+
+Gfx_Text_Layout *get_text_layout(Gfx_Font *font, string text, u32 raster_height, Vector2 scale, float32 wrap_width) {
+	Text_Layout_Cache *cache = &text_layout_cache;
+	if (!cache->initted) text_layout_cache_init(cache);
+	
+	// Evict what hasn't been used for a while, the lru tail is the least recently used
+	if (cache->last_swept_frame != text_layout_cache_frame) {
+		cache->last_swept_frame = text_layout_cache_frame;
+		while (cache->lru_tail != UINT32_MAX
+		    && cache->entries[cache->lru_tail].last_used_frame+TEXT_LAYOUT_CACHE_MAX_UNUSED_FRAMES < text_layout_cache_frame) {
+			text_layout_cache_evict(cache, cache->lru_tail);
+		}
+	}
+	
+	u32 scale_x_bits = *(u32*)&scale.x;
+	u32 scale_y_bits = *(u32*)&scale.y;
+	u32 wrap_bits = *(u32*)&wrap_width;
+	
+	u64 hash = string_get_hash(text);
+	hash = xx_hash(hash ^ font->id);
+	hash = xx_hash(hash ^ (((u64)raster_height << 32) | wrap_bits));
+	hash = xx_hash(hash ^ (((u64)scale_x_bits << 32) | scale_y_bits));
+	
+	u64 slot = hash & cache->slot_mask;
+	while (cache->slots[slot] != 0) {
+		u32 index = cache->slots[slot]-1;
+		Text_Layout_Cache_Entry *e = &cache->entries[index];
+		
+		if (e->hash == hash && e->font_id == font->id && e->raster_height == raster_height
+		 && *(u32*)&e->scale.x == scale_x_bits && *(u32*)&e->scale.y == scale_y_bits
+		 && *(u32*)&e->wrap_width == wrap_bits && strings_match(e->text, text)) {
+			
+			cache->stats.hits += 1;
+			e->last_used_frame = text_layout_cache_frame;
+			if (cache->lru_head != index) {
+				text_layout_cache_lru_unlink(cache, index);
+				text_layout_cache_lru_push_head(cache, index);
+			}
+			return &e->layout;
+		}
+		
+		slot = (slot+1) & cache->slot_mask;
+	}
+	
+	cache->stats.misses += 1;
+	
+	if (cache->free_head == UINT32_MAX) {
+		text_layout_cache_evict(cache, cache->lru_tail);
+		
+		// The evicted slot may have been shifted into the probe sequence, so probe again
+		slot = hash & cache->slot_mask;
+		while (cache->slots[slot] != 0) slot = (slot+1) & cache->slot_mask;
+	}
+	
+	u32 index = cache->free_head;
+	Text_Layout_Cache_Entry *e = &cache->entries[index];
+	cache->free_head = e->lru_next;
+	
+	// Entries keep their text buffer & glyph array so reused entries mostly don't allocate
+	if (e->text_capacity < (u64)text.count) {
+		if (e->text_capacity) dealloc(get_heap_allocator(), e->text.data);
+		e->text_capacity = get_next_power_of_two(max(text.count, 32));
+		e->text.data = alloc(get_heap_allocator(), e->text_capacity);
+	}
+	if (text.count) memcpy(e->text.data, text.data, text.count);
+	e->text.count = text.count;
+	
+	e->hash = hash;
+	e->font_id = font->id;
+	e->raster_height = raster_height;
+	e->scale = scale;
+	e->wrap_width = wrap_width;
+	e->last_used_frame = text_layout_cache_frame;
+	
+	text_layout_build(&e->layout, font, text, raster_height, scale, wrap_width);
+	
+	cache->slots[slot] = index+1;
+	text_layout_cache_lru_push_head(cache, index);
+	cache->stats.entry_count += 1;
+	
+	return &e->layout;
+}
+
+Gfx_Text_Metrics measure_text(Gfx_Font *font, string text, u32 raster_height, Vector2 scale) {
+	return get_text_layout(font, text, raster_height, scale, 0)->metrics;
+}
@@ -7,24 +7,31 @@ const Gfx_Handle GFX_INVALID_HANDLE = 0;
 
 string temp_win32_null_terminated_wide_to_fixed_utf8(const u16 *utf16);
 
-// We wanna pack this at some point
-// #Cleanup #Memory why am I doing alignat(16)?
-typedef struct alignat(16) D3D11_Vertex {
-	
-	Vector4 color;
-	Vector4 position;
-	Vector2 uv;
-	Vector2 self_uv;
-	s8 texture_index;
-	u8 type;
-	u8 sampler;
-	u8 has_scissor;
-	
-	Vector4 userdata[VERTEX_2D_USER_DATA_COUNT];
-	
-	Vector4 scissor;
-	
-} D3D11_Vertex;
+// Images up to this size (that are not render targets) live in a slice of a texture array with
+// the other images of the same size & format instead of getting their own texture. Then the
+// whole array only takes one slot when batching, so a frame with hundreds of different sprites
+// can be drawn in a few draw calls.
+#ifndef D3D11_TEXTURE_ARRAY_MAX_IMAGE_SIZE
+	#define D3D11_TEXTURE_ARRAY_MAX_IMAGE_SIZE 512
+#endif
+#define D3D11_TEXTURE_ARRAY_INITIAL_SLICES 16
+
+// Gfx_Batched_Image.texture_array
+typedef struct D3D11_Texture_Array {
+	Gfx_Texture_Array slices;
+	// Batches keep the array and not the view, since the view changes when the array grows
+	ID3D11Texture2D *texture;
+	ID3D11ShaderResourceView *view;
+	u32 capacity;
+} D3D11_Texture_Array;
+
+// Gfx_Image.gfx_handle
+typedef struct D3D11_Image {
+	Gfx_Batched_Image batched;
+	// Only set for images that have their own texture, the others are a slice of batched.texture_array
+	ID3D11Texture2D *texture;
+	ID3D11ShaderResourceView *view;
+} D3D11_Image;
 
 // #Global
 
@@ -61,11 +68,22 @@ void *d3d11_staging_quad_buffer = 0;
 ID3D11Buffer *d3d11_cbuffer = 0;
 u64 d3d11_cbuffer_size = 0;
 
-Draw_Quad *d3d11_sort_quad_buffer = 0;
-u64 d3d11_sort_quad_buffer_size = 0;
+// Vertex shader transform. Identity for regular quads since they are already in ndc, and
+// world_to_clip for draw lists which are cached in world space.
+ID3D11Buffer *d3d11_transform_cbuffer = 0;
+Matrix4 d3d11_transform = {0};
 
 u64 d3d11_thread_id = 0;
 
+Gfx_D3D11_Frame_Stats d3d11_current_frame_stats = {0};
+Gfx_D3D11_Frame_Stats d3d11_last_frame_stats = {0};
+
+// Draw_List.gfx_cache
+typedef struct D3D11_Draw_List_Cache {
+	Gfx_Draw_List_Cache batching;
+	ID3D11Buffer *vbo;
+} D3D11_Draw_List_Cache;
+
 const char* d3d11_stringify_category(D3D11_MESSAGE_CATEGORY category) {
     switch (category) {
     case D3D11_MESSAGE_CATEGORY_APPLICATION_DEFINED: return "Application Defined";
@@ -300,7 +318,7 @@ d3d11_compile_shader(string source) {
 
 
 
-	#define layout_base_count 9
+	#define layout_base_count 10
 	D3D11_INPUT_ELEMENT_DESC layout[layout_base_count+VERTEX_2D_USER_DATA_COUNT];
 	memset(layout, 0, sizeof(layout));
 	
@@ -308,7 +326,7 @@ d3d11_compile_shader(string source) {
 	layout[0].SemanticIndex = 0;
 	layout[0].Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
 	layout[0].InputSlot = 0;
-	layout[0].AlignedByteOffset = offsetof(D3D11_Vertex, position);
+	layout[0].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, position);
 	layout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[0].InstanceDataStepRate = 0;
 	
@@ -316,7 +334,7 @@ d3d11_compile_shader(string source) {
 	layout[1].SemanticIndex = 0;
 	layout[1].Format = DXGI_FORMAT_R32G32_FLOAT;
 	layout[1].InputSlot = 0;
-	layout[1].AlignedByteOffset = offsetof(D3D11_Vertex, uv);
+	layout[1].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, uv);
 	layout[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[1].InstanceDataStepRate = 0;
 	
@@ -324,7 +342,7 @@ d3d11_compile_shader(string source) {
 	layout[2].SemanticIndex = 0;
 	layout[2].Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
 	layout[2].InputSlot = 0;
-	layout[2].AlignedByteOffset = offsetof(D3D11_Vertex, color);
+	layout[2].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, color);
 	layout[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[2].InstanceDataStepRate = 0;
 	
@@ -332,7 +350,7 @@ d3d11_compile_shader(string source) {
 	layout[3].SemanticIndex = 0;
 	layout[3].Format = DXGI_FORMAT_R8_SINT;
 	layout[3].InputSlot = 0;
-	layout[3].AlignedByteOffset = offsetof(D3D11_Vertex, texture_index);
+	layout[3].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, texture_index);
 	layout[3].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[3].InstanceDataStepRate = 0;
 	
@@ -340,7 +358,7 @@ d3d11_compile_shader(string source) {
 	layout[4].SemanticIndex = 0;
 	layout[4].Format = DXGI_FORMAT_R8_UINT;
 	layout[4].InputSlot = 0;
-	layout[4].AlignedByteOffset = offsetof(D3D11_Vertex, type);
+	layout[4].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, type);
 	layout[4].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[4].InstanceDataStepRate = 0;
 	
@@ -348,7 +366,7 @@ d3d11_compile_shader(string source) {
 	layout[5].SemanticIndex = 0;
 	layout[5].Format = DXGI_FORMAT_R8_SINT;
 	layout[5].InputSlot = 0;
-	layout[5].AlignedByteOffset = offsetof(D3D11_Vertex, sampler);
+	layout[5].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, sampler);
 	layout[5].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[5].InstanceDataStepRate = 0;
 	
@@ -356,7 +374,7 @@ d3d11_compile_shader(string source) {
 	layout[6].SemanticIndex = 0;
 	layout[6].Format = DXGI_FORMAT_R32G32_FLOAT;
 	layout[6].InputSlot = 0;
-	layout[6].AlignedByteOffset = offsetof(D3D11_Vertex, self_uv);
+	layout[6].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, self_uv);
 	layout[6].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[6].InstanceDataStepRate = 0;
 	
@@ -364,7 +382,7 @@ d3d11_compile_shader(string source) {
 	layout[7].SemanticIndex = 0;
 	layout[7].Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
 	layout[7].InputSlot = 0;
-	layout[7].AlignedByteOffset = offsetof(D3D11_Vertex, scissor);
+	layout[7].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, scissor);
 	layout[7].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[7].InstanceDataStepRate = 0;
 	
@@ -372,16 +390,24 @@ d3d11_compile_shader(string source) {
 	layout[8].SemanticIndex = 0;
 	layout[8].Format = DXGI_FORMAT_R8_UINT;
 	layout[8].InputSlot = 0;
-	layout[8].AlignedByteOffset = offsetof(D3D11_Vertex, has_scissor);
+	layout[8].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, has_scissor);
 	layout[8].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	layout[8].InstanceDataStepRate = 0;
 	
+	layout[9].SemanticName = "ARRAY_SLICE";
+	layout[9].SemanticIndex = 0;
+	layout[9].Format = DXGI_FORMAT_R16_UINT;
+	layout[9].InputSlot = 0;
+	layout[9].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, texture_array_slice);
+	layout[9].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+	layout[9].InstanceDataStepRate = 0;
+	
 	for (int i = 0; i < VERTEX_2D_USER_DATA_COUNT; ++i) {
 	    layout[layout_base_count + i].SemanticName = "USERDATA";
 	    layout[layout_base_count + i].SemanticIndex = i;
 	    layout[layout_base_count + i].Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
 	    layout[layout_base_count + i].InputSlot = 0;
-	    layout[layout_base_count + i].AlignedByteOffset = offsetof(D3D11_Vertex, userdata) + sizeof(Vector4) * i;
+	    layout[layout_base_count + i].AlignedByteOffset = offsetof(Gfx_Quad_Vertex, userdata) + sizeof(Vector4) * i;
 	    layout[layout_base_count + i].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	}
 	
@@ -550,12 +576,28 @@ void gfx_init() {
 	
 	assert(ok, "Failed compiling default shader");
 
+	{
+		d3d11_transform = m4_scalar(1.0);
+		
+		D3D11_BUFFER_DESC desc = ZERO(D3D11_BUFFER_DESC);
+		desc.ByteWidth      = sizeof(Matrix4);
+		desc.Usage          = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags      = D3D11_BIND_CONSTANT_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		
+		D3D11_SUBRESOURCE_DATA data = ZERO(D3D11_SUBRESOURCE_DATA);
+		data.pSysMem = &d3d11_transform;
+		
+		hr = ID3D11Device_CreateBuffer(d3d11_device, &desc, &data, &d3d11_transform_cbuffer);
+		d3d11_check_hr(hr);
+	}
+
 	log_info("D3D11 init done");
 	
 	draw_frame_init(&draw_frame);
 }
 
-void d3d11_draw_call(int number_of_rendered_quads, ID3D11ShaderResourceView **textures, u64 num_textures, Draw_Frame *frame, Gfx_Image *render_target) {
+void d3d11_draw_call(ID3D11Buffer *vbo, u64 first_quad, u64 number_of_rendered_quads, Matrix4 transform, Gfx_Texture_Batch *batch, Draw_Frame *frame, Gfx_Image *render_target) {
 
 	u32 view_width;
 	u32 view_height;
@@ -581,17 +623,26 @@ void d3d11_draw_call(int number_of_rendered_quads, ID3D11ShaderResourceView **te
 	viewport.MaxDepth = 1.0;
 	ID3D11DeviceContext_RSSetViewports(d3d11_context, 1, &viewport);
 	
-    UINT stride = sizeof(D3D11_Vertex);
+    UINT stride = sizeof(Gfx_Quad_Vertex);
     UINT offset = 0;
 	
 	ID3D11DeviceContext_IASetInputLayout(d3d11_context, d3d11_image_vertex_layout);
-    ID3D11DeviceContext_IASetVertexBuffers(d3d11_context, 0, 1, &d3d11_quad_vbo, &stride, &offset);
+    ID3D11DeviceContext_IASetVertexBuffers(d3d11_context, 0, 1, &vbo, &stride, &offset);
     ID3D11DeviceContext_IASetIndexBuffer(d3d11_context, d3d11_quad_ibo, DXGI_FORMAT_R32_UINT, 0);
     ID3D11DeviceContext_IASetPrimitiveTopology(d3d11_context, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
     ID3D11DeviceContext_VSSetShader(d3d11_context, d3d11_vertex_shader_for_2d, NULL, 0);
     ID3D11DeviceContext_PSSetShader(d3d11_context, d3d11_fragment_shader_for_2d, NULL, 0);
     
+	if (!bytes_match(&transform, &d3d11_transform, sizeof(Matrix4))) {
+		D3D11_MAPPED_SUBRESOURCE transform_mapping;
+		ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_transform_cbuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &transform_mapping);
+		memcpy(transform_mapping.pData, &transform, sizeof(Matrix4));
+		ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_transform_cbuffer, 0);
+		d3d11_transform = transform;
+	}
+	ID3D11DeviceContext_VSSetConstantBuffers(d3d11_context, 1, 1, &d3d11_transform_cbuffer);
+    
 	if (frame->cbuffer && d3d11_cbuffer && d3d11_cbuffer_size) {
 		D3D11_MAPPED_SUBRESOURCE cbuffer_mapping;
 		ID3D11DeviceContext_Map(
@@ -612,12 +663,115 @@ void d3d11_draw_call(int number_of_rendered_quads, ID3D11ShaderResourceView **te
     ID3D11DeviceContext_PSSetSamplers(d3d11_context, 1, 1, &d3d11_image_sampler_nl_fl);
     ID3D11DeviceContext_PSSetSamplers(d3d11_context, 2, 1, &d3d11_image_sampler_np_fl);
     ID3D11DeviceContext_PSSetSamplers(d3d11_context, 3, 1, &d3d11_image_sampler_nl_fp);
-    ID3D11DeviceContext_PSSetShaderResources(d3d11_context, 0, num_textures, textures);
+    
+    ID3D11ShaderResourceView *texture_views[GFX_MAX_BOUND_TEXTURES];
+    for (u64 i = 0; i < batch->num_textures; i++) texture_views[i] = batch->textures[i]->view;
+    ID3D11DeviceContext_PSSetShaderResources(d3d11_context, 0, batch->num_textures, texture_views);
+    
+    ID3D11ShaderResourceView *array_views[GFX_MAX_BOUND_TEXTURE_ARRAYS];
+    for (u64 i = 0; i < batch->num_arrays; i++) array_views[i] = ((D3D11_Texture_Array*)batch->arrays[i])->view;
+    ID3D11DeviceContext_PSSetShaderResources(d3d11_context, GFX_MAX_BOUND_TEXTURES, batch->num_arrays, array_views);
 
-    ID3D11DeviceContext_DrawIndexed(d3d11_context, number_of_rendered_quads * 6, 0, 0);
+    ID3D11DeviceContext_DrawIndexed(d3d11_context, number_of_rendered_quads * 6, 0, first_quad * 4);
     
-    ID3D11ShaderResourceView* null_srv[32] = {0};
-    ID3D11DeviceContext_PSSetShaderResources(d3d11_context, 0, num_textures, null_srv);
+    d3d11_current_frame_stats.draw_calls += 1;
+    
+    ID3D11ShaderResourceView* null_srv[GFX_MAX_BOUND_TEXTURES] = {0};
+    ID3D11DeviceContext_PSSetShaderResources(d3d11_context, 0, batch->num_textures, null_srv);
+    ID3D11DeviceContext_PSSetShaderResources(d3d11_context, GFX_MAX_BOUND_TEXTURES, batch->num_arrays, null_srv);
+}
+
+// gfx_quad_processing.c impl
+// Uploads the staged quads and draws them
+void gfx_draw_staged_quads(u64 number_of_rendered_quads, Gfx_Texture_Batch *batch, Draw_Frame *frame, Gfx_Image *render_target) {
+	tm_scope("Write to gpu") {
+	    D3D11_MAPPED_SUBRESOURCE buffer_mapping;
+		tm_scope("The Map call") {
+			HRESULT hr = ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0, D3D11_MAP_WRITE_DISCARD, 0, &buffer_mapping);
+			d3d11_check_hr(hr);
+		}
+		tm_scope("The memcpy") {
+			memcpy(buffer_mapping.pData, d3d11_staging_quad_buffer, number_of_rendered_quads*sizeof(Gfx_Quad_Vertex)*4);
+		}
+		tm_scope("The Unmap call") {
+			ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0);
+		}
+	}
+	
+	///
+	// Draw call
+	tm_scope("Draw call") d3d11_draw_call(d3d11_quad_vbo, 0, number_of_rendered_quads, m4_scalar(1.0), batch, frame, render_target);
+}
+
+///
+// Draw list caching
+// Each Draw_List gets an immutable vertex buffer with its quads in world space, split in batches
+// that fit in the texture slots (see gfx_draw_list_cache_build).
+
+D3D11_Draw_List_Cache *d3d11_update_draw_list_cache(Draw_List *list) {
+	D3D11_Draw_List_Cache *cache = (D3D11_Draw_List_Cache*)list->gfx_cache;
+	if (!cache) {
+		cache = alloc(get_heap_allocator(), sizeof(D3D11_Draw_List_Cache));
+		*cache = ZERO(D3D11_Draw_List_Cache);
+		gfx_draw_list_cache_init(&cache->batching);
+		list->gfx_cache = cache;
+	}
+	
+	if (!gfx_draw_list_cache_begin_rebuild(&cache->batching, list)) return cache;
+	
+	if (cache->vbo) {
+		D3D11Release(cache->vbo);
+		cache->vbo = 0;
+	}
+	
+	u64 quad_count = growing_array_get_valid_count(list->quads);
+	if (quad_count == 0) return cache;
+	
+	tm_scope("Rebuild draw list cache") {
+		Scratch scratch = scratch_begin();
+		Gfx_Quad_Vertex *vertices = alloc(scratch.allocator, quad_count*4*sizeof(Gfx_Quad_Vertex));
+		
+		d3d11_current_frame_stats.texture_limit_flushes += gfx_draw_list_cache_build(&cache->batching, list, vertices);
+		
+		D3D11_BUFFER_DESC desc = ZERO(D3D11_BUFFER_DESC);
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.ByteWidth = quad_count*4*sizeof(Gfx_Quad_Vertex);
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		
+		D3D11_SUBRESOURCE_DATA data = ZERO(D3D11_SUBRESOURCE_DATA);
+		data.pSysMem = vertices;
+		
+		HRESULT hr = ID3D11Device_CreateBuffer(d3d11_device, &desc, &data, &cache->vbo);
+		d3d11_check_hr(hr);
+		
+		scratch_end(scratch);
+	}
+	
+	return cache;
+}
+
+// gfx_quad_processing.c impl
+void gfx_draw_cached_draw_list(Draw_List_Submission *sub, Draw_Frame *frame, Gfx_Image *render_target) {
+	D3D11_Draw_List_Cache *cache = (D3D11_Draw_List_Cache*)sub->list->gfx_cache;
+	if (!cache || !cache->vbo) return;
+	
+	u64 batch_count = growing_array_get_valid_count(cache->batching.batches);
+	for (u64 i = 0; i < batch_count; i++) {
+		Gfx_Draw_List_Batch *batch = &cache->batching.batches[i];
+		d3d11_draw_call(cache->vbo, batch->first_quad, batch->quad_count, sub->world_to_clip, &batch->textures, frame, render_target);
+	}
+}
+
+void gfx_release_draw_list_cache(Draw_List *list) {
+	assert(context.thread_id == d3d11_thread_id, "gfx_ functions must be called on the main thread");
+	
+	D3D11_Draw_List_Cache *cache = (D3D11_Draw_List_Cache*)list->gfx_cache;
+	if (!cache) return;
+	
+	if (cache->vbo) D3D11Release(cache->vbo);
+	gfx_draw_list_cache_deinit(&cache->batching);
+	dealloc(get_heap_allocator(), cache);
+	list->gfx_cache = 0;
 }
 
 void gfx_clear_render_target(Gfx_Image *render_target, Vector4 clear_color) {
@@ -630,16 +784,24 @@ void gfx_clear_render_target(Gfx_Image *render_target, Vector4 clear_color) {
 void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 	assert(context.thread_id == d3d11_thread_id, "gfx_ functions must be called on the main thread");
 	
-	HRESULT hr;
+	if (!frame->quad_buffer) return;
 	
+	// Cached draw lists can't be sorted together with the other quads, so when z sorting we
+	// just transform them into the quad buffer.
+	if (frame->enable_z_sorting) draw_frame_expand_draw_lists(frame);
 	
-	if (!frame->quad_buffer) return;
+	u64 max_draw_list_batch_quads = 0;
+	for (u64 i = 0; i < frame->draw_list_count; i++) {
+		D3D11_Draw_List_Cache *cache = d3d11_update_draw_list_cache(frame->draw_lists[i].list);
+		max_draw_list_batch_quads = max(max_draw_list_batch_quads, cache->batching.max_batch_quads);
+	}
 
-	u64 number_of_quads = growing_array_get_valid_count(frame->quad_buffer);
+	u64 number_of_quads = frame->quad_count;
 	
 	///
 	// Maybe grow quad vbo
-	u64 required_size = sizeof(D3D11_Vertex) * number_of_quads*4;
+	// Draw lists use the same index buffer, so it needs to fit the largest draw list batch too.
+	u64 required_size = sizeof(Gfx_Quad_Vertex) * max(number_of_quads, max_draw_list_batch_quads)*4;
 
 	// #Copypaste
 	if (required_size > d3d11_quad_vbo_size) {
@@ -648,7 +810,7 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 			dealloc(get_heap_allocator(), d3d11_staging_quad_buffer);
 		}
 		u64 new_size = get_next_power_of_two(required_size);
-		u64 new_indices = ((new_size/sizeof(D3D11_Vertex))/4)*6;
+		u64 new_indices = ((new_size/sizeof(Gfx_Quad_Vertex))/4)*6;
 		
 		d3d11_quad_vbo_size = new_size;
 		
@@ -687,197 +849,9 @@ void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
 		log_verbose("Grew quad vbo to %d bytes.", d3d11_quad_vbo_size);
 	}
 
-	if (number_of_quads > 0) {
-		///
-		// Render geometry from into vbo quad list
-	    
-		
-		ID3D11ShaderResourceView *textures[32];
-		ID3D11ShaderResourceView *last_texture = 0;
-		u64 num_textures = 0;
-		s8 last_texture_index = 0;
-		
-		D3D11_Vertex* head = (D3D11_Vertex*)d3d11_staging_quad_buffer;
-		D3D11_Vertex* pointer = head;
-		u64 number_of_rendered_quads = 0;
-		
-		
-		///
-		// This is where we convert Draw_Quad's to vertices. It should be very fast as all it's doing is mostly
-		// copying and some minor computing.
-		// Most computation is done in draw_quad_projected in drawing.c.
-		// This way, we could easily build different draw frames on different threads and then render them
-		// here on the main thread.
-		//
-		tm_scope("Quad processing") {
-			if (frame->enable_z_sorting) tm_scope("Z sorting") {
-				if (!d3d11_sort_quad_buffer || (d3d11_sort_quad_buffer_size < number_of_quads*sizeof(Draw_Quad))) {
-					// #Memory #Heapalloc
-					if (d3d11_sort_quad_buffer) dealloc(get_heap_allocator(), d3d11_sort_quad_buffer);
-					d3d11_sort_quad_buffer = alloc(get_heap_allocator(), number_of_quads*sizeof(Draw_Quad));
-					d3d11_sort_quad_buffer_size = number_of_quads*sizeof(Draw_Quad);
-				}
-				radix_sort(frame->quad_buffer, d3d11_sort_quad_buffer, number_of_quads, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
-			}
-		
-			for (u64 i = 0; i < number_of_quads; i++)  {
-				
-				Draw_Quad *q = &frame->quad_buffer[i];
-				
-				assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
-				assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
-				
-				s8 texture_index = -1;
-				
-				if (q->image) {
-					
-					if (last_texture == q->image->gfx_handle) {
-						texture_index = last_texture_index;
-					} else {
-						// First look if texture is already bound
-						for (u64 j = 0; j < num_textures; j++) {
-							if (textures[j] == q->image->gfx_handle) {
-								texture_index = (s8)j;
-								break;
-							}
-						}
-						// Otherwise use a new slot
-						if (texture_index <= -1) {
-							if (num_textures >= 32) {
-								// If max textures reached, make a draw call and start over
-								D3D11_MAPPED_SUBRESOURCE buffer_mapping;
-								ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0, D3D11_MAP_WRITE_DISCARD, 0, &buffer_mapping);
-								memcpy(buffer_mapping.pData, d3d11_staging_quad_buffer, number_of_rendered_quads*sizeof(D3D11_Vertex)*4);
-								ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0);
-								d3d11_draw_call(number_of_rendered_quads, textures, num_textures, frame, render_target);
-								head = (D3D11_Vertex*)d3d11_staging_quad_buffer;
-								num_textures = 0;
-								texture_index = 0;
-								number_of_rendered_quads = 0;
-								pointer = head;
-							} else {
-								texture_index = (s8)num_textures;
-								num_textures += 1;
-							}
-						}
-					}
-					textures[texture_index] = q->image->gfx_handle;
-					last_texture = q->image->gfx_handle;
-					last_texture_index = texture_index;
-				}
-				
-				
-				
-				// We will write to 4 vertices for the one quad
-				 {
-				
-					D3D11_Vertex* BL  = pointer + 0;
-					D3D11_Vertex* TL  = pointer + 1;
-					D3D11_Vertex* TR  = pointer + 2;
-					D3D11_Vertex* BR  = pointer + 3;
-					pointer += 4;
-					
-					BL->position = v4(q->bottom_left.x,  q->bottom_left.y,  0, 1);
-					TL->position = v4(q->top_left.x,     q->top_left.y,     0, 1);
-					TR->position = v4(q->top_right.x,    q->top_right.y,    0, 1);
-					BR->position = v4(q->bottom_right.x, q->bottom_right.y, 0, 1);
-					
-					
-					if (q->image) {
-
-						BL->uv = v2(q->uv.x1, q->uv.y1);
-						TL->uv = v2(q->uv.x1, q->uv.y2);
-						TR->uv = v2(q->uv.x2, q->uv.y2);
-						BR->uv = v2(q->uv.x2, q->uv.y1);
-						// #Hack #Bug #Cleanup
-						// When a window dimension is uneven it slightly under/oversamples on an axis by a
-						// seemingly arbitrary amount. The 0.25 is a magic value I got from trial and error.
-						// (It undersamples by a fourth of the atlas texture?)
-						// Anything > 0.25 < will slightly over/undersample on my machine.
-						// I have no idea about #Portability here.
-						// - Charlie M 26th July 2024
-						if (window.width % 2 != 0) {
-							BL->uv.x += (2.0/(float)q->image->width)*0.25;
-							TL->uv.x += (2.0/(float)q->image->width)*0.25;
-							TR->uv.x += (2.0/(float)q->image->width)*0.25;
-							BR->uv.x += (2.0/(float)q->image->width)*0.25;
-						}
-						if (window.height % 2 != 0) {
-							BL->uv.y -= (2.0/(float)q->image->height)*0.25;
-							TL->uv.y -= (2.0/(float)q->image->height)*0.25;
-							TR->uv.y -= (2.0/(float)q->image->height)*0.25;
-							BR->uv.y -= (2.0/(float)q->image->height)*0.25;
-						}
-
-						u8 sampler = -1;
-						if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
-									&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
-								sampler = 0;
-						if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
-									&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
-								sampler = 1;
-						if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
-									&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
-								sampler = 2;
-						if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
-									&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
-								sampler = 3;
-						BL->sampler=TL->sampler=TR->sampler=BR->sampler = (u8)sampler;
-								
-					}
-					BL->texture_index=TL->texture_index=TR->texture_index=BR->texture_index = texture_index;
-					
-					BL->self_uv = v2(0, 0);
-					TL->self_uv = v2(0, 1);
-					TR->self_uv = v2(1, 1);
-					BR->self_uv = v2(1, 0);
-					
-					// #Speed #Cleanup
-					// Many programs may not user userdata, which means a lot of redundant time spent on this.
-					memcpy(BL->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(TL->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(TR->userdata, q->userdata, sizeof(q->userdata));
-					memcpy(BR->userdata, q->userdata, sizeof(q->userdata));
-					
-					BL->color = TL->color = TR->color = BR->color = q->color;
-					
-					BL->type=TL->type=TR->type=BR->type = (u8)q->type;
-					
-					float t = q->scissor.y1;
-					q->scissor.y1 = q->scissor.y2;
-					q->scissor.y2 = t;
-					
-					q->scissor.y1 = window.pixel_height - q->scissor.y1;
-					q->scissor.y2 = window.pixel_height - q->scissor.y2;
-					
-					BL->has_scissor=TL->has_scissor=TR->has_scissor=BR->has_scissor = q->has_scissor;
-					BL->scissor=TL->scissor=TR->scissor=BR->scissor = q->scissor;
-					
-					number_of_rendered_quads += 1;
-				}
-			}
-		}
-		
-		tm_scope("Write to gpu") {
-		    D3D11_MAPPED_SUBRESOURCE buffer_mapping;
-			tm_scope("The Map call") {
-				hr = ID3D11DeviceContext_Map(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0, D3D11_MAP_WRITE_DISCARD, 0, &buffer_mapping);
-			d3d11_check_hr(hr);
-			}
-			tm_scope("The memcpy") {
-				memcpy(buffer_mapping.pData, d3d11_staging_quad_buffer, number_of_rendered_quads*sizeof(D3D11_Vertex)*4);
-			}
-			tm_scope("The Unmap call") {
-				ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource*)d3d11_quad_vbo, 0);
-			}
-		}
-		
-		///
-		// Draw call
-		tm_scope("Draw call") d3d11_draw_call(number_of_rendered_quads, textures, num_textures, frame, render_target);
-    }
-    
-    
+	if (number_of_quads > 0 || frame->draw_list_count > 0) {
+		d3d11_current_frame_stats.texture_limit_flushes += gfx_process_draw_frame_quads(frame, (Gfx_Quad_Vertex*)d3d11_staging_quad_buffer, render_target);
+	}
 }
 void gfx_render_draw_frame_to_window(Draw_Frame *frame) {
 	gfx_render_draw_frame(frame, 0);
@@ -893,21 +867,32 @@ void gfx_update() {
 		d3d11_update_swapchain();
 	}
 
+	draw_capture_update(&draw_frame);
+	
 	// Clear window & render global draw frame to window
 	gfx_render_draw_frame_to_window(&draw_frame);
 	draw_frame_reset(&draw_frame);
+	text_layout_cache_end_frame();
 
 	tm_scope("Present") {
 		IDXGISwapChain1_Present(d3d11_swap_chain, window.enable_vsync, window.enable_vsync ? 0 : DXGI_PRESENT_ALLOW_TEARING);
 	}
 	ID3D11DeviceContext_ClearRenderTargetView(d3d11_context, d3d11_window_render_target_view, (float*)&window.clear_color);
 	
+	d3d11_current_frame_stats.texture_arrays = gfx_texture_arrays ? growing_array_get_valid_count(gfx_texture_arrays) : 0;
+	d3d11_last_frame_stats = d3d11_current_frame_stats;
+	d3d11_current_frame_stats = ZERO(Gfx_D3D11_Frame_Stats);
+	
 #if CONFIGURATION == DEBUG
 	d3d11_output_debug_messages();
 #endif
 	
 }
 
+Gfx_D3D11_Frame_Stats gfx_d3d11_get_frame_stats() {
+	return d3d11_last_frame_stats;
+}
+
 void gfx_reserve_vbo_bytes(u64 number_of_bytes) {
 	assert(context.thread_id == d3d11_thread_id, "gfx_ functions must be called on the main thread");
 
@@ -918,7 +903,7 @@ void gfx_reserve_vbo_bytes(u64 number_of_bytes) {
 			dealloc(get_heap_allocator(), d3d11_staging_quad_buffer);
 		}
 		u64 new_size = get_next_power_of_two(number_of_bytes);
-		u64 new_indices = ((new_size/sizeof(D3D11_Vertex))/4)*6;
+		u64 new_indices = ((new_size/sizeof(Gfx_Quad_Vertex))/4)*6;
 		
 		d3d11_quad_vbo_size = new_size;
 		
@@ -959,6 +944,95 @@ void gfx_reserve_vbo_bytes(u64 number_of_bytes) {
 }
 
 
+DXGI_FORMAT d3d11_format_from_channels(u32 channels) {
+	// #Hdr
+	switch (channels) {
+		case 1: return DXGI_FORMAT_R8_UNORM;
+		case 2: return DXGI_FORMAT_R8G8_UNORM;
+		case 4: return DXGI_FORMAT_R8G8B8A8_UNORM;
+		default: panic("You should not be here");
+	}
+	return DXGI_FORMAT_UNKNOWN;
+}
+
+void d3d11_texture_array_resize(D3D11_Texture_Array *array, u32 new_capacity) {
+	D3D11_TEXTURE2D_DESC desc = ZERO(D3D11_TEXTURE2D_DESC);
+	desc.Width = array->slices.width;
+	desc.Height = array->slices.height;
+	desc.MipLevels = 1;
+	desc.ArraySize = new_capacity;
+	desc.Format = d3d11_format_from_channels(array->slices.channels);
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	
+	ID3D11Texture2D *texture = 0;
+	HRESULT hr = ID3D11Device_CreateTexture2D(d3d11_device, &desc, 0, &texture);
+	d3d11_check_hr(hr);
+	
+	ID3D11ShaderResourceView *view = 0;
+	hr = ID3D11Device_CreateShaderResourceView(d3d11_device, (ID3D11Resource*)texture, 0, &view);
+	d3d11_check_hr(hr);
+	
+	if (array->texture) {
+		// One mip level, so the subresource index is the same as the slice.
+		// The new slice may already be counted in used, so only copy what the old texture has.
+		u32 copy_count = min(array->slices.used, array->capacity);
+		for (u32 i = 0; i < copy_count; i++) {
+			ID3D11DeviceContext_CopySubresourceRegion(d3d11_context, (ID3D11Resource*)texture, i, 0, 0, 0, (ID3D11Resource*)array->texture, i, 0);
+		}
+		D3D11Release(array->view);
+		D3D11Release(array->texture);
+	}
+	
+	array->texture = texture;
+	array->view = view;
+	array->capacity = new_capacity;
+	
+	log_verbose("Texture array %dx%d (%d channels) now has %d slices", array->slices.width, array->slices.height, array->slices.channels, new_capacity);
+}
+
+// Finds or makes a texture array for the image and gives it a slice
+void d3d11_texture_array_add_image(D3D11_Image *d3d11_image, Gfx_Image *image) {
+	D3D11_Texture_Array *array = (D3D11_Texture_Array*)gfx_find_texture_array(image->width, image->height, image->channels, D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION);
+	
+	if (!array) {
+		array = alloc(get_heap_allocator(), sizeof(D3D11_Texture_Array));
+		*array = ZERO(D3D11_Texture_Array);
+		gfx_texture_array_init(&array->slices, image->width, image->height, image->channels);
+		d3d11_texture_array_resize(array, D3D11_TEXTURE_ARRAY_INITIAL_SLICES);
+	}
+	
+	gfx_texture_array_add_image(&array->slices, &d3d11_image->batched);
+	
+	if (d3d11_image->batched.texture_array_slice >= array->capacity) {
+		d3d11_texture_array_resize(array, min(array->capacity*2, D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION));
+	}
+}
+
+void d3d11_texture_array_remove_image(D3D11_Image *d3d11_image) {
+	D3D11_Texture_Array *array = (D3D11_Texture_Array*)gfx_texture_array_remove_image(&d3d11_image->batched);
+	if (!array) return;
+	
+	D3D11Release(array->view);
+	D3D11Release(array->texture);
+	dealloc(get_heap_allocator(), array);
+}
+
+// The texture & subresource that the pixels of an image are in
+ID3D11Texture2D *d3d11_get_image_texture(D3D11_Image *d3d11_image, u32 *subresource) {
+	D3D11_Texture_Array *array = (D3D11_Texture_Array*)d3d11_image->batched.texture_array;
+	if (array) {
+		// One mip level, so the subresource index is the same as the slice
+		*subresource = d3d11_image->batched.texture_array_slice;
+		return array->texture;
+	}
+	*subresource = 0;
+	return d3d11_image->texture;
+}
+
+
 void gfx_init_image(Gfx_Image *image, void *initial_data, bool render_target) {
 
 	assert(context.thread_id == d3d11_thread_id, "gfx_ functions must be called on the main thread");
@@ -971,80 +1045,82 @@ void gfx_init_image(Gfx_Image *image, void *initial_data, bool render_target) {
     }
     
 	assert(image->channels > 0 && image->channels <= 4 && image->channels != 3, "Only 1, 2 or 4 channels allowed on images. Got %d", image->channels);
-
-	D3D11_TEXTURE2D_DESC desc = ZERO(D3D11_TEXTURE2D_DESC);
-	desc.Width = image->width;
-	desc.Height = image->height;
-	desc.MipLevels = 1;
-	desc.ArraySize = 1;
-	// #Hdr
-	switch (image->channels) {
-		case 1: desc.Format = DXGI_FORMAT_R8_UNORM; break;
-		case 2: desc.Format = DXGI_FORMAT_R8G8_UNORM; break;
-		case 4: desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; break;
-		default: panic("You should not be here");
-	}
-	desc.SampleDesc.Count = 1;
-	desc.SampleDesc.Quality = 0;
-	desc.Usage = D3D11_USAGE_DEFAULT;
-	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-	if (render_target) {
-		desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
-	}
-	desc.CPUAccessFlags = 0;
-	desc.MiscFlags = 0;
-	
-	D3D11_SUBRESOURCE_DATA data_desc = ZERO(D3D11_SUBRESOURCE_DATA);
-	data_desc.pSysMem = data;
-	data_desc.SysMemPitch  = image->width * image->channels; // #Hdr
-	
-	ID3D11Texture2D* texture = 0;
-	HRESULT hr = ID3D11Device_CreateTexture2D(d3d11_device, &desc, &data_desc, &texture);
-	d3d11_check_hr(hr);
 	
-	hr = ID3D11Device_CreateShaderResourceView(d3d11_device, (ID3D11Resource*)texture, 0, &image->gfx_handle);
-	d3d11_check_hr(hr);
+	// #Memory #Heapalloc
+	D3D11_Image *d3d11_image = alloc(get_heap_allocator(), sizeof(D3D11_Image));
+	*d3d11_image = ZERO(D3D11_Image);
+	d3d11_image->batched.batch_slot = -1;
+	image->gfx_handle = d3d11_image;
+	image->gfx_render_target = 0;
+	
+	bool use_texture_array = !render_target 
+		&& image->width  <= D3D11_TEXTURE_ARRAY_MAX_IMAGE_SIZE 
+		&& image->height <= D3D11_TEXTURE_ARRAY_MAX_IMAGE_SIZE;
+	if (use_texture_array) {
+		d3d11_texture_array_add_image(d3d11_image, image);
+		u32 subresource;
+		ID3D11Texture2D *texture = d3d11_get_image_texture(d3d11_image, &subresource);
+		ID3D11DeviceContext_UpdateSubresource(d3d11_context, (ID3D11Resource*)texture, subresource, 0, data, image->width * image->channels, 0);
+	} else {
+		D3D11_TEXTURE2D_DESC desc = ZERO(D3D11_TEXTURE2D_DESC);
+		desc.Width = image->width;
+		desc.Height = image->height;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = d3d11_format_from_channels(image->channels);
+		desc.SampleDesc.Count = 1;
+		desc.SampleDesc.Quality = 0;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		if (render_target) {
+			desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+		}
+		desc.CPUAccessFlags = 0;
+		desc.MiscFlags = 0;
+		
+		D3D11_SUBRESOURCE_DATA data_desc = ZERO(D3D11_SUBRESOURCE_DATA);
+		data_desc.pSysMem = data;
+		data_desc.SysMemPitch  = image->width * image->channels; // #Hdr
+		
+		HRESULT hr = ID3D11Device_CreateTexture2D(d3d11_device, &desc, &data_desc, &d3d11_image->texture);
+		d3d11_check_hr(hr);
+		
+		hr = ID3D11Device_CreateShaderResourceView(d3d11_device, (ID3D11Resource*)d3d11_image->texture, 0, &d3d11_image->view);
+		d3d11_check_hr(hr);
+		
+		if (render_target) {
+			D3D11_RENDER_TARGET_VIEW_DESC rtv_desc = ZERO(D3D11_RENDER_TARGET_VIEW_DESC);
+		    rtv_desc.Format = desc.Format;
+		    rtv_desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+		    rtv_desc.Texture2D.MipSlice = 0;
+		
+		    // Create the render target view
+		    hr = ID3D11Device_CreateRenderTargetView(
+		    	d3d11_device, 
+		    	(ID3D11Resource*)d3d11_image->texture, 
+		    	&rtv_desc, 
+		    	&image->gfx_render_target
+	    	);
+	    	d3d11_check_hr(hr);
+		}
+	}
 	
 	if (!initial_data) {
 		dealloc(image->allocator, data);
 	}
 	
-	if (render_target) {
-		D3D11_RENDER_TARGET_VIEW_DESC rtv_desc = ZERO(D3D11_RENDER_TARGET_VIEW_DESC);
-	    rtv_desc.Format = desc.Format;
-	    rtv_desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-	    rtv_desc.Texture2D.MipSlice = 0;
-	
-	    // Create the render target view
-	    hr = ID3D11Device_CreateRenderTargetView(
-	    	d3d11_device, 
-	    	(ID3D11Resource*)texture, 
-	    	&rtv_desc, 
-	    	&image->gfx_render_target
-    	);
-    	d3d11_check_hr(hr);
-	} else {
-		image->gfx_render_target = 0;
-	}
-	
 	log_verbose("Created a D3D11 image%s of width %d and height %d.", render_target ? STR(" render target") : STR(""), image->width, image->height);
 }
 void gfx_set_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *data) {
 	assert(context.thread_id == d3d11_thread_id, "gfx_ functions must be called on the main thread");
 	
     assert(image && data, "Bad parameters passed to gfx_set_image_data");
-
-    ID3D11ShaderResourceView *view = image->gfx_handle;
-    ID3D11Resource *resource = NULL;
-    ID3D11ShaderResourceView_GetResource(view, &resource);
-    
-    assert(resource, "Invalid image passed to gfx_set_image_data");
+    assert(image->gfx_handle, "Invalid image passed to gfx_set_image_data");
     
     assert(x+w <= image->width && y+h <= image->height, "Specified subregion in image is out of bounds");
 
-    ID3D11Texture2D *texture = NULL;
-    HRESULT hr = ID3D11Resource_QueryInterface(resource, &IID_ID3D11Texture2D, (void**)&texture);
-    assert(SUCCEEDED(hr), "Expected gfx resource to be a texture but it wasn't");
+    u32 subresource;
+    ID3D11Texture2D *texture = d3d11_get_image_texture(image->gfx_handle, &subresource);
 
     D3D11_BOX region;
     region.left = x;
@@ -1056,9 +1132,7 @@ void gfx_set_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *data
 
 	// #Hdr
 	// #Incomplete bit-width 8 assumed
-    ID3D11DeviceContext_UpdateSubresource(d3d11_context, (ID3D11Resource*)texture, 0, &region, data, w * image->channels, 0);
-    
-    ID3D11Resource_Release(resource);
+    ID3D11DeviceContext_UpdateSubresource(d3d11_context, (ID3D11Resource*)texture, subresource, &region, data, w * image->channels, 0);
 }
 void gfx_read_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *output) {
 	
@@ -1072,31 +1146,32 @@ void gfx_read_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *out
     region.front = 0;
     region.back = 1;
     
-	ID3D11Resource *resource = 0;
-	ID3D11View_GetResource(image->gfx_handle, &resource);
-	
-	ID3D11Texture2D *texture = 0;
-	HRESULT hr = ID3D11Resource_QueryInterface(resource, &IID_ID3D11Texture2D, (void**)&texture);
-	d3d11_check_hr(hr);
-	
-	D3D11_TEXTURE2D_DESC desc;
-    texture->lpVtbl->GetDesc(texture, &desc);
+    u32 subresource;
+    ID3D11Texture2D *texture = d3d11_get_image_texture(image->gfx_handle, &subresource);
     
-    D3D11_TEXTURE2D_DESC staging_desc = desc;
+    // Not a copy of the texture desc, since that could be a whole texture array
+    D3D11_TEXTURE2D_DESC staging_desc = ZERO(D3D11_TEXTURE2D_DESC);
+    staging_desc.Width = image->width;
+    staging_desc.Height = image->height;
+    staging_desc.MipLevels = 1;
+    staging_desc.ArraySize = 1;
+    staging_desc.Format = d3d11_format_from_channels(image->channels);
+    staging_desc.SampleDesc.Count = 1;
+    staging_desc.SampleDesc.Quality = 0;
     staging_desc.Usage = D3D11_USAGE_STAGING;
     staging_desc.BindFlags = 0;
     staging_desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
     staging_desc.MiscFlags = 0;
     
     ID3D11Texture2D *staging_texture = 0;
-    hr = ID3D11Device_CreateTexture2D(d3d11_device, &staging_desc, 0, &staging_texture);
+    HRESULT hr = ID3D11Device_CreateTexture2D(d3d11_device, &staging_desc, 0, &staging_texture);
 	d3d11_check_hr(hr);
 	
 	ID3D11DeviceContext_CopySubresourceRegion(
 		d3d11_context, 
 		(ID3D11Resource *)staging_texture, 
 		0, 0, 0, 0, 
-		(ID3D11Resource *)texture, 0, 
+		(ID3D11Resource *)texture, subresource, 
 		&region
 	);
 	
@@ -1112,27 +1187,23 @@ void gfx_read_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *out
 	
 	ID3D11DeviceContext_Unmap(d3d11_context, (ID3D11Resource *)staging_texture, 0);
 	
-	ID3D11Resource_Release(resource);
 	ID3D11Texture2D_Release(staging_texture);
 }
 void gfx_deinit_image(Gfx_Image *image) {
 	assert(context.thread_id == d3d11_thread_id, "gfx_ functions must be called on the main thread");
 
-	ID3D11ShaderResourceView *view = image->gfx_handle;
-	ID3D11Resource *resource = 0;
-	ID3D11ShaderResourceView_GetResource(view, &resource);
+	D3D11_Image *d3d11_image = image->gfx_handle;
+	if (!d3d11_image) return;
 	
-	ID3D11Texture2D *texture = 0;
-	HRESULT hr = ID3D11Resource_QueryInterface(resource, &IID_ID3D11Texture2D, (void**)&texture);
-	if (SUCCEEDED(hr)) {
-		D3D11Release(view);
-		D3D11Release(texture);
-		log("Destroyed an image");
-	} else {
-		panic("Unhandled D3D11 resource deletion");
+	if (d3d11_image->texture) {
+		D3D11Release(d3d11_image->view);
+		D3D11Release(d3d11_image->texture);
 	}
+	d3d11_texture_array_remove_image(d3d11_image);
 	
-	ID3D11Resource_Release(resource);
+	dealloc(get_heap_allocator(), d3d11_image);
+	image->gfx_handle = 0;
+	log("Destroyed an image");
 }
 
 bool 
@@ -1176,6 +1247,7 @@ struct VS_INPUT
     uint type : TYPE;
     uint sampler_index : SAMPLER_INDEX;
     uint has_scissor : HAS_SCISSOR;
+    uint texture_array_slice : ARRAY_SLICE;
     float4 userdata[$VERTEX_2D_USER_DATA_COUNT] : USERDATA;
     float4 scissor : SCISSOR;
 };
@@ -1191,17 +1263,24 @@ struct PS_INPUT
     int type: TYPE;
     int sampler_index: SAMPLER_INDEX;
     uint has_scissor : HAS_SCISSOR;
+    uint texture_array_slice : ARRAY_SLICE;
     float4 userdata[$VERTEX_2D_USER_DATA_COUNT] : USERDATA;
     float4 scissor : SCISSOR;
 };
 
 
 
+cbuffer Transform : register(b1)
+{
+    row_major float4x4 transform;
+};
+
 PS_INPUT vs_main(VS_INPUT input)
 {
     PS_INPUT output;
-    output.position_screen = input.position;
-    output.position = input.position;
+    float4 position = mul(transform, input.position);
+    output.position_screen = position;
+    output.position = position;
     output.uv = input.uv;
     output.color = input.color;
     output.texture_index = input.texture_index;
@@ -1213,17 +1292,97 @@ PS_INPUT vs_main(VS_INPUT input)
 	}
 	output.scissor = input.scissor;
 	output.has_scissor = input.has_scissor;
+	output.texture_array_slice = input.texture_array_slice;
     return output;
 }
 
-// #Magicvalue
+// #Magicvalue #Volatile GFX_MAX_BOUND_TEXTURES, GFX_MAX_BOUND_TEXTURE_ARRAYS
 Texture2D textures[32] : register(t0);
+Texture2DArray texture_arrays[16] : register(t32);
 SamplerState image_sampler_0 : register(s0);
 SamplerState image_sampler_1 : register(s1);
 SamplerState image_sampler_2 : register(s2);
 SamplerState image_sampler_3 : register(s3);
 
-float4 sample_texture(int texture_index, int sampler_index, float2 uv) {
+float4 sample_texture_array(int array_index, int sampler_index, float2 uv, uint slice) {
+	float3 uvw = float3(uv, (float)slice);
+	if (sampler_index == 0) {
+		if (array_index ==  0)       return texture_arrays[0].Sample(image_sampler_0, uvw);
+		else if (array_index ==  1)  return texture_arrays[1].Sample(image_sampler_0, uvw);
+		else if (array_index ==  2)  return texture_arrays[2].Sample(image_sampler_0, uvw);
+		else if (array_index ==  3)  return texture_arrays[3].Sample(image_sampler_0, uvw);
+		else if (array_index ==  4)  return texture_arrays[4].Sample(image_sampler_0, uvw);
+		else if (array_index ==  5)  return texture_arrays[5].Sample(image_sampler_0, uvw);
+		else if (array_index ==  6)  return texture_arrays[6].Sample(image_sampler_0, uvw);
+		else if (array_index ==  7)  return texture_arrays[7].Sample(image_sampler_0, uvw);
+		else if (array_index ==  8)  return texture_arrays[8].Sample(image_sampler_0, uvw);
+		else if (array_index ==  9)  return texture_arrays[9].Sample(image_sampler_0, uvw);
+		else if (array_index ==  10) return texture_arrays[10].Sample(image_sampler_0, uvw);
+		else if (array_index ==  11) return texture_arrays[11].Sample(image_sampler_0, uvw);
+		else if (array_index ==  12) return texture_arrays[12].Sample(image_sampler_0, uvw);
+		else if (array_index ==  13) return texture_arrays[13].Sample(image_sampler_0, uvw);
+		else if (array_index ==  14) return texture_arrays[14].Sample(image_sampler_0, uvw);
+		else if (array_index ==  15) return texture_arrays[15].Sample(image_sampler_0, uvw);
+	} else if (sampler_index == 1) {
+		if (array_index ==  0)       return texture_arrays[0].Sample(image_sampler_1, uvw);
+		else if (array_index ==  1)  return texture_arrays[1].Sample(image_sampler_1, uvw);
+		else if (array_index ==  2)  return texture_arrays[2].Sample(image_sampler_1, uvw);
+		else if (array_index ==  3)  return texture_arrays[3].Sample(image_sampler_1, uvw);
+		else if (array_index ==  4)  return texture_arrays[4].Sample(image_sampler_1, uvw);
+		else if (array_index ==  5)  return texture_arrays[5].Sample(image_sampler_1, uvw);
+		else if (array_index ==  6)  return texture_arrays[6].Sample(image_sampler_1, uvw);
+		else if (array_index ==  7)  return texture_arrays[7].Sample(image_sampler_1, uvw);
+		else if (array_index ==  8)  return texture_arrays[8].Sample(image_sampler_1, uvw);
+		else if (array_index ==  9)  return texture_arrays[9].Sample(image_sampler_1, uvw);
+		else if (array_index ==  10) return texture_arrays[10].Sample(image_sampler_1, uvw);
+		else if (array_index ==  11) return texture_arrays[11].Sample(image_sampler_1, uvw);
+		else if (array_index ==  12) return texture_arrays[12].Sample(image_sampler_1, uvw);
+		else if (array_index ==  13) return texture_arrays[13].Sample(image_sampler_1, uvw);
+		else if (array_index ==  14) return texture_arrays[14].Sample(image_sampler_1, uvw);
+		else if (array_index ==  15) return texture_arrays[15].Sample(image_sampler_1, uvw);
+	} else if (sampler_index == 2) {
+		if (array_index ==  0)       return texture_arrays[0].Sample(image_sampler_2, uvw);
+		else if (array_index ==  1)  return texture_arrays[1].Sample(image_sampler_2, uvw);
+		else if (array_index ==  2)  return texture_arrays[2].Sample(image_sampler_2, uvw);
+		else if (array_index ==  3)  return texture_arrays[3].Sample(image_sampler_2, uvw);
+		else if (array_index ==  4)  return texture_arrays[4].Sample(image_sampler_2, uvw);
+		else if (array_index ==  5)  return texture_arrays[5].Sample(image_sampler_2, uvw);
+		else if (array_index ==  6)  return texture_arrays[6].Sample(image_sampler_2, uvw);
+		else if (array_index ==  7)  return texture_arrays[7].Sample(image_sampler_2, uvw);
+		else if (array_index ==  8)  return texture_arrays[8].Sample(image_sampler_2, uvw);
+		else if (array_index ==  9)  return texture_arrays[9].Sample(image_sampler_2, uvw);
+		else if (array_index ==  10) return texture_arrays[10].Sample(image_sampler_2, uvw);
+		else if (array_index ==  11) return texture_arrays[11].Sample(image_sampler_2, uvw);
+		else if (array_index ==  12) return texture_arrays[12].Sample(image_sampler_2, uvw);
+		else if (array_index ==  13) return texture_arrays[13].Sample(image_sampler_2, uvw);
+		else if (array_index ==  14) return texture_arrays[14].Sample(image_sampler_2, uvw);
+		else if (array_index ==  15) return texture_arrays[15].Sample(image_sampler_2, uvw);
+	} else if (sampler_index == 3) {
+		if (array_index ==  0)       return texture_arrays[0].Sample(image_sampler_3, uvw);
+		else if (array_index ==  1)  return texture_arrays[1].Sample(image_sampler_3, uvw);
+		else if (array_index ==  2)  return texture_arrays[2].Sample(image_sampler_3, uvw);
+		else if (array_index ==  3)  return texture_arrays[3].Sample(image_sampler_3, uvw);
+		else if (array_index ==  4)  return texture_arrays[4].Sample(image_sampler_3, uvw);
+		else if (array_index ==  5)  return texture_arrays[5].Sample(image_sampler_3, uvw);
+		else if (array_index ==  6)  return texture_arrays[6].Sample(image_sampler_3, uvw);
+		else if (array_index ==  7)  return texture_arrays[7].Sample(image_sampler_3, uvw);
+		else if (array_index ==  8)  return texture_arrays[8].Sample(image_sampler_3, uvw);
+		else if (array_index ==  9)  return texture_arrays[9].Sample(image_sampler_3, uvw);
+		else if (array_index ==  10) return texture_arrays[10].Sample(image_sampler_3, uvw);
+		else if (array_index ==  11) return texture_arrays[11].Sample(image_sampler_3, uvw);
+		else if (array_index ==  12) return texture_arrays[12].Sample(image_sampler_3, uvw);
+		else if (array_index ==  13) return texture_arrays[13].Sample(image_sampler_3, uvw);
+		else if (array_index ==  14) return texture_arrays[14].Sample(image_sampler_3, uvw);
+		else if (array_index ==  15) return texture_arrays[15].Sample(image_sampler_3, uvw);
+	}
+	
+	return float4(1.0, 0.0, 0.0, 1.0);
+}
+
+float4 sample_texture(int texture_index, int sampler_index, float2 uv, uint slice) {
+	// Indices after the textures are texture arrays
+	if (texture_index >= 32) return sample_texture_array(texture_index-32, sampler_index, uv, slice);
+	
 	// I love hlsl
 	if (sampler_index == 0) {
 		if (texture_index ==  0)       return textures[0].Sample(image_sampler_0, uv);
@@ -1371,6 +1530,7 @@ $INJECT_PIXEL_POST_PROCESS
 \043define QUAD_TYPE_REGULAR 0\n
 \043define QUAD_TYPE_TEXT 1\n
 \043define QUAD_TYPE_CIRCLE 2\n
+\043define QUAD_TYPE_TEXT_SDF 3\n
 float4 ps_main(PS_INPUT input) : SV_TARGET
 {
 
@@ -1382,14 +1542,19 @@ float4 ps_main(PS_INPUT input) : SV_TARGET
 	}
 
 	if (input.type == QUAD_TYPE_REGULAR) {
-		if (input.texture_index >= 0 && input.texture_index < 32 && input.sampler_index >= 0  && input.sampler_index <= 3) {
-			return pixel_shader_extension(input, sample_texture(input.texture_index, input.sampler_index, input.uv)*input.color);
+		if (input.texture_index >= 0 && input.texture_index < 48 && input.sampler_index >= 0  && input.sampler_index <= 3) {
+			return pixel_shader_extension(input, sample_texture(input.texture_index, input.sampler_index, input.uv, input.texture_array_slice)*input.color);
 		} else {
 			return pixel_shader_extension(input, input.color);
 		}
-	} else if (input.type == QUAD_TYPE_TEXT) {
-		if (input.texture_index >= 0 && input.texture_index < 32 && input.sampler_index >= 0  && input.sampler_index <= 3) {
-			float alpha = sample_texture(input.texture_index, input.sampler_index, input.uv).x;
+	} else if (input.type == QUAD_TYPE_TEXT || input.type == QUAD_TYPE_TEXT_SDF) {
+		if (input.texture_index >= 0 && input.texture_index < 48 && input.sampler_index >= 0  && input.sampler_index <= 3) {
+			float alpha = sample_texture(input.texture_index, input.sampler_index, input.uv, input.texture_array_slice).x;
+			if (input.type == QUAD_TYPE_TEXT_SDF) {
+				// Edge is at 0.5, antialias over about one screen pixel whatever the scale
+				float w = max(fwidth(alpha)*0.5, 0.0001);
+				alpha = smoothstep(0.5-w, 0.5+w, alpha);
+			}
 			return pixel_shader_extension(input, float4(1.0, 1.0, 1.0, alpha)*input.color);
 		} else {
 			return pixel_shader_extension(input, input.color);
@@ -1400,8 +1565,8 @@ float4 ps_main(PS_INPUT input) : SV_TARGET
 	
 		if (dist > 0.5) return float4(0.0, 0.0, 0.0, 0.0);
 	
-		if (input.texture_index >= 0 && input.texture_index < 32 && input.sampler_index >= 0  && input.sampler_index <= 3) {
-			return pixel_shader_extension(input, sample_texture(input.texture_index, input.sampler_index, input.uv)*input.color);
+		if (input.texture_index >= 0 && input.texture_index < 48 && input.sampler_index >= 0  && input.sampler_index <= 3) {
+			return pixel_shader_extension(input, sample_texture(input.texture_index, input.sampler_index, input.uv, input.texture_array_slice)*input.color);
 		} else {
 			return pixel_shader_extension(input, input.color);
 		}
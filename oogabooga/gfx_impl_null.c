@@ -0,0 +1,308 @@
+/*
+	Null renderer
+
+	Goes through the same quad processing as the d3d11 renderer (gfx_quad_processing.c: z
+	sorting, texture slot assignment, vertex generation, draw list caching) but never talks to
+	a gpu. Instead of issuing api calls it counts what would have been issued, so it's useful
+	for profiling the cpu side of rendering on machines without a gpu.
+	It still needs an os layer, and there's only one for windows so far.
+
+	Stats are accumulated over all gfx_ calls in a frame and gfx_update ends the frame:
+		gfx_null_get_frame_stats()         Stats of the last finished frame
+		gfx_null_get_current_frame_stats() Stats so far in the current frame
+
+	What is counted:
+		- bytes_uploaded: vertex, transform & cbuffer bytes that d3d11 would have copied to
+			the gpu. Cached draw lists only count when they are rebuilt.
+		- texture_bytes_uploaded: bytes passed to gfx_init_image & gfx_set_image_data
+		- draw_calls & quads_drawn
+		- texture_binds: textures & texture arrays bound per draw call, summed
+		- texture_limit_flushes: batches that had to be broken because a draw call can only bind
+			32 textures and 16 texture arrays.
+		- texture_arrays: same grouping of small images into texture arrays as d3d11
+
+	Images keep their pixels on the cpu so gfx_read_image_data gives back what was set, but
+	nothing is ever rendered to render targets.
+*/
+
+const Gfx_Handle GFX_INVALID_HANDLE = 0;
+
+#ifndef NULL_TEXTURE_ARRAY_MAX_IMAGE_SIZE
+	#define NULL_TEXTURE_ARRAY_MAX_IMAGE_SIZE 512
+#endif
+// D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION
+#define NULL_TEXTURE_ARRAY_MAX_SLICES 2048
+
+// Gfx_Image.gfx_handle
+typedef struct Null_Image {
+	Gfx_Batched_Image batched;
+	u32 width, height, channels;
+	u8 *pixels;
+} Null_Image;
+
+// #Global
+
+Gfx_Quad_Vertex *null_staging_quad_buffer = 0;
+u64 null_staging_quad_buffer_size = 0;
+
+u64 null_cbuffer_size = 0;
+Matrix4 null_transform = {0};
+
+Gfx_Null_Frame_Stats null_current_frame_stats = {0};
+Gfx_Null_Frame_Stats null_last_frame_stats = {0};
+
+u64 null_thread_id = 0;
+
+void null_reserve_staging_bytes(u64 number_of_bytes) {
+	if (number_of_bytes <= null_staging_quad_buffer_size) return;
+
+	if (null_staging_quad_buffer) dealloc(get_heap_allocator(), null_staging_quad_buffer);
+
+	null_staging_quad_buffer_size = get_next_power_of_two(number_of_bytes);
+	null_staging_quad_buffer = alloc(get_heap_allocator(), null_staging_quad_buffer_size);
+
+	log_verbose("Grew null quad staging buffer to %d bytes.", null_staging_quad_buffer_size);
+}
+
+// Counts what d3d11_draw_call would have sent to the gpu
+void null_draw_call(u64 number_of_rendered_quads, Matrix4 transform, Gfx_Texture_Batch *batch, Draw_Frame *frame) {
+	Gfx_Null_Frame_Stats *stats = &null_current_frame_stats;
+
+	if (!bytes_match(&transform, &null_transform, sizeof(Matrix4))) {
+		stats->bytes_uploaded += sizeof(Matrix4);
+		null_transform = transform;
+	}
+	if (frame->cbuffer && null_cbuffer_size) {
+		stats->bytes_uploaded += null_cbuffer_size;
+	}
+
+	stats->draw_calls += 1;
+	stats->quads_drawn += number_of_rendered_quads;
+	stats->texture_binds += batch->num_textures + batch->num_arrays;
+}
+
+// gfx_quad_processing.c impl
+void gfx_draw_staged_quads(u64 number_of_rendered_quads, Gfx_Texture_Batch *batch, Draw_Frame *frame, Gfx_Image *render_target) {
+	null_current_frame_stats.bytes_uploaded += number_of_rendered_quads*sizeof(Gfx_Quad_Vertex)*4;
+	null_draw_call(number_of_rendered_quads, m4_scalar(1.0), batch, frame);
+}
+
+///
+// Draw list caching
+// Same as d3d11_update_draw_list_cache. The vertices are generated and thrown away, and the
+// size of the immutable vertex buffer d3d11 would create is counted as uploaded.
+
+Gfx_Draw_List_Cache *null_update_draw_list_cache(Draw_List *list) {
+	Gfx_Draw_List_Cache *cache = (Gfx_Draw_List_Cache*)list->gfx_cache;
+	if (!cache) {
+		cache = alloc(get_heap_allocator(), sizeof(Gfx_Draw_List_Cache));
+		gfx_draw_list_cache_init(cache);
+		list->gfx_cache = cache;
+	}
+
+	if (!gfx_draw_list_cache_begin_rebuild(cache, list)) return cache;
+
+	u64 quad_count = growing_array_get_valid_count(list->quads);
+	if (quad_count == 0) return cache;
+
+	tm_scope("Rebuild draw list cache") {
+		null_reserve_staging_bytes(quad_count*4*sizeof(Gfx_Quad_Vertex));
+
+		null_current_frame_stats.texture_limit_flushes += gfx_draw_list_cache_build(cache, list, null_staging_quad_buffer);
+
+		null_current_frame_stats.bytes_uploaded += quad_count*4*sizeof(Gfx_Quad_Vertex);
+		null_current_frame_stats.draw_list_cache_rebuilds += 1;
+	}
+
+	return cache;
+}
+
+// gfx_quad_processing.c impl
+void gfx_draw_cached_draw_list(Draw_List_Submission *sub, Draw_Frame *frame, Gfx_Image *render_target) {
+	Gfx_Draw_List_Cache *cache = (Gfx_Draw_List_Cache*)sub->list->gfx_cache;
+	if (!cache) return;
+
+	u64 batch_count = growing_array_get_valid_count(cache->batches);
+	for (u64 i = 0; i < batch_count; i++) {
+		Gfx_Draw_List_Batch *batch = &cache->batches[i];
+		null_draw_call(batch->quad_count, sub->world_to_clip, &batch->textures, frame);
+	}
+}
+
+///
+// gfx_interface.c impl
+
+void gfx_init() {
+	log_verbose("null gfx_init");
+
+	null_thread_id = context.thread_id;
+
+	draw_frame_init(&draw_frame);
+
+	log_info("Null renderer initialized, nothing will be drawn");
+}
+
+void gfx_release_draw_list_cache(Draw_List *list) {
+	assert(context.thread_id == null_thread_id, "gfx_ functions must be called on the main thread");
+
+	Gfx_Draw_List_Cache *cache = (Gfx_Draw_List_Cache*)list->gfx_cache;
+	if (!cache) return;
+
+	gfx_draw_list_cache_deinit(cache);
+	dealloc(get_heap_allocator(), cache);
+	list->gfx_cache = 0;
+}
+
+void gfx_clear_render_target(Gfx_Image *render_target, Vector4 clear_color) {
+	assert(context.thread_id == null_thread_id, "gfx_ functions must be called on the main thread");
+	assert(render_target->gfx_render_target, "Image was not created as a render target");
+	null_current_frame_stats.clears += 1;
+}
+
+void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
+	assert(context.thread_id == null_thread_id, "gfx_ functions must be called on the main thread");
+
+	if (!frame->quad_buffer) return;
+
+	if (render_target) assert(render_target->gfx_render_target, "Image was not created as a render target");
+
+	if (frame->enable_z_sorting) draw_frame_expand_draw_lists(frame);
+
+	for (u64 i = 0; i < frame->draw_list_count; i++) {
+		null_update_draw_list_cache(frame->draw_lists[i].list);
+	}
+
+	u64 number_of_quads = frame->quad_count;
+
+	null_reserve_staging_bytes(sizeof(Gfx_Quad_Vertex)*number_of_quads*4);
+
+	null_current_frame_stats.frames_rendered += 1;
+	null_current_frame_stats.quads_processed += number_of_quads;
+
+	if (number_of_quads == 0 && frame->draw_list_count == 0) return;
+
+	null_current_frame_stats.texture_limit_flushes += gfx_process_draw_frame_quads(frame, null_staging_quad_buffer, render_target);
+}
+void gfx_render_draw_frame_to_window(Draw_Frame *frame) {
+	gfx_render_draw_frame(frame, 0);
+}
+
+void gfx_update() {
+	if (window.should_close) return;
+
+	draw_capture_update(&draw_frame);
+
+	gfx_render_draw_frame_to_window(&draw_frame);
+	draw_frame_reset(&draw_frame);
+	text_layout_cache_end_frame();
+
+	null_current_frame_stats.texture_arrays = gfx_texture_arrays ? growing_array_get_valid_count(gfx_texture_arrays) : 0;
+	null_last_frame_stats = null_current_frame_stats;
+	null_current_frame_stats = ZERO(Gfx_Null_Frame_Stats);
+}
+
+Gfx_Null_Frame_Stats gfx_null_get_frame_stats() {
+	return null_last_frame_stats;
+}
+Gfx_Null_Frame_Stats gfx_null_get_current_frame_stats() {
+	return null_current_frame_stats;
+}
+
+void gfx_reserve_vbo_bytes(u64 number_of_bytes) {
+	assert(context.thread_id == null_thread_id, "gfx_ functions must be called on the main thread");
+	null_reserve_staging_bytes(number_of_bytes);
+}
+
+void gfx_init_image(Gfx_Image *image, void *initial_data, bool render_target) {
+	assert(context.thread_id == null_thread_id, "gfx_ functions must be called on the main thread");
+
+	assert(image->channels > 0 && image->channels <= 4 && image->channels != 3, "Only 1, 2 or 4 channels allowed on images. Got %d", image->channels);
+
+	// #Incomplete 8 bit width assumed
+	u64 size = (u64)image->width*image->height*image->channels;
+
+	// #Memory #Heapalloc
+	Null_Image *null_image = alloc(get_heap_allocator(), sizeof(Null_Image) + size);
+	*null_image = ZERO(Null_Image);
+	null_image->batched.batch_slot = -1;
+	null_image->width = image->width;
+	null_image->height = image->height;
+	null_image->channels = image->channels;
+	null_image->pixels = (u8*)(null_image+1);
+
+	if (initial_data) {
+		memcpy(null_image->pixels, initial_data, size);
+		null_current_frame_stats.texture_bytes_uploaded += size;
+	} else {
+		memset(null_image->pixels, 0, size);
+	}
+
+	image->gfx_handle = null_image;
+	image->gfx_render_target = render_target ? null_image : 0;
+
+	bool use_texture_array = !render_target
+		&& image->width  <= NULL_TEXTURE_ARRAY_MAX_IMAGE_SIZE
+		&& image->height <= NULL_TEXTURE_ARRAY_MAX_IMAGE_SIZE;
+	if (use_texture_array) {
+		Gfx_Texture_Array *array = gfx_find_texture_array(image->width, image->height, image->channels, NULL_TEXTURE_ARRAY_MAX_SLICES);
+		if (!array) {
+			// #Memory #Heapalloc
+			array = alloc(get_heap_allocator(), sizeof(Gfx_Texture_Array));
+			gfx_texture_array_init(array, image->width, image->height, image->channels);
+		}
+		gfx_texture_array_add_image(array, &null_image->batched);
+	}
+
+	log_verbose("Created a null image%s of width %d and height %d.", render_target ? STR(" render target") : STR(""), image->width, image->height);
+}
+void gfx_set_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *data) {
+	assert(context.thread_id == null_thread_id, "gfx_ functions must be called on the main thread");
+	assert(image && data, "Bad parameters passed to gfx_set_image_data");
+	assert(image->gfx_handle, "Invalid image passed to gfx_set_image_data");
+	assert(x+w <= image->width && y+h <= image->height, "Specified subregion in image is out of bounds");
+
+	Null_Image *null_image = image->gfx_handle;
+	u64 row_bytes = (u64)w*image->channels;
+	for (u32 row = 0; row < h; row++) {
+		memcpy(
+			null_image->pixels + ((u64)(y+row)*image->width + x)*image->channels,
+			(u8*)data + row*row_bytes,
+			row_bytes
+		);
+	}
+	null_current_frame_stats.texture_bytes_uploaded += row_bytes*h;
+}
+void gfx_read_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *output) {
+	assert(context.thread_id == null_thread_id, "gfx_ functions must be called on the main thread");
+	assert(image && output, "Bad parameters passed to gfx_read_image_data");
+	assert(x+w <= image->width && y+h <= image->height, "Specified subregion in image is out of bounds");
+
+	Null_Image *null_image = image->gfx_handle;
+	u64 row_bytes = (u64)w*image->channels;
+	for (u32 row = 0; row < h; row++) {
+		memcpy(
+			(u8*)output + row*row_bytes,
+			null_image->pixels + ((u64)(y+row)*image->width + x)*image->channels,
+			row_bytes
+		);
+	}
+}
+void gfx_deinit_image(Gfx_Image *image) {
+	assert(context.thread_id == null_thread_id, "gfx_ functions must be called on the main thread");
+
+	Null_Image *null_image = image->gfx_handle;
+	if (null_image) {
+		Gfx_Texture_Array *empty_array = gfx_texture_array_remove_image(&null_image->batched);
+		if (empty_array) dealloc(get_heap_allocator(), empty_array);
+		dealloc(get_heap_allocator(), null_image);
+	}
+	image->gfx_handle = 0;
+	image->gfx_render_target = 0;
+}
+
+bool
+gfx_shader_recompile_with_extension(string ext_source, u64 cbuffer_size) {
+	// Nothing to compile, but keep the cbuffer size so the uploads are counted
+	null_cbuffer_size = cbuffer_size;
+	return true;
+}
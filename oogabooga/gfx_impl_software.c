@@ -0,0 +1,927 @@
+
+/*
+	Software renderer
+
+	Renders Draw_Frame's on the cpu so we can render without a gpu, for example for golden image
+	tests, thumbnails or profiling on build machines.
+
+	Rendering a frame goes like this:
+		1. Setup: each quad is converted to pixel space edge functions & attribute planes, clipped
+			to the target & scissor. This is done in chunks on the parallel_for thread pool.
+		2. Binning: each quad is added to the bin of each SOFTWARE_TILE_SIZE tile it touches, in
+			draw order.
+		3. Raster: each tile is a parallel_for job. The tile is loaded into a float buffer, all its
+			quads are shaded & blended 4 pixels at a time, and then the tile is written back.
+			Tiles never overlap so nothing needs to be synchronized.
+
+	Shading matches the d3d11 shader: QUAD_TYPE_REGULAR, QUAD_TYPE_TEXT, QUAD_TYPE_TEXT_SDF &
+	QUAD_TYPE_CIRCLE, scissor,
+	nearest/linear filtering (picking min or mag filter by the texel to pixel ratio) with clamped
+	uv's, and src alpha blending.
+
+	Not supported:
+		- Pixel shader extensions (gfx_shader_recompile_with_extension returns false) so
+			Draw_Frame.cbuffer & Draw_Quad.userdata are ignored.
+		- Rendering to images with less than 4 channels.
+
+	Images are stored as 8 bit per channel with the first row at the top, same as d3d11 textures.
+
+	Use gfx_software_get_last_render_stats to see how many pixels were shaded and how fast.
+
+	The window image is presented with GDI in gfx_update. To render without a window, render to a
+	render target and use gfx_read_image_data.
+	There's only a windows os layer so far, so this doesn't make oogabooga run on linux, it only
+	takes away the need for a gpu.
+*/
+
+const Gfx_Handle GFX_INVALID_HANDLE = 0;
+
+#define SOFTWARE_TILE_SIZE 64
+// Quads per setup job
+#define SOFTWARE_SETUP_CHUNK 4096
+
+typedef struct Software_Image {
+	u32 width, height, channels;
+	u8 *pixels;
+} Software_Image;
+
+// A quad ready to be rasterized, in pixel space with y pointing down.
+// Everything is set up to be evaluated at pixel corners, the half pixel offset to the centers is
+// already baked in.
+typedef struct Software_Quad {
+	// Covered pixels, clipped to target & scissor. max is exclusive. Empty if min_x >= max_x.
+	s32 min_x, min_y, max_x, max_y;
+
+	// Inside if e(x, y) = edge_a*x + edge_b*y + edge_c is >= 0 for inclusive (top-left) edges and
+	// > 0 for other edges, so pixels exactly on an edge shared by two quads are only drawn once.
+	u32 edge_count;
+	float32 edge_a[4], edge_b[4], edge_c[4];
+	bool edge_inclusive[4];
+
+	// >= 0 for the triangle (BL, TL, TR), < 0 for (BL, TR, BR), same split as the d3d11 index buffer
+	float32 diagonal_a, diagonal_b, diagonal_c;
+
+	// u, v, self_u, self_v planes for each of the two triangles
+	float32 attribute_a[2][4], attribute_b[2][4], attribute_c[2][4];
+
+	Vector4 color;
+	Software_Image *image;
+	Gfx_Filter_Mode filter;
+	u8 type;
+} Software_Quad;
+
+// #Global
+
+Software_Image *software_window_image = 0;
+// BGRA copy of the window image for GDI
+u8 *software_present_buffer = 0;
+u64 software_present_buffer_size = 0;
+
+// 2 per quad, since quads that are not convex are split in two triangles
+Software_Quad *software_quads = 0;
+u64 software_quad_capacity = 0;
+
+// bin_offsets[tile]..bin_offsets[tile+1] is the range of quad indices in bin_items for a tile
+u32 *software_bin_offsets = 0;
+u64 software_bin_offset_capacity = 0;
+u32 *software_bin_items = 0;
+u64 software_bin_item_capacity = 0;
+
+// Z sort keys, the second half is used as help buffer for the radix sort
+u64 *software_sort_key_buffer = 0;
+u64 software_sort_key_buffer_count = 0;
+
+Gfx_Software_Render_Stats software_last_render_stats = {0};
+
+u64 software_thread_id = 0;
+
+///
+// 4 wide float lanes
+// Just enough of an abstraction to write the pixel loop once for both sse and scalar.
+// Masks are all bits set (sse) or 1.0 (scalar) per lane.
+#if ENABLE_SIMD
+typedef __m128 Lanes;
+inline Lanes lanes_set1(float32 x) { return _mm_set1_ps(x); }
+inline Lanes lanes_set(float32 a, float32 b, float32 c, float32 d) { return _mm_setr_ps(a, b, c, d); }
+inline Lanes lanes_load(float32 *p) { return _mm_load_ps(p); }
+inline void  lanes_store(float32 *p, Lanes a) { _mm_store_ps(p, a); }
+inline Lanes lanes_add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes lanes_sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes lanes_mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes lanes_min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+inline Lanes lanes_ge(Lanes a, Lanes b)  { return _mm_cmpge_ps(a, b); }
+inline Lanes lanes_gt(Lanes a, Lanes b)  { return _mm_cmpgt_ps(a, b); }
+inline Lanes lanes_lt(Lanes a, Lanes b)  { return _mm_cmplt_ps(a, b); }
+inline Lanes lanes_le(Lanes a, Lanes b)  { return _mm_cmple_ps(a, b); }
+inline Lanes lanes_and(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+inline Lanes lanes_select(Lanes mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline u32   lanes_mask_bits(Lanes mask) { return (u32)_mm_movemask_ps(mask); }
+#else
+typedef struct Lanes { float32 v[4]; } Lanes;
+inline Lanes lanes_set1(float32 x) { Lanes r = {x, x, x, x}; return r; }
+inline Lanes lanes_set(float32 a, float32 b, float32 c, float32 d) { Lanes r = {a, b, c, d}; return r; }
+inline Lanes lanes_load(float32 *p) { Lanes r = {p[0], p[1], p[2], p[3]}; return r; }
+inline void  lanes_store(float32 *p, Lanes a) { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+#define LANES_OP(name, expr) inline Lanes name(Lanes a, Lanes b) { Lanes r; for (int i = 0; i < 4; i++) r.v[i] = (expr); return r; }
+LANES_OP(lanes_add, a.v[i]+b.v[i])
+LANES_OP(lanes_sub, a.v[i]-b.v[i])
+LANES_OP(lanes_mul, a.v[i]*b.v[i])
+LANES_OP(lanes_min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+LANES_OP(lanes_ge,  a.v[i] >= b.v[i] ? 1.0f : 0.0f)
+LANES_OP(lanes_gt,  a.v[i] >  b.v[i] ? 1.0f : 0.0f)
+LANES_OP(lanes_lt,  a.v[i] <  b.v[i] ? 1.0f : 0.0f)
+LANES_OP(lanes_le,  a.v[i] <= b.v[i] ? 1.0f : 0.0f)
+LANES_OP(lanes_and, (a.v[i] != 0 && b.v[i] != 0) ? 1.0f : 0.0f)
+#undef LANES_OP
+inline Lanes lanes_select(Lanes mask, Lanes a, Lanes b) { Lanes r; for (int i = 0; i < 4; i++) r.v[i] = mask.v[i] != 0 ? a.v[i] : b.v[i]; return r; }
+inline u32   lanes_mask_bits(Lanes mask) { u32 r = 0; for (int i = 0; i < 4; i++) if (mask.v[i] != 0) r |= 1 << i; return r; }
+#endif
+
+///
+// Images
+
+Software_Image *software_make_image(u32 width, u32 height, u32 channels) {
+	Software_Image *image = alloc(get_heap_allocator(), sizeof(Software_Image));
+	image->width = width;
+	image->height = height;
+	image->channels = channels;
+	image->pixels = alloc(get_heap_allocator(), max(width*height*channels, 1));
+	return image;
+}
+void software_destroy_image(Software_Image *image) {
+	dealloc(get_heap_allocator(), image->pixels);
+	dealloc(get_heap_allocator(), image);
+}
+
+void software_clear_image(Software_Image *image, Vector4 color) {
+	u8 c[4];
+	c[0] = (u8)(clamp(color.r, 0.0f, 1.0f)*255.0f + 0.5f);
+	c[1] = (u8)(clamp(color.g, 0.0f, 1.0f)*255.0f + 0.5f);
+	c[2] = (u8)(clamp(color.b, 0.0f, 1.0f)*255.0f + 0.5f);
+	c[3] = (u8)(clamp(color.a, 0.0f, 1.0f)*255.0f + 0.5f);
+
+	u64 pixel_count = (u64)image->width*image->height;
+	for (u64 i = 0; i < pixel_count; i++) {
+		memcpy(image->pixels + i*image->channels, c, image->channels);
+	}
+}
+
+// Same as an unorm texture in d3d11: missing color channels are 0 and missing alpha is 1
+inline Vector4 software_fetch_texel(Software_Image *image, s32 x, s32 y) {
+	x = clamp(x, 0, (s32)image->width-1);
+	y = clamp(y, 0, (s32)image->height-1);
+	u8 *p = image->pixels + ((u64)y*image->width + x)*image->channels;
+	const float32 s = 1.0f/255.0f;
+	switch (image->channels) {
+		case 1: return v4(p[0]*s, 0, 0, 1);
+		case 2: return v4(p[0]*s, p[1]*s, 0, 1);
+		default: return v4(p[0]*s, p[1]*s, p[2]*s, p[3]*s);
+	}
+}
+
+Vector4 software_sample(Software_Image *image, Gfx_Filter_Mode filter, float32 u, float32 v) {
+	float32 x = u*(float32)image->width;
+	float32 y = v*(float32)image->height;
+
+	if (filter == GFX_FILTER_MODE_NEAREST) {
+		return software_fetch_texel(image, (s32)floorf(x), (s32)floorf(y));
+	}
+
+	x -= 0.5f;
+	y -= 0.5f;
+	float32 fx = floorf(x);
+	float32 fy = floorf(y);
+	float32 tx = x-fx;
+	float32 ty = y-fy;
+	s32 x0 = (s32)fx;
+	s32 y0 = (s32)fy;
+
+	Vector4 t00 = software_fetch_texel(image, x0,   y0);
+	Vector4 t10 = software_fetch_texel(image, x0+1, y0);
+	Vector4 t01 = software_fetch_texel(image, x0,   y0+1);
+	Vector4 t11 = software_fetch_texel(image, x0+1, y0+1);
+
+	return v4_lerp(v4_lerp(t00, t10, tx), v4_lerp(t01, t11, tx), ty);
+}
+
+///
+// Setup
+
+typedef struct Software_Setup_Job {
+	Draw_Quad *quads;
+	u64 *sorted_keys; // Null if not z sorting
+	u64 quad_count;
+	Software_Quad *result;
+	float32 target_width;
+	float32 target_height;
+} Software_Setup_Job;
+
+// e(p) = a*x + b*y + c, which is 0 on the line through p0 & p1.
+// Degenerate edges are always inside.
+void software_make_edge(Vector2 p0, Vector2 p1, float32 *a, float32 *b, float32 *c) {
+	*a =   p1.y-p0.y;
+	*b = -(p1.x-p0.x);
+	if (*a == 0 && *b == 0) {
+		*c = 1;
+		return;
+	}
+	*c = -(*a*p0.x + *b*p0.y);
+}
+
+// f(p) = a*x + b*y + c so that f(p0) = f0, f(p1) = f1 & f(p2) = f2
+void software_make_plane(Vector2 p0, Vector2 p1, Vector2 p2, float32 f0, float32 f1, float32 f2, float32 *a, float32 *b, float32 *c) {
+	float32 det = (p1.x-p0.x)*(p2.y-p0.y) - (p2.x-p0.x)*(p1.y-p0.y);
+	if (det == 0) {
+		*a = 0;
+		*b = 0;
+		*c = f0;
+		return;
+	}
+	*a = ((f1-f0)*(p2.y-p0.y) - (f2-f0)*(p1.y-p0.y))/det;
+	*b = ((f2-f0)*(p1.x-p0.x) - (f1-f0)*(p2.x-p0.x))/det;
+	*c = f0 - *a*p0.x - *b*p0.y;
+}
+
+// Flips the edges so the inside is positive, picks the inclusive edges & moves the evaluation
+// point to the pixel centers.
+void software_finish_edges(Software_Quad *s, Vector2 inside_point) {
+	for (u32 i = 0; i < s->edge_count; i++) {
+		if (s->edge_a[i]*inside_point.x + s->edge_b[i]*inside_point.y + s->edge_c[i] < 0) {
+			s->edge_a[i] = -s->edge_a[i];
+			s->edge_b[i] = -s->edge_b[i];
+			s->edge_c[i] = -s->edge_c[i];
+		}
+		// Top-left rule: with y down, a left edge has the inside to the right (a > 0) and a top
+		// edge is horizontal with the inside below it (a == 0, b > 0).
+		s->edge_inclusive[i] = s->edge_a[i] > 0 || (s->edge_a[i] == 0 && s->edge_b[i] > 0);
+		s->edge_c[i] += 0.5f*s->edge_a[i] + 0.5f*s->edge_b[i];
+	}
+	s->diagonal_c += 0.5f*s->diagonal_a + 0.5f*s->diagonal_b;
+	for (u32 t = 0; t < 2; t++) {
+		for (u32 i = 0; i < 4; i++) {
+			s->attribute_c[t][i] += 0.5f*s->attribute_a[t][i] + 0.5f*s->attribute_b[t][i];
+		}
+	}
+}
+
+void software_setup_quad(Draw_Quad *q, Software_Quad *result, float32 target_width, float32 target_height) {
+	Software_Quad *first = &result[0];
+	Software_Quad *second = &result[1];
+	first->min_x = first->max_x = 0;
+	second->min_x = second->max_x = 0;
+
+	// BL, TL, TR, BR in pixels
+	Vector2 p[4];
+	Vector2 ndc[4] = {q->bottom_left, q->top_left, q->top_right, q->bottom_right};
+	for (int i = 0; i < 4; i++) {
+		p[i].x = (ndc[i].x*0.5f + 0.5f)*target_width;
+		p[i].y = (0.5f - ndc[i].y*0.5f)*target_height;
+	}
+
+	float32 min_x = min(min(p[0].x, p[1].x), min(p[2].x, p[3].x));
+	float32 max_x = max(max(p[0].x, p[1].x), max(p[2].x, p[3].x));
+	float32 min_y = min(min(p[0].y, p[1].y), min(p[2].y, p[3].y));
+	float32 max_y = max(max(p[0].y, p[1].y), max(p[2].y, p[3].y));
+
+	// Axis aligned rectangles (most sprites & glyphs) are covered exactly by their bounds, so they
+	// don't need any edge functions.
+	bool is_rectangle = true;
+	for (int i = 0; i < 4; i++) {
+		if (p[i].x != p[(i+1)%4].x && p[i].y != p[(i+1)%4].y) is_rectangle = false;
+	}
+
+	// A pixel is covered when its center is. For rectangles we apply the top-left rule here, so x
+	// covers [ceil(min-0.5), ceil(max-0.5)). Otherwise the bounds are conservative and the edge
+	// functions take care of it.
+	float32 bounds_min_x = max(ceilf(min_x-0.5f), 0.0f);
+	float32 bounds_min_y = max(ceilf(min_y-0.5f), 0.0f);
+	float32 bounds_max_x = min(is_rectangle ? ceilf(max_x-0.5f) : floorf(max_x-0.5f)+1.0f, target_width);
+	float32 bounds_max_y = min(is_rectangle ? ceilf(max_y-0.5f) : floorf(max_y-0.5f)+1.0f, target_height);
+
+	if (q->has_scissor) {
+		// Same as d3d11: scissor is in window pixels from the bottom, and a pixel is inside when
+		// its center is in [min, max)
+		float32 scissor_min_y = (float32)window.pixel_height - q->scissor.y2;
+		float32 scissor_max_y = (float32)window.pixel_height - q->scissor.y1;
+		bounds_min_x = max(bounds_min_x, ceilf(q->scissor.x1-0.5f));
+		bounds_max_x = min(bounds_max_x, ceilf(q->scissor.x2-0.5f));
+		bounds_min_y = max(bounds_min_y, ceilf(scissor_min_y-0.5f));
+		bounds_max_y = min(bounds_max_y, ceilf(scissor_max_y-0.5f));
+	}
+
+	// Also takes care of NaN's
+	if (!(bounds_min_x < bounds_max_x && bounds_min_y < bounds_max_y)) return;
+
+	Software_Quad s = ZERO(Software_Quad);
+	s.min_x = (s32)bounds_min_x;
+	s.min_y = (s32)bounds_min_y;
+	s.max_x = (s32)bounds_max_x;
+	s.max_y = (s32)bounds_max_y;
+	s.color = q->color;
+	s.image = q->image ? q->image->gfx_handle : 0;
+	s.type = q->type;
+
+	// u, v, self_u, self_v per corner, same as d3d11_write_quad_vertices
+	float32 attributes[4][4] = {
+		{q->uv.x1, q->uv.y1, 0, 0},
+		{q->uv.x1, q->uv.y2, 0, 1},
+		{q->uv.x2, q->uv.y2, 1, 1},
+		{q->uv.x2, q->uv.y1, 1, 0},
+	};
+
+	// Triangles (BL, TL, TR) & (BL, TR, BR)
+	const int triangles[2][3] = {{0, 1, 2}, {0, 2, 3}};
+	for (int t = 0; t < 2; t++) {
+		const int *v = triangles[t];
+		for (int i = 0; i < 4; i++) {
+			software_make_plane(
+				p[v[0]], p[v[1]], p[v[2]],
+				attributes[v[0]][i], attributes[v[1]][i], attributes[v[2]][i],
+				&s.attribute_a[t][i], &s.attribute_b[t][i], &s.attribute_c[t][i]
+			);
+		}
+	}
+
+	if (s.image) {
+		// There are no mips, so the filter is just picked by whether the image is minified
+		float32 du_dx = s.attribute_a[0][0]*s.image->width,  dv_dx = s.attribute_a[0][1]*s.image->height;
+		float32 du_dy = s.attribute_b[0][0]*s.image->width,  dv_dy = s.attribute_b[0][1]*s.image->height;
+		float32 texels_per_pixel_sq = max(du_dx*du_dx + dv_dx*dv_dx, du_dy*du_dy + dv_dy*dv_dy);
+		s.filter = texels_per_pixel_sq > 1.0f ? q->image_min_filter : q->image_mag_filter;
+	}
+
+	if (is_rectangle) {
+		s.edge_count = 0;
+		software_make_edge(p[0], p[2], &s.diagonal_a, &s.diagonal_b, &s.diagonal_c);
+		if (s.diagonal_a*p[1].x + s.diagonal_b*p[1].y + s.diagonal_c < 0) {
+			s.diagonal_a = -s.diagonal_a;
+			s.diagonal_b = -s.diagonal_b;
+			s.diagonal_c = -s.diagonal_c;
+		}
+		software_finish_edges(&s, p[0]);
+		*first = s;
+		return;
+	}
+
+	// Convex if the corners all turn the same way
+	float32 turn[4];
+	bool has_left_turn = false;
+	bool has_right_turn = false;
+	for (int i = 0; i < 4; i++) {
+		Vector2 a = p[i], b = p[(i+1)%4], c = p[(i+2)%4];
+		turn[i] = (b.x-a.x)*(c.y-b.y) - (b.y-a.y)*(c.x-b.x);
+		if (turn[i] > 0) has_right_turn = true;
+		if (turn[i] < 0) has_left_turn = true;
+	}
+	if (!has_left_turn && !has_right_turn) return; // No area
+
+	if (!(has_left_turn && has_right_turn)) {
+		s.edge_count = 4;
+		for (int i = 0; i < 4; i++) {
+			software_make_edge(p[i], p[(i+1)%4], &s.edge_a[i], &s.edge_b[i], &s.edge_c[i]);
+		}
+		software_make_edge(p[0], p[2], &s.diagonal_a, &s.diagonal_b, &s.diagonal_c);
+		if (s.diagonal_a*p[1].x + s.diagonal_b*p[1].y + s.diagonal_c < 0) {
+			s.diagonal_a = -s.diagonal_a;
+			s.diagonal_b = -s.diagonal_b;
+			s.diagonal_c = -s.diagonal_c;
+		}
+		Vector2 center = v2((p[0].x+p[1].x+p[2].x+p[3].x)/4, (p[0].y+p[1].y+p[2].y+p[3].y)/4);
+		software_finish_edges(&s, center);
+		*first = s;
+	} else {
+		// Not convex, so draw the two triangles separately. The shared edge might get
+		// blended twice, but you would have to go out of your way to draw quads like this.
+		for (int t = 0; t < 2; t++) {
+			const int *v = triangles[t];
+			Software_Quad tri = s;
+			tri.edge_count = 3;
+			for (int i = 0; i < 3; i++) {
+				software_make_edge(p[v[i]], p[v[(i+1)%3]], &tri.edge_a[i], &tri.edge_b[i], &tri.edge_c[i]);
+			}
+			tri.diagonal_a = 0;
+			tri.diagonal_b = 0;
+			tri.diagonal_c = t == 0 ? 1 : -1;
+			Vector2 center = v2((p[v[0]].x+p[v[1]].x+p[v[2]].x)/3, (p[v[0]].y+p[v[1]].y+p[v[2]].y)/3);
+			software_finish_edges(&tri, center);
+			result[t] = tri;
+		}
+	}
+}
+
+void software_setup_job(u64 job_index, void *data) {
+	Software_Setup_Job *job = (Software_Setup_Job*)data;
+
+	u64 first = job_index*SOFTWARE_SETUP_CHUNK;
+	u64 last = min(first+SOFTWARE_SETUP_CHUNK, job->quad_count);
+
+	for (u64 i = first; i < last; i++) {
+		Draw_Quad *q;
+		if (job->sorted_keys) q = &job->quads[job->sorted_keys[i] & Z_SORT_KEY_INDEX_MASK];
+		else                  q = &job->quads[i];
+
+		software_setup_quad(q, &job->result[i*2], job->target_width, job->target_height);
+	}
+}
+
+///
+// Raster
+
+typedef struct Software_Raster_Job {
+	Software_Image *target;
+	u64 tiles_x;
+	volatile u64 pixels;
+	volatile u64 tiles;
+} Software_Raster_Job;
+
+thread_local alignat(16) float32 software_tile_r[SOFTWARE_TILE_SIZE*SOFTWARE_TILE_SIZE];
+thread_local alignat(16) float32 software_tile_g[SOFTWARE_TILE_SIZE*SOFTWARE_TILE_SIZE];
+thread_local alignat(16) float32 software_tile_b[SOFTWARE_TILE_SIZE*SOFTWARE_TILE_SIZE];
+thread_local alignat(16) float32 software_tile_a[SOFTWARE_TILE_SIZE*SOFTWARE_TILE_SIZE];
+
+// Returns the number of shaded pixels
+u64 software_raster_quad_in_tile(Software_Quad *s, s32 tile_x, s32 tile_y, s32 tile_width, s32 tile_height) {
+	// In tile coordinates
+	s32 x0 = max(s->min_x-tile_x, 0);
+	s32 y0 = max(s->min_y-tile_y, 0);
+	s32 x1 = min(s->max_x-tile_x, tile_width);
+	s32 y1 = min(s->max_y-tile_y, tile_height);
+	if (x0 >= x1 || y0 >= y1) return 0;
+
+	u64 pixels = 0;
+
+	const Lanes zero = lanes_set1(0);
+	const Lanes one = lanes_set1(1);
+	const Lanes half = lanes_set1(0.5f);
+	const Lanes quarter = lanes_set1(0.25f);
+	const Lanes lane_offsets = lanes_set(0, 1, 2, 3);
+	const Lanes range_min = lanes_set1((float32)x0);
+	const Lanes range_max = lanes_set1((float32)x1);
+
+	const Lanes color_r = lanes_set1(s->color.r);
+	const Lanes color_g = lanes_set1(s->color.g);
+	const Lanes color_b = lanes_set1(s->color.b);
+	const Lanes color_a = lanes_set1(s->color.a);
+
+	bool need_attributes = s->image || s->type == QUAD_TYPE_CIRCLE;
+	
+	// The d3d11 shader uses fwidth() for the SDF edge width. uv's are linear over each
+	// triangle, so it's the same for the whole quad: distance field units per screen pixel.
+	float32 sdf_half_width = 0;
+	if (s->type == QUAD_TYPE_TEXT_SDF && s->image) {
+		float32 texels_x = v2_length(v2(s->attribute_a[0][0]*s->image->width, s->attribute_a[0][1]*s->image->height));
+		float32 texels_y = v2_length(v2(s->attribute_b[0][0]*s->image->width, s->attribute_b[0][1]*s->image->height));
+		sdf_half_width = max((texels_x+texels_y)*(FONT_SDF_PIXEL_DIST_SCALE/255.0f)*0.5f, 0.0001f);
+	}
+
+	Lanes edge_a[4];
+	for (u32 i = 0; i < s->edge_count; i++) edge_a[i] = lanes_set1(s->edge_a[i]);
+
+	for (s32 y = y0; y < y1; y++) {
+		float32 py = (float32)(tile_y+y);
+		u64 row = (u64)y*SOFTWARE_TILE_SIZE;
+
+		Lanes edge_row[4];
+		for (u32 i = 0; i < s->edge_count; i++) edge_row[i] = lanes_set1(s->edge_b[i]*py + s->edge_c[i]);
+
+		for (s32 x = x0 & ~3; x < x1; x += 4) {
+			Lanes local_x = lanes_add(lanes_set1((float32)x), lane_offsets);
+			Lanes px = lanes_add(local_x, lanes_set1((float32)tile_x));
+
+			Lanes mask = lanes_and(lanes_ge(local_x, range_min), lanes_lt(local_x, range_max));
+			for (u32 i = 0; i < s->edge_count; i++) {
+				Lanes e = lanes_add(lanes_mul(edge_a[i], px), edge_row[i]);
+				mask = lanes_and(mask, s->edge_inclusive[i] ? lanes_ge(e, zero) : lanes_gt(e, zero));
+			}
+			if (!lanes_mask_bits(mask)) continue;
+
+			Lanes src_r = color_r;
+			Lanes src_g = color_g;
+			Lanes src_b = color_b;
+			Lanes src_a = color_a;
+
+			if (need_attributes) {
+				Lanes diagonal = lanes_add(lanes_mul(lanes_set1(s->diagonal_a), px), lanes_set1(s->diagonal_b*py + s->diagonal_c));
+				Lanes first_triangle = lanes_ge(diagonal, zero);
+
+				Lanes attributes[4];
+				for (u32 i = 0; i < 4; i++) {
+					Lanes a0 = lanes_add(lanes_mul(lanes_set1(s->attribute_a[0][i]), px), lanes_set1(s->attribute_b[0][i]*py + s->attribute_c[0][i]));
+					Lanes a1 = lanes_add(lanes_mul(lanes_set1(s->attribute_a[1][i]), px), lanes_set1(s->attribute_b[1][i]*py + s->attribute_c[1][i]));
+					attributes[i] = lanes_select(first_triangle, a0, a1);
+				}
+
+				if (s->type == QUAD_TYPE_CIRCLE) {
+					Lanes du = lanes_sub(attributes[2], half);
+					Lanes dv = lanes_sub(attributes[3], half);
+					Lanes dist_sq = lanes_add(lanes_mul(du, du), lanes_mul(dv, dv));
+					mask = lanes_and(mask, lanes_le(dist_sq, quarter));
+					if (!lanes_mask_bits(mask)) continue;
+				}
+
+				if (s->image) {
+					alignat(16) float32 u[4], v[4];
+					alignat(16) float32 r[4], g[4], b[4], a[4];
+					lanes_store(u, attributes[0]);
+					lanes_store(v, attributes[1]);
+					u32 bits = lanes_mask_bits(mask);
+					for (u32 i = 0; i < 4; i++) {
+						Vector4 texel = v4(0, 0, 0, 0);
+						if (bits & (1 << i)) texel = software_sample(s->image, s->filter, u[i], v[i]);
+						r[i] = texel.r; g[i] = texel.g; b[i] = texel.b; a[i] = texel.a;
+					}
+					if (s->type == QUAD_TYPE_TEXT) {
+						// Glyphs are single channel alpha
+						src_a = lanes_mul(src_a, lanes_load(r));
+					} else if (s->type == QUAD_TYPE_TEXT_SDF) {
+						// smoothstep(0.5-w, 0.5+w, distance)
+						for (u32 i = 0; i < 4; i++) {
+							float32 t = clamp((r[i]-(0.5f-sdf_half_width))/(2.0f*sdf_half_width), 0.0f, 1.0f);
+							r[i] = t*t*(3.0f-2.0f*t);
+						}
+						src_a = lanes_mul(src_a, lanes_load(r));
+					} else {
+						src_r = lanes_mul(src_r, lanes_load(r));
+						src_g = lanes_mul(src_g, lanes_load(g));
+						src_b = lanes_mul(src_b, lanes_load(b));
+						src_a = lanes_mul(src_a, lanes_load(a));
+					}
+				}
+			}
+
+			// src*src_alpha + dst*(1-src_alpha), and src_alpha + dst_alpha for alpha
+			float32 *dst_r = software_tile_r+row+x;
+			float32 *dst_g = software_tile_g+row+x;
+			float32 *dst_b = software_tile_b+row+x;
+			float32 *dst_a = software_tile_a+row+x;
+			Lanes dr = lanes_load(dst_r);
+			Lanes dg = lanes_load(dst_g);
+			Lanes db = lanes_load(dst_b);
+			Lanes da = lanes_load(dst_a);
+			Lanes inv_a = lanes_sub(one, src_a);
+			lanes_store(dst_r, lanes_select(mask, lanes_add(lanes_mul(src_r, src_a), lanes_mul(dr, inv_a)), dr));
+			lanes_store(dst_g, lanes_select(mask, lanes_add(lanes_mul(src_g, src_a), lanes_mul(dg, inv_a)), dg));
+			lanes_store(dst_b, lanes_select(mask, lanes_add(lanes_mul(src_b, src_a), lanes_mul(db, inv_a)), db));
+			lanes_store(dst_a, lanes_select(mask, lanes_min(lanes_add(src_a, da), one), da));
+
+			u32 bits = lanes_mask_bits(mask);
+			pixels += (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+		}
+	}
+
+	return pixels;
+}
+
+void software_raster_tile_job(u64 tile_index, void *data) {
+	Software_Raster_Job *job = (Software_Raster_Job*)data;
+
+	u32 first_item = software_bin_offsets[tile_index];
+	u32 last_item = software_bin_offsets[tile_index+1];
+	if (first_item == last_item) return;
+
+	Software_Image *target = job->target;
+	s32 tile_x = (s32)((tile_index % job->tiles_x)*SOFTWARE_TILE_SIZE);
+	s32 tile_y = (s32)((tile_index / job->tiles_x)*SOFTWARE_TILE_SIZE);
+	s32 tile_width  = min(SOFTWARE_TILE_SIZE, (s32)target->width-tile_x);
+	s32 tile_height = min(SOFTWARE_TILE_SIZE, (s32)target->height-tile_y);
+
+	const float32 s = 1.0f/255.0f;
+	for (s32 y = 0; y < tile_height; y++) {
+		u8 *src = target->pixels + ((u64)(tile_y+y)*target->width + tile_x)*4;
+		u64 row = (u64)y*SOFTWARE_TILE_SIZE;
+		for (s32 x = 0; x < tile_width; x++) {
+			software_tile_r[row+x] = src[x*4+0]*s;
+			software_tile_g[row+x] = src[x*4+1]*s;
+			software_tile_b[row+x] = src[x*4+2]*s;
+			software_tile_a[row+x] = src[x*4+3]*s;
+		}
+	}
+
+	u64 pixels = 0;
+	for (u32 i = first_item; i < last_item; i++) {
+		pixels += software_raster_quad_in_tile(&software_quads[software_bin_items[i]], tile_x, tile_y, tile_width, tile_height);
+	}
+
+	for (s32 y = 0; y < tile_height; y++) {
+		u8 *dst = target->pixels + ((u64)(tile_y+y)*target->width + tile_x)*4;
+		u64 row = (u64)y*SOFTWARE_TILE_SIZE;
+		for (s32 x = 0; x < tile_width; x++) {
+			dst[x*4+0] = (u8)(clamp(software_tile_r[row+x], 0.0f, 1.0f)*255.0f + 0.5f);
+			dst[x*4+1] = (u8)(clamp(software_tile_g[row+x], 0.0f, 1.0f)*255.0f + 0.5f);
+			dst[x*4+2] = (u8)(clamp(software_tile_b[row+x], 0.0f, 1.0f)*255.0f + 0.5f);
+			dst[x*4+3] = (u8)(clamp(software_tile_a[row+x], 0.0f, 1.0f)*255.0f + 0.5f);
+		}
+	}
+
+	atomic_add_64(&job->pixels, pixels);
+	atomic_add_64(&job->tiles, 1);
+}
+
+///
+// Window
+
+void software_update_window_image() {
+	if (software_window_image
+		&& software_window_image->width == (u32)window.pixel_width
+		&& software_window_image->height == (u32)window.pixel_height) return;
+
+	if (software_window_image) software_destroy_image(software_window_image);
+	software_window_image = software_make_image(max(window.pixel_width, 1), max(window.pixel_height, 1), 4);
+	software_clear_image(software_window_image, window.clear_color);
+
+	log_verbose("Resized software window image to %dx%d", software_window_image->width, software_window_image->height);
+}
+
+void software_present() {
+#if TARGET_OS == WINDOWS
+	Software_Image *image = software_window_image;
+	u64 size = (u64)image->width*image->height*4;
+	if (size > software_present_buffer_size) {
+		if (software_present_buffer) dealloc(get_heap_allocator(), software_present_buffer);
+		software_present_buffer = alloc(get_heap_allocator(), size);
+		software_present_buffer_size = size;
+	}
+
+	// GDI wants BGRA
+	for (u64 i = 0; i < size; i += 4) {
+		software_present_buffer[i+0] = image->pixels[i+2];
+		software_present_buffer[i+1] = image->pixels[i+1];
+		software_present_buffer[i+2] = image->pixels[i+0];
+		software_present_buffer[i+3] = image->pixels[i+3];
+	}
+
+	BITMAPINFO info = ZERO(BITMAPINFO);
+	info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	info.bmiHeader.biWidth = (LONG)image->width;
+	info.bmiHeader.biHeight = -(LONG)image->height; // Negative for top-down
+	info.bmiHeader.biPlanes = 1;
+	info.bmiHeader.biBitCount = 32;
+	info.bmiHeader.biCompression = BI_RGB;
+
+	HDC dc = GetDC(window._os_handle);
+	StretchDIBits(dc, 0, 0, image->width, image->height, 0, 0, image->width, image->height, software_present_buffer, &info, DIB_RGB_COLORS, SRCCOPY);
+	ReleaseDC(window._os_handle, dc);
+#endif
+}
+
+///
+// gfx_interface.c impl
+
+void gfx_init() {
+	log_verbose("software gfx_init");
+
+	software_thread_id = context.thread_id;
+
+	software_update_window_image();
+
+	draw_frame_init(&draw_frame);
+
+	log_info("Software renderer initialized, rendering with %i threads", parallel_for_get_thread_count());
+}
+
+void gfx_clear_render_target(Gfx_Image *render_target, Vector4 clear_color) {
+	assert(context.thread_id == software_thread_id, "gfx_ functions must be called on the main thread");
+	assert(render_target->gfx_render_target, "Image was not created as a render target");
+	software_clear_image(render_target->gfx_render_target, clear_color);
+}
+
+void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target) {
+	assert(context.thread_id == software_thread_id, "gfx_ functions must be called on the main thread");
+
+	if (!frame->quad_buffer) return;
+
+	float64 start_seconds = os_get_elapsed_seconds();
+
+	Software_Image *target;
+	if (render_target) {
+		assert(render_target->gfx_render_target, "Image was not created as a render target");
+		target = render_target->gfx_render_target;
+	} else {
+		software_update_window_image();
+		target = software_window_image;
+	}
+	assert(target->channels == 4, "The software renderer can only render to images with 4 channels");
+
+	// Nothing is cached, so draw lists are just transformed into the quad buffer
+	draw_frame_expand_draw_lists(frame);
+
+	u64 number_of_quads = frame->quad_count;
+
+	software_last_render_stats = ZERO(Gfx_Software_Render_Stats);
+
+	if (number_of_quads == 0) return;
+
+	assert(number_of_quads*2 <= 0xFFFFFFFFULL, "Too many quads for the software renderer");
+
+	u64 *sorted_keys = 0;
+	if (frame->enable_z_sorting) tm_scope("Z sorting") {
+		if (!software_sort_key_buffer || software_sort_key_buffer_count < number_of_quads) {
+			// #Memory #Heapalloc
+			if (software_sort_key_buffer) dealloc(get_heap_allocator(), software_sort_key_buffer);
+			software_sort_key_buffer_count = get_next_power_of_two(number_of_quads);
+			software_sort_key_buffer = alloc(get_heap_allocator(), software_sort_key_buffer_count*2*sizeof(u64));
+		}
+		sorted_keys = software_sort_key_buffer;
+		draw_frame_sort_quad_keys(frame, sorted_keys, sorted_keys+software_sort_key_buffer_count);
+	}
+
+	///
+	// Setup
+	u64 setup_count = number_of_quads*2;
+	if (setup_count > software_quad_capacity) {
+		// #Memory #Heapalloc
+		if (software_quads) dealloc(get_heap_allocator(), software_quads);
+		software_quad_capacity = get_next_power_of_two(setup_count);
+		software_quads = alloc(get_heap_allocator(), software_quad_capacity*sizeof(Software_Quad));
+	}
+
+	tm_scope("Software quad setup") {
+		Software_Setup_Job setup_job;
+		setup_job.quads = frame->quad_buffer;
+		setup_job.sorted_keys = sorted_keys;
+		setup_job.quad_count = number_of_quads;
+		setup_job.result = software_quads;
+		setup_job.target_width = (float32)target->width;
+		setup_job.target_height = (float32)target->height;
+		parallel_for((number_of_quads+SOFTWARE_SETUP_CHUNK-1)/SOFTWARE_SETUP_CHUNK, software_setup_job, &setup_job);
+	}
+
+	///
+	// Binning
+	u64 tiles_x = (target->width+SOFTWARE_TILE_SIZE-1)/SOFTWARE_TILE_SIZE;
+	u64 tiles_y = (target->height+SOFTWARE_TILE_SIZE-1)/SOFTWARE_TILE_SIZE;
+	u64 tile_count = tiles_x*tiles_y;
+
+	if (tile_count+1 > software_bin_offset_capacity) {
+		if (software_bin_offsets) dealloc(get_heap_allocator(), software_bin_offsets);
+		software_bin_offset_capacity = get_next_power_of_two(tile_count+1);
+		software_bin_offsets = alloc(get_heap_allocator(), software_bin_offset_capacity*sizeof(u32));
+	}
+
+	u64 quad_count = 0;
+	tm_scope("Software binning") {
+		// Count per tile, then turn the counts into offsets and fill
+		memset(software_bin_offsets, 0, (tile_count+1)*sizeof(u32));
+		u64 item_count = 0;
+		for (u64 i = 0; i < setup_count; i++) {
+			Software_Quad *s = &software_quads[i];
+			if (s->min_x >= s->max_x) continue;
+			quad_count += 1;
+			s32 tx0 = s->min_x/SOFTWARE_TILE_SIZE, tx1 = (s->max_x-1)/SOFTWARE_TILE_SIZE;
+			s32 ty0 = s->min_y/SOFTWARE_TILE_SIZE, ty1 = (s->max_y-1)/SOFTWARE_TILE_SIZE;
+			for (s32 ty = ty0; ty <= ty1; ty++) {
+				for (s32 tx = tx0; tx <= tx1; tx++) {
+					software_bin_offsets[ty*tiles_x + tx + 1] += 1;
+				}
+			}
+			item_count += (u64)(tx1-tx0+1)*(ty1-ty0+1);
+		}
+		assert(item_count <= 0xFFFFFFFFULL, "Too many quads in the software renderer bins");
+
+		if (item_count > software_bin_item_capacity) {
+			if (software_bin_items) dealloc(get_heap_allocator(), software_bin_items);
+			software_bin_item_capacity = get_next_power_of_two(item_count);
+			software_bin_items = alloc(get_heap_allocator(), software_bin_item_capacity*sizeof(u32));
+		}
+
+		for (u64 t = 0; t < tile_count; t++) {
+			software_bin_offsets[t+1] += software_bin_offsets[t];
+		}
+
+		// Use the offsets as write heads. Afterwards each one has moved to the start of the next
+		// tile, so shifting them back by one tile gives the offsets again.
+		for (u64 i = 0; i < setup_count; i++) {
+			Software_Quad *s = &software_quads[i];
+			if (s->min_x >= s->max_x) continue;
+			s32 tx0 = s->min_x/SOFTWARE_TILE_SIZE, tx1 = (s->max_x-1)/SOFTWARE_TILE_SIZE;
+			s32 ty0 = s->min_y/SOFTWARE_TILE_SIZE, ty1 = (s->max_y-1)/SOFTWARE_TILE_SIZE;
+			for (s32 ty = ty0; ty <= ty1; ty++) {
+				for (s32 tx = tx0; tx <= tx1; tx++) {
+					u32 *head = &software_bin_offsets[ty*tiles_x + tx];
+					software_bin_items[*head] = (u32)i;
+					*head += 1;
+				}
+			}
+		}
+		memmove(software_bin_offsets+1, software_bin_offsets, tile_count*sizeof(u32));
+		software_bin_offsets[0] = 0;
+	}
+
+	///
+	// Raster
+	Software_Raster_Job raster_job = ZERO(Software_Raster_Job);
+	raster_job.target = target;
+	raster_job.tiles_x = tiles_x;
+	tm_scope("Software raster") {
+		parallel_for(tile_count, software_raster_tile_job, &raster_job);
+	}
+
+	float64 seconds = os_get_elapsed_seconds()-start_seconds;
+	software_last_render_stats.quads = quad_count;
+	software_last_render_stats.pixels = raster_job.pixels;
+	software_last_render_stats.tiles = raster_job.tiles;
+	software_last_render_stats.seconds = seconds;
+	software_last_render_stats.mpixels_per_second = seconds > 0 ? ((float64)raster_job.pixels/seconds)/1000000.0 : 0;
+}
+void gfx_render_draw_frame_to_window(Draw_Frame *frame) {
+	gfx_render_draw_frame(frame, 0);
+}
+
+Gfx_Software_Render_Stats gfx_software_get_last_render_stats() {
+	return software_last_render_stats;
+}
+
+void gfx_update() {
+	if (window.should_close) return;
+
+	software_update_window_image();
+
+	draw_capture_update(&draw_frame);
+
+	// Render global draw frame to window
+	gfx_render_draw_frame_to_window(&draw_frame);
+	draw_frame_reset(&draw_frame);
+	text_layout_cache_end_frame();
+
+	tm_scope("Present") {
+		software_present();
+	}
+	software_clear_image(software_window_image, window.clear_color);
+}
+
+void gfx_reserve_vbo_bytes(u64 number_of_bytes) {
+	// There is no vbo, but we can reserve room for the quad setup
+	u64 number_of_quads = number_of_bytes/sizeof(Draw_Quad);
+	if (number_of_quads*2 > software_quad_capacity) {
+		if (software_quads) dealloc(get_heap_allocator(), software_quads);
+		software_quad_capacity = get_next_power_of_two(number_of_quads*2);
+		software_quads = alloc(get_heap_allocator(), software_quad_capacity*sizeof(Software_Quad));
+	}
+}
+
+void gfx_release_draw_list_cache(Draw_List *list) {
+	// Nothing is cached
+	list->gfx_cache = 0;
+}
+
+void gfx_init_image(Gfx_Image *image, void *initial_data, bool render_target) {
+	assert(context.thread_id == software_thread_id, "gfx_ functions must be called on the main thread");
+
+	assert(image->channels > 0 && image->channels <= 4 && image->channels != 3, "Only 1, 2 or 4 channels allowed on images. Got %d", image->channels);
+
+	Software_Image *software_image = software_make_image(image->width, image->height, image->channels);
+
+	// #Incomplete 8 bit width assumed
+	u64 size = (u64)image->width*image->height*image->channels;
+	if (initial_data) memcpy(software_image->pixels, initial_data, size);
+	else              memset(software_image->pixels, 0, size);
+
+	image->gfx_handle = software_image;
+	image->gfx_render_target = render_target ? software_image : 0;
+
+	log_verbose("Created a software image%s of width %d and height %d.", render_target ? STR(" render target") : STR(""), image->width, image->height);
+}
+void gfx_set_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *data) {
+	assert(context.thread_id == software_thread_id, "gfx_ functions must be called on the main thread");
+	assert(image && data, "Bad parameters passed to gfx_set_image_data");
+	assert(image->gfx_handle, "Invalid image passed to gfx_set_image_data");
+	assert(x+w <= image->width && y+h <= image->height, "Specified subregion in image is out of bounds");
+
+	Software_Image *software_image = image->gfx_handle;
+	u64 row_bytes = (u64)w*image->channels;
+	for (u32 row = 0; row < h; row++) {
+		memcpy(
+			software_image->pixels + ((u64)(y+row)*image->width + x)*image->channels,
+			(u8*)data + row*row_bytes,
+			row_bytes
+		);
+	}
+}
+void gfx_read_image_data(Gfx_Image *image, u32 x, u32 y, u32 w, u32 h, void *output) {
+	assert(context.thread_id == software_thread_id, "gfx_ functions must be called on the main thread");
+	assert(image && output, "Bad parameters passed to gfx_read_image_data");
+	assert(x+w <= image->width && y+h <= image->height, "Specified subregion in image is out of bounds");
+
+	Software_Image *software_image = image->gfx_handle;
+	u64 row_bytes = (u64)w*image->channels;
+	for (u32 row = 0; row < h; row++) {
+		memcpy(
+			(u8*)output + row*row_bytes,
+			software_image->pixels + ((u64)(y+row)*image->width + x)*image->channels,
+			row_bytes
+		);
+	}
+}
+void gfx_deinit_image(Gfx_Image *image) {
+	assert(context.thread_id == software_thread_id, "gfx_ functions must be called on the main thread");
+
+	if (image->gfx_handle) software_destroy_image(image->gfx_handle);
+	image->gfx_handle = 0;
+	image->gfx_render_target = 0;
+}
+
+bool
+gfx_shader_recompile_with_extension(string ext_source, u64 cbuffer_size) {
+	log_error("The software renderer does not support shader extensions");
+	return false;
+}
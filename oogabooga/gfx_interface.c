@@ -5,13 +5,21 @@
 	#include <d3dcompiler.h>
 	#include <dxgidebug.h>
 	#include <d3dcommon.h>
-	typedef ID3D11ShaderResourceView * Gfx_Handle;
+	typedef struct D3D11_Image * Gfx_Handle;
 	typedef ID3D11RenderTargetView * Gfx_Render_Target_Handle;
 	
+#elif GFX_RENDERER == GFX_RENDERER_SOFTWARE
+	typedef struct Software_Image * Gfx_Handle;
+	typedef struct Software_Image * Gfx_Render_Target_Handle;
+	
+#elif GFX_RENDERER == GFX_RENDERER_NULL
+	typedef struct Null_Image * Gfx_Handle;
+	typedef struct Null_Image * Gfx_Render_Target_Handle;
+	
 #elif GFX_RENDERER == GFX_RENDERER_VULKAN
-	#error "We only have a D3D11 renderer at the moment"
+	#error "We only have D3D11, software & null renderers at the moment"
 #elif GFX_RENDERER == GFX_RENDERER_METAL
-	#error "We only have a D3D11 renderer at the moment"
+	#error "We only have D3D11, software & null renderers at the moment"
 #else
 	#error "Unknown renderer GFX_RENDERER defined"
 #endif
@@ -26,6 +34,7 @@ ogb_instance const Gfx_Handle GFX_INVALID_HANDLE;
 #define QUAD_TYPE_REGULAR 0
 #define QUAD_TYPE_TEXT 1
 #define QUAD_TYPE_CIRCLE 2
+#define QUAD_TYPE_TEXT_SDF 3 // Image is a single channel distance field, see font_enable_sdf
 
 typedef enum Gfx_Filter_Mode {
 	GFX_FILTER_MODE_NEAREST,
@@ -37,9 +46,15 @@ typedef struct Gfx_Image {
 	Gfx_Handle gfx_handle;
 	Gfx_Render_Target_Handle gfx_render_target;
 	Allocator allocator;
+	
+	// Set on images that are packed in a Texture_Atlas (see texture_atlas.c). Drawing them
+	// draws the atlas_uv rect of the atlas page instead.
+	struct Gfx_Image *atlas_page;
+	Vector4 atlas_uv;
 } Gfx_Image;
 
 typedef struct Draw_Frame Draw_Frame;
+typedef struct Draw_List Draw_List;
 
 // Implemented per renderer
 ogb_instance void gfx_render_draw_frame(Draw_Frame *frame, Gfx_Image *render_target);
@@ -52,6 +67,50 @@ ogb_instance void gfx_init();
 ogb_instance void gfx_update();
 ogb_instance void gfx_reserve_vbo_bytes(u64 number_of_bytes);
 ogb_instance bool gfx_shader_recompile_with_extension(string ext_source, u64 cbuffer_size);
+// Frees whatever the renderer cached for a Draw_List (called by draw_list_destroy)
+ogb_instance void gfx_release_draw_list_cache(Draw_List *list);
+
+#if GFX_RENDERER == GFX_RENDERER_SOFTWARE
+typedef struct Gfx_Software_Render_Stats {
+	u64 quads;  // Quads that were rasterized (after clipping)
+	u64 pixels; // Pixels shaded. A pixel covered by multiple quads is counted multiple times.
+	u64 tiles;  // Tiles with at least one quad
+	float64 seconds; // Time spent in gfx_render_draw_frame
+	float64 mpixels_per_second;
+} Gfx_Software_Render_Stats;
+// Stats of the last gfx_render_draw_frame call
+ogb_instance Gfx_Software_Render_Stats gfx_software_get_last_render_stats();
+#endif
+
+#if GFX_RENDERER == GFX_RENDERER_D3D11
+typedef struct Gfx_D3D11_Frame_Stats {
+	u64 draw_calls;
+	u64 texture_limit_flushes; // Draw calls that were split because all texture & texture array slots were used
+	u64 texture_arrays;        // Texture arrays that small images are grouped into
+} Gfx_D3D11_Frame_Stats;
+// Stats of the last frame, which ends in gfx_update
+ogb_instance Gfx_D3D11_Frame_Stats gfx_d3d11_get_frame_stats();
+#endif
+
+#if GFX_RENDERER == GFX_RENDERER_NULL
+typedef struct Gfx_Null_Frame_Stats {
+	u64 frames_rendered; // gfx_render_draw_frame calls
+	u64 quads_processed; // Quads in the rendered frames, not counting draw lists
+	u64 quads_drawn;     // Quads in all draw calls, including draw lists
+	u64 draw_calls;
+	u64 texture_binds;   // Textures & texture arrays bound per draw call, summed
+	u64 texture_limit_flushes; // Draw calls that were split because all texture & texture array slots were used
+	u64 bytes_uploaded;  // Vertex & constant buffer bytes
+	u64 texture_bytes_uploaded;
+	u64 draw_list_cache_rebuilds;
+	u64 clears;
+	u64 texture_arrays;  // Texture arrays that small images are grouped into, at the end of the frame
+} Gfx_Null_Frame_Stats;
+// Stats of the last frame, which ends in gfx_update
+ogb_instance Gfx_Null_Frame_Stats gfx_null_get_frame_stats();
+// Stats so far in this frame
+ogb_instance Gfx_Null_Frame_Stats gfx_null_get_current_frame_stats();
+#endif
 
 DEPRECATED(bool shader_recompile_with_extension(string ext_source, u64 cbuffer_size), "Use gfx_shader_recompile_with_extension");
 
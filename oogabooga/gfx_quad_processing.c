@@ -0,0 +1,456 @@
+/*
+	Quad processing shared by the d3d11 & null renderers
+
+	Converts the Draw_Quad's of a Draw_Frame (and cached Draw_List's) to vertices, split in
+	batches that fit in the texture slots of one draw call. Small images live in a slice of a
+	texture array with the other images of the same size & format, and then the whole array
+	only takes one slot.
+
+	A renderer that includes this:
+		- Puts a Gfx_Batched_Image first in the struct behind Gfx_Image.gfx_handle
+		- Puts a Gfx_Texture_Array first in its texture arrays
+		- Puts a Gfx_Draw_List_Cache first in what it stores in Draw_List.gfx_cache
+		- Implements gfx_draw_staged_quads & gfx_draw_cached_draw_list
+*/
+
+// #Volatile reflected in the d3d11 shader
+// Vertex texture_index 0-31 is a texture, 32-47 is a texture array (+ texture_array_slice)
+#define GFX_MAX_BOUND_TEXTURES 32
+#define GFX_MAX_BOUND_TEXTURE_ARRAYS 16
+
+// We wanna pack this at some point
+// #Cleanup #Memory why am I doing alignat(16)?
+typedef struct alignat(16) Gfx_Quad_Vertex {
+
+	Vector4 color;
+	Vector4 position;
+	Vector2 uv;
+	Vector2 self_uv;
+	s8 texture_index;
+	u8 type;
+	u8 sampler;
+	u8 has_scissor;
+	u16 texture_array_slice;
+
+	Vector4 userdata[VERTEX_2D_USER_DATA_COUNT];
+
+	Vector4 scissor;
+
+} Gfx_Quad_Vertex;
+
+// Gfx_Batched_Image.texture_array
+// Only the slice bookkeeping, the renderer keeps the pixels.
+typedef struct Gfx_Texture_Array {
+	u32 width, height, channels;
+	// Slices [0, used) have been handed out, freed ones go in free_slices
+	u32 used;
+	u32 *free_slices; // Growing array
+	u64 image_count;
+	// Same as Gfx_Batched_Image.batch_id & batch_slot
+	u64 batch_id;
+	s8 batch_slot;
+} Gfx_Texture_Array;
+
+typedef struct Gfx_Batched_Image {
+	// Only set for images that live in a slice of a texture array instead of their own texture
+	Gfx_Texture_Array *texture_array;
+	u32 texture_array_slice;
+	// Which batch of quads this image was last given a texture slot in, so the slot can be
+	// found in O(1) instead of searching the bound textures.
+	u64 batch_id;
+	s8 batch_slot;
+} Gfx_Batched_Image;
+
+// The textures & texture arrays bound for one draw call
+typedef struct Gfx_Texture_Batch {
+	u64 id;
+	Gfx_Handle textures[GFX_MAX_BOUND_TEXTURES];
+	u64 num_textures;
+	Gfx_Texture_Array *arrays[GFX_MAX_BOUND_TEXTURE_ARRAYS];
+	u64 num_arrays;
+} Gfx_Texture_Batch;
+
+typedef struct Gfx_Draw_List_Batch {
+	u64 first_quad;
+	u64 quad_count;
+	Gfx_Texture_Batch textures;
+} Gfx_Draw_List_Batch;
+
+typedef struct Gfx_Draw_List_Cache {
+	u64 version;
+	// Vertices depend on the window size, see gfx_write_quad_vertices
+	u32 window_width;
+	u32 window_height;
+	u32 window_pixel_height;
+	Gfx_Draw_List_Batch *batches; // Growing array
+	u64 max_batch_quads;
+} Gfx_Draw_List_Cache;
+
+// Implemented by the renderer
+// Draws the first number_of_quads quads written to the staging buffer passed to gfx_process_draw_frame_quads
+void gfx_draw_staged_quads(u64 number_of_quads, Gfx_Texture_Batch *batch, Draw_Frame *frame, Gfx_Image *render_target);
+void gfx_draw_cached_draw_list(Draw_List_Submission *sub, Draw_Frame *frame, Gfx_Image *render_target);
+
+// #Global
+
+Gfx_Texture_Array **gfx_texture_arrays = 0; // Growing array
+u64 gfx_next_batch_id = 1;
+
+// Z sort keys, the second half is used as help buffer for the radix sort
+u64 *gfx_sort_key_buffer = 0;
+u64 gfx_sort_key_buffer_count = 0;
+
+void gfx_begin_texture_batch(Gfx_Texture_Batch *batch) {
+	batch->id = gfx_next_batch_id;
+	gfx_next_batch_id += 1;
+	batch->num_textures = 0;
+	batch->num_arrays = 0;
+}
+
+// Returns the vertex texture_index for the image in this batch, or -1 if the batch has no free
+// slot for it. Images remember which batch & slot they were last given, so this is O(1).
+s8 gfx_get_batch_texture_index(Gfx_Texture_Batch *batch, Gfx_Image *image) {
+	Gfx_Batched_Image *batched = (Gfx_Batched_Image*)image->gfx_handle;
+	Gfx_Texture_Array *array = batched->texture_array;
+	if (array) {
+		if (array->batch_id == batch->id) return array->batch_slot;
+		if (batch->num_arrays >= GFX_MAX_BOUND_TEXTURE_ARRAYS) return -1;
+
+		array->batch_id = batch->id;
+		array->batch_slot = (s8)(GFX_MAX_BOUND_TEXTURES + batch->num_arrays);
+		batch->arrays[batch->num_arrays] = array;
+		batch->num_arrays += 1;
+		return array->batch_slot;
+	}
+
+	if (batched->batch_id == batch->id) return batched->batch_slot;
+	if (batch->num_textures >= GFX_MAX_BOUND_TEXTURES) return -1;
+
+	batched->batch_id = batch->id;
+	batched->batch_slot = (s8)batch->num_textures;
+	batch->textures[batch->num_textures] = image->gfx_handle;
+	batch->num_textures += 1;
+	return batched->batch_slot;
+}
+
+///
+// Texture arrays
+// The renderer finds an array with gfx_find_texture_array or makes one with
+// gfx_texture_array_init, and frees arrays that gfx_texture_array_remove_image returns.
+
+// Returns an array for images of this size & format that has room for one more, or 0
+Gfx_Texture_Array *gfx_find_texture_array(u32 width, u32 height, u32 channels, u32 max_slices) {
+	if (!gfx_texture_arrays) return 0;
+
+	u64 array_count = growing_array_get_valid_count(gfx_texture_arrays);
+	for (u64 i = 0; i < array_count; i++) {
+		Gfx_Texture_Array *a = gfx_texture_arrays[i];
+		if (a->width != width || a->height != height || a->channels != channels) continue;
+
+		bool has_room = growing_array_get_valid_count(a->free_slices) > 0 || a->used < max_slices;
+		if (has_room) return a;
+	}
+	return 0;
+}
+
+void gfx_texture_array_init(Gfx_Texture_Array *array, u32 width, u32 height, u32 channels) {
+	if (!gfx_texture_arrays) {
+		growing_array_init((void**)&gfx_texture_arrays, sizeof(Gfx_Texture_Array*), get_heap_allocator());
+	}
+
+	*array = ZERO(Gfx_Texture_Array);
+	array->width = width;
+	array->height = height;
+	array->channels = channels;
+	growing_array_init((void**)&array->free_slices, sizeof(u32), get_heap_allocator());
+	growing_array_add((void**)&gfx_texture_arrays, &array);
+}
+
+// Gives the image a slice, freed slices first. A slice >= the old array->used means the array grew.
+void gfx_texture_array_add_image(Gfx_Texture_Array *array, Gfx_Batched_Image *image) {
+	u32 slice;
+	u64 free_count = growing_array_get_valid_count(array->free_slices);
+	if (free_count > 0) {
+		slice = array->free_slices[free_count-1];
+		growing_array_pop((void**)&array->free_slices);
+	} else {
+		slice = array->used;
+		array->used += 1;
+	}
+
+	array->image_count += 1;
+	image->texture_array = array;
+	image->texture_array_slice = slice;
+}
+
+// Returns the array if this was its last image. It's then taken out of gfx_texture_arrays and
+// the renderer should free it.
+Gfx_Texture_Array *gfx_texture_array_remove_image(Gfx_Batched_Image *image) {
+	Gfx_Texture_Array *array = image->texture_array;
+	if (!array) return 0;
+
+	u32 slice = image->texture_array_slice;
+	image->texture_array = 0;
+	image->texture_array_slice = 0;
+
+	array->image_count -= 1;
+	if (array->image_count > 0) {
+		growing_array_add((void**)&array->free_slices, &slice);
+		return 0;
+	}
+
+	s32 index = growing_array_find_index_from_left_by_value((void**)&gfx_texture_arrays, &array);
+	assert(index != -1, "Texture array was not in gfx_texture_arrays");
+	growing_array_unordered_remove_by_index((void**)&gfx_texture_arrays, (u32)index);
+
+	growing_array_deinit((void**)&array->free_slices);
+	return array;
+}
+
+// Writes the 4 vertices for a quad.
+// The uv's & scissor depend on the window size, so cached vertices need to be rebuilt if it changes.
+void gfx_write_quad_vertices(Gfx_Quad_Vertex *pointer, Draw_Quad *q, s8 texture_index) {
+	Gfx_Quad_Vertex* BL  = pointer + 0;
+	Gfx_Quad_Vertex* TL  = pointer + 1;
+	Gfx_Quad_Vertex* TR  = pointer + 2;
+	Gfx_Quad_Vertex* BR  = pointer + 3;
+
+	BL->position = v4(q->bottom_left.x,  q->bottom_left.y,  0, 1);
+	TL->position = v4(q->top_left.x,     q->top_left.y,     0, 1);
+	TR->position = v4(q->top_right.x,    q->top_right.y,    0, 1);
+	BR->position = v4(q->bottom_right.x, q->bottom_right.y, 0, 1);
+
+
+	if (q->image) {
+
+		BL->uv = v2(q->uv.x1, q->uv.y1);
+		TL->uv = v2(q->uv.x1, q->uv.y2);
+		TR->uv = v2(q->uv.x2, q->uv.y2);
+		BR->uv = v2(q->uv.x2, q->uv.y1);
+		// #Hack #Bug #Cleanup
+		// When a window dimension is uneven it slightly under/oversamples on an axis by a
+		// seemingly arbitrary amount. The 0.25 is a magic value I got from trial and error.
+		// (It undersamples by a fourth of the atlas texture?)
+		// Anything > 0.25 < will slightly over/undersample on my machine.
+		// I have no idea about #Portability here.
+		// - Charlie M 26th July 2024
+		if (window.width % 2 != 0) {
+			BL->uv.x += (2.0/(float)q->image->width)*0.25;
+			TL->uv.x += (2.0/(float)q->image->width)*0.25;
+			TR->uv.x += (2.0/(float)q->image->width)*0.25;
+			BR->uv.x += (2.0/(float)q->image->width)*0.25;
+		}
+		if (window.height % 2 != 0) {
+			BL->uv.y -= (2.0/(float)q->image->height)*0.25;
+			TL->uv.y -= (2.0/(float)q->image->height)*0.25;
+			TR->uv.y -= (2.0/(float)q->image->height)*0.25;
+			BR->uv.y -= (2.0/(float)q->image->height)*0.25;
+		}
+
+		u8 sampler = -1;
+		if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
+					&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
+				sampler = 0;
+		if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
+					&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
+				sampler = 1;
+		if (q->image_min_filter == GFX_FILTER_MODE_LINEAR
+					&& q->image_mag_filter == GFX_FILTER_MODE_NEAREST)
+				sampler = 2;
+		if (q->image_min_filter == GFX_FILTER_MODE_NEAREST
+					&& q->image_mag_filter == GFX_FILTER_MODE_LINEAR)
+				sampler = 3;
+		BL->sampler=TL->sampler=TR->sampler=BR->sampler = (u8)sampler;
+
+	}
+	BL->texture_index=TL->texture_index=TR->texture_index=BR->texture_index = texture_index;
+
+	u16 slice = q->image ? (u16)((Gfx_Batched_Image*)q->image->gfx_handle)->texture_array_slice : 0;
+	BL->texture_array_slice=TL->texture_array_slice=TR->texture_array_slice=BR->texture_array_slice = slice;
+
+	BL->self_uv = v2(0, 0);
+	TL->self_uv = v2(0, 1);
+	TR->self_uv = v2(1, 1);
+	BR->self_uv = v2(1, 0);
+
+	// #Speed #Cleanup
+	// Many programs may not user userdata, which means a lot of redundant time spent on this.
+	memcpy(BL->userdata, q->userdata, sizeof(q->userdata));
+	memcpy(TL->userdata, q->userdata, sizeof(q->userdata));
+	memcpy(TR->userdata, q->userdata, sizeof(q->userdata));
+	memcpy(BR->userdata, q->userdata, sizeof(q->userdata));
+
+	BL->color = TL->color = TR->color = BR->color = q->color;
+
+	BL->type=TL->type=TR->type=BR->type = (u8)q->type;
+
+	// Flip y, scissor is in window pixels from the bottom
+	Vector4 scissor = q->scissor;
+	scissor.y1 = window.pixel_height - q->scissor.y2;
+	scissor.y2 = window.pixel_height - q->scissor.y1;
+
+	BL->has_scissor=TL->has_scissor=TR->has_scissor=BR->has_scissor = q->has_scissor;
+	BL->scissor=TL->scissor=TR->scissor=BR->scissor = scissor;
+}
+
+///
+// Draw list caching
+// The quads of a Draw_List are written once in world space and split in batches. The renderer
+// keeps the vertices (d3d11 in an immutable vertex buffer) until the list changes, or the
+// window size does because of the uv & scissor stuff in gfx_write_quad_vertices.
+
+void gfx_draw_list_cache_init(Gfx_Draw_List_Cache *cache) {
+	*cache = ZERO(Gfx_Draw_List_Cache);
+	growing_array_init((void**)&cache->batches, sizeof(Gfx_Draw_List_Batch), get_heap_allocator());
+}
+void gfx_draw_list_cache_deinit(Gfx_Draw_List_Cache *cache) {
+	growing_array_deinit((void**)&cache->batches);
+}
+
+// If the cache is out of date, this clears it and returns true so the renderer rebuilds it
+bool gfx_draw_list_cache_begin_rebuild(Gfx_Draw_List_Cache *cache, Draw_List *list) {
+	bool up_to_date = cache->version == list->version
+	               && cache->window_width == window.width
+	               && cache->window_height == window.height
+	               && cache->window_pixel_height == window.pixel_height;
+	if (up_to_date) return false;
+
+	cache->version = list->version;
+	cache->window_width = window.width;
+	cache->window_height = window.height;
+	cache->window_pixel_height = window.pixel_height;
+
+	growing_array_clear((void**)&cache->batches);
+	cache->max_batch_quads = 0;
+
+	return true;
+}
+
+// Writes the vertices of all quads in the list and splits them in batches.
+// vertices needs room for 4 per quad. Returns how many batches had to be broken because of the
+// texture slot limit.
+u64 gfx_draw_list_cache_build(Gfx_Draw_List_Cache *cache, Draw_List *list, Gfx_Quad_Vertex *vertices) {
+	u64 texture_limit_flushes = 0;
+
+	Gfx_Draw_List_Batch *batch = 0;
+
+	u64 quad_count = growing_array_get_valid_count(list->quads);
+	for (u64 i = 0; i < quad_count; i++) {
+		Draw_Quad *q = &list->quads[i];
+
+		assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
+		assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
+
+		s8 texture_index = -1;
+		if (q->image && batch) {
+			texture_index = gfx_get_batch_texture_index(&batch->textures, q->image);
+		}
+
+		bool new_batch = !batch || (q->image && texture_index == -1);
+		if (new_batch) {
+			if (batch) texture_limit_flushes += 1;
+			batch = growing_array_add_empty((void**)&cache->batches);
+			*batch = ZERO(Gfx_Draw_List_Batch);
+			batch->first_quad = i;
+			gfx_begin_texture_batch(&batch->textures);
+			if (q->image) texture_index = gfx_get_batch_texture_index(&batch->textures, q->image);
+		}
+
+		gfx_write_quad_vertices(vertices+i*4, q, texture_index);
+
+		batch->quad_count += 1;
+		cache->max_batch_quads = max(cache->max_batch_quads, batch->quad_count);
+	}
+
+	return texture_limit_flushes;
+}
+
+///
+// This is where we convert Draw_Quad's to vertices. It should be very fast as all it's doing is mostly
+// copying and some minor computing.
+// Most computation is done in draw_quad_projected in drawing.c.
+// This way, we could easily build different draw frames on different threads and then render them
+// here on the main thread.
+//
+// staging needs room for 4 vertices per quad in the frame. The cached draw lists must be up to
+// date. Returns how many draw calls had to be broken because of the texture slot limit.
+u64 gfx_process_draw_frame_quads(Draw_Frame *frame, Gfx_Quad_Vertex *staging, Gfx_Image *render_target) {
+	u64 number_of_quads = frame->quad_count;
+	u64 texture_limit_flushes = 0;
+
+	Gfx_Texture_Batch batch;
+	gfx_begin_texture_batch(&batch);
+
+	Gfx_Quad_Vertex* pointer = staging;
+	u64 number_of_rendered_quads = 0;
+
+	u64 next_draw_list = 0;
+
+	tm_scope("Quad processing") {
+		u64 *sorted_keys = 0;
+		if (frame->enable_z_sorting) tm_scope("Z sorting") {
+			if (!gfx_sort_key_buffer || gfx_sort_key_buffer_count < number_of_quads) {
+				// #Memory #Heapalloc
+				if (gfx_sort_key_buffer) dealloc(get_heap_allocator(), gfx_sort_key_buffer);
+				gfx_sort_key_buffer_count = get_next_power_of_two(number_of_quads);
+				gfx_sort_key_buffer = alloc(get_heap_allocator(), gfx_sort_key_buffer_count*2*sizeof(u64));
+			}
+			sorted_keys = gfx_sort_key_buffer;
+			draw_frame_sort_quad_keys(frame, sorted_keys, sorted_keys+gfx_sort_key_buffer_count);
+		}
+
+		for (u64 i = 0; i < number_of_quads; i++)  {
+
+			// Draw lists drawn before this quad. Draw what we have so far and then the list.
+			while (next_draw_list < frame->draw_list_count && frame->draw_lists[next_draw_list].quad_index == i) {
+				if (number_of_rendered_quads > 0) {
+					gfx_draw_staged_quads(number_of_rendered_quads, &batch, frame, render_target);
+					gfx_begin_texture_batch(&batch);
+					number_of_rendered_quads = 0;
+					pointer = staging;
+				}
+				gfx_draw_cached_draw_list(&frame->draw_lists[next_draw_list], frame, render_target);
+				next_draw_list += 1;
+			}
+
+			Draw_Quad *q;
+			if (sorted_keys) q = &frame->quad_buffer[sorted_keys[i] & Z_SORT_KEY_INDEX_MASK];
+			else             q = &frame->quad_buffer[i];
+
+			assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
+			assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
+
+			s8 texture_index = -1;
+
+			if (q->image) {
+				texture_index = gfx_get_batch_texture_index(&batch, q->image);
+				if (texture_index == -1) {
+					// If all texture slots are used, make a draw call and start over
+					gfx_draw_staged_quads(number_of_rendered_quads, &batch, frame, render_target);
+					texture_limit_flushes += 1;
+					gfx_begin_texture_batch(&batch);
+					number_of_rendered_quads = 0;
+					pointer = staging;
+					texture_index = gfx_get_batch_texture_index(&batch, q->image);
+				}
+			}
+
+			// We will write to 4 vertices for the one quad
+			gfx_write_quad_vertices(pointer, q, texture_index);
+			pointer += 4;
+			number_of_rendered_quads += 1;
+		}
+	}
+
+	if (number_of_rendered_quads > 0) {
+		gfx_draw_staged_quads(number_of_rendered_quads, &batch, frame, render_target);
+	}
+
+	// Draw lists drawn after the last quad
+	while (next_draw_list < frame->draw_list_count) {
+		gfx_draw_cached_draw_list(&frame->draw_lists[next_draw_list], frame, render_target);
+		next_draw_list += 1;
+	}
+
+	return texture_limit_flushes;
+}
@@ -45,10 +45,16 @@ Allocator get_initialization_allocator() {
 ///
 // Basic general heap allocator, free list
 ///
+// Small allocations (<= HEAP_MAX_SMALL_SIZE) are served from segregated size class free
+// lists with a per-thread cache in front of them, see "Size classes" below.
+// Large allocations (>= HEAP_LARGE_ALLOCATION_THRESHOLD) get their own OS virtual memory,
+// see "Large allocations" below.
+// Everything in between goes to the block heap here, which is:
 // Technically thread safe but synchronization is horrible.
 // Fragmentation is catastrophic.
 // We could fix it by merging free nodes every now and then
 // BUT: We aren't really supposed to allocate/deallocate directly on the heap too much anyways...
+// Free memory in heap blocks stays committed until heap_trim() is called, see "Trimming" below.
 
 #define MAX_HEAP_BLOCK_SIZE align_next(MB(500), os.page_size)
 #define DEFAULT_HEAP_BLOCK_SIZE (min(MAX_HEAP_BLOCK_SIZE, program_memory_capacity))
@@ -66,7 +72,11 @@ typedef struct Heap_Block {
 	Heap_Free_Node *free_head;
 	void* start;
 	Heap_Block *next;
-	// 32 bytes !!
+	// One bit per page of the block that heap_trim() decommitted and that wasn't allocated from
+	// since. 0 until the block is trimmed for the first time.
+	u64 *decommitted_pages;
+	u64 decommitted_page_count;
+	// 48 bytes !!
 #if CONFIGURATION == DEBUG
 	u64 total_allocated;
 	u64 padding;
@@ -83,15 +93,22 @@ typedef alignat(16) struct Heap_Allocation_Metadata {
 #endif
 } Heap_Allocation_Metadata;
 
+#ifndef HEAP_RETAINED_FREE_BYTES
+	#define HEAP_RETAINED_FREE_BYTES MB(16)
+#endif
+
 // #Global
 ogb_instance Heap_Block *heap_head;
 ogb_instance bool heap_initted;
 ogb_instance Spinlock heap_lock;
+// How much free block heap memory heap_trim() keeps committed
+ogb_instance u64 heap_retained_free_bytes;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Heap_Block *heap_head;
 bool heap_initted = false;
 Spinlock heap_lock;
+u64 heap_retained_free_bytes = HEAP_RETAINED_FREE_BYTES;
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 	
 
@@ -113,8 +130,9 @@ bool is_pointer_in_stack(void* p) {
 bool is_pointer_in_static_memory(void* p) {
     return (uintptr_t)p >= (uintptr_t)os.static_memory_start && (uintptr_t)p < (uintptr_t)os.static_memory_end;
 }
+bool is_pointer_in_large_allocation(void *p);
 bool is_pointer_valid(void *p) {
-	return is_pointer_in_program_memory(p) || is_pointer_in_stack(p) || is_pointer_in_static_memory(p);
+	return is_pointer_in_program_memory(p) || is_pointer_in_stack(p) || is_pointer_in_static_memory(p) || is_pointer_in_large_allocation(p);
 }
 
 // Meant for debug
@@ -213,6 +231,17 @@ Heap_Search_Result search_heap_block(Heap_Block *block, u64 size) {
 	return result;
 }
 
+// Locks the pages that are entirely inside a free node, except for the one with the node itself
+// since we still need to read & write that.
+void heap_lock_free_node_pages(Heap_Free_Node *node) {
+	void *free_tail = (u8*)node + node->size;
+	void *next_page = (void*)align_next((u8*)node + sizeof(Heap_Free_Node), os.page_size);
+	void *last_page_end = (void*)align_previous(free_tail, os.page_size);
+	if ((u8*)last_page_end > (u8*)next_page) {
+		os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
+	}
+}
+
 Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 
 	size += sizeof(Heap_Block);
@@ -230,6 +259,8 @@ Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 	block->total_allocated = 0;
 #endif
 	
+	block->decommitted_pages = 0;
+	block->decommitted_page_count = 0;
 	block->start = ((u8*)block)+sizeof(Heap_Block);
 	block->size = size;
 	block->next = 0;
@@ -240,31 +271,62 @@ Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 	return block;
 }
 
-void heap_init() {
-	if (heap_initted) return;
-	assert(HEAP_ALIGNMENT == 16);
-	assert(sizeof(Heap_Allocation_Metadata) % HEAP_ALIGNMENT == 0);
-	heap_initted = true;
-	heap_head = make_heap_block(0, DEFAULT_HEAP_BLOCK_SIZE);
-	spinlock_init(&heap_lock);
-}
+#define heap_block_page_is_decommitted(block, page) ((block)->decommitted_pages[(page)/64] & (1ull << ((page)%64)))
 
-void *heap_alloc(u64 size) {
+// Commits the pages in [start, end) that heap_trim() decommitted. Pages that were never
+// decommitted are skipped without asking the OS.
+void heap_block_commit_trimmed_pages(Heap_Block *block, u8 *start, u8 *end) {
+	u64 page = (u64)(start-(u8*)block)/os.page_size;
+	u64 end_page = (u64)(end-(u8*)block)/os.page_size;
+	
+	while (page < end_page && block->decommitted_page_count) {
+		if (page % 64 == 0 && block->decommitted_pages[page/64] == 0) {
+			page += 64;
+			continue;
+		}
+		if (!heap_block_page_is_decommitted(block, page)) {
+			page += 1;
+			continue;
+		}
+		
+		u64 run_start = page;
+		while (page < end_page && heap_block_page_is_decommitted(block, page)) {
+			block->decommitted_pages[page/64] &= ~(1ull << (page%64));
+			block->decommitted_page_count -= 1;
+			page += 1;
+		}
+		bool ok = os_commit_program_memory_pages((u8*)block + run_start*os.page_size, (page-run_start)*os.page_size);
+		assert(ok, "Failed committing trimmed heap memory. Out of memory?");
+	}
+}
+void heap_block_mark_trimmed_pages(Heap_Block *block, u8 *start, u8 *end) {
+	if (!block->decommitted_pages) {
+		// Can't come from the heap since we are holding the heap lock
+		u64 word_count = (block->size/os.page_size+63)/64;
+		u64 bytes = align_next(word_count*sizeof(u64), os.page_size);
+		block->decommitted_pages = (u64*)os_reserve_next_memory_pages(bytes);
+		assert(block->decommitted_pages, "Failed reserving memory for heap trim bookkeeping. Out of memory?");
+		os_unlock_program_memory_pages(block->decommitted_pages, bytes);
+		memset(block->decommitted_pages, 0, bytes);
+	}
+	
+	u64 end_page = (u64)(end-(u8*)block)/os.page_size;
+	for (u64 page = (u64)(start-(u8*)block)/os.page_size; page < end_page; page++) {
+		if (heap_block_page_is_decommitted(block, page)) continue;
+		block->decommitted_pages[page/64] |= 1ull << (page%64);
+		block->decommitted_page_count += 1;
+	}
+}
 
-	if (!heap_initted) heap_init();
+// Size includes the metadata, returns the pointer after it
+void *heap_block_alloc(u64 size) {
 
 	// #Sync #Speed oof
 	spinlock_acquire_or_wait(&heap_lock);
 	
-
-
-
-	
-	size += sizeof(Heap_Allocation_Metadata);
-	
 	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
 	
-	assert(size < MAX_HEAP_BLOCK_SIZE, "Past Charlie has been lazy and did not handle large allocations like this. I apologize on behalf of past Charlie. A quick fix could be to increase the heap block size for now. #Incomplete #Limitation");
+	assert(size < MAX_HEAP_BLOCK_SIZE, "Internal heap error: Allocations this large should have gone to heap_large_alloc");
 	
 	
 #if VERY_DEBUG
@@ -339,6 +401,14 @@ void *heap_alloc(u64 size) {
 		os_unlock_program_memory_pages(first_page, (u64)last_page_end-(u64)first_page);
 	}
 	
+	if (best_fit_block->decommitted_page_count) {
+		// Pages we are about to use, including the header of the remaining free node, might
+		// have been decommitted by heap_trim
+		u64 used_size = size == best_fit->size ? size : size+sizeof(Heap_Free_Node);
+		u8 *commit_end = (u8*)align_next((u8*)best_fit + used_size, os.page_size);
+		heap_block_commit_trimmed_pages(best_fit_block, (u8*)first_page, commit_end);
+	}
+	
 	Heap_Free_Node *new_free_node = 0;
 	if (size != best_fit->size) {
 		u64 remainder = best_fit->size - size;
@@ -347,13 +417,7 @@ void *heap_alloc(u64 size) {
 		new_free_node->next = best_fit->next;
 		
 		// Lock remaining free node
-		// #Copypaste
-		void *free_tail = (u8*)new_free_node + new_free_node->size;
-		void *next_page = (void*)align_next(new_free_node, os.page_size);
-		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-		if ((u8*)last_page_end > (u8*)next_page) {
-			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-		}
+		heap_lock_free_node_pages(new_free_node);
 	}
 	
 	
@@ -396,17 +460,11 @@ void *heap_alloc(u64 size) {
 	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
 	return p;
 }
-void heap_dealloc(void *p) {
+void heap_block_dealloc(Heap_Allocation_Metadata *meta) {
 	// #Sync #Speed oof
-	
-	if (!heap_initted) heap_init();
-
 	spinlock_acquire_or_wait(&heap_lock);
 	
-	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
-	p = (u8*)p-sizeof(Heap_Allocation_Metadata);
-	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(p);
-	check_meta(meta);
+	void *p = meta;
 	
 	// Yoink meta data before we start overwriting it
 	Heap_Block *block = meta->block;
@@ -424,13 +482,6 @@ void heap_dealloc(void *p) {
 	new_node->size = size;
 	
 	if (new_node < block->free_head) {
-		// #Copypaste
-		void *free_tail = (u8*)new_node + new_node->size;
-		void *next_page = (void*)align_next(new_node, os.page_size);
-		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-		if ((u8*)last_page_end > (u8*)next_page) {
-			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-		}
 		
 		if ((u8*)new_node+size == (u8*)block->free_head) {
 			new_node->size = size + block->free_head->size;
@@ -441,19 +492,15 @@ void heap_dealloc(void *p) {
 			block->free_head = new_node;
 		}
 		
+		heap_lock_free_node_pages(new_node);
+		
 	} else {
 	
 		if (!block->free_head) {
 			block->free_head = new_node;
 			new_node->next = 0;
 			
-			// #Copypaste
-			void *free_tail = (u8*)new_node + new_node->size;
-			void *next_page = (void*)align_next(new_node, os.page_size);
-			void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-			if ((u8*)last_page_end > (u8*)next_page) {
-				os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-			}
+			heap_lock_free_node_pages(new_node);
 			
 		} else {
 			Heap_Free_Node *node = block->free_head;
@@ -474,22 +521,9 @@ void heap_dealloc(void *p) {
 					if (cast(u8*)new_node == node_tail) {
 						
 						// We need to account for the cases where we coalesce free blocks with start/end in the middle
-						// of a page.
-						
-						u64 new_node_size = new_node->size;
-						
-						// #Copypaste
-						void *free_tail = (u8*)new_node + new_node->size;
-						void *next_page = (void*)align_previous(node_tail, os.page_size);
-						void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-
-						if ((u8*)next_page < (u8*)node) next_page = (u8*)next_page + os.page_size;
-						
-						if ((u8*)last_page_end > (u8*)next_page) {
-							os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-						}
-						
-						node->size += new_node_size;
+						// of a page, so the pages are locked for the merged node as a whole.
+						node->size += new_node->size;
+						heap_lock_free_node_pages(node);
 						
 						break;
 					} else {
@@ -502,13 +536,7 @@ void heap_dealloc(void *p) {
 							new_node->next = new_node->next->next;
 						}
 						
-						// #Copypaste
-						void *free_tail = (u8*)new_node + new_node->size;
-						void *next_page = (void*)align_next(new_node, os.page_size);
-						void *last_page_end = (void*)align_previous(free_tail, os.page_size);
-						if ((u8*)last_page_end > (u8*)next_page) {
-							os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
-						}
+						heap_lock_free_node_pages(new_node);
 						
 						break;
 					}
@@ -531,221 +559,1728 @@ void heap_dealloc(void *p) {
 	spinlock_release(&heap_lock);
 }
 
-void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			return heap_alloc(size);
-			break;
-		}
-		case ALLOCATOR_DEALLOCATE: {
-			heap_dealloc(p);
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			if (!p) {
-				return heap_alloc(size);
-			}
-			assert(is_pointer_valid(p), "Invalid pointer passed to heap allocator reallocate");
-			Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
-			check_meta(meta);
-			void *new = heap_alloc(size);
-			memcpy(new, p, min(size, meta->size));
-			heap_dealloc(p);
-			return new;
-		}
-	}
-	return 0;
-}
-
-Allocator get_heap_allocator() {
-	Allocator heap_allocator;
-	
-	heap_allocator.proc = heap_allocator_proc;
-	heap_allocator.data = 0;
-	
-	return heap_allocator;
-}
-
-///
 ///
-// Temporary storage
-///
-
-#ifndef TEMPORARY_STORAGE_SIZE
-	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
+// Size classes
+//
+// Small allocations are rounded up to a size class: 16 byte steps up to 128 bytes, then 4
+// classes per power of two up to HEAP_MAX_SMALL_SIZE. Each class has a central free list of
+// slots, and each thread keeps a few slots of every class in a cache so most heap_alloc &
+// heap_dealloc calls don't sync at all. When a thread cache runs dry it grabs a batch from the
+// central list, and when it gets too full it gives a batch back. The central lists get new
+// slots by carving up spans allocated from the block heap.
+//
+// Slots keep the same Heap_Allocation_Metadata as block heap allocations, with meta->block
+// being the block the span lives in. That's also how we tell them apart: meta->size of a
+// block heap allocation is always > HEAP_MAX_SMALL_SIZE.
+
+#ifndef HEAP_MAX_SMALL_SIZE
+	#define HEAP_MAX_SMALL_SIZE KB(32)
 #endif
-
-ogb_instance void* talloc(u64);
-ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
+#define HEAP_SIZE_CLASS_COUNT 40 // 8 + 4*log2(HEAP_MAX_SMALL_SIZE/128)
+#define HEAP_SPAN_SIZE KB(64)
+#define HEAP_MIN_SLOTS_PER_SPAN 8
+// How much is moved between a thread cache and the central list at a time
+#define HEAP_CACHE_BATCH_BYTES KB(16)
+#define HEAP_CACHE_MIN_BATCH 4
+#define HEAP_CACHE_MAX_BATCH 64
+
+typedef struct Heap_Free_Slot Heap_Free_Slot;
+typedef struct Heap_Free_Slot {
+	Heap_Free_Slot *next;
+	Heap_Block *block;
+} Heap_Free_Slot;
+
+typedef struct Heap_Size_Class {
+	Spinlock lock;
+	Heap_Free_Slot *free_head;
+	u64 free_count;
+	u64 slot_size;
+	u64 batch_count;
+	u64 span_count;
+} Heap_Size_Class;
+
+typedef struct Heap_Thread_Cache {
+	Heap_Free_Slot *free_heads[HEAP_SIZE_CLASS_COUNT];
+	u64 free_counts[HEAP_SIZE_CLASS_COUNT];
+} Heap_Thread_Cache;
 
 // #Global
-ogb_instance Allocator 
-get_temporary_allocator();
+ogb_instance Heap_Size_Class heap_size_classes[HEAP_SIZE_CLASS_COUNT];
+ogb_instance u8 heap_size_class_lookup[HEAP_MAX_SMALL_SIZE/HEAP_ALIGNMENT+1];
+ogb_instance thread_local Heap_Thread_Cache heap_thread_cache;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-thread_local void * temporary_storage = 0;
-thread_local void * temporary_storage_pointer = 0;
-thread_local bool   has_warned_temporary_storage_overflow = false;
-thread_local Allocator temp_allocator;
+Heap_Size_Class heap_size_classes[HEAP_SIZE_CLASS_COUNT];
+u8 heap_size_class_lookup[HEAP_MAX_SMALL_SIZE/HEAP_ALIGNMENT+1];
+thread_local Heap_Thread_Cache heap_thread_cache = {0};
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
-ogb_instance Allocator 
-get_temporary_allocator() {
-	if (!temporary_storage) return get_initialization_allocator();
-	return temp_allocator;
+u64 heap_size_class_get_slot_size(u64 class_index) {
+	if (class_index < 8) return (class_index+1)*16;
+	u64 doubling = (class_index-8)/4;
+	u64 step = 32ull << doubling;
+	return (128ull << doubling) + ((class_index-8)%4+1)*step;
 }
-#endif
 
-ogb_instance void* 
-temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
+u64 heap_size_class_get_span_size(Heap_Size_Class *c) {
+	return max(HEAP_SPAN_SIZE, c->slot_size*HEAP_MIN_SLOTS_PER_SPAN);
+}
 
-ogb_instance void 
-temporary_storage_init(u64 arena_size);
+void heap_size_classes_init() {
+	assert(heap_size_class_get_slot_size(HEAP_SIZE_CLASS_COUNT-1) == HEAP_MAX_SMALL_SIZE, "HEAP_SIZE_CLASS_COUNT does not match HEAP_MAX_SMALL_SIZE");
+	
+	u64 class_index = 0;
+	for (u64 i = 0; i < sizeof(heap_size_class_lookup); i++) {
+		u64 size = i*HEAP_ALIGNMENT;
+		while (heap_size_class_get_slot_size(class_index) < size) class_index += 1;
+		heap_size_class_lookup[i] = (u8)class_index;
+	}
+	
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i++) {
+		Heap_Size_Class *c = &heap_size_classes[i];
+		spinlock_init(&c->lock);
+		c->free_head = 0;
+		c->free_count = 0;
+		c->span_count = 0;
+		c->slot_size = heap_size_class_get_slot_size(i);
+		c->batch_count = clamp(HEAP_CACHE_BATCH_BYTES/c->slot_size, HEAP_CACHE_MIN_BATCH, HEAP_CACHE_MAX_BATCH);
+	}
+}
 
-ogb_instance void* 
-talloc(u64 size);
+///
+// Large allocations
+//
+// Allocations of HEAP_LARGE_ALLOCATION_THRESHOLD bytes or more skip the heap entirely and get
+// their own reserved & committed OS virtual memory, which is released again on dealloc so big
+// asset buffers don't fragment the block heap or pin memory after they are freed.
+// They live outside of program memory, and that's how heap_dealloc tells them apart. Their
+// sizes are kept in a side table (open addressing on the pointer) since there's no metadata
+// in front of them.
+
+#ifndef HEAP_LARGE_ALLOCATION_THRESHOLD
+	#define HEAP_LARGE_ALLOCATION_THRESHOLD MB(4)
+#endif
+#define HEAP_LARGE_TABLE_INITIAL_CAPACITY 256
 
-ogb_instance void 
-reset_temporary_storage();
+typedef struct Heap_Large_Allocation {
+	void *p;
+	u64 size;
+	u64 committed_size;
+} Heap_Large_Allocation;
+
+typedef struct Heap_Large_Table {
+	// Lives in its own virtual memory, allocating it from the heap while holding the lock
+	// could end up right back here.
+	Heap_Large_Allocation *entries;
+	u64 capacity;
+	u64 count;
+	u64 committed_bytes;
+	u64 peak_committed_bytes;
+	u64 total_allocation_count;
+} Heap_Large_Table;
 
+// #Global
+ogb_instance Heap_Large_Table heap_large_table;
+ogb_instance Spinlock heap_large_lock;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			return talloc(size);
-			break;
-		}
-		case ALLOCATOR_DEALLOCATE: {
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			panic("Temporary allocator cannot 'reallocate'");
-			return 0;
-		}
+Heap_Large_Table heap_large_table = {0};
+Spinlock heap_large_lock;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+Heap_Large_Allocation *heap_large_table_find(void *p) {
+	Heap_Large_Table *t = &heap_large_table;
+	if (!t->capacity) return 0;
+	u64 mask = t->capacity-1;
+	for (u64 i = xx_hash((u64)p) & mask; t->entries[i].p; i = (i+1) & mask) {
+		if (t->entries[i].p == p) return &t->entries[i];
 	}
 	return 0;
 }
-
-void temporary_storage_init(u64 arena_size) {
+void heap_large_table_insert_no_grow(Heap_Large_Table *t, Heap_Large_Allocation a) {
+	u64 mask = t->capacity-1;
+	u64 i = xx_hash((u64)a.p) & mask;
+	while (t->entries[i].p) i = (i+1) & mask;
+	t->entries[i] = a;
+	t->count += 1;
+}
+void heap_large_table_insert(Heap_Large_Allocation a) {
+	Heap_Large_Table *t = &heap_large_table;
 	
-	temporary_storage = heap_alloc(arena_size);
-	assert(temporary_storage, "Failed allocating temporary storage");
-	temporary_storage_pointer = temporary_storage;
-
-	temp_allocator.proc = temp_allocator_proc;
-	temp_allocator.data = 0;
+	// Keep load at or below 1/2
+	if ((t->count+1)*2 > t->capacity) {
+		Heap_Large_Table old = *t;
+		t->capacity = old.capacity ? old.capacity*2 : HEAP_LARGE_TABLE_INITIAL_CAPACITY;
+		t->count = 0;
+		u64 table_size = align_next(t->capacity*sizeof(Heap_Large_Allocation), os.page_size);
+		t->entries = (Heap_Large_Allocation*)os_reserve_virtual_memory(table_size);
+		assert(t->entries, "Failed reserving memory for the large allocation table");
+		bool ok = os_commit_virtual_memory(t->entries, table_size);
+		assert(ok, "Failed committing memory for the large allocation table");
+		
+		for (u64 i = 0; i < old.capacity; i++) {
+			if (old.entries[i].p) heap_large_table_insert_no_grow(t, old.entries[i]);
+		}
+		if (old.entries) {
+			os_release_virtual_memory(old.entries, align_next(old.capacity*sizeof(Heap_Large_Allocation), os.page_size));
+		}
+	}
 	
-	temp_allocator.proc = temp_allocator_proc;
+	heap_large_table_insert_no_grow(t, a);
+}
+void heap_large_table_remove(Heap_Large_Allocation *entry) {
+	Heap_Large_Table *t = &heap_large_table;
+	u64 mask = t->capacity-1;
+	u64 hole = (u64)(entry-t->entries);
+	
+	// Backward shift so probe chains don't break
+	u64 i = (hole+1) & mask;
+	while (t->entries[i].p) {
+		u64 home = xx_hash((u64)t->entries[i].p) & mask;
+		if (((i-home) & mask) >= ((i-hole) & mask)) {
+			t->entries[hole] = t->entries[i];
+			hole = i;
+		}
+		i = (i+1) & mask;
+	}
+	t->entries[hole] = ZERO(Heap_Large_Allocation);
+	t->count -= 1;
 }
 
-void* talloc(u64 size) {
+void *heap_large_alloc(u64 size) {
+	u64 committed_size = align_next(size, os.page_size);
+	void *p = os_reserve_virtual_memory(committed_size);
+	assert(p, "Failed reserving %llu bytes of virtual memory for a large allocation", size);
+	bool ok = os_commit_virtual_memory(p, committed_size);
+	assert(ok, "Failed committing %llu bytes of virtual memory for a large allocation", size);
 	
-	assert(size < TEMPORARY_STORAGE_SIZE, "Bruddah this is too large for temp allocator");
+	assert(!is_pointer_in_program_memory(p), "Internal heap error: Large allocation ended up in program memory");
 	
-	void* p = temporary_storage_pointer;
+	spinlock_acquire_or_wait(&heap_large_lock);
+	Heap_Large_Allocation a;
+	a.p = p;
+	a.size = size;
+	a.committed_size = committed_size;
+	heap_large_table_insert(a);
+	heap_large_table.committed_bytes += committed_size;
+	heap_large_table.peak_committed_bytes = max(heap_large_table.peak_committed_bytes, heap_large_table.committed_bytes);
+	heap_large_table.total_allocation_count += 1;
+	spinlock_release(&heap_large_lock);
 	
-	temporary_storage_pointer = (u8*)temporary_storage_pointer + size;
+	return p;
+}
+void heap_large_dealloc(void *p) {
+	spinlock_acquire_or_wait(&heap_large_lock);
+	Heap_Large_Allocation *entry = heap_large_table_find(p);
+	assert(entry, "A bad pointer was passed to heap_dealloc: it is not in program memory and not a large allocation");
+	u64 committed_size = entry->committed_size;
+	heap_large_table.committed_bytes -= committed_size;
+	heap_large_table_remove(entry);
+	spinlock_release(&heap_large_lock);
 	
-	if ((u8*)temporary_storage_pointer >= (u8*)temporary_storage+TEMPORARY_STORAGE_SIZE) {
-		if (!has_warned_temporary_storage_overflow) {
-			os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, we wrap around at the start.\n"));
-			has_warned_temporary_storage_overflow = true;
+	os_release_virtual_memory(p, committed_size);
+}
+// Also true for pointers into the middle of one. This is a linear search, but it's only
+// reached for pointers that aren't in program memory, the stack or static memory anyways.
+bool is_pointer_in_large_allocation(void *p) {
+	spinlock_acquire_or_wait(&heap_large_lock);
+	bool found = false;
+	for (u64 i = 0; i < heap_large_table.capacity; i++) {
+		Heap_Large_Allocation *a = &heap_large_table.entries[i];
+		if (a->p && (u8*)p >= (u8*)a->p && (u8*)p < (u8*)a->p+a->size) {
+			found = true;
+			break;
 		}
-		temporary_storage_pointer = temporary_storage;
-		return talloc(size);;
 	}
-	
-	return p;
+	spinlock_release(&heap_large_lock);
+	return found;
+}
+// Returns 0 if p is not a large allocation
+u64 heap_large_get_size(void *p) {
+	spinlock_acquire_or_wait(&heap_large_lock);
+	Heap_Large_Allocation *entry = heap_large_table_find(p);
+	u64 size = entry ? entry->size : 0;
+	spinlock_release(&heap_large_lock);
+	return size;
 }
 
-void reset_temporary_storage() {
-	temporary_storage_pointer = temporary_storage;	
-	has_warned_temporary_storage_overflow = false;
+void heap_init() {
+	if (heap_initted) return;
+	assert(HEAP_ALIGNMENT == 16);
+	assert(sizeof(Heap_Allocation_Metadata) % HEAP_ALIGNMENT == 0);
+	assert(sizeof(Heap_Free_Slot) <= HEAP_ALIGNMENT);
+	heap_initted = true;
+	heap_head = make_heap_block(0, DEFAULT_HEAP_BLOCK_SIZE);
+	spinlock_init(&heap_lock);
+	spinlock_init(&heap_large_lock);
+	heap_size_classes_init();
 }
 
-#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+// Moves up to count slots from the central list of a class to the thread cache.
+// Carves a new span if the central list is empty.
+void heap_thread_cache_refill(u64 class_index) {
+	Heap_Size_Class *c = &heap_size_classes[class_index];
+	Heap_Thread_Cache *cache = &heap_thread_cache;
+	
+	spinlock_acquire_or_wait(&c->lock);
+	
+	if (!c->free_head) {
+		u64 span_size = heap_size_class_get_span_size(c);
+		u8 *span = (u8*)heap_block_alloc(span_size+sizeof(Heap_Allocation_Metadata));
+		Heap_Allocation_Metadata *span_meta = (Heap_Allocation_Metadata*)span-1;
+		u64 slot_count = span_size/c->slot_size;
+		
+		// Link them up backwards so they are handed out in address order
+		for (s64 i = (s64)slot_count-1; i >= 0; i--) {
+			Heap_Free_Slot *slot = (Heap_Free_Slot*)(span + (u64)i*c->slot_size);
+			slot->block = span_meta->block;
+			slot->next = c->free_head;
+			c->free_head = slot;
+		}
+		c->free_count += slot_count;
+		c->span_count += 1;
+	}
+	
+	Heap_Free_Slot *first = c->free_head;
+	Heap_Free_Slot *last = first;
+	u64 count = 1;
+	while (count < c->batch_count && last->next) {
+		last = last->next;
+		count += 1;
+	}
+	c->free_head = last->next;
+	c->free_count -= count;
+	
+	spinlock_release(&c->lock);
+	
+	last->next = cache->free_heads[class_index];
+	cache->free_heads[class_index] = first;
+	cache->free_counts[class_index] += count;
+}
 
+// Gives count slots of a class in the thread cache back to the central list
+void heap_thread_cache_release(u64 class_index, u64 count) {
+	Heap_Size_Class *c = &heap_size_classes[class_index];
+	Heap_Thread_Cache *cache = &heap_thread_cache;
+	
+	if (count == 0) return;
+	assert(count <= cache->free_counts[class_index], "Internal heap error");
+	
+	Heap_Free_Slot *first = cache->free_heads[class_index];
+	Heap_Free_Slot *last = first;
+	for (u64 i = 1; i < count; i++) last = last->next;
+	cache->free_heads[class_index] = last->next;
+	cache->free_counts[class_index] -= count;
+	
+	spinlock_acquire_or_wait(&c->lock);
+	last->next = c->free_head;
+	c->free_head = first;
+	c->free_count += count;
+	spinlock_release(&c->lock);
+}
 
-typedef struct Arena {
-	void *start;
-	void *next;
-	u64 size;
-} Arena;
+// Gives all cached slots of this thread back to the central lists.
+// Called when a thread exits, otherwise the slots would be lost.
+void heap_thread_cache_flush() {
+	if (!heap_initted) return;
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i++) {
+		heap_thread_cache_release(i, heap_thread_cache.free_counts[i]);
+	}
+}
 
+void *heap_alloc(u64 size) {
 
+	if (!heap_initted) heap_init();
 
-// Allocates arena from heap
-Arena make_arena(u64 size) {
-	size = align_next(size, 8);
-	Arena arena;
+	if (size >= HEAP_LARGE_ALLOCATION_THRESHOLD || size+sizeof(Heap_Allocation_Metadata)+HEAP_ALIGNMENT >= MAX_HEAP_BLOCK_SIZE) {
+		return heap_large_alloc(size);
+	}
 	
-	arena.start = alloc(get_heap_allocator(), size);
-	arena.next = arena.start;
-	arena.size = size;
+	size += sizeof(Heap_Allocation_Metadata);
 	
-	return arena;
-}
+	if (size > HEAP_MAX_SMALL_SIZE) return heap_block_alloc(size);
+	
+	u64 class_index = heap_size_class_lookup[(size+HEAP_ALIGNMENT-1)/HEAP_ALIGNMENT];
+	Heap_Thread_Cache *cache = &heap_thread_cache;
+	
+	if (!cache->free_heads[class_index]) heap_thread_cache_refill(class_index);
+	
+	Heap_Free_Slot *slot = cache->free_heads[class_index];
+	cache->free_heads[class_index] = slot->next;
+	cache->free_counts[class_index] -= 1;
+	
+	Heap_Block *block = slot->block;
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)slot;
+	meta->size = heap_size_classes[class_index].slot_size;
+	meta->block = block;
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
 
-void *arena_push(Arena *arena, u64 size) {
-	void *p = arena->next;
-	arena->next = (u8*)arena->next + size;
+	check_meta(meta);
+	
+	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
+	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
 	return p;
 }
-#define arena_push_struct(parena, type) arena_push((parena), sizeof(type))
-
-void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	if (size > 8) size = align_next(size, 8);
-	Arena *arena = (Arena*)data;
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			return arena_push(arena, size);
-		}
-		case ALLOCATOR_DEALLOCATE: {
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			panic("Arena allocator cannot 'reallocate'");
-			return 0;
-		}
+void heap_dealloc(void *p) {
+	
+	if (!heap_initted) heap_init();
+	
+	if (!is_pointer_in_program_memory(p)) {
+		heap_large_dealloc(p);
+		return;
 	}
-	return 0;
-}
-
-// Allocates arena from heap
-Allocator make_arena_allocator(u64 size) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
 	
-	Arena *arena = (Arena*)mem;
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
 	
-	arena->start = (u8*)mem + sizeof(Arena);
-	arena->next = arena->start;
-	arena->size = size;
+	if (meta->size > HEAP_MAX_SMALL_SIZE) {
+		heap_block_dealloc(meta);
+		return;
+	}
 	
-	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
+	u64 class_index = heap_size_class_lookup[meta->size/HEAP_ALIGNMENT];
+	assert(heap_size_classes[class_index].slot_size == meta->size, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
 	
-	return allocator;
+	Heap_Block *block = meta->block;
+	
+#if CONFIGURATION == DEBUG
+	memset(meta, 0x69696969, meta->size);
+#endif
+	
+	Heap_Thread_Cache *cache = &heap_thread_cache;
+	Heap_Free_Slot *slot = (Heap_Free_Slot*)meta;
+	slot->block = block;
+	slot->next = cache->free_heads[class_index];
+	cache->free_heads[class_index] = slot;
+	cache->free_counts[class_index] += 1;
+	
+	u64 batch_count = heap_size_classes[class_index].batch_count;
+	if (cache->free_counts[class_index] > batch_count*2) {
+		heap_thread_cache_release(class_index, batch_count);
+	}
 }
-Allocator make_arena_allocator_with_memory(u64 size, void *p) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
+
+typedef struct Heap_Stats {
+	// Block heap
+	u64 block_count;
+	u64 block_bytes;
+	u64 block_free_bytes;
 	
-	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
+	// Size classes. Slots sitting in thread caches count as used, we can't see those.
+	u64 span_count;
+	u64 span_bytes;
+	u64 span_free_bytes;
 	
-	arena->start = p;
-	arena->next = arena->start;
-	arena->size = size;
+	// Large allocations
+	u64 large_allocation_count;
+	u64 large_allocation_bytes; // Committed
+	u64 large_allocation_peak_bytes;
+	u64 large_allocation_total_count; // Over the whole run
+} Heap_Stats;
+
+Heap_Stats heap_get_stats() {
+	Heap_Stats stats = ZERO(Heap_Stats);
+	if (!heap_initted) return stats;
 	
-	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
+	spinlock_acquire_or_wait(&heap_lock);
+	for (Heap_Block *block = heap_head; block; block = block->next) {
+		stats.block_count += 1;
+		stats.block_bytes += block->size;
+		for (Heap_Free_Node *node = block->free_head; node; node = node->next) {
+			stats.block_free_bytes += node->size;
+		}
+	}
+	spinlock_release(&heap_lock);
 	
-	return allocator;
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i++) {
+		Heap_Size_Class *c = &heap_size_classes[i];
+		spinlock_acquire_or_wait(&c->lock);
+		stats.span_count += c->span_count;
+		stats.span_bytes += c->span_count*heap_size_class_get_span_size(c);
+		stats.span_free_bytes += c->free_count*c->slot_size;
+		spinlock_release(&c->lock);
+	}
+	
+	spinlock_acquire_or_wait(&heap_large_lock);
+	stats.large_allocation_count = heap_large_table.count;
+	stats.large_allocation_bytes = heap_large_table.committed_bytes;
+	stats.large_allocation_peak_bytes = heap_large_table.peak_committed_bytes;
+	stats.large_allocation_total_count = heap_large_table.total_allocation_count;
+	spinlock_release(&heap_large_lock);
+	
+	return stats;
 }
-Allocator make_arena_allocator_from_arena(Arena *arena) {
-	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
+
+///
+// Trimming
+///
+// Memory in heap blocks is never given back to the OS by itself, so after a big level or
+// wave the memory it used stays committed. heap_trim() decommits the pages in free nodes
+// (except the page with the node header), but keeps heap_retained_free_bytes of them
+// committed for what's allocated next. The address range stays with the heap and is
+// committed again when it's allocated from.
+// Call it when a lot was just freed, like at the end of a level or wave, or when idle.
+// Size class spans and large allocations are not affected: large allocations are given back
+// as soon as they are freed, and spans keep their slots.
+
+typedef struct Heap_Trim_Result {
+	u64 coalesced_node_count;
+	u64 decommitted_bytes;
+	u64 retained_free_bytes;
+} Heap_Trim_Result;
+
+// Free nodes are not always in address order (see heap_block_dealloc), so neighbours can
+// only be found after sorting.
+Heap_Free_Node *heap_sort_free_nodes(Heap_Free_Node *head) {
+	if (!head || !head->next) return head;
 	
-	return allocator;
+	Heap_Free_Node *slow = head;
+	Heap_Free_Node *fast = head->next;
+	while (fast && fast->next) {
+		slow = slow->next;
+		fast = fast->next->next;
+	}
+	Heap_Free_Node *second = slow->next;
+	slow->next = 0;
+	
+	Heap_Free_Node *a = heap_sort_free_nodes(head);
+	Heap_Free_Node *b = heap_sort_free_nodes(second);
+	Heap_Free_Node *result = 0;
+	Heap_Free_Node **tail = &result;
+	while (a && b) {
+		if (a < b) { *tail = a; a = a->next; }
+		else       { *tail = b; b = b->next; }
+		tail = &(*tail)->next;
+	}
+	*tail = a ? a : b;
+	return result;
+}
+
+Heap_Trim_Result heap_trim_to(u64 retained_free_bytes) {
+	Heap_Trim_Result result = ZERO(Heap_Trim_Result);
+	if (!heap_initted) return result;
+	
+	// Slots cached on other threads go back when those threads exit
+	heap_thread_cache_flush();
+	
+	spinlock_acquire_or_wait(&heap_lock);
+	for (Heap_Block *block = heap_head; block; block = block->next) {
+		block->free_head = heap_sort_free_nodes(block->free_head);
+		Heap_Free_Node *node = block->free_head;
+		while (node) {
+			bool merged = false;
+			while (node->next && (u8*)node + node->size == (u8*)node->next) {
+				node->size += node->next->size;
+				node->next = node->next->next;
+				result.coalesced_node_count += 1;
+				merged = true;
+			}
+			if (merged) heap_lock_free_node_pages(node);
+			
+			u8 *first_page = (u8*)align_next((u8*)node + sizeof(Heap_Free_Node), os.page_size);
+			u8 *last_page_end = (u8*)align_previous((u8*)node + node->size, os.page_size);
+			if (last_page_end > first_page) {
+				// Keep the start of the node committed while there's budget left, that's
+				// where the next allocation from this node goes.
+				u64 budget_left = retained_free_bytes - result.retained_free_bytes;
+				u64 keep = align_previous(min(budget_left, (u64)(last_page_end-first_page)), os.page_size);
+				result.retained_free_bytes += keep;
+				if (first_page+keep < last_page_end) {
+					result.decommitted_bytes += os_decommit_program_memory_pages(first_page+keep, (u64)(last_page_end-(first_page+keep)));
+					heap_block_mark_trimmed_pages(block, first_page+keep, last_page_end);
+				}
+			}
+			
+			node = node->next;
+		}
+	}
+	spinlock_release(&heap_lock);
+	
+	if (result.decommitted_bytes) {
+		log_verbose("Heap trim gave %llu bytes back to the OS, kept %llu bytes of free memory committed", result.decommitted_bytes, result.retained_free_bytes);
+	}
+	
+	return result;
+}
+Heap_Trim_Result heap_trim() {
+	return heap_trim_to(heap_retained_free_bytes);
+}
+
+void *heap_realloc(void *p, u64 size) {
+	if (!p) {
+		return heap_alloc(size);
+	}
+	if (!is_pointer_in_program_memory(p)) {
+		u64 old_size = heap_large_get_size(p);
+		assert(old_size, "Invalid pointer passed to heap allocator reallocate");
+		if (size >= HEAP_LARGE_ALLOCATION_THRESHOLD && align_next(size, os.page_size) == align_next(old_size, os.page_size)) {
+			// Still fits in the same pages
+			spinlock_acquire_or_wait(&heap_large_lock);
+			heap_large_table_find(p)->size = size;
+			spinlock_release(&heap_large_lock);
+			return p;
+		}
+		void *new = heap_alloc(size);
+		memcpy(new, p, min(size, old_size));
+		heap_dealloc(p);
+		return new;
+	}
+	assert(is_pointer_valid(p), "Invalid pointer passed to heap allocator reallocate");
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
+	if (meta->size <= HEAP_MAX_SMALL_SIZE && size+sizeof(Heap_Allocation_Metadata) <= meta->size
+	 && heap_size_class_lookup[(size+sizeof(Heap_Allocation_Metadata)+HEAP_ALIGNMENT-1)/HEAP_ALIGNMENT] == heap_size_class_lookup[meta->size/HEAP_ALIGNMENT]) {
+		// Still the same size class, nothing to do
+		return p;
+	}
+	void *new = heap_alloc(size);
+	memcpy(new, p, min(size, meta->size-sizeof(Heap_Allocation_Metadata)));
+	heap_dealloc(p);
+	return new;
+}
+
+void frame_allocation_check_record(u64 size);
+#if ENABLE_HEAP_PROFILING
+typedef struct Heap_Profile_Callsite Heap_Profile_Callsite;
+void heap_profile_record_alloc(void *p, u64 size, Heap_Profile_Callsite *callsite);
+Heap_Profile_Callsite *heap_profile_record_dealloc(void *p);
+#endif
+
+void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			void *result = heap_alloc(size);
+			frame_allocation_check_record(size);
+#if ENABLE_HEAP_PROFILING
+			heap_profile_record_alloc(result, size, 0);
+#endif
+			return result;
+		}
+		case ALLOCATOR_DEALLOCATE: {
+#if ENABLE_HEAP_PROFILING
+			// Before the memory can be handed out again on another thread
+			heap_profile_record_dealloc(p);
+#endif
+			heap_dealloc(p);
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+#if ENABLE_HEAP_PROFILING
+			// Stays with whoever allocated it in the first place
+			Heap_Profile_Callsite *callsite = p ? heap_profile_record_dealloc(p) : 0;
+#endif
+			void *result = heap_realloc(p, size);
+			if (result != p) frame_allocation_check_record(size);
+#if ENABLE_HEAP_PROFILING
+			heap_profile_record_alloc(result, size, callsite);
+#endif
+			return result;
+		}
+	}
+	return 0;
+}
+
+Allocator get_heap_allocator() {
+	Allocator heap_allocator;
+	
+	heap_allocator.proc = heap_allocator_proc;
+	heap_allocator.data = 0;
+	
+	return heap_allocator;
+}
+
+///
+///
+// Arena
+///
+// Reserves a range of virtual memory up front and commits pages as they are pushed to, so it
+// can grow up to its reserved size without ever moving. Pushing past the reserved size
+// asserts instead of silently overwriting whatever comes after.
+// Good for things that live and die together, like everything for one frame or one level.
+//
+//     Arena arena = make_arena(GB(1));
+//     Arena_Marker marker = arena_get_marker(&arena);
+//     ... arena_push(&arena, ...) ...
+//     arena_pop_to_marker(&arena, marker); // Everything pushed since the marker is gone
+//     arena_reset(&arena);                 // Everything is gone
+//     arena_destroy(&arena);
+
+#define ARENA_COMMIT_SIZE KB(64)
+#define ARENA_DEFAULT_ALIGNMENT 8
+
+typedef struct Arena {
+	u8 *base;
+	u64 position;
+	u64 committed;
+	u64 reserved;
+	u64 high_water;
+	// Memory from make_arena_with_memory, nothing to commit or release
+	bool fixed_memory;
+} Arena;
+
+typedef struct Arena_Marker {
+	u64 position;
+} Arena_Marker;
+
+// Reserves size bytes of virtual memory, nothing is committed until it's pushed to
+Arena make_arena(u64 size) {
+	Arena arena = ZERO(Arena);
+	arena.reserved = align_next(size, os.page_size);
+	arena.base = (u8*)os_reserve_virtual_memory(arena.reserved);
+	assert(arena.base, "Failed reserving %llu bytes of virtual memory for an arena", arena.reserved);
+	return arena;
+}
+Arena make_arena_with_memory(u64 size, void *p) {
+	Arena arena = ZERO(Arena);
+	arena.base = (u8*)p;
+	arena.reserved = size;
+	arena.committed = size;
+	arena.fixed_memory = true;
+	return arena;
+}
+void arena_destroy(Arena *arena) {
+	if (arena->base && !arena->fixed_memory) os_release_virtual_memory(arena->base, arena->reserved);
+	*arena = ZERO(Arena);
+}
+
+// Makes sure the first bytes of the arena are committed
+void arena_commit(Arena *arena, u64 bytes) {
+	if (bytes <= arena->committed) return;
+	
+	assert(bytes <= arena->reserved, "Arena is out of its %llu bytes of reserved memory", arena->reserved);
+	
+	u64 new_committed = min(align_next(bytes, ARENA_COMMIT_SIZE), arena->reserved);
+	bool ok = os_commit_virtual_memory(arena->base+arena->committed, new_committed-arena->committed);
+	assert(ok, "Failed committing %llu bytes of arena memory", new_committed-arena->committed);
+	arena->committed = new_committed;
+}
+
+void *arena_push_aligned(Arena *arena, u64 size, u64 alignment) {
+	assert(alignment && (alignment & (alignment-1)) == 0, "Arena alignment must be a power of two, got %llu", alignment);
+	
+	u64 start = align_next((u64)arena->base+arena->position, alignment) - (u64)arena->base;
+	u64 end = start + size;
+	if (end > arena->committed) arena_commit(arena, end);
+	
+	arena->position = end;
+	arena->high_water = max(arena->high_water, end);
+	return arena->base+start;
+}
+void *arena_push(Arena *arena, u64 size) {
+	return arena_push_aligned(arena, size, ARENA_DEFAULT_ALIGNMENT);
+}
+#define arena_push_struct(parena, type) arena_push((parena), sizeof(type))
+
+Arena_Marker arena_get_marker(Arena *arena) {
+	Arena_Marker marker;
+	marker.position = arena->position;
+	return marker;
+}
+void arena_pop_to_marker(Arena *arena, Arena_Marker marker) {
+	assert(marker.position <= arena->position, "Arena marker is past the arena position, was the arena reset or popped to an earlier marker?");
+	arena->position = marker.position;
+}
+
+void arena_reset(Arena *arena) {
+	arena->position = 0;
+}
+// Also gives the committed memory back to the OS, except for the first ARENA_COMMIT_SIZE bytes
+void arena_reset_and_decommit(Arena *arena) {
+	arena->position = 0;
+	if (arena->fixed_memory || arena->committed <= ARENA_COMMIT_SIZE) return;
+	os_decommit_virtual_memory(arena->base+ARENA_COMMIT_SIZE, arena->committed-ARENA_COMMIT_SIZE);
+	arena->committed = ARENA_COMMIT_SIZE;
+}
+
+void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	Arena *arena = (Arena*)data;
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return arena_push(arena, size);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			panic("Arena allocator cannot 'reallocate'");
+			return 0;
+		}
+	}
+	return 0;
+}
+
+// Arena struct is allocated from heap, destroy with destroy_arena_allocator
+Allocator make_arena_allocator(u64 size) {
+	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
+	*arena = make_arena(size);
+	
+	Allocator allocator;
+	allocator.data = arena;
+	allocator.proc = arena_allocator_proc;
+	
+	return allocator;
+}
+Allocator make_arena_allocator_with_memory(u64 size, void *p) {
+	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
+	*arena = make_arena_with_memory(size, p);
+	
+	Allocator allocator;
+	allocator.data = arena;
+	allocator.proc = arena_allocator_proc;
+	
+	return allocator;
+}
+Allocator make_arena_allocator_from_arena(Arena *arena) {
+	Allocator allocator;
+	allocator.data = arena;
+	allocator.proc = arena_allocator_proc;
+	
+	return allocator;
+}
+void destroy_arena_allocator(Allocator allocator) {
+	assert(allocator.proc == arena_allocator_proc, "destroy_arena_allocator was passed an allocator that is not an arena allocator");
+	Arena *arena = (Arena*)allocator.data;
+	arena_destroy(arena);
+	dealloc(get_heap_allocator(), arena);
+}
+
+///
+///
+// Pool
+///
+// Fixed size slots with O(1) alloc and free. Free slots are kept in an intrusive free list
+// (a free slot holds a pointer to the next free slot) and the pool grows by whole chunks
+// from its backing allocator. Slots never move, so pointers stay valid until they are freed.
+// Good for lots of same-sized things that come and go, like audio players, particles or entities.
+//
+//     Pool pool = make_pool_for(Entity, 256, get_heap_allocator(), false);
+//     Entity *e = pool_alloc_struct(&pool, Entity);
+//     ...
+//     pool_free(&pool, e);
+//     pool_destroy(&pool);
+//
+// If thread_safe is true, pool_alloc & pool_free can be called from any thread without taking
+// a lock. Only growing the pool takes a spinlock.
+// To walk every slot, free or not, loop over pool->chunks and use pool_chunk_get_slot.
+// Slots are zeroed when their chunk is made. While a slot is free its first 8 bytes hold the
+// free list pointer, the rest is left as it was.
+
+#define POOL_SLOT_ALIGNMENT 16
+// The free list head is a pointer in the low bits and a counter in the high bits, which is
+// bumped on every swap so a slot that was popped & pushed back in between is not mistaken
+// for the same head (ABA).
+#define POOL_POINTER_BITS 48
+#define POOL_POINTER_MASK ((1ULL << POOL_POINTER_BITS)-1)
+
+typedef struct Pool_Free_Slot {
+	struct Pool_Free_Slot *next;
+} Pool_Free_Slot;
+
+typedef struct Pool_Chunk {
+	struct Pool_Chunk *next;
+	u8 *slots;
+	u64 slot_count;
+} Pool_Chunk;
+
+typedef struct Pool {
+	u64 slot_size;
+	u64 slots_per_chunk;
+	Allocator backing;
+	bool thread_safe;
+	
+	// Newest first. Chunks are only ever added, so this can be walked while another thread
+	// grows the pool.
+	Pool_Chunk *volatile chunks;
+	volatile u64 free_head;
+	Spinlock grow_lock;
+	
+	u64 chunk_count;
+	u64 capacity;
+	volatile u64 used;
+	volatile u64 peak_used;
+} Pool;
+
+typedef struct Pool_Stats {
+	u64 slot_size;
+	u64 chunk_count;
+	u64 capacity;
+	u64 used;
+	u64 peak_used;
+	// Everything allocated from the backing allocator, including chunk headers and padding
+	u64 bytes;
+} Pool_Stats;
+
+Pool make_pool(u64 slot_size, u64 slots_per_chunk, Allocator backing, bool thread_safe) {
+	assert(slot_size > 0, "Pool slot size must be more than 0");
+	assert(slots_per_chunk > 0, "Pool needs at least one slot per chunk");
+	
+	Pool pool = ZERO(Pool);
+	pool.slot_size = align_next(max(slot_size, sizeof(Pool_Free_Slot)), POOL_SLOT_ALIGNMENT);
+	pool.slots_per_chunk = slots_per_chunk;
+	pool.backing = backing;
+	pool.thread_safe = thread_safe;
+	spinlock_init(&pool.grow_lock);
+	return pool;
+}
+#define make_pool_for(type, slots_per_chunk, backing, thread_safe) make_pool(sizeof(type), (slots_per_chunk), (backing), (thread_safe))
+
+void pool_destroy(Pool *pool) {
+	Pool_Chunk *chunk = pool->chunks;
+	while (chunk) {
+		Pool_Chunk *next = chunk->next;
+		dealloc(pool->backing, chunk);
+		chunk = next;
+	}
+	*pool = ZERO(Pool);
+}
+
+void *pool_chunk_get_slot(Pool *pool, Pool_Chunk *chunk, u64 index) {
+	assert(index < chunk->slot_count, "Pool slot index %llu out of range (%llu)", index, chunk->slot_count);
+	return chunk->slots + index*pool->slot_size;
+}
+
+bool pool_owns_pointer(Pool *pool, void *p) {
+	for (Pool_Chunk *chunk = pool->chunks; chunk; chunk = chunk->next) {
+		u8 *end = chunk->slots + chunk->slot_count*pool->slot_size;
+		if ((u8*)p >= chunk->slots && (u8*)p < end) {
+			return ((u64)((u8*)p - chunk->slots) % pool->slot_size) == 0;
+		}
+	}
+	return false;
+}
+
+void pool_push_free_slots(Pool *pool, Pool_Free_Slot *first, Pool_Free_Slot *last) {
+	if (!pool->thread_safe) {
+		last->next = (Pool_Free_Slot*)pool->free_head;
+		pool->free_head = (u64)first;
+		return;
+	}
+	while (true) {
+		u64 head = pool->free_head;
+		last->next = (Pool_Free_Slot*)(head & POOL_POINTER_MASK);
+		u64 new_head = (u64)first | ((head & ~POOL_POINTER_MASK) + (1ULL << POOL_POINTER_BITS));
+		if (compare_and_swap_64(&pool->free_head, new_head, head)) return;
+	}
+}
+Pool_Free_Slot *pool_pop_free_slot(Pool *pool) {
+	if (!pool->thread_safe) {
+		Pool_Free_Slot *slot = (Pool_Free_Slot*)pool->free_head;
+		if (slot) pool->free_head = (u64)slot->next;
+		return slot;
+	}
+	while (true) {
+		u64 head = pool->free_head;
+		Pool_Free_Slot *slot = (Pool_Free_Slot*)(head & POOL_POINTER_MASK);
+		if (!slot) return 0;
+		// If another thread pops this slot first, slot->next may be garbage by now, but then the
+		// counter has moved on and the swap fails. Chunks are never freed, so the read is safe.
+		u64 new_head = (u64)slot->next | ((head & ~POOL_POINTER_MASK) + (1ULL << POOL_POINTER_BITS));
+		if (compare_and_swap_64(&pool->free_head, new_head, head)) return slot;
+	}
+}
+
+void pool_grow(Pool *pool) {
+	u64 count = pool->slots_per_chunk;
+	u64 chunk_size = sizeof(Pool_Chunk) + POOL_SLOT_ALIGNMENT + count*pool->slot_size;
+	Pool_Chunk *chunk = (Pool_Chunk*)alloc_uninitialized(pool->backing, chunk_size);
+	assert(chunk, "Failed allocating a %llu byte pool chunk", chunk_size);
+	memset(chunk, 0, chunk_size);
+	
+	chunk->slots = (u8*)align_next((u64)(chunk+1), POOL_SLOT_ALIGNMENT);
+	chunk->slot_count = count;
+	assert(((u64)chunk->slots + count*pool->slot_size) <= POOL_POINTER_MASK, "Pool chunk is outside of the address range the free list can point to");
+	
+	for (u64 i = 0; i < count-1; i++) {
+		Pool_Free_Slot *slot = (Pool_Free_Slot*)(chunk->slots + i*pool->slot_size);
+		slot->next = (Pool_Free_Slot*)(chunk->slots + (i+1)*pool->slot_size);
+	}
+	
+	chunk->next = pool->chunks;
+	MEMORY_BARRIER;
+	pool->chunks = chunk;
+	pool->chunk_count += 1;
+	pool->capacity += count;
+	
+	pool_push_free_slots(pool, (Pool_Free_Slot*)chunk->slots, (Pool_Free_Slot*)(chunk->slots + (count-1)*pool->slot_size));
+}
+
+// Memory is not zeroed, except for slots that were never used
+void *pool_alloc(Pool *pool) {
+	assert(pool->slot_size, "Pool was not made with make_pool");
+	
+	Pool_Free_Slot *slot = pool_pop_free_slot(pool);
+	while (!slot) {
+		if (pool->thread_safe) spinlock_acquire_or_wait(&pool->grow_lock);
+		// Another thread might have grown the pool while we waited for the lock
+		slot = pool_pop_free_slot(pool);
+		if (!slot) {
+			pool_grow(pool);
+			slot = pool_pop_free_slot(pool);
+		}
+		if (pool->thread_safe) spinlock_release(&pool->grow_lock);
+	}
+	slot->next = 0;
+	
+	if (pool->thread_safe) {
+		u64 used = atomic_add_64(&pool->used, 1)+1;
+		u64 peak = pool->peak_used;
+		while (used > peak && !compare_and_swap_64(&pool->peak_used, used, peak)) {
+			peak = pool->peak_used;
+		}
+	} else {
+		pool->used += 1;
+		pool->peak_used = max(pool->peak_used, pool->used);
+	}
+	
+	return slot;
+}
+#define pool_alloc_struct(ppool, type) ((type*)pool_alloc(ppool))
+
+void pool_free(Pool *pool, void *p) {
+	if (!p) return;
+	
+#if CONFIGURATION == DEBUG
+	assert(pool_owns_pointer(pool, p), "Pointer %p passed to pool_free is not a slot in this pool", p);
+#endif
+	
+	pool_push_free_slots(pool, (Pool_Free_Slot*)p, (Pool_Free_Slot*)p);
+	
+	if (pool->thread_safe) atomic_add_64(&pool->used, (u64)-1);
+	else                   pool->used -= 1;
+}
+
+Pool_Stats pool_get_stats(Pool *pool) {
+	Pool_Stats stats = ZERO(Pool_Stats);
+	stats.slot_size = pool->slot_size;
+	stats.chunk_count = pool->chunk_count;
+	stats.capacity = pool->capacity;
+	stats.used = pool->used;
+	stats.peak_used = pool->peak_used;
+	stats.bytes = pool->chunk_count*(sizeof(Pool_Chunk) + POOL_SLOT_ALIGNMENT + pool->slots_per_chunk*pool->slot_size);
+	return stats;
+}
+
+void* pool_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	Pool *pool = (Pool*)data;
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			assert(size <= pool->slot_size, "Pool allocator with %llu byte slots can't allocate %llu bytes", pool->slot_size, size);
+			return pool_alloc(pool);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			pool_free(pool, p);
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			assert(size <= pool->slot_size, "Pool allocator with %llu byte slots can't reallocate to %llu bytes", pool->slot_size, size);
+			if (!p) return pool_alloc(pool);
+			return p;
+		}
+	}
+	return 0;
+}
+
+// Every allocation takes one slot, so sizes must be <= the pool's slot size
+Allocator make_pool_allocator(Pool *pool) {
+	Allocator allocator;
+	allocator.data = pool;
+	allocator.proc = pool_allocator_proc;
+	
+	return allocator;
+}
+
+///
+///
+// Temporary storage
+///
+// Each thread has two temporary arenas. The first one is what talloc & get_temporary_allocator
+// use, and it's reset with reset_temporary_storage() (typically once per frame).
+// Both can be used for scoped scratch memory with scratch_begin()/scratch_end():
+//
+//     Scratch scratch = scratch_begin();
+//     ... alloc(scratch.allocator, ...) ...
+//     scratch_end(scratch); // Everything allocated since scratch_begin is gone
+//
+// If you are given an allocator to return results in, and it might be a scratch allocator of
+// your caller, use scratch_begin_avoiding(that_allocator) so you get the other arena and
+// don't free the results when ending your scratch.
+//
+// The arenas reserve TEMPORARY_STORAGE_RESERVE_SIZE of virtual memory and commit pages as
+// they are needed (see Arena above), so they don't wrap around and overwrite live data when
+// they fill up.
+// They keep track of how much was used at most so budgets can be based on real data, see
+// temporary_storage_get_stats().
+
+#ifndef TEMPORARY_STORAGE_SIZE
+	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb, committed up front for the main thread
+#endif
+#ifndef TEMPORARY_STORAGE_RESERVE_SIZE
+	#define TEMPORARY_STORAGE_RESERVE_SIZE GB(1) // Per arena
+#endif
+#define TEMPORARY_STORAGE_ALIGNMENT 16
+#define TEMPORARY_ARENA_COUNT 2
+
+typedef struct Temporary_Arena {
+	Arena arena;
+	u64 open_scratch_count;
+	Allocator allocator;
+} Temporary_Arena;
+
+typedef struct Scratch {
+	Temporary_Arena *arena;
+	Arena_Marker marker;
+	Allocator allocator;
+	u64 depth; // Scratches on the same arena must end in the reverse order they began
+} Scratch;
+
+typedef struct Temporary_Storage_Stats {
+	// Calling thread, all arenas
+	u64 used;
+	u64 committed;
+	u64 high_water;
+	// Highest high water of any thread so far
+	u64 peak_high_water_all_threads;
+} Temporary_Storage_Stats;
+
+ogb_instance void* talloc(u64);
+ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
+
+// #Global
+ogb_instance Allocator 
+get_temporary_allocator();
+
+ogb_instance volatile u64 temporary_storage_peak_high_water;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+thread_local Temporary_Arena temporary_arenas[TEMPORARY_ARENA_COUNT] = {0};
+thread_local Allocator temp_allocator;
+volatile u64 temporary_storage_peak_high_water = 0;
+
+ogb_instance Allocator 
+get_temporary_allocator() {
+	if (!temporary_arenas[0].arena.base) return get_initialization_allocator();
+	return temp_allocator;
+}
+#endif
+
+ogb_instance void* 
+temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
+
+ogb_instance void 
+temporary_storage_init(u64 arena_size);
+
+// Releases the temporary arenas of the calling thread
+ogb_instance void 
+temporary_storage_destroy();
+
+ogb_instance void* 
+talloc(u64 size);
+
+ogb_instance void 
+reset_temporary_storage();
+
+ogb_instance Scratch 
+scratch_begin();
+
+ogb_instance Scratch 
+scratch_begin_avoiding(Allocator conflict);
+
+ogb_instance void 
+scratch_end(Scratch scratch);
+
+ogb_instance Temporary_Storage_Stats 
+temporary_storage_get_stats();
+
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+void* temporary_arena_push(Temporary_Arena *t, u64 size) {
+	Arena *arena = &t->arena;
+	
+	assert(align_next(arena->position, TEMPORARY_STORAGE_ALIGNMENT)+size <= arena->reserved, "Temporary storage is out of its %llu bytes of reserved memory. Increase TEMPORARY_STORAGE_RESERVE_SIZE, or use scratch_begin/scratch_end to free temporary memory sooner.", arena->reserved);
+	
+	u64 high_water = arena->high_water;
+	void *p = arena_push_aligned(arena, size, TEMPORARY_STORAGE_ALIGNMENT);
+	
+	if (arena->high_water > high_water) {
+		while (true) {
+			u64 peak = temporary_storage_peak_high_water;
+			if (arena->high_water <= peak || compare_and_swap_64(&temporary_storage_peak_high_water, arena->high_water, peak)) break;
+		}
+	}
+	
+	return p;
+}
+
+void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	Temporary_Arena *arena = data ? (Temporary_Arena*)data : &temporary_arenas[0];
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return temporary_arena_push(arena, size);
+			break;
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			panic("Temporary allocator cannot 'reallocate'");
+			return 0;
+		}
+	}
+	return 0;
+}
+
+void temporary_storage_init(u64 arena_size) {
+	
+	for (u64 i = 0; i < TEMPORARY_ARENA_COUNT; i++) {
+		Temporary_Arena *t = &temporary_arenas[i];
+		*t = ZERO(Temporary_Arena);
+		t->arena = make_arena(max(TEMPORARY_STORAGE_RESERVE_SIZE, arena_size));
+		t->allocator.proc = temp_allocator_proc;
+		t->allocator.data = t;
+	}
+	
+	// Only the arena for talloc gets memory up front, the other one commits when first used
+	arena_commit(&temporary_arenas[0].arena, arena_size);
+
+	temp_allocator = temporary_arenas[0].allocator;
+}
+
+void temporary_storage_destroy() {
+	for (u64 i = 0; i < TEMPORARY_ARENA_COUNT; i++) {
+		Temporary_Arena *t = &temporary_arenas[i];
+		if (t->arena.base) arena_destroy(&t->arena);
+		*t = ZERO(Temporary_Arena);
+	}
+}
+
+void* talloc(u64 size) {
+	return temporary_arena_push(&temporary_arenas[0], size);
+}
+
+void reset_temporary_storage() {
+	Temporary_Arena *t = &temporary_arenas[0];
+	assert(t->open_scratch_count == 0, "reset_temporary_storage() was called between a scratch_begin() and scratch_end() on the temporary allocator");
+	arena_reset(&t->arena);
+}
+
+Scratch scratch_begin_avoiding(Allocator conflict) {
+	// Nested scratches go on the second arena by default so they don't free results that
+	// the caller put on the temporary allocator.
+	for (s64 i = TEMPORARY_ARENA_COUNT-1; i >= 0; i--) {
+		Temporary_Arena *t = &temporary_arenas[i];
+		// (An allocator with temp_allocator_proc and no data is the first arena too)
+		Temporary_Arena *conflict_arena = conflict.data ? (Temporary_Arena*)conflict.data : &temporary_arenas[0];
+		if (conflict.proc == temp_allocator_proc && conflict_arena == t) continue;
+		
+		assert(t->arena.base, "Temporary storage was not initialized for this thread");
+		
+		Scratch scratch;
+		scratch.arena = t;
+		scratch.marker = arena_get_marker(&t->arena);
+		scratch.allocator = t->allocator;
+		t->open_scratch_count += 1;
+		scratch.depth = t->open_scratch_count;
+		return scratch;
+	}
+	panic("Internal error: No temporary arena without conflict");
+	return ZERO(Scratch);
+}
+Scratch scratch_begin() {
+	return scratch_begin_avoiding(ZERO(Allocator));
+}
+void scratch_end(Scratch scratch) {
+	assert(scratch.arena->open_scratch_count > 0, "scratch_end() without scratch_begin()");
+	assert(scratch.depth == scratch.arena->open_scratch_count, "scratch_end() out of order: A scratch that began later on the same arena is still open, ending this one would free its memory");
+	arena_pop_to_marker(&scratch.arena->arena, scratch.marker);
+	scratch.arena->open_scratch_count -= 1;
+}
+
+Temporary_Storage_Stats temporary_storage_get_stats() {
+	Temporary_Storage_Stats stats = ZERO(Temporary_Storage_Stats);
+	for (u64 i = 0; i < TEMPORARY_ARENA_COUNT; i++) {
+		stats.used += temporary_arenas[i].arena.position;
+		stats.committed += temporary_arenas[i].arena.committed;
+		stats.high_water += temporary_arenas[i].arena.high_water;
+	}
+	stats.peak_high_water_all_threads = temporary_storage_peak_high_water;
+	return stats;
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+///
+///
+// Heap profiling
+///
+// With ENABLE_HEAP_PROFILING, every allocation through the heap allocator is recorded with the
+// file & line it was allocated from, its size and when it happened. alloc() and
+// alloc_uninitialized() are macros that pass their callsite along in that case. Allocations
+// that don't go through them (like growing arrays, which call the allocator proc directly) are
+// attributed to "(unknown)", and reallocations stay with the callsite that first allocated.
+//
+// heap_profile_end_frame() is called by os_update and keeps track of allocations per frame.
+// heap_profile_dump_json() writes live bytes by callsite, allocations per frame and free list
+// fragmentation per heap block. It's called on exit, but it's also useful to call it when
+// memory seems to grow, and diff two dumps.
+//
+// None of this is compiled when ENABLE_HEAP_PROFILING is 0.
+
+#if ENABLE_HEAP_PROFILING
+
+#define HEAP_PROFILE_MAX_CALLSITES 8192 // Must be a power of two
+#define HEAP_PROFILE_TABLE_INITIAL_CAPACITY 4096 // Must be a power of two
+
+typedef struct Heap_Profile_Callsite {
+	const char *file;
+	u32 line;
+	u64 live_count;
+	u64 live_bytes;
+	u64 peak_live_bytes;
+	u64 total_count;
+	u64 total_bytes;
+	// Only valid while dumping
+	f64 oldest_live_timestamp;
+} Heap_Profile_Callsite;
+
+typedef struct Heap_Profile_Allocation {
+	void *p;
+	u64 size;
+	f64 timestamp;
+	Heap_Profile_Callsite *callsite;
+} Heap_Profile_Allocation;
+
+typedef struct Heap_Profile_Stats {
+	u64 live_count;
+	u64 live_bytes;
+	u64 peak_live_bytes;
+	u64 callsite_count;
+	
+	u64 frame_count;
+	u64 last_frame_alloc_count;
+	u64 last_frame_alloc_bytes;
+	u64 last_frame_dealloc_count;
+	u64 peak_frame_alloc_count;
+	u64 peak_frame_alloc_bytes;
+	u64 total_alloc_count;
+	u64 total_alloc_bytes;
+} Heap_Profile_Stats;
+
+typedef struct Heap_Profile {
+	// Both tables live in their own virtual memory, for the same reason as Heap_Large_Table.
+	// Callsites never move, so allocations can point to them.
+	Heap_Profile_Callsite *callsites;
+	Heap_Profile_Allocation *allocations;
+	u64 allocation_capacity;
+	
+	// Current frame
+	u64 frame_alloc_count;
+	u64 frame_alloc_bytes;
+	u64 frame_dealloc_count;
+	
+	Heap_Profile_Stats stats;
+} Heap_Profile;
+
+// #Global
+ogb_instance Heap_Profile heap_profile;
+ogb_instance Spinlock heap_profile_lock;
+ogb_instance thread_local const char *heap_profile_callsite_file;
+ogb_instance thread_local u32 heap_profile_callsite_line;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Heap_Profile heap_profile = {0};
+Spinlock heap_profile_lock;
+thread_local const char *heap_profile_callsite_file = 0;
+thread_local u32 heap_profile_callsite_line = 0;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void heap_profile_set_callsite(const char *file, u32 line) {
+	heap_profile_callsite_file = file;
+	heap_profile_callsite_line = line;
+}
+
+Heap_Profile_Callsite *heap_profile_get_callsite(const char *file, u32 line) {
+	Heap_Profile *h = &heap_profile;
+	if (!h->callsites) {
+		u64 table_size = align_next(HEAP_PROFILE_MAX_CALLSITES*sizeof(Heap_Profile_Callsite), os.page_size);
+		h->callsites = (Heap_Profile_Callsite*)os_reserve_virtual_memory(table_size);
+		assert(h->callsites, "Failed reserving memory for the heap profile callsites");
+		bool ok = os_commit_virtual_memory(h->callsites, table_size);
+		assert(ok, "Failed committing memory for the heap profile callsites");
+	}
+	
+	// The same file can come from different string literals, so it's hashed by its contents
+	u64 mask = HEAP_PROFILE_MAX_CALLSITES-1;
+	u64 i = (string_get_hash(STR(file)) ^ xx_hash(line)) & mask;
+	while (h->callsites[i].file) {
+		Heap_Profile_Callsite *c = &h->callsites[i];
+		if (c->line == line && (c->file == file || strings_match(STR(c->file), STR(file)))) return c;
+		i = (i+1) & mask;
+	}
+	
+	assert(h->stats.callsite_count < HEAP_PROFILE_MAX_CALLSITES/2, "Heap profiling ran out of callsites, increase HEAP_PROFILE_MAX_CALLSITES");
+	h->callsites[i].file = file;
+	h->callsites[i].line = line;
+	h->stats.callsite_count += 1;
+	return &h->callsites[i];
+}
+
+Heap_Profile_Allocation *heap_profile_table_find(void *p) {
+	Heap_Profile *h = &heap_profile;
+	if (!h->allocation_capacity) return 0;
+	u64 mask = h->allocation_capacity-1;
+	for (u64 i = xx_hash((u64)p) & mask; h->allocations[i].p; i = (i+1) & mask) {
+		if (h->allocations[i].p == p) return &h->allocations[i];
+	}
+	return 0;
+}
+void heap_profile_table_insert_no_grow(Heap_Profile *h, Heap_Profile_Allocation a) {
+	u64 mask = h->allocation_capacity-1;
+	u64 i = xx_hash((u64)a.p) & mask;
+	while (h->allocations[i].p) i = (i+1) & mask;
+	h->allocations[i] = a;
+}
+void heap_profile_table_insert(Heap_Profile_Allocation a) {
+	Heap_Profile *h = &heap_profile;
+	
+	// Keep load at or below 1/2
+	if ((h->stats.live_count+1)*2 > h->allocation_capacity) {
+		Heap_Profile_Allocation *old_allocations = h->allocations;
+		u64 old_capacity = h->allocation_capacity;
+		h->allocation_capacity = old_capacity ? old_capacity*2 : HEAP_PROFILE_TABLE_INITIAL_CAPACITY;
+		u64 table_size = align_next(h->allocation_capacity*sizeof(Heap_Profile_Allocation), os.page_size);
+		h->allocations = (Heap_Profile_Allocation*)os_reserve_virtual_memory(table_size);
+		assert(h->allocations, "Failed reserving memory for the heap profile allocation table");
+		bool ok = os_commit_virtual_memory(h->allocations, table_size);
+		assert(ok, "Failed committing memory for the heap profile allocation table");
+		
+		for (u64 i = 0; i < old_capacity; i++) {
+			if (old_allocations[i].p) heap_profile_table_insert_no_grow(h, old_allocations[i]);
+		}
+		if (old_allocations) {
+			os_release_virtual_memory(old_allocations, align_next(old_capacity*sizeof(Heap_Profile_Allocation), os.page_size));
+		}
+	}
+	
+	heap_profile_table_insert_no_grow(h, a);
+}
+void heap_profile_table_remove(Heap_Profile_Allocation *entry) {
+	Heap_Profile *h = &heap_profile;
+	u64 mask = h->allocation_capacity-1;
+	u64 hole = (u64)(entry-h->allocations);
+	
+	// Backward shift so probe chains don't break
+	u64 i = (hole+1) & mask;
+	while (h->allocations[i].p) {
+		u64 home = xx_hash((u64)h->allocations[i].p) & mask;
+		if (((i-home) & mask) >= ((i-hole) & mask)) {
+			h->allocations[hole] = h->allocations[i];
+			hole = i;
+		}
+		i = (i+1) & mask;
+	}
+	h->allocations[hole] = ZERO(Heap_Profile_Allocation);
+}
+
+// If callsite is 0, it's whatever was passed to heap_profile_set_callsite on this thread
+void heap_profile_record_alloc(void *p, u64 size, Heap_Profile_Callsite *callsite) {
+	f64 now = os_get_elapsed_seconds();
+	
+	spinlock_acquire_or_wait(&heap_profile_lock);
+	Heap_Profile *h = &heap_profile;
+	
+	if (!callsite) {
+		if (heap_profile_callsite_file) callsite = heap_profile_get_callsite(heap_profile_callsite_file, heap_profile_callsite_line);
+		else                            callsite = heap_profile_get_callsite("(unknown)", 0);
+	}
+	
+	Heap_Profile_Allocation a;
+	a.p = p;
+	a.size = size;
+	a.timestamp = now;
+	a.callsite = callsite;
+	heap_profile_table_insert(a);
+	
+	callsite->live_count += 1;
+	callsite->live_bytes += size;
+	callsite->peak_live_bytes = max(callsite->peak_live_bytes, callsite->live_bytes);
+	callsite->total_count += 1;
+	callsite->total_bytes += size;
+	
+	h->stats.live_count += 1;
+	h->stats.live_bytes += size;
+	h->stats.peak_live_bytes = max(h->stats.peak_live_bytes, h->stats.live_bytes);
+	h->stats.total_alloc_count += 1;
+	h->stats.total_alloc_bytes += size;
+	h->frame_alloc_count += 1;
+	h->frame_alloc_bytes += size;
+	
+	spinlock_release(&heap_profile_lock);
+}
+// Returns the callsite the allocation was made from
+Heap_Profile_Callsite *heap_profile_record_dealloc(void *p) {
+	spinlock_acquire_or_wait(&heap_profile_lock);
+	Heap_Profile *h = &heap_profile;
+	
+	Heap_Profile_Allocation *entry = heap_profile_table_find(p);
+	assert(entry, "Heap profiling: A pointer was deallocated that the heap allocator never handed out, or it was deallocated twice");
+	
+	Heap_Profile_Callsite *callsite = entry->callsite;
+	callsite->live_count -= 1;
+	callsite->live_bytes -= entry->size;
+	h->stats.live_count -= 1;
+	h->stats.live_bytes -= entry->size;
+	h->frame_dealloc_count += 1;
+	heap_profile_table_remove(entry);
+	
+	spinlock_release(&heap_profile_lock);
+	return callsite;
+}
+
+void heap_profile_end_frame() {
+	spinlock_acquire_or_wait(&heap_profile_lock);
+	Heap_Profile *h = &heap_profile;
+	h->stats.frame_count += 1;
+	h->stats.last_frame_alloc_count = h->frame_alloc_count;
+	h->stats.last_frame_alloc_bytes = h->frame_alloc_bytes;
+	h->stats.last_frame_dealloc_count = h->frame_dealloc_count;
+	h->stats.peak_frame_alloc_count = max(h->stats.peak_frame_alloc_count, h->frame_alloc_count);
+	h->stats.peak_frame_alloc_bytes = max(h->stats.peak_frame_alloc_bytes, h->frame_alloc_bytes);
+	h->frame_alloc_count = 0;
+	h->frame_alloc_bytes = 0;
+	h->frame_dealloc_count = 0;
+	spinlock_release(&heap_profile_lock);
+}
+
+Heap_Profile_Stats heap_profile_get_stats() {
+	spinlock_acquire_or_wait(&heap_profile_lock);
+	Heap_Profile_Stats stats = heap_profile.stats;
+	spinlock_release(&heap_profile_lock);
+	return stats;
+}
+
+// Counts are 0 if nothing was allocated from there
+Heap_Profile_Callsite heap_profile_get_callsite_stats(const char *file, u32 line) {
+	spinlock_acquire_or_wait(&heap_profile_lock);
+	Heap_Profile_Callsite callsite = *heap_profile_get_callsite(file, line);
+	spinlock_release(&heap_profile_lock);
+	return callsite;
+}
+
+void heap_profile_write_json_string(String_Builder *b, const char *s) {
+	string_builder_append(b, STR("\""));
+	for (; *s; s++) {
+		if (*s == '\\' || *s == '"') string_builder_append(b, STR("\\"));
+		string_builder_append(b, (string){1, (u8*)s});
+	}
+	string_builder_append(b, STR("\""));
+}
+
+bool heap_profile_dump_json(string path) {
+	Scratch scratch = scratch_begin();
+	String_Builder b;
+	string_builder_init_reserve(&b, KB(64), scratch.allocator);
+	
+	f64 now = os_get_elapsed_seconds();
+	
+	spinlock_acquire_or_wait(&heap_profile_lock);
+	Heap_Profile *h = &heap_profile;
+	Heap_Profile_Stats s = h->stats;
+	
+	string_builder_printf(&b, "{\n\t\"live_count\": %llu,\n\t\"live_bytes\": %llu,\n\t\"peak_live_bytes\": %llu,\n", s.live_count, s.live_bytes, s.peak_live_bytes);
+	string_builder_printf(&b, "\t\"frames\": {\"count\": %llu, \"last_alloc_count\": %llu, \"last_alloc_bytes\": %llu, \"last_dealloc_count\": %llu, \"peak_alloc_count\": %llu, \"peak_alloc_bytes\": %llu, \"average_alloc_count\": %.2f, \"average_alloc_bytes\": %.2f},\n",
+		s.frame_count, s.last_frame_alloc_count, s.last_frame_alloc_bytes, s.last_frame_dealloc_count,
+		s.peak_frame_alloc_count, s.peak_frame_alloc_bytes,
+		s.frame_count ? (f64)s.total_alloc_count/(f64)s.frame_count : 0.0,
+		s.frame_count ? (f64)s.total_alloc_bytes/(f64)s.frame_count : 0.0);
+	
+	// Callsites by live bytes, with the age of their oldest live allocation. Old allocations
+	// from a callsite that keeps growing are usually the leak.
+	Heap_Profile_Callsite **sorted = (Heap_Profile_Callsite**)alloc(scratch.allocator, sizeof(Heap_Profile_Callsite*)*(s.callsite_count+1));
+	u64 sorted_count = 0;
+	if (h->callsites) {
+		for (u64 i = 0; i < HEAP_PROFILE_MAX_CALLSITES; i++) {
+			Heap_Profile_Callsite *c = &h->callsites[i];
+			if (!c->file) continue;
+			c->oldest_live_timestamp = now;
+			
+			u64 j = sorted_count;
+			while (j > 0 && sorted[j-1]->live_bytes < c->live_bytes) {
+				sorted[j] = sorted[j-1];
+				j -= 1;
+			}
+			sorted[j] = c;
+			sorted_count += 1;
+		}
+	}
+	for (u64 i = 0; i < h->allocation_capacity; i++) {
+		Heap_Profile_Allocation *a = &h->allocations[i];
+		if (a->p) a->callsite->oldest_live_timestamp = min(a->callsite->oldest_live_timestamp, a->timestamp);
+	}
+	
+	string_builder_append(&b, STR("\t\"callsites\": [\n"));
+	for (u64 i = 0; i < sorted_count; i++) {
+		Heap_Profile_Callsite *c = sorted[i];
+		string_builder_append(&b, STR("\t\t{\"file\": "));
+		heap_profile_write_json_string(&b, c->file);
+		string_builder_printf(&b, ", \"line\": %u, \"live_count\": %llu, \"live_bytes\": %llu, \"peak_live_bytes\": %llu, \"total_count\": %llu, \"total_bytes\": %llu, \"oldest_live_age_seconds\": %.3f}%cs\n",
+			c->line, c->live_count, c->live_bytes, c->peak_live_bytes, c->total_count, c->total_bytes,
+			now-c->oldest_live_timestamp, i+1 < sorted_count ? "," : "");
+	}
+	string_builder_append(&b, STR("\t],\n"));
+	spinlock_release(&heap_profile_lock);
+	
+	// Free list fragmentation per heap block: 0 when all free memory is one node, towards 1
+	// when it's split up in many small nodes that can't fit bigger allocations.
+	string_builder_append(&b, STR("\t\"heap_blocks\": [\n"));
+	if (heap_initted) {
+		spinlock_acquire_or_wait(&heap_lock);
+		for (Heap_Block *block = heap_head; block; block = block->next) {
+			u64 free_bytes = 0;
+			u64 free_node_count = 0;
+			u64 largest_free_node = 0;
+			for (Heap_Free_Node *node = block->free_head; node; node = node->next) {
+				free_bytes += node->size;
+				free_node_count += 1;
+				largest_free_node = max(largest_free_node, node->size);
+			}
+			f64 fragmentation = free_bytes ? 1.0 - (f64)largest_free_node/(f64)free_bytes : 0.0;
+			string_builder_printf(&b, "\t\t{\"size\": %llu, \"free_bytes\": %llu, \"free_node_count\": %llu, \"largest_free_node\": %llu, \"fragmentation\": %.4f}%cs\n",
+				block->size, free_bytes, free_node_count, largest_free_node, fragmentation, block->next ? "," : "");
+		}
+		spinlock_release(&heap_lock);
+	}
+	string_builder_append(&b, STR("\t]\n}\n"));
+	
+	bool ok = os_write_entire_file_s(path, string_builder_get_string(b));
+	if (ok) log_verbose("Wrote heap profile to %s", path);
+	else    log_error("Failed writing heap profile to %s", path);
+	
+	scratch_end(scratch);
+	return ok;
+}
+
+#endif // ENABLE_HEAP_PROFILING
+
+///
+///
+// Allocation-free frames
+///
+// The steady state frame shouldn't touch the heap at all. Things like buffers that grow on
+// demand can sneak allocations back in though, so this can check for it:
+//
+//     frame_allocation_check_set_mode(FRAME_ALLOCATION_CHECK_REPORT); // Once loading is done
+//
+// From then on, os_update ends the previous frame and begins the next one, and every heap
+// allocation in between, on any thread, is counted. Reallocations count if they move.
+//     FRAME_ALLOCATION_CHECK_REPORT logs the first allocation of each frame with a stack trace,
+//                                   and a count at the end of the frame.
+//     FRAME_ALLOCATION_CHECK_TRAP   crashes with a stack trace on the first allocation. For CI.
+// If you don't use os_update, or want to check some other span, call frame_allocation_check_begin()
+// and frame_allocation_check_end() yourself.
+// Stack traces are only available in DEBUG.
+
+typedef enum Frame_Allocation_Check_Mode {
+	FRAME_ALLOCATION_CHECK_OFF,
+	FRAME_ALLOCATION_CHECK_REPORT,
+	FRAME_ALLOCATION_CHECK_TRAP,
+} Frame_Allocation_Check_Mode;
+
+typedef struct Frame_Allocation_Check_Stats {
+	u64 frame_count; // Checked frames
+	u64 frames_with_allocations;
+	u64 allocation_count;
+	u64 allocation_bytes;
+	u64 last_frame_allocation_count;
+	u64 last_frame_allocation_bytes;
+} Frame_Allocation_Check_Stats;
+
+typedef struct Frame_Allocation_Check {
+	Frame_Allocation_Check_Mode mode;
+	volatile bool in_frame;
+	volatile u64 frame_allocation_count;
+	volatile u64 frame_allocation_bytes;
+	Frame_Allocation_Check_Stats stats;
+} Frame_Allocation_Check;
+
+// #Global
+ogb_instance Frame_Allocation_Check frame_allocation_check;
+ogb_instance thread_local bool frame_allocation_check_is_reporting;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Frame_Allocation_Check frame_allocation_check = {0};
+// Getting the stack trace or logging must not end up reporting itself
+thread_local bool frame_allocation_check_is_reporting = false;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void frame_allocation_check_begin() {
+	frame_allocation_check.frame_allocation_count = 0;
+	frame_allocation_check.frame_allocation_bytes = 0;
+	MEMORY_BARRIER;
+	frame_allocation_check.in_frame = true;
+}
+// Returns the number of heap allocations since frame_allocation_check_begin
+u64 frame_allocation_check_end() {
+	Frame_Allocation_Check *f = &frame_allocation_check;
+	if (!f->in_frame) return 0;
+	f->in_frame = false;
+	MEMORY_BARRIER;
+	
+	u64 count = f->frame_allocation_count;
+	u64 bytes = f->frame_allocation_bytes;
+	f->stats.frame_count += 1;
+	f->stats.allocation_count += count;
+	f->stats.allocation_bytes += bytes;
+	f->stats.last_frame_allocation_count = count;
+	f->stats.last_frame_allocation_bytes = bytes;
+	if (count) {
+		f->stats.frames_with_allocations += 1;
+		if (f->mode == FRAME_ALLOCATION_CHECK_REPORT) {
+			log_warning("Frame made %llu heap allocations (%llu bytes)", count, bytes);
+		}
+	}
+	return count;
+}
+
+// Called by os_update
+void frame_allocation_check_next_frame() {
+	if (frame_allocation_check.in_frame) frame_allocation_check_end();
+	if (frame_allocation_check.mode != FRAME_ALLOCATION_CHECK_OFF) frame_allocation_check_begin();
+}
+
+void frame_allocation_check_set_mode(Frame_Allocation_Check_Mode mode) {
+	frame_allocation_check.mode = mode;
+	if (mode == FRAME_ALLOCATION_CHECK_OFF) frame_allocation_check_end();
+}
+
+Frame_Allocation_Check_Stats frame_allocation_check_get_stats() {
+	return frame_allocation_check.stats;
+}
+
+// Called by the heap allocator for every allocation
+void frame_allocation_check_record(u64 size) {
+	Frame_Allocation_Check *f = &frame_allocation_check;
+	if (!f->in_frame || frame_allocation_check_is_reporting) return;
+	
+	u64 previous_count = atomic_add_64(&f->frame_allocation_count, 1);
+	atomic_add_64(&f->frame_allocation_bytes, size);
+	
+	if (f->mode == FRAME_ALLOCATION_CHECK_OFF) return;
+	if (previous_count > 0 && f->mode != FRAME_ALLOCATION_CHECK_TRAP) return;
+	
+	frame_allocation_check_is_reporting = true;
+	
+	u64 trace_count;
+	string *trace = os_get_stack_trace(&trace_count, get_temporary_allocator());
+	log_warning("Heap allocation of %llu bytes in a frame that should be allocation-free. Stack trace:", size);
+	for (u64 i = 0; i < trace_count; i++) {
+		log_warning("    %s", trace[i]);
+	}
+	
+	frame_allocation_check_is_reporting = false;
+	
+	if (f->mode == FRAME_ALLOCATION_CHECK_TRAP) {
+		panic("Heap allocation in a frame that should be allocation-free, see the stack trace above");
+	}
 }
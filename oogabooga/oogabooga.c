@@ -126,6 +126,22 @@
 					tm_scope_var
 					tm_scope_accum
 					
+		- ENABLE_HEAP_PROFILING
+			Record the callsite, size & time of every heap allocation. Live bytes by callsite,
+			allocations per frame and heap block fragmentation are dumped to heap_profile.json
+			on exit, or whenever you call heap_profile_dump_json().
+			Allocations are slower with this enabled, and it costs nothing when disabled.
+		
+			0: Disable
+			1: Enable
+			
+			Example:
+			
+				#define ENABLE_HEAP_PROFILING 1
+				
+			Note:
+				See Heap profiling in memory.c
+					
 		- OOGABOOGA_HEADLESS
             Run oogabooga in headless mode, i.e. no window, no graphics, no audio.
             Useful if you only need the oogabooga standard library for something like a game server.
@@ -136,6 +152,19 @@
             Example:
             
                 #define OOGABOOGA_HEADLESS 1
+				
+		- GFX_RENDERER
+			Which renderer to use. Defaults to GFX_RENDERER_D3D11 (windows is the only supported os).
+			
+			GFX_RENDERER_D3D11:    Direct3D 11
+			GFX_RENDERER_SOFTWARE: Rasterizes on the cpu, see gfx_impl_software.c. Useful for
+			                       rendering on windows machines without a gpu, like build servers.
+			GFX_RENDERER_NULL:     Processes quads like d3d11 but draws nothing, and counts uploads,
+			                       draw calls & texture binds instead. See gfx_impl_null.c.
+			
+			Example:
+			
+				#define GFX_RENDERER GFX_RENDERER_SOFTWARE
 */
 
 #define OGB_VERSION_MAJOR 0
@@ -223,6 +252,10 @@ typedef u8 bool;
     #define INITIAL_PROGRAM_MEMORY_SIZE MB(5)
 #endif
 
+#ifndef ENABLE_HEAP_PROFILING
+	#define ENABLE_HEAP_PROFILING 0
+#endif
+
 #if ENABLE_SIMD && !defined(SIMD_ENABLE_SSE2)
 	#if COMPILER_CAN_DO_SSE2
 		#define SIMD_ENABLE_SSE2 1
@@ -290,6 +323,8 @@ typedef u8 bool;
 #define GFX_RENDERER_D3D11  0
 #define GFX_RENDERER_VULKAN 1
 #define GFX_RENDERER_METAL  2
+#define GFX_RENDERER_SOFTWARE 3
+#define GFX_RENDERER_NULL     4
 #ifndef GFX_RENDERER
 // #Portability
 	#if TARGET_OS == WINDOWS
@@ -332,6 +367,7 @@ typedef u8 bool;
 #include "random.c"
 #include "color.c"
 #include "memory.c"
+#include "sort.c"
 #include "input.c"
 
 #ifndef OOGABOOGA_HEADLESS
@@ -341,6 +377,8 @@ typedef u8 bool;
     #include "font.c"
 
     #include "drawing.c"
+    #include "draw_capture.c"
+    #include "texture_atlas.c"
 
     #include "audio.c"
 #endif
@@ -365,11 +403,17 @@ typedef u8 bool;
     #ifndef OOGABOOGA_HEADLESS
         // #Portability
         #if GFX_RENDERER == GFX_RENDERER_D3D11
+            #include "gfx_quad_processing.c"
             #include "gfx_impl_d3d11.c"
+        #elif GFX_RENDERER == GFX_RENDERER_SOFTWARE
+            #include "gfx_impl_software.c"
+        #elif GFX_RENDERER == GFX_RENDERER_NULL
+            #include "gfx_quad_processing.c"
+            #include "gfx_impl_null.c"
         #elif GFX_RENDERER == GFX_RENDERER_VULKAN
-            #error "We only have a D3D11 renderer at the moment"
+            #error "We only have D3D11, software & null renderers at the moment"
         #elif GFX_RENDERER == GFX_RENDERER_METAL
-            #error "We only have a D3D11 renderer at the moment"
+            #error "We only have D3D11, software & null renderers at the moment"
         #else
             #error "Unknown renderer GFX_RENDERER defined"
         #endif
@@ -471,6 +515,12 @@ int main(int argc, char **argv) {
 	
 	dump_profile_result();
 	
+#endif
+
+#if ENABLE_HEAP_PROFILING
+	
+	heap_profile_dump_json(STR("heap_profile.json"));
+	
 #endif
 	
 	// This is so any threads waiting for window to close will close on exit
@@ -21,6 +21,7 @@
 #define VIRTUAL_MEMORY_BASE ((void*)0x0000690000000000ULL)
 void* heap_alloc(u64);
 void heap_dealloc(void*);
+void heap_thread_cache_flush();
 
 u16 *win32_fixed_utf8_to_null_terminated_wide(string utf8, Allocator allocator) {
 
@@ -618,7 +619,12 @@ DWORD WINAPI win32_thread_invoker(LPVOID param) {
 	
 	t->proc(t);
 	
-	heap_dealloc(temporary_storage);
+	log_verbose("Thread %llu used at most %llu bytes of temporary storage", t->id, temporary_storage_get_stats().high_water);
+	temporary_storage_destroy();
+#ifndef OOGABOOGA_HEADLESS
+	text_layout_cache_destroy();
+#endif
+	heap_thread_cache_flush();
 	
 	return 0;
 }
@@ -1432,6 +1438,9 @@ os_unlock_program_memory_pages(void *start, u64 size) {
 	// Probably super slow but this shouldn't happen often at all + it's only in debug.
 	// - Charlie M 28th July 2024
 	for (u8 *p = (u8*)start; p < (u8*)start+size; p += os.page_size) {
+		// Free heap memory may have been decommitted by heap_trim
+		MEMORY_BASIC_INFORMATION info;
+		if (VirtualQuery(p, &info, sizeof(info)) && info.State != MEM_COMMIT) continue;
 		DWORD old_protect = PAGE_NOACCESS;
 		BOOL ok = VirtualProtect(p, os.page_size, PAGE_READWRITE, &old_protect);
 		assert(ok, "VirtualProtect Failed with error %d", GetLastError());
@@ -1448,6 +1457,8 @@ os_lock_program_memory_pages(void *start, u64 size) {
 	// Probably super slow but this shouldn't happen often at all + it's only in debug.
 	// - Charlie M 28th July 2024
 	for (u8 *p = (u8*)start; p < (u8*)start+size; p += os.page_size) {
+		MEMORY_BASIC_INFORMATION info;
+		if (VirtualQuery(p, &info, sizeof(info)) && info.State != MEM_COMMIT) continue;
 		DWORD old_protect = PAGE_READWRITE;
 		BOOL ok = VirtualProtect(p, os.page_size, PAGE_NOACCESS, &old_protect);
 		assert(ok, "VirtualProtect Failed with error %d", GetLastError());
@@ -1455,6 +1466,76 @@ os_lock_program_memory_pages(void *start, u64 size) {
 #endif
 }
 
+// VirtualQuery gives us runs of pages with the same state that never cross the regions
+// program memory was allocated in, so we go one run at a time.
+u64
+os_decommit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	
+	u64 decommitted = 0;
+	u8 *p = (u8*)start;
+	u8 *end = (u8*)start+size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T ok = VirtualQuery(p, &info, sizeof(info));
+		assert(ok, "VirtualQuery Failed with error %d", GetLastError());
+		u8 *run_end = min((u8*)info.BaseAddress+info.RegionSize, end);
+		if (info.State == MEM_COMMIT) {
+			BOOL freed = VirtualFree(p, (u64)(run_end-p), MEM_DECOMMIT);
+			assert(freed, "VirtualFree Failed with error %d", GetLastError());
+			decommitted += (u64)(run_end-p);
+		}
+		p = run_end;
+	}
+	return decommitted;
+}
+bool
+os_commit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory pages, the size must be aligned to page_size");
+	
+	u8 *p = (u8*)start;
+	u8 *end = (u8*)start+size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T ok = VirtualQuery(p, &info, sizeof(info));
+		assert(ok, "VirtualQuery Failed with error %d", GetLastError());
+		u8 *run_end = min((u8*)info.BaseAddress+info.RegionSize, end);
+		if (info.State != MEM_COMMIT) {
+			if (!VirtualAlloc(p, (u64)(run_end-p), MEM_COMMIT, PAGE_READWRITE)) return false;
+		}
+		p = run_end;
+	}
+	return true;
+}
+
+void*
+os_reserve_virtual_memory(u64 size) {
+	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_virtual_memory");
+	return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+bool
+os_commit_virtual_memory(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory pages, the size must be aligned to page_size");
+	return VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+}
+void
+os_decommit_virtual_memory(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	BOOL ok = VirtualFree(start, size, MEM_DECOMMIT);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+void
+os_release_virtual_memory(void *start, u64 size) {
+	// MEM_RELEASE wants size 0 and frees the whole reservation
+	(void)size;
+	BOOL ok = VirtualFree(start, 0, MEM_RELEASE);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+
 ///
 ///
 // Mouse pointer
@@ -1931,6 +2012,11 @@ void os_update() {
 
 	has_os_update_been_called_at_all = true;
 
+#if ENABLE_HEAP_PROFILING
+	heap_profile_end_frame();
+#endif
+	frame_allocation_check_next_frame();
+
 	win32_do_handle_raw_input = true;
 #ifndef OOGABOOGA_HEADLESS
 	window.dpi = window.monitor->dpi;
@@ -127,7 +127,7 @@ typedef struct Thread {
 	u64 id; // This is valid after os_thread_start
 	Context initial_context;
 	void* data;
-	u64 temporary_storage_size; // Defaults to KB(10)
+	u64 temporary_storage_size; // Committed up front, grows as needed. Defaults to KB(10)
 	Thread_Proc proc;
 	Thread_Handle os_handle;
 	
@@ -486,6 +486,27 @@ void ogb_instance
 os_unlock_program_memory_pages(void *start, u64 size);
 void ogb_instance
 os_lock_program_memory_pages(void *start, u64 size);
+// For giving unused program memory back to the OS and taking it back when it's needed again,
+// see heap_trim(). Ranges may cross the OS regions program memory is made of.
+// Pages that are committed again are zero. Returns how many bytes were actually decommitted.
+ogb_instance u64
+os_decommit_program_memory_pages(void *start, u64 size);
+ogb_instance bool
+os_commit_program_memory_pages(void *start, u64 size);
+
+// Raw virtual memory, separate from the program memory that the heap lives in.
+// Reserve a big range up front and commit pages of it as you need them, so memory can
+// grow without ever moving. All sizes & addresses must be aligned to os.page_size.
+// Committed pages are zero initialized by the OS.
+ogb_instance void*
+os_reserve_virtual_memory(u64 size);
+ogb_instance bool
+os_commit_virtual_memory(void *start, u64 size);
+ogb_instance void
+os_decommit_virtual_memory(void *start, u64 size);
+// Releases the whole range returned by os_reserve_virtual_memory
+ogb_instance void
+os_release_virtual_memory(void *start, u64 size);
 
 ///
 ///
@@ -0,0 +1,340 @@
+
+/*
+
+	Parallel LSD radix sorts for integer keys.
+
+	These split the work between the parallel_for threads (see concurrency.c) when there are
+	enough items for it to pay off, otherwise they just run on the calling thread.
+	All sorts are stable and only look at bits [first_bit, first_bit+number_of_bits) of the key,
+	so you can sort by a bit range of a bigger key (see Z sorting in drawing.c).
+	Keys are treated as unsigned.
+	Passes where all keys have the same digit are skipped, so sorting keys which only differ in
+	a few bits is a lot cheaper than the number of bits suggests.
+
+	Example Usage:
+
+		// Plain keys
+		u64 *keys = ...;
+		u64 *help_buffer = alloc(allocator, sizeof(u64)*count);
+		radix_sort_u64(keys, help_buffer, count, 0, 64);
+
+		// Keys with a payload index, for example to sort entities by some value and then
+		// iterate them in that order.
+		u32 *keys    = alloc(allocator, sizeof(u32)*count);
+		u32 *indices = alloc(allocator, sizeof(u32)*count);
+		u32 *help_keys    = alloc(allocator, sizeof(u32)*count);
+		u32 *help_indices = alloc(allocator, sizeof(u32)*count);
+		for (u32 i = 0; i < count; i++) {
+			keys[i] = entities[i].sort_value;
+			indices[i] = i;
+		}
+		radix_sort_u32_with_indices(keys, indices, help_keys, help_indices, count, 0, 32);
+		for (u32 i = 0; i < count; i++) {
+			Entity *e = &entities[indices[i]];
+			...
+		}
+
+		// Key + value pairs
+		Radix_Key_Value_U64 *pairs = ...;
+		Radix_Key_Value_U64 *help_pairs = alloc(allocator, sizeof(Radix_Key_Value_U64)*count);
+		radix_sort_key_values_u64(pairs, help_pairs, count, 0, 64);
+
+	Help buffers need room for item_count items of the same type as what's being sorted.
+	The result always ends up in the original arrays.
+
+*/
+
+typedef struct Radix_Key_Value_U64 {
+	u64 key;
+	u64 value;
+} Radix_Key_Value_U64;
+
+void ogb_instance
+radix_sort_u32(u32 *keys, u32 *help_buffer, u64 item_count, u64 first_bit, u64 number_of_bits);
+
+void ogb_instance
+radix_sort_u64(u64 *keys, u64 *help_buffer, u64 item_count, u64 first_bit, u64 number_of_bits);
+
+void ogb_instance
+radix_sort_u32_with_indices(u32 *keys, u32 *indices, u32 *help_keys, u32 *help_indices, u64 item_count, u64 first_bit, u64 number_of_bits);
+
+void ogb_instance
+radix_sort_u64_with_indices(u64 *keys, u32 *indices, u64 *help_keys, u32 *help_indices, u64 item_count, u64 first_bit, u64 number_of_bits);
+
+void ogb_instance
+radix_sort_key_values_u64(Radix_Key_Value_U64 *items, Radix_Key_Value_U64 *help_buffer, u64 item_count, u64 first_bit, u64 number_of_bits);
+
+// Below this many items per thread it's not worth waking up the workers.
+#define RADIX_SORT_MIN_ITEMS_PER_TASK 16384
+#define RADIX_SORT_MAX_TASKS 16
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+#define RADIX_SORT_RADIX 256
+#define RADIX_SORT_BITS_PER_PASS 8
+#define RADIX_SORT_MAX_PASSES 8
+
+typedef enum Radix_Sort_Layout {
+	RADIX_SORT_LAYOUT_U32,
+	RADIX_SORT_LAYOUT_U64,
+	RADIX_SORT_LAYOUT_KEY_VALUE_U64,
+} Radix_Sort_Layout;
+
+typedef struct Radix_Sort_State {
+	Radix_Sort_Layout layout;
+
+	void *src;
+	void *dst;
+	u32 *src_indices; // Optional
+	u32 *dst_indices;
+
+	u64 item_count;
+	u64 task_count;
+	u64 items_per_task;
+
+	u64 first_bit;
+	u64 pass_count;
+	u64 last_pass_mask;
+
+	// Per pass when computing histograms for all passes, otherwise the pass being sorted.
+	u64 pass;
+
+	// [task][pass][digit]
+	// Counts while computing histograms, then offsets into dst while scattering.
+	u64 *task_histograms;
+	u64 totals[RADIX_SORT_MAX_PASSES][RADIX_SORT_RADIX];
+	Spinlock totals_lock;
+} Radix_Sort_State;
+
+inline u64 radix_sort_get_key(Radix_Sort_Layout layout, void *items, u64 i) {
+	switch (layout) {
+		case RADIX_SORT_LAYOUT_U32:           return ((u32*)items)[i];
+		case RADIX_SORT_LAYOUT_U64:           return ((u64*)items)[i];
+		case RADIX_SORT_LAYOUT_KEY_VALUE_U64: return ((Radix_Key_Value_U64*)items)[i].key;
+	}
+	return 0;
+}
+inline u64 radix_sort_get_pass_mask(Radix_Sort_State *s, u64 pass) {
+	return pass == s->pass_count-1 ? s->last_pass_mask : RADIX_SORT_RADIX-1;
+}
+inline u64 *radix_sort_get_task_histogram(Radix_Sort_State *s, u64 task, u64 pass) {
+	return s->task_histograms + (task*RADIX_SORT_MAX_PASSES + pass)*RADIX_SORT_RADIX;
+}
+
+// Counts digits of all passes in one go, since we need to read all the keys anyways.
+void radix_sort_histogram_all_passes_job(u64 task, void *data) {
+	Radix_Sort_State *s = (Radix_Sort_State*)data;
+
+	u64 first = task*s->items_per_task;
+	u64 last = min(first+s->items_per_task, s->item_count);
+
+	u64 counts[RADIX_SORT_MAX_PASSES][RADIX_SORT_RADIX];
+	memset(counts, 0, sizeof(u64)*RADIX_SORT_RADIX*s->pass_count);
+
+	for (u64 i = first; i < last; i++) {
+		u64 key = radix_sort_get_key(s->layout, s->src, i) >> s->first_bit;
+		for (u64 pass = 0; pass < s->pass_count; pass++) {
+			counts[pass][(key >> (pass*RADIX_SORT_BITS_PER_PASS)) & radix_sort_get_pass_mask(s, pass)] += 1;
+		}
+	}
+
+	for (u64 pass = 0; pass < s->pass_count; pass++) {
+		memcpy(radix_sort_get_task_histogram(s, task, pass), counts[pass], sizeof(counts[pass]));
+	}
+
+	spinlock_acquire_or_wait(&s->totals_lock);
+	for (u64 pass = 0; pass < s->pass_count; pass++) {
+		for (u64 digit = 0; digit < RADIX_SORT_RADIX; digit++) {
+			s->totals[pass][digit] += counts[pass][digit];
+		}
+	}
+	spinlock_release(&s->totals_lock);
+}
+
+// After the first executed pass the items have moved, so the per task counts of later passes
+// need to be recomputed. The totals stay the same.
+void radix_sort_histogram_job(u64 task, void *data) {
+	Radix_Sort_State *s = (Radix_Sort_State*)data;
+
+	u64 first = task*s->items_per_task;
+	u64 last = min(first+s->items_per_task, s->item_count);
+
+	u64 shift = s->first_bit + s->pass*RADIX_SORT_BITS_PER_PASS;
+	u64 mask = radix_sort_get_pass_mask(s, s->pass);
+
+	u64 *counts = radix_sort_get_task_histogram(s, task, s->pass);
+	memset(counts, 0, sizeof(u64)*RADIX_SORT_RADIX);
+
+	for (u64 i = first; i < last; i++) {
+		counts[(radix_sort_get_key(s->layout, s->src, i) >> shift) & mask] += 1;
+	}
+}
+
+void radix_sort_scatter_job(u64 task, void *data) {
+	Radix_Sort_State *s = (Radix_Sort_State*)data;
+
+	u64 first = task*s->items_per_task;
+	u64 last = min(first+s->items_per_task, s->item_count);
+
+	u64 shift = s->first_bit + s->pass*RADIX_SORT_BITS_PER_PASS;
+	u64 mask = radix_sort_get_pass_mask(s, s->pass);
+
+	u64 offsets[RADIX_SORT_RADIX];
+	memcpy(offsets, radix_sort_get_task_histogram(s, task, s->pass), sizeof(offsets));
+
+	// The switch is outside the loop so each layout gets its own tight loop
+	switch (s->layout) {
+		case RADIX_SORT_LAYOUT_U32: {
+			u32 *src = (u32*)s->src;
+			u32 *dst = (u32*)s->dst;
+			if (s->src_indices) {
+				for (u64 i = first; i < last; i++) {
+					u64 dst_index = offsets[(src[i] >> shift) & mask]++;
+					dst[dst_index] = src[i];
+					s->dst_indices[dst_index] = s->src_indices[i];
+				}
+			} else {
+				for (u64 i = first; i < last; i++) {
+					dst[offsets[(src[i] >> shift) & mask]++] = src[i];
+				}
+			}
+			break;
+		}
+		case RADIX_SORT_LAYOUT_U64: {
+			u64 *src = (u64*)s->src;
+			u64 *dst = (u64*)s->dst;
+			if (s->src_indices) {
+				for (u64 i = first; i < last; i++) {
+					u64 dst_index = offsets[(src[i] >> shift) & mask]++;
+					dst[dst_index] = src[i];
+					s->dst_indices[dst_index] = s->src_indices[i];
+				}
+			} else {
+				for (u64 i = first; i < last; i++) {
+					dst[offsets[(src[i] >> shift) & mask]++] = src[i];
+				}
+			}
+			break;
+		}
+		case RADIX_SORT_LAYOUT_KEY_VALUE_U64: {
+			Radix_Key_Value_U64 *src = (Radix_Key_Value_U64*)s->src;
+			Radix_Key_Value_U64 *dst = (Radix_Key_Value_U64*)s->dst;
+			for (u64 i = first; i < last; i++) {
+				dst[offsets[(src[i].key >> shift) & mask]++] = src[i];
+			}
+			break;
+		}
+	}
+}
+
+void radix_sort_internal(Radix_Sort_Layout layout, void *items, u32 *indices, void *help_buffer, u32 *help_indices, u64 item_count, u64 first_bit, u64 number_of_bits) {
+	u64 item_size = 0;
+	u64 key_bits = 0;
+	switch (layout) {
+		case RADIX_SORT_LAYOUT_U32:           item_size = sizeof(u32);                 key_bits = 32; break;
+		case RADIX_SORT_LAYOUT_U64:           item_size = sizeof(u64);                 key_bits = 64; break;
+		case RADIX_SORT_LAYOUT_KEY_VALUE_U64: item_size = sizeof(Radix_Key_Value_U64); key_bits = 64; break;
+	}
+
+	assert(first_bit + number_of_bits <= key_bits, "Bit range [%i, %i) is out of range for %i bit keys", first_bit, first_bit+number_of_bits, key_bits);
+	assert(!indices || item_count <= 0xFFFFFFFFULL, "Too many items to sort with u32 indices (%i)", item_count);
+	assert(!indices || help_indices, "help_indices is required when sorting with indices");
+
+	if (item_count <= 1 || number_of_bits == 0) return;
+
+	// Big allocations, keep it off the stack. This runs every frame for z sorting, so it
+	// goes on scratch memory instead of the heap.
+	Scratch scratch = scratch_begin();
+	Radix_Sort_State *s = alloc(scratch.allocator, sizeof(Radix_Sort_State));
+	memset(s, 0, sizeof(Radix_Sort_State));
+
+	s->layout = layout;
+	s->src = items;
+	s->dst = help_buffer;
+	s->src_indices = indices;
+	s->dst_indices = help_indices;
+	s->item_count = item_count;
+	s->first_bit = first_bit;
+	s->pass_count = (number_of_bits + RADIX_SORT_BITS_PER_PASS - 1) / RADIX_SORT_BITS_PER_PASS;
+
+	u64 last_pass_bits = number_of_bits - (s->pass_count-1)*RADIX_SORT_BITS_PER_PASS;
+	s->last_pass_mask = (1ULL << last_pass_bits)-1;
+
+	// Don't start the worker pool for sorts that run as one task anyways
+	s->task_count = 1;
+	if (item_count > RADIX_SORT_MIN_ITEMS_PER_TASK) {
+		u64 max_tasks = min(parallel_for_get_thread_count(), RADIX_SORT_MAX_TASKS);
+		s->task_count = clamp(item_count/RADIX_SORT_MIN_ITEMS_PER_TASK, 1, max_tasks);
+	}
+	s->items_per_task = (item_count + s->task_count - 1) / s->task_count;
+
+	spinlock_init(&s->totals_lock);
+
+	s->task_histograms = alloc(scratch.allocator, sizeof(u64)*RADIX_SORT_RADIX*RADIX_SORT_MAX_PASSES*s->task_count);
+
+	parallel_for(s->task_count, radix_sort_histogram_all_passes_job, s);
+
+	bool task_histograms_are_fresh = true;
+	for (u64 pass = 0; pass < s->pass_count; pass++) {
+
+		// If all items have the same digit this pass wouldn't move anything
+		bool skip = false;
+		for (u64 digit = 0; digit < RADIX_SORT_RADIX; digit++) {
+			if (s->totals[pass][digit] == item_count) {
+				skip = true;
+				break;
+			}
+		}
+		if (skip) continue;
+
+		s->pass = pass;
+
+		if (!task_histograms_are_fresh) {
+			parallel_for(s->task_count, radix_sort_histogram_job, s);
+		}
+
+		// Turn counts into offsets. Task n writes each digit after all earlier tasks, which
+		// keeps the sort stable.
+		u64 offset = 0;
+		for (u64 digit = 0; digit < RADIX_SORT_RADIX; digit++) {
+			for (u64 task = 0; task < s->task_count; task++) {
+				u64 *histogram = radix_sort_get_task_histogram(s, task, pass);
+				u64 count = histogram[digit];
+				histogram[digit] = offset;
+				offset += count;
+			}
+		}
+
+		parallel_for(s->task_count, radix_sort_scatter_job, s);
+
+		void *temp = s->src; s->src = s->dst; s->dst = temp;
+		u32 *temp_indices = s->src_indices; s->src_indices = s->dst_indices; s->dst_indices = temp_indices;
+
+		task_histograms_are_fresh = false;
+	}
+
+	if (s->src != items) {
+		memcpy(items, s->src, item_count*item_size);
+		if (indices) memcpy(indices, s->src_indices, item_count*sizeof(u32));
+	}
+
+	scratch_end(scratch);
+}
+
+void radix_sort_u32(u32 *keys, u32 *help_buffer, u64 item_count, u64 first_bit, u64 number_of_bits) {
+	radix_sort_internal(RADIX_SORT_LAYOUT_U32, keys, 0, help_buffer, 0, item_count, first_bit, number_of_bits);
+}
+void radix_sort_u64(u64 *keys, u64 *help_buffer, u64 item_count, u64 first_bit, u64 number_of_bits) {
+	radix_sort_internal(RADIX_SORT_LAYOUT_U64, keys, 0, help_buffer, 0, item_count, first_bit, number_of_bits);
+}
+void radix_sort_u32_with_indices(u32 *keys, u32 *indices, u32 *help_keys, u32 *help_indices, u64 item_count, u64 first_bit, u64 number_of_bits) {
+	radix_sort_internal(RADIX_SORT_LAYOUT_U32, keys, indices, help_keys, help_indices, item_count, first_bit, number_of_bits);
+}
+void radix_sort_u64_with_indices(u64 *keys, u32 *indices, u64 *help_keys, u32 *help_indices, u64 item_count, u64 first_bit, u64 number_of_bits) {
+	radix_sort_internal(RADIX_SORT_LAYOUT_U64, keys, indices, help_keys, help_indices, item_count, first_bit, number_of_bits);
+}
+void radix_sort_key_values_u64(Radix_Key_Value_U64 *items, Radix_Key_Value_U64 *help_buffer, u64 item_count, u64 first_bit, u64 number_of_bits) {
+	radix_sort_internal(RADIX_SORT_LAYOUT_KEY_VALUE_U64, items, 0, help_buffer, 0, item_count, first_bit, number_of_bits);
+}
+
+#endif // !OOGABOOGA_LINK_EXTERNAL_INSTANCE
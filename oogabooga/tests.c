@@ -258,6 +258,514 @@ void test_allocator_threaded(Thread *t) {
     }
 }
 
+typedef struct Heap_Benchmark_Thread_Data {
+    u64 seed;
+    u64 iterations;
+    u64 size_offset;
+    void *live[64];
+} Heap_Benchmark_Thread_Data;
+void heap_benchmark_thread_proc(Thread *t) {
+    Heap_Benchmark_Thread_Data *data = (Heap_Benchmark_Thread_Data*)t->data;
+    Allocator heap = get_heap_allocator();
+    seed_for_random = data->seed;
+
+    for (u64 i = 0; i < data->iterations; i++) {
+        u64 r = get_random();
+        u64 index = r % 64;
+        if (data->live[index]) {
+            u8 *p = (u8*)data->live[index];
+            assert(p[0] == (u8)index, "Failed: Heap memory was corrupted by another thread");
+            dealloc(heap, p);
+        }
+        u64 size = data->size_offset + 16 + (r >> 32) % 1024;
+        u8 *p = (u8*)alloc(heap, size);
+        p[0] = (u8)index;
+        p[size-1] = (u8)index;
+        data->live[index] = p;
+    }
+}
+f64 heap_benchmark(u64 thread_count, u64 iterations, u64 size_offset) {
+    Allocator heap = get_heap_allocator();
+    Thread threads[8];
+    Heap_Benchmark_Thread_Data datas[8];
+    assert(thread_count <= 8);
+
+    f64 start = os_get_elapsed_seconds();
+    for (u64 i = 0; i < thread_count; i++) {
+        datas[i] = ZERO(Heap_Benchmark_Thread_Data);
+        datas[i].seed = i+1;
+        datas[i].iterations = iterations;
+        datas[i].size_offset = size_offset;
+        os_thread_init(&threads[i], heap_benchmark_thread_proc);
+        threads[i].data = &datas[i];
+        os_thread_start(&threads[i]);
+    }
+    for (u64 i = 0; i < thread_count; i++) {
+        os_thread_join(&threads[i]);
+        os_thread_destroy(&threads[i]);
+    }
+    f64 seconds = os_get_elapsed_seconds() - start;
+
+    // Whatever is left is freed on this thread instead
+    for (u64 i = 0; i < thread_count; i++) {
+        for (u64 j = 0; j < 64; j++) {
+            if (datas[i].live[j]) dealloc(heap, datas[i].live[j]);
+        }
+    }
+
+    return seconds;
+}
+void test_heap_size_classes() {
+    Allocator heap = get_heap_allocator();
+
+    for (u64 size = 0; size <= HEAP_MAX_SMALL_SIZE; size += HEAP_ALIGNMENT) {
+        u64 class_index = heap_size_class_lookup[size/HEAP_ALIGNMENT];
+        assert(heap_size_classes[class_index].slot_size >= size, "Failed: Size class too small for %llu bytes", size);
+        assert(class_index == 0 || heap_size_classes[class_index-1].slot_size < size, "Failed: Size %llu not in the smallest class that fits", size);
+    }
+
+    // The thread cache hands back what was just freed
+    void *a = alloc(heap, 40);
+    dealloc(heap, a);
+    void *b = alloc(heap, 40);
+    assert(a == b, "Failed: Expected the freed slot to be reused");
+
+    // Reallocating within the size class keeps the slot
+    void *c = heap_allocator_proc(48, b, ALLOCATOR_REALLOCATE, 0);
+    assert(b == c, "Failed: Reallocating within the size class should not move");
+    memset(c, 0xAB, 48);
+    void *d = heap_allocator_proc(4000, c, ALLOCATOR_REALLOCATE, 0);
+    assert(d != c && ((u8*)d)[47] == 0xAB, "Failed: Reallocating to a bigger class should move and copy");
+    dealloc(heap, d);
+
+    // Small and large allocations next to each other
+    void *small = alloc(heap, 100);
+    void *large = alloc(heap, HEAP_MAX_SMALL_SIZE*2);
+    memset(small, 1, 100);
+    memset(large, 2, HEAP_MAX_SMALL_SIZE*2);
+    dealloc(heap, small);
+    dealloc(heap, large);
+
+    u64 thread_count = clamp(os_get_number_of_logical_processors(), 2, 8);
+    const u64 iterations = 200000;
+    f64 small_seconds = heap_benchmark(thread_count, iterations, 0);
+    // Same thing but all past HEAP_MAX_SMALL_SIZE, which is what every allocation used to go through
+    f64 large_seconds = heap_benchmark(thread_count, iterations/100, HEAP_MAX_SMALL_SIZE);
+
+    f64 ops = (f64)(thread_count*iterations);
+    print("%llu threads: %.2f M alloc/free per second with size classes, %.2f M with the block heap... ",
+        thread_count,
+        ops/small_seconds/1000000.0,
+        (ops/100.0)/large_seconds/1000000.0
+    );
+}
+
+void test_heap_large_allocations() {
+    Allocator heap = get_heap_allocator();
+    const u64 threshold = HEAP_LARGE_ALLOCATION_THRESHOLD;
+
+    Heap_Stats before = heap_get_stats();
+
+    u8 *a = (u8*)alloc(heap, threshold);
+    u8 *b = (u8*)alloc(heap, threshold*3+1);
+    assert(!is_pointer_in_program_memory(a) && !is_pointer_in_program_memory(b), "Failed: Large allocations should get their own virtual memory");
+    assert((u64)a % os.page_size == 0 && (u64)b % os.page_size == 0, "Failed: Large allocations should be page aligned");
+    assert(is_pointer_valid(b+threshold), "Failed: Pointer into a large allocation should be valid");
+    a[0] = 1;
+    a[threshold-1] = 2;
+    b[threshold*3] = 3;
+
+    Heap_Stats stats = heap_get_stats();
+    assert(stats.large_allocation_count == before.large_allocation_count+2, "Failed: Expected 2 more large allocations, got %llu", stats.large_allocation_count-before.large_allocation_count);
+    assert(stats.large_allocation_bytes >= before.large_allocation_bytes+threshold*4+1, "Failed: Large allocation bytes not counted");
+    assert(stats.large_allocation_peak_bytes >= stats.large_allocation_bytes, "Failed: Peak below current");
+    assert(stats.block_bytes == before.block_bytes, "Failed: Large allocations should not grow the block heap");
+
+    // Growing within the committed pages doesn't move
+    u8 *b2 = (u8*)heap_allocator_proc(threshold*3+2, b, ALLOCATOR_REALLOCATE, 0);
+    assert(b2 == b && b2[threshold*3] == 3, "Failed: Expected reallocation within the same pages to keep the pointer");
+
+    u8 *a2 = (u8*)heap_allocator_proc(threshold*2, a, ALLOCATOR_REALLOCATE, 0);
+    assert(a2[0] == 1 && a2[threshold-1] == 2, "Failed: Large reallocation did not copy");
+
+    // Shrinking below the threshold goes back to the heap
+    u8 *a3 = (u8*)heap_allocator_proc(100, a2, ALLOCATOR_REALLOCATE, 0);
+    assert(is_pointer_in_program_memory(a3) && a3[0] == 1, "Failed: Expected a small reallocation to move back to the heap");
+
+    dealloc(heap, a3);
+    dealloc(heap, b2);
+    stats = heap_get_stats();
+    assert(stats.large_allocation_count == before.large_allocation_count, "Failed: Large allocations were not released");
+    assert(stats.large_allocation_bytes == before.large_allocation_bytes, "Failed: Large allocation bytes were not released");
+
+    // Past the max heap block size, this used to assert
+    u64 huge_size = MAX_HEAP_BLOCK_SIZE+MB(1);
+    u8 *huge = (u8*)heap_alloc(huge_size);
+    huge[0] = 1;
+    huge[huge_size-1] = 1;
+    heap_dealloc(huge);
+}
+
+void scratch_test_make_results(Allocator results, u64 **out) {
+    // Results might be on a scratch of the caller, so we avoid that one
+    Scratch scratch = scratch_begin_avoiding(results);
+    assert(scratch.allocator.data != results.data, "Failed: Scratch should avoid the results allocator");
+    u64 *junk = (u64*)alloc(scratch.allocator, 1024);
+    junk[0] = 1;
+    *out = (u64*)alloc(results, sizeof(u64));
+    **out = 1234;
+    scratch_end(scratch);
+}
+void test_scratch_arenas() {
+    reset_temporary_storage();
+
+    // Scratches are freed at scratch_end, nested ones included
+    Scratch a = scratch_begin();
+    u8 *a0 = (u8*)alloc(a.allocator, 100);
+    Scratch b = scratch_begin();
+    assert(b.arena == a.arena, "Failed: Without a conflict nested scratches share the arena");
+    assert(b.depth == a.depth+1, "Failed: Nested scratch should be one deeper, so ending them out of order is caught");
+    u8 *b0 = (u8*)alloc(b.allocator, 100);
+    scratch_end(b);
+    u8 *b1 = (u8*)alloc(a.allocator, 100);
+    assert(b0 == b1, "Failed: Scratch memory was not freed at scratch_end");
+    scratch_end(a);
+    Scratch c = scratch_begin();
+    assert(alloc(c.allocator, 100) == a0, "Failed: Outer scratch memory was not freed at scratch_end");
+    assert((u64)a0 % 16 == 0, "Failed: Scratch memory should be 16 byte aligned");
+
+    // The callee puts results on our scratch and uses the other arena for its own scratch
+    u64 *result;
+    scratch_test_make_results(c.allocator, &result);
+    u64 *after = (u64*)alloc(c.allocator, sizeof(u64));
+    *after = 5678;
+    assert(*result == 1234, "Failed: Results were freed by the callee scratch");
+    scratch_end(c);
+
+    // Scratches don't free what's on the temporary allocator, even if they end up on it
+    u64 *temp = (u64*)alloc(get_temporary_allocator(), sizeof(u64));
+    *temp = 42;
+    Scratch d = scratch_begin();
+    scratch_test_make_results(d.allocator, &result);
+    scratch_end(d);
+    assert(*temp == 42, "Failed: Temporary memory was freed by a scratch");
+
+    // Growing past the initial size commits more instead of wrapping around over live data
+    Temporary_Storage_Stats before = temporary_storage_get_stats();
+    u64 big = before.committed + MB(4);
+    u8 *p = (u8*)talloc(big);
+    p[0] = 1;
+    p[big-1] = 2;
+    assert(*temp == 42, "Failed: Temporary storage wrapped around over live data");
+    assert(p > (u8*)temp, "Failed: Temporary storage wrapped around");
+    Temporary_Storage_Stats stats = temporary_storage_get_stats();
+    assert(stats.committed > before.committed && stats.committed >= big, "Failed: Expected temporary storage to grow");
+    assert(stats.high_water >= stats.used && stats.high_water >= big, "Failed: High water mark not tracked");
+    assert(stats.peak_high_water_all_threads >= big, "Failed: Peak high water mark not tracked");
+
+    // The high water mark stays after a reset
+    reset_temporary_storage();
+    stats = temporary_storage_get_stats();
+    assert(stats.used == 0 && stats.high_water >= big, "Failed: Expected reset to keep the high water mark");
+}
+
+void test_arena() {
+    Arena arena = make_arena(MB(64));
+    assert(arena.committed == 0, "Failed: Arena should not commit anything up front");
+
+    u8 *a = (u8*)arena_push(&arena, 3);
+    u8 *b = (u8*)arena_push_aligned(&arena, 100, 64);
+    assert((u64)b % 64 == 0 && b > a, "Failed: Arena aligned push");
+    assert(arena.committed == ARENA_COMMIT_SIZE, "Failed: Expected one commit chunk, got %llu bytes", arena.committed);
+
+    // Markers
+    Arena_Marker marker = arena_get_marker(&arena);
+    u8 *c = (u8*)arena_push(&arena, 1000);
+    arena_pop_to_marker(&arena, marker);
+    assert(arena_push(&arena, 1000) == c, "Failed: Memory after the marker was not freed");
+
+    // Grows by committing more, without moving
+    u8 *big = (u8*)arena_push(&arena, MB(10));
+    memset(big, 1, MB(10));
+    assert(arena.committed >= MB(10) && arena.base == (u8*)a, "Failed: Arena did not grow in place");
+    u64 high_water = arena.position;
+
+    arena_reset(&arena);
+    assert(arena.position == 0 && arena.committed >= MB(10), "Failed: arena_reset should keep memory committed");
+    assert(arena.high_water == high_water, "Failed: High water mark was lost");
+    arena_reset_and_decommit(&arena);
+    assert(arena.committed == ARENA_COMMIT_SIZE, "Failed: Expected arena_reset_and_decommit to decommit");
+    assert(arena_push(&arena, 3) == a, "Failed: Expected reset arena to start over");
+    arena_destroy(&arena);
+
+    // As an allocator
+    Allocator allocator = make_arena_allocator(MB(1));
+    int *numbers = (int*)alloc(allocator, sizeof(int)*1000);
+    for (int i = 0; i < 1000; i++) numbers[i] = i;
+    assert(numbers[999] == 999, "Failed: Arena allocator memory");
+    destroy_arena_allocator(allocator);
+
+    // On memory we already have
+    u8 buffer[256];
+    Arena fixed = make_arena_with_memory(sizeof(buffer), buffer);
+    assert(arena_push(&fixed, 200) == buffer, "Failed: Fixed memory arena should push into the given memory");
+    arena_destroy(&fixed);
+}
+
+typedef struct Pool_Test_Entity {
+    u64 id;
+    Vector3 position;
+    struct Pool_Test_Entity *parent;
+} Pool_Test_Entity;
+typedef struct Pool_Test_Thread_Data {
+    Pool *pool;
+    u64 seed;
+    u64 iterations;
+    Pool_Test_Entity *live[32];
+} Pool_Test_Thread_Data;
+void pool_test_thread_proc(Thread *t) {
+    Pool_Test_Thread_Data *data = (Pool_Test_Thread_Data*)t->data;
+    seed_for_random = data->seed;
+
+    for (u64 i = 0; i < data->iterations; i++) {
+        u64 index = get_random() % 32;
+        if (data->live[index]) {
+            assert(data->live[index]->id == data->seed*1000+index, "Failed: Pool slot was handed out twice");
+            pool_free(data->pool, data->live[index]);
+        }
+        Pool_Test_Entity *e = pool_alloc_struct(data->pool, Pool_Test_Entity);
+        e->id = data->seed*1000+index;
+        data->live[index] = e;
+    }
+}
+void test_pool() {
+    Pool pool = make_pool_for(Pool_Test_Entity, 64, get_heap_allocator(), false);
+    assert(pool.slot_size >= sizeof(Pool_Test_Entity) && pool.slot_size % POOL_SLOT_ALIGNMENT == 0, "Failed: Pool slot size");
+
+    Pool_Test_Entity *entities[200];
+    for (u64 i = 0; i < 200; i++) {
+        entities[i] = pool_alloc_struct(&pool, Pool_Test_Entity);
+        assert((u64)entities[i] % POOL_SLOT_ALIGNMENT == 0, "Failed: Pool slot is not aligned");
+        assert(entities[i]->id == 0, "Failed: Never used pool slots should be zero");
+        entities[i]->id = i;
+    }
+    Pool_Stats stats = pool_get_stats(&pool);
+    assert(stats.chunk_count == 4 && stats.capacity == 256, "Failed: Expected 4 chunks of 64, got %llu chunks", stats.chunk_count);
+    assert(stats.used == 200 && stats.peak_used == 200, "Failed: Pool used count");
+
+    // Freed slots are reused before growing
+    Pool_Test_Entity *freed = entities[50];
+    pool_free(&pool, freed);
+    assert(pool_alloc_struct(&pool, Pool_Test_Entity) == freed, "Failed: Expected the last freed slot back");
+    for (u64 i = 0; i < 200; i++) {
+        if (i != 50) assert(entities[i]->id == i, "Failed: Pool slot was overwritten");
+    }
+
+    for (u64 i = 0; i < 200; i++) pool_free(&pool, entities[i]);
+    stats = pool_get_stats(&pool);
+    assert(stats.used == 0 && stats.peak_used == 200 && stats.chunk_count == 4, "Failed: Pool stats after freeing everything");
+
+    // Walking the chunks sees every slot
+    u64 slot_count = 0;
+    for (Pool_Chunk *chunk = pool.chunks; chunk; chunk = chunk->next) {
+        for (u64 i = 0; i < chunk->slot_count; i++) {
+            assert(pool_owns_pointer(&pool, pool_chunk_get_slot(&pool, chunk, i)), "Failed: pool_owns_pointer");
+            slot_count += 1;
+        }
+    }
+    assert(slot_count == 256, "Failed: Expected 256 slots, walked %llu", slot_count);
+    assert(!pool_owns_pointer(&pool, (u8*)pool.chunks->slots+1), "Failed: Pointer into the middle of a slot");
+    pool_destroy(&pool);
+
+    // As an allocator
+    pool = make_pool(100, 8, get_heap_allocator(), false);
+    Allocator allocator = make_pool_allocator(&pool);
+    u8 *a = (u8*)alloc(allocator, 100);
+    u8 *b = (u8*)alloc(allocator, 1);
+    assert(a != b && pool.used == 2, "Failed: Pool allocator");
+    dealloc(allocator, a);
+    dealloc(allocator, b);
+    assert(pool.used == 0, "Failed: Pool allocator dealloc");
+    pool_destroy(&pool);
+
+    // Thread safe, slots come and go from several threads at once
+    pool = make_pool_for(Pool_Test_Entity, 16, get_heap_allocator(), true);
+    Thread threads[4];
+    Pool_Test_Thread_Data datas[4];
+    for (u64 i = 0; i < 4; i++) {
+        datas[i] = ZERO(Pool_Test_Thread_Data);
+        datas[i].pool = &pool;
+        datas[i].seed = i+1;
+        datas[i].iterations = 100000;
+        os_thread_init(&threads[i], pool_test_thread_proc);
+        threads[i].data = &datas[i];
+        os_thread_start(&threads[i]);
+    }
+    for (u64 i = 0; i < 4; i++) {
+        os_thread_join(&threads[i]);
+        os_thread_destroy(&threads[i]);
+    }
+    u64 live = 0;
+    for (u64 i = 0; i < 4; i++) {
+        for (u64 j = 0; j < 32; j++) {
+            if (datas[i].live[j]) live += 1;
+        }
+    }
+    stats = pool_get_stats(&pool);
+    assert(stats.used == live, "Failed: Expected %llu used slots, got %llu", live, stats.used);
+    assert(stats.capacity >= live && stats.capacity <= 4*32+4*16, "Failed: Pool grew more than needed, capacity %llu", stats.capacity);
+    pool_destroy(&pool);
+}
+
+#if ENABLE_HEAP_PROFILING
+void test_heap_profiling() {
+    Allocator heap = get_heap_allocator();
+    Heap_Profile_Stats before = heap_profile_get_stats();
+
+    void *a[10];
+    u32 line = __LINE__+2;
+    for (u64 i = 0; i < 10; i++) {
+        a[i] = alloc(heap, 1000);
+    }
+    Heap_Profile_Callsite c = heap_profile_get_callsite_stats(__FILE__, line);
+    assert(c.live_count == 10 && c.live_bytes == 10000, "Failed: Expected 10 live allocations of 1000 bytes from line %u, got %llu (%llu bytes)", line, c.live_count, c.live_bytes);
+
+    Heap_Profile_Stats stats = heap_profile_get_stats();
+    assert(stats.live_bytes >= before.live_bytes+10000, "Failed: Heap profile live bytes");
+    assert(stats.total_alloc_count >= before.total_alloc_count+10, "Failed: Heap profile total count");
+
+    // Reallocating stays with the original callsite
+    a[0] = heap.proc(MB(5), a[0], ALLOCATOR_REALLOCATE, heap.data);
+    c = heap_profile_get_callsite_stats(__FILE__, line);
+    assert(c.live_count == 10 && c.live_bytes == 9000+MB(5), "Failed: Reallocation was not attributed to the original callsite");
+
+    for (u64 i = 0; i < 10; i++) dealloc(heap, a[i]);
+    c = heap_profile_get_callsite_stats(__FILE__, line);
+    // The reallocation counts as an allocation of its own in the totals
+    assert(c.live_count == 0 && c.live_bytes == 0 && c.total_count == 11 && c.peak_live_bytes >= 9000+MB(5), "Failed: Heap profile after dealloc");
+
+    // Per frame
+    heap_profile_end_frame();
+    void *p = alloc(heap, 64);
+    heap_profile_end_frame();
+    stats = heap_profile_get_stats();
+    assert(stats.last_frame_alloc_count == 1 && stats.last_frame_alloc_bytes == 64 && stats.last_frame_dealloc_count == 0, "Failed: Heap profile frame stats");
+    dealloc(heap, p);
+
+    assert(heap_profile_dump_json(STR("heap_profile_test.json")), "Failed: Could not dump heap profile");
+    string json;
+    bool ok = os_read_entire_file("heap_profile_test.json", &json, heap);
+    assert(ok, "Failed: Could not read heap profile dump");
+    assert(string_find_from_left(json, STR("\"callsites\"")) != -1 && string_find_from_left(json, STR("\"heap_blocks\"")) != -1, "Failed: Heap profile dump is missing sections");
+    dealloc_string(heap, json);
+    os_file_delete("heap_profile_test.json");
+}
+#endif
+
+void test_frame_allocation_check() {
+    Allocator heap = get_heap_allocator();
+    Frame_Allocation_Check_Stats before = frame_allocation_check_get_stats();
+
+    void *p = alloc(heap, 64);
+
+    // The check counts allocations from every thread, and the audio thread or parallel_for
+    // workers may allocate while it's running. So only assert on what this test allocates.
+
+    // With the mode off, begin/end only count
+    frame_allocation_check_begin();
+    void *a = alloc(heap, 100);
+    void *b = alloc(heap, 200);
+    u64 count = frame_allocation_check_end();
+    assert(count >= 2, "Failed: Expected at least 2 heap allocations in the frame, got %llu", count);
+
+    // Freeing, temporary memory and reallocating in place are fine. Other threads may still
+    // allocate in here, so check that the reallocation stayed in place instead of the count.
+    void *before_realloc = p;
+    frame_allocation_check_begin();
+    dealloc(heap, a);
+    talloc(1000);
+    p = heap.proc(60, p, ALLOCATOR_REALLOCATE, heap.data);
+    frame_allocation_check_end();
+    assert(p == before_realloc, "Failed: Shrinking reallocation moved");
+
+    // Reallocating to somewhere else is not
+    frame_allocation_check_begin();
+    p = heap.proc(KB(64), p, ALLOCATOR_REALLOCATE, heap.data);
+    count = frame_allocation_check_end();
+    assert(count >= 1, "Failed: Expected the reallocation to count, got %llu", count);
+
+    Frame_Allocation_Check_Stats stats = frame_allocation_check_get_stats();
+    assert(stats.frame_count == before.frame_count+3, "Failed: Frame allocation check frame count");
+    assert(stats.frames_with_allocations >= before.frames_with_allocations+2, "Failed: Frame allocation check frames with allocations");
+    assert(stats.last_frame_allocation_bytes >= KB(64), "Failed: Frame allocation check bytes");
+
+    // Outside of a frame nothing is counted
+    void *c = alloc(heap, 100);
+    assert(frame_allocation_check_get_stats().allocation_count == stats.allocation_count, "Failed: Allocation outside of a frame was counted");
+
+    dealloc(heap, b);
+    dealloc(heap, c);
+    dealloc(heap, p);
+}
+
+u64 heap_trim_test_count_decommitted_pages() {
+    u64 count = 0;
+    for (Heap_Block *block = heap_head; block; block = block->next) count += block->decommitted_page_count;
+    return count;
+}
+void test_heap_trim() {
+    Allocator heap = get_heap_allocator();
+
+    // Neighbours that were freed out of order are merged
+    u64 size = KB(100);
+    u8 *a = (u8*)alloc(heap, size);
+    u8 *b = (u8*)alloc(heap, size);
+    u8 *c = (u8*)alloc(heap, size);
+    u8 *d = (u8*)alloc(heap, size);
+    bool contiguous = b-a == c-b && c-b == d-c && b > a;
+    dealloc(heap, a);
+    dealloc(heap, c);
+    dealloc(heap, b);
+    Heap_Trim_Result result = heap_trim_to(GB(64));
+    if (contiguous) assert(result.coalesced_node_count >= 1, "Failed: Expected free nodes to be merged");
+    assert(result.decommitted_bytes == 0, "Failed: Nothing should be decommitted within the budget");
+    dealloc(heap, d);
+
+    // Freed memory goes back to the OS, and comes back when it's needed again
+    u8 *blocks[64];
+    for (u64 i = 0; i < 64; i++) {
+        blocks[i] = (u8*)alloc(heap, KB(256));
+        memset(blocks[i], (int)i, KB(256));
+    }
+    for (u64 i = 0; i < 64; i++) dealloc(heap, blocks[i]);
+
+    result = heap_trim_to(0);
+    assert(result.decommitted_bytes >= MB(8), "Failed: Expected at least 8mb to be decommitted, got %llu", result.decommitted_bytes);
+    assert(result.retained_free_bytes == 0, "Failed: Nothing should be retained with a budget of 0");
+    u64 decommitted_pages = heap_trim_test_count_decommitted_pages();
+    assert(decommitted_pages*os.page_size >= result.decommitted_bytes, "Failed: Decommitted pages were not tracked");
+
+    for (u64 i = 0; i < 64; i++) {
+        blocks[i] = (u8*)alloc(heap, KB(256));
+        memset(blocks[i], (int)i, KB(256));
+    }
+    // Only the pages that were allocated from are committed again
+    assert(heap_trim_test_count_decommitted_pages() <= decommitted_pages-(KB(256)*64)/os.page_size+64, "Failed: Allocated pages are still tracked as decommitted");
+    for (u64 i = 0; i < 64; i++) {
+        assert(blocks[i][0] == (u8)i && blocks[i][KB(256)-1] == (u8)i, "Failed: Trimmed heap memory was not usable again");
+        dealloc(heap, blocks[i]);
+    }
+
+    // Within the budget, free memory stays committed
+    result = heap_trim_to(MB(4));
+    assert(result.retained_free_bytes <= MB(4) && result.retained_free_bytes > 0, "Failed: Expected up to 4mb retained, got %llu", result.retained_free_bytes);
+
+    // Small allocations still work after trimming
+    int *numbers = (int*)alloc(heap, sizeof(int)*100);
+    numbers[99] = 99;
+    dealloc(heap, numbers);
+}
+
 void test_strings() {
 	Allocator heap = get_heap_allocator();
 	{
@@ -1499,6 +2007,1366 @@ void test_sort() {
     
     print("Merge sort took on average %llu cycles and %.2f ms\n", cycles / num_samples, (seconds * 1000.0) / (float64)num_samples);
 }
+
+void test_z_sort_keys() {
+
+    u64 counts[]  = {10000, 100000, 1000000};
+    int samples[] = {50, 10, 3};
+
+    u64 max_count = counts[2];
+
+    Draw_Frame *frame = alloc(get_heap_allocator(), sizeof(Draw_Frame));
+    draw_frame_init_reserve(frame, max_count);
+
+    Draw_Quad *help_quads = alloc(get_heap_allocator(), max_count*sizeof(Draw_Quad));
+    u64 *keys = alloc(get_heap_allocator(), max_count*2*sizeof(u64));
+
+    for (u64 c = 0; c < sizeof(counts)/sizeof(counts[0]); c++) {
+        u64 item_count = counts[c];
+        int num_samples = samples[c];
+
+        frame->quad_count = item_count;
+        Draw_Quad *quads = frame->quad_buffer;
+
+        f64 quad_seconds = 0;
+        f64 key_seconds = 0;
+
+        for (int a = 0; a < num_samples; a++) {
+            for (u64 i = 0; i < item_count; i++) {
+                quads[i].z = get_random_int_in_range(-MAX_Z+1, MAX_Z-1);
+            }
+
+            float64 start_seconds = os_get_elapsed_seconds();
+            radix_sort(quads, help_quads, item_count, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+            quad_seconds += os_get_elapsed_seconds() - start_seconds;
+
+            for (u64 i = 0; i < item_count; i++) {
+                quads[i].z = get_random_int_in_range(-MAX_Z+1, MAX_Z-1);
+            }
+
+            // Sort keys, then gather into the help buffer so we end up with the same result as above
+            start_seconds = os_get_elapsed_seconds();
+            draw_frame_sort_quad_keys(frame, keys, keys+item_count);
+            for (u64 i = 0; i < item_count; i++) {
+                help_quads[i] = quads[keys[i] & Z_SORT_KEY_INDEX_MASK];
+            }
+            key_seconds += os_get_elapsed_seconds() - start_seconds;
+
+            for (u64 i = 1; i < item_count; i++) {
+                assert(help_quads[i].z >= help_quads[i-1].z, "Failed: not correctly sorted");
+                if (help_quads[i].z == help_quads[i-1].z) {
+                    assert((keys[i] & Z_SORT_KEY_INDEX_MASK) > (keys[i-1] & Z_SORT_KEY_INDEX_MASK), "Failed: z sort is not stable");
+                }
+            }
+        }
+
+        print("Z sorting %llu quads: Draw_Quad radix sort %.2f ms, key sort + gather %.2f ms\n",
+            item_count,
+            (quad_seconds * 1000.0) / (float64)num_samples,
+            (key_seconds * 1000.0) / (float64)num_samples
+        );
+    }
+
+    dealloc(get_heap_allocator(), keys);
+    dealloc(get_heap_allocator(), help_quads);
+    draw_frame_destroy(frame);
+    dealloc(get_heap_allocator(), frame);
+}
+
+void test_draw_frame_quad_arena() {
+    Draw_Frame *frame = alloc(get_heap_allocator(), sizeof(Draw_Frame));
+    draw_frame_init(frame);
+
+    Draw_Quad *first_buffer = frame->quad_buffer;
+
+    Draw_Quad quad = ZERO(Draw_Quad);
+    quad.bottom_left  = v2(-0.5, -0.5);
+    quad.top_left     = v2(-0.5,  0.5);
+    quad.top_right    = v2( 0.5,  0.5);
+    quad.bottom_right = v2( 0.5, -0.5);
+
+    const u64 quad_count = 50000;
+    for (u64 i = 0; i < quad_count; i++) {
+        quad.color.r = (float32)i;
+        draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+    }
+
+    assert(frame->quad_count == quad_count, "Failed: Expected %i quads, got %i", quad_count, frame->quad_count);
+    assert(frame->quad_buffer == first_buffer, "Failed: Quad buffer moved");
+    for (u64 i = 0; i < quad_count; i++) {
+        assert(frame->quad_buffer[i].color.r == (float32)i, "Failed: Quad %i was not kept intact", i);
+    }
+
+    u64 committed_after_draw = frame->quad_arena.committed_bytes;
+    assert(committed_after_draw >= quad_count*sizeof(Draw_Quad), "Failed: Not enough committed quad memory");
+
+    draw_frame_reset(frame);
+
+    Draw_Frame_Quad_Memory_Stats stats = draw_frame_get_quad_memory_stats(frame);
+    assert(frame->quad_count == 0, "Failed: Quad count was not reset");
+    assert(frame->quad_buffer == first_buffer, "Failed: Quad buffer moved after reset");
+    assert(stats.last_frame_bytes == quad_count*sizeof(Draw_Quad), "Failed: Wrong last frame bytes");
+    assert(stats.peak_bytes == quad_count*sizeof(Draw_Quad), "Failed: Wrong peak bytes");
+    assert(stats.committed_bytes == committed_after_draw, "Failed: Memory should stay committed after one reset");
+
+    // Sustained low usage should give memory back to the OS but keep what the frames need
+    for (u64 i = 0; i < DRAW_FRAME_QUAD_DECOMMIT_FRAMES; i++) {
+        draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+        draw_frame_reset(frame);
+    }
+
+    stats = draw_frame_get_quad_memory_stats(frame);
+    assert(stats.committed_bytes == DRAW_FRAME_QUAD_COMMIT_CHUNK, "Failed: Expected quad memory to be decommitted to one chunk, committed is %i", stats.committed_bytes);
+    assert(stats.peak_bytes == quad_count*sizeof(Draw_Quad), "Failed: Peak bytes should be kept after decommit");
+
+    // And grow again
+    for (u64 i = 0; i < quad_count; i++) {
+        draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+    }
+    assert(frame->quad_count == quad_count, "Failed: Expected %i quads after decommit, got %i", quad_count, frame->quad_count);
+
+    // Z & scissor stacks grow as needed and are kept across resets
+    for (s32 i = 0; i < 100; i++) {
+        push_z_layer_in_frame(i, frame);
+        push_window_scissor_in_frame(v2(i, i), v2(i+1, i+1), frame);
+    }
+    Draw_Quad *q = draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+    assert(q->z == 99, "Failed: Wrong z from z stack");
+    assert(q->has_scissor && q->scissor.x == 99, "Failed: Wrong scissor from scissor stack");
+
+    s32 *z_stack = frame->z_stack;
+    draw_frame_reset(frame);
+    assert(frame->z_count == 0 && frame->scissor_count == 0, "Failed: Stacks were not reset");
+    assert(frame->z_stack == z_stack && frame->z_capacity >= 100, "Failed: Z stack storage should be kept after reset");
+    q = draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+    assert(q->z == 0 && !q->has_scissor, "Failed: Quad picked up z or scissor after reset");
+
+    draw_frame_destroy(frame);
+    dealloc(get_heap_allocator(), frame);
+}
+
+void test_draw_list() {
+    Draw_Frame *frame = alloc(get_heap_allocator(), sizeof(Draw_Frame));
+    draw_frame_init(frame);
+
+    Draw_List list;
+    draw_list_init(&list);
+
+    for (int i = 0; i < 10; i++) {
+        Draw_Quad *q = draw_list_add_rect(&list, v2(-0.5, -0.5), v2(0.1, 0.1), v4(100+i, 0, 0, 1));
+        q->z = 7;
+    }
+    // Outside of the clip space, should be culled when expanded
+    draw_list_add_rect(&list, v2(10, 10), v2(1, 1), v4(-1, 0, 0, 1));
+    assert(growing_array_get_valid_count(list.quads) == 11, "Failed: Wrong draw list quad count");
+
+    u64 version = list.version;
+    draw_list_invalidate(&list);
+    assert(list.version != version, "Failed: draw_list_invalidate did not bump the version");
+
+    Draw_Quad quad = ZERO(Draw_Quad);
+    quad.bottom_left  = v2(-0.5, -0.5);
+    quad.top_left     = v2(-0.5,  0.5);
+    quad.top_right    = v2( 0.5,  0.5);
+    quad.bottom_right = v2( 0.5, -0.5);
+
+    // 2 quads, list, 1 quad, list, list
+    quad.color.r = 0; draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+    quad.color.r = 1; draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+    draw_list_projected_in_frame(&list, m4_scalar(1.0), frame);
+    quad.color.r = 2; draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+    draw_list_projected_in_frame(&list, m4_scalar(1.0), frame);
+    draw_list_projected_in_frame(&list, m4_scalar(1.0), frame);
+
+    assert(frame->quad_count == 3 && frame->draw_list_count == 3, "Failed: Draw lists should not be expanded until rendering");
+
+    draw_frame_expand_draw_lists(frame);
+
+    float32 expected[3+10*3];
+    u64 n = 0;
+    expected[n++] = 0; expected[n++] = 1;
+    for (int i = 0; i < 10; i++) expected[n++] = 100+i;
+    expected[n++] = 2;
+    for (int i = 0; i < 10; i++) expected[n++] = 100+i;
+    for (int i = 0; i < 10; i++) expected[n++] = 100+i;
+
+    assert(frame->quad_count == n, "Failed: Expected %i quads after expanding draw lists, got %i", n, frame->quad_count);
+    assert(frame->draw_list_count == 0, "Failed: Draw lists were not consumed");
+    for (u64 i = 0; i < n; i++) {
+        assert(frame->quad_buffer[i].color.r == expected[i], "Failed: Wrong quad order after expanding draw lists at %i", i);
+        if (expected[i] >= 100) assert(frame->quad_buffer[i].z == 7, "Failed: Draw list quad lost its z");
+    }
+
+    draw_list_clear(&list);
+    draw_frame_reset(frame);
+    draw_list_projected_in_frame(&list, m4_scalar(1.0), frame);
+    assert(frame->draw_list_count == 0, "Failed: Empty draw lists should be ignored");
+
+    draw_list_destroy(&list);
+    draw_frame_destroy(frame);
+    dealloc(get_heap_allocator(), frame);
+}
+typedef struct Draw_Frame_Group_Test_Data {
+    u64 sprites_per_frame;
+} Draw_Frame_Group_Test_Data;
+void draw_frame_group_test_record(Draw_Frame *frame, u64 frame_index, void *data) {
+    Draw_Frame_Group_Test_Data *test_data = (Draw_Frame_Group_Test_Data*)data;
+
+    Draw_Quad quad = ZERO(Draw_Quad);
+    quad.bottom_left  = v2(-0.01, -0.01);
+    quad.top_left     = v2(-0.01,  0.01);
+    quad.top_right    = v2( 0.01,  0.01);
+    quad.bottom_right = v2( 0.01, -0.01);
+    quad.color.g = (float32)frame_index;
+
+    push_window_scissor_in_frame(v2(frame_index, 0), v2(frame_index+1, 1), frame);
+    for (u64 i = 0; i < test_data->sprites_per_frame; i++) {
+        push_z_layer_in_frame((s32)(i%3), frame);
+        quad.color.r = (float32)i;
+        draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+        pop_z_layer_in_frame(frame);
+    }
+    pop_window_scissor_in_frame(frame);
+}
+
+void test_draw_frame_group() {
+    Allocator allocator = get_heap_allocator();
+
+    const u64 total_sprites = 150000;
+    const int num_samples = 5;
+
+    u64 *keys = alloc(allocator, total_sprites*2*sizeof(u64));
+
+    u64 max_frames = parallel_for_get_thread_count();
+    for (u64 frame_count = 1; frame_count <= max_frames; frame_count *= 2) {
+        Draw_Frame_Group group;
+        draw_frame_group_init(&group, frame_count);
+
+        Draw_Frame_Group_Test_Data data;
+        data.sprites_per_frame = total_sprites/frame_count;
+        u64 expected_count = data.sprites_per_frame*frame_count+1;
+
+        f64 record_seconds = 0;
+        f64 merge_seconds = 0;
+
+        for (int a = 0; a < num_samples; a++) {
+            draw_frame_group_reset(&group);
+            group.merged.enable_z_sorting = true;
+
+            // Directly drawn quads go before the recorded ones
+            Draw_Quad first = ZERO(Draw_Quad);
+            first.color.g = -1;
+            draw_quad_projected_in_frame(first, m4_scalar(1.0), &group.merged);
+
+            float64 start_seconds = os_get_elapsed_seconds();
+            draw_frame_group_record(&group, draw_frame_group_test_record, &data);
+            record_seconds += os_get_elapsed_seconds() - start_seconds;
+
+            start_seconds = os_get_elapsed_seconds();
+            draw_frame_group_merge(&group);
+            draw_frame_sort_quad_keys(&group.merged, keys, keys+group.merged.quad_count);
+            merge_seconds += os_get_elapsed_seconds() - start_seconds;
+
+            assert(group.merged.quad_count == expected_count, "Failed: Expected %i merged quads, got %i", expected_count, group.merged.quad_count);
+
+            // Merging again without recording anything should not add anything
+            draw_frame_group_merge(&group);
+            assert(group.merged.quad_count == expected_count, "Failed: Merging twice duplicated quads");
+
+            for (u64 i = 1; i < expected_count; i++) {
+                Draw_Quad *prev = &group.merged.quad_buffer[keys[i-1] & Z_SORT_KEY_INDEX_MASK];
+                Draw_Quad *q    = &group.merged.quad_buffer[keys[i] & Z_SORT_KEY_INDEX_MASK];
+                assert(q->z >= prev->z, "Failed: Merged quads not sorted by z");
+                assert(q->has_scissor && q->scissor.x == q->color.g, "Failed: Quad got the scissor of another frame");
+                if (q->z == prev->z) {
+                    assert(q->color.g > prev->color.g || (q->color.g == prev->color.g && q->color.r > prev->color.r), "Failed: Quads with the same z are not in frame order");
+                }
+            }
+        }
+
+        print("Draw_Frame_Group %llu sprites on %llu frames: record %.2f ms, merge + z sort %.2f ms\n",
+            total_sprites,
+            frame_count,
+            (record_seconds * 1000.0) / (float64)num_samples,
+            (merge_seconds * 1000.0) / (float64)num_samples
+        );
+
+        draw_frame_group_destroy(&group);
+    }
+
+    // Recording frames reserve their own (smaller) size, the merged frame has room for all of them
+    Draw_Frame_Group group;
+    draw_frame_group_init_with_quad_reserve_size(&group, 64, MB(64));
+    Draw_Frame_Quad_Memory_Stats frame_stats  = draw_frame_get_quad_memory_stats(draw_frame_group_get_frame(&group, 63));
+    Draw_Frame_Quad_Memory_Stats merged_stats = draw_frame_get_quad_memory_stats(&group.merged);
+    assert(frame_stats.reserved_bytes == MB(64), "Failed: Group frame did not reserve the given size");
+    assert(merged_stats.reserved_bytes >= MB(64)*64, "Failed: Merged frame can't fit all group frames");
+    draw_frame_group_destroy(&group);
+
+    dealloc(allocator, keys);
+}
+
+// With z sorting on, a frame that draws the same as the last one must not touch the heap, or
+// FRAME_ALLOCATION_CHECK_TRAP would trip on every frame of a game.
+void test_frame_allocation_check_draw_frame() {
+    Allocator allocator = get_heap_allocator();
+
+    Gfx_Image *target = make_image_render_target(64, 64, 4, 0, allocator);
+    Draw_Frame *frame = alloc(allocator, sizeof(Draw_Frame));
+    draw_frame_init(frame);
+
+    // Enough quads for the sort to go wide on the thread pool
+    const u64 quad_count = RADIX_SORT_MIN_ITEMS_PER_TASK*4;
+    u64 *keys = alloc(allocator, quad_count*2*sizeof(u64));
+
+    Draw_Quad quad = ZERO(Draw_Quad);
+    quad.bottom_left  = v2(-0.01, -0.01);
+    quad.top_left     = v2(-0.01,  0.01);
+    quad.top_right    = v2( 0.01,  0.01);
+    quad.bottom_right = v2( 0.01, -0.01);
+    quad.color = v4(1, 1, 1, 1);
+
+    // The first frames grow the renderer buffers, so only check after warming up
+    for (int i = 0; i < 4; i++) {
+        bool check = i >= 2;
+        if (check) frame_allocation_check_begin();
+
+        draw_frame_reset(frame);
+        frame->enable_z_sorting = true;
+        for (u64 j = 0; j < quad_count; j++) {
+            Draw_Quad *q = draw_quad_projected_in_frame(quad, m4_scalar(1.0), frame);
+            q->z = (s32)((j*7919) % 1000);
+        }
+        draw_frame_sort_quad_keys(frame, keys, keys+quad_count);
+        gfx_render_draw_frame(frame, target);
+
+        if (check) {
+            u64 count = frame_allocation_check_end();
+            assert(count == 0, "Failed: A warmed up z sorted frame made %llu heap allocations", count);
+        }
+    }
+
+    dealloc(allocator, keys);
+    draw_frame_destroy(frame);
+    dealloc(allocator, frame);
+    delete_image(target);
+}
+
+void test_draw_capture() {
+    Allocator allocator = get_heap_allocator();
+
+    u8 pixels[2*2*4];
+    for (int i = 0; i < (int)sizeof(pixels); i++) pixels[i] = (u8)(i*13);
+    Gfx_Image *image_a = make_image(2, 2, 4, pixels, allocator);
+    Gfx_Image *image_b = make_image(3, 1, 1, 0, allocator);
+
+    Draw_Frame *frame = alloc(allocator, sizeof(Draw_Frame));
+    draw_frame_init(frame);
+    frame->enable_z_sorting = true;
+    frame->camera_xform = m4_make_translation(v3(5, 6, 0));
+
+    Draw_List list;
+    draw_list_init(&list);
+    draw_list_add_image(&list, image_b, v2(0, 0), v2(10, 10), COLOR_RED);
+    draw_list_add_rect(&list, v2(10, 0), v2(10, 10), COLOR_GREEN);
+
+    Vector4 cbuffer = v4(1, 2, 3, 4);
+    frame->cbuffer = &cbuffer;
+
+    const u64 quad_count = 1000;
+    for (u64 i = 0; i < quad_count; i++) {
+        Draw_Quad *q;
+        if (i % 3 == 0) q = draw_image_in_frame(i % 2 ? image_a : image_b, v2(i, 0), v2(8, 8), v4(1, 0, 0, 1), frame);
+        else            q = draw_rect_in_frame(v2(i, 1), v2(4, 4), v4(0, 1, 0, 0.5), frame);
+        q->z = (s32)(i % 7) - 3;
+        if (i % 5 == 0) {
+            q->has_scissor = true;
+            q->scissor = v4(1, 2, 3, 4);
+        }
+        if (i % 11 == 0) q->userdata[0] = v4(i, 0, 0, 1);
+        if (i % 13 == 0) q->type = QUAD_TYPE_CIRCLE;
+        if (i == 500) draw_list_projected_in_frame(&list, m4_scalar(2.0), frame);
+    }
+    draw_list_projected_in_frame(&list, m4_scalar(3.0), frame);
+
+    Draw_Capture_Options options = ZERO(Draw_Capture_Options);
+    options.cbuffer_size = sizeof(cbuffer);
+    options.include_image_pixels = true;
+    string data = draw_frame_capture(frame, options, allocator);
+    assert(data.count < quad_count*sizeof(Draw_Quad)*3/4, "Failed: Capture is not compact, %i bytes for %i quads", data.count, quad_count);
+
+    Draw_Capture *capture = draw_capture_load(data, allocator);
+    assert(capture, "Failed: Could not load capture");
+    assert(capture->image_count == 2, "Failed: Expected 2 images, got %i", capture->image_count);
+    assert(capture->list_count == 1, "Failed: The same list should only be captured once");
+
+    Draw_Frame *replay = &capture->frame;
+    assert(replay->quad_count == quad_count, "Failed: Wrong quad count");
+    assert(replay->enable_z_sorting && !replay->enable_z_sorting_texture_batching, "Failed: Wrong sorting flags");
+    assert(bytes_match(&replay->projection, &frame->projection, sizeof(Matrix4)), "Failed: Wrong projection");
+    assert(bytes_match(&replay->camera_xform, &frame->camera_xform, sizeof(Matrix4)), "Failed: Wrong camera");
+    assert(replay->cbuffer && bytes_match(replay->cbuffer, &cbuffer, sizeof(cbuffer)), "Failed: Wrong cbuffer");
+
+    for (u64 i = 0; i < quad_count; i++) {
+        Draw_Quad a = frame->quad_buffer[i];
+        Draw_Quad b = replay->quad_buffer[i];
+        assert((a.image == 0) == (b.image == 0), "Failed: Wrong image on quad %i", i);
+        if (a.image) {
+            assert(a.image->width == b.image->width && a.image->channels == b.image->channels, "Failed: Wrong image on quad %i", i);
+            assert(bytes_match(&a.uv, &b.uv, sizeof(Vector4)), "Failed: Wrong uv on quad %i", i);
+            assert(a.image_min_filter == b.image_min_filter && a.image_mag_filter == b.image_mag_filter, "Failed: Wrong filters on quad %i", i);
+        }
+        assert(bytes_match(&a.bottom_left, &b.bottom_left, sizeof(Vector2)*4), "Failed: Wrong corners on quad %i", i);
+        assert(bytes_match(&a.color, &b.color, sizeof(Vector4)), "Failed: Wrong color on quad %i", i);
+        assert(a.z == b.z && a.type == b.type && a.has_scissor == b.has_scissor, "Failed: Wrong quad %i", i);
+        if (a.has_scissor) assert(bytes_match(&a.scissor, &b.scissor, sizeof(Vector4)), "Failed: Wrong scissor on quad %i", i);
+        assert(bytes_match(a.userdata, b.userdata, sizeof(a.userdata)), "Failed: Wrong userdata on quad %i", i);
+    }
+
+    assert(replay->draw_list_count == 2, "Failed: Wrong draw list submission count");
+    assert(replay->draw_lists[0].quad_index == 501 && replay->draw_lists[1].quad_index == quad_count, "Failed: Wrong draw list submission position");
+    assert(replay->draw_lists[0].list == replay->draw_lists[1].list, "Failed: Submissions should share the list");
+    assert(bytes_match(&replay->draw_lists[1].world_to_clip, &frame->draw_lists[1].world_to_clip, sizeof(Matrix4)), "Failed: Wrong draw list transform");
+    Draw_List *replay_list = replay->draw_lists[0].list;
+    assert(growing_array_get_valid_count(replay_list->quads) == 2, "Failed: Wrong draw list quad count");
+    assert(replay_list->quads[0].image && replay_list->quads[0].image->width == 3 && !replay_list->quads[1].image, "Failed: Wrong draw list quads");
+
+    // Image pixels
+    Gfx_Image *replay_image_a = 0;
+    for (u64 i = 0; i < capture->image_count; i++) {
+        if (capture->images[i]->width == 2) replay_image_a = capture->images[i];
+    }
+    u8 read_pixels[2*2*4];
+    gfx_read_image_data(replay_image_a, 0, 0, 2, 2, read_pixels);
+    assert(bytes_match(read_pixels, pixels, sizeof(pixels)), "Failed: Wrong image pixels");
+
+    // Preparing the frame again puts back what rendering changes
+    draw_frame_expand_draw_lists(replay);
+    assert(replay->draw_list_count == 0, "Failed: Expected draw lists to be expanded");
+    draw_capture_prepare_frame(capture);
+    assert(replay->quad_count == quad_count && replay->draw_list_count == 2, "Failed: draw_capture_prepare_frame did not restore the frame");
+
+    draw_capture_release(capture);
+
+    // Truncated & garbage data fails to load
+    string truncated = data;
+    truncated.count = data.count/2;
+    assert(!draw_capture_load(truncated, allocator), "Failed: Loaded a truncated capture");
+    string garbage = STR("This is not a capture");
+    assert(!draw_capture_load(garbage, allocator), "Failed: Loaded garbage");
+
+    dealloc_string(allocator, data);
+    draw_list_destroy(&list);
+    draw_frame_destroy(frame);
+    dealloc(allocator, frame);
+    delete_image(image_a);
+    delete_image(image_b);
+}
+
+void test_texture_atlas() {
+    Allocator allocator = get_heap_allocator();
+
+    const u32 page_size = 256;
+    Texture_Atlas atlas;
+    texture_atlas_init(&atlas, page_size, page_size, 4, allocator);
+
+    // Random sizes, each image filled with its own color
+    const u64 image_count = 150;
+    Gfx_Image *images[150];
+    u8 *pixels = alloc(allocator, 48*48*4);
+    u64 seed = 1234;
+    for (u64 i = 0; i < image_count; i++) {
+        seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+        u32 w = 4 + (u32)((seed >> 33) % 44);
+        u32 h = 4 + (u32)((seed >> 45) % 44);
+        for (u32 p = 0; p < w*h; p++) {
+            pixels[p*4+0] = (u8)i;
+            pixels[p*4+1] = (u8)(i >> 8);
+            pixels[p*4+2] = 0x55;
+            pixels[p*4+3] = 0xff;
+        }
+        images[i] = texture_atlas_add_image(&atlas, w, h, pixels);
+        assert(images[i] && images[i]->atlas_page, "Failed: Image was not added to the atlas");
+        assert(images[i]->width == w && images[i]->height == h, "Failed: Wrong sub-image size");
+    }
+    dealloc(allocator, pixels);
+
+    Texture_Atlas_Stats stats = texture_atlas_get_stats(&atlas);
+    assert(stats.image_count == image_count, "Failed: Wrong atlas image count");
+    assert(stats.page_count > 1, "Failed: Expected the images to need more than one page");
+    // The first page is full, so it shows how tight the packing is
+    float32 first_page_occupancy = (float32)atlas.pages[0].used_pixels/(float32)(page_size*page_size);
+    assert(first_page_occupancy > 0.7f, "Failed: Atlas packing is too wasteful (%.2f)", first_page_occupancy);
+
+    // Padded rects on the same page must not overlap
+    const s32 pad = TEXTURE_ATLAS_PADDING;
+    for (u64 i = 0; i < image_count; i++) {
+        Gfx_Image *a = images[i];
+        s32 ax = (s32)(a->atlas_uv.x1*page_size + 0.5f) - pad;
+        s32 ay = (s32)(a->atlas_uv.y1*page_size + 0.5f) - pad;
+        s32 aw = (s32)a->width + pad*2;
+        s32 ah = (s32)a->height + pad*2;
+        assert(ax >= 0 && ay >= 0 && ax+aw <= (s32)page_size && ay+ah <= (s32)page_size, "Failed: Image %llu is outside the page", i);
+        for (u64 j = i+1; j < image_count; j++) {
+            Gfx_Image *b = images[j];
+            if (b->atlas_page != a->atlas_page) continue;
+            s32 bx = (s32)(b->atlas_uv.x1*page_size + 0.5f) - pad;
+            s32 by = (s32)(b->atlas_uv.y1*page_size + 0.5f) - pad;
+            s32 bw = (s32)b->width + pad*2;
+            s32 bh = (s32)b->height + pad*2;
+            bool overlap = ax < bx+bw && bx < ax+aw && ay < by+bh && by < ay+ah;
+            assert(!overlap, "Failed: Images %llu and %llu overlap in the atlas", i, j);
+        }
+    }
+
+    // The pixels ended up where the uv's say, including the repeated edge in the padding
+    Gfx_Image *page = images[0]->atlas_page;
+    u8 *page_pixels = alloc(allocator, page_size*page_size*4);
+    gfx_read_image_data(page, 0, 0, page_size, page_size, page_pixels);
+    for (u64 i = 0; i < image_count; i++) {
+        if (images[i]->atlas_page != page) continue;
+        u32 x = (u32)(images[i]->atlas_uv.x1*page_size + 0.5f);
+        u32 y = (u32)(images[i]->atlas_uv.y1*page_size + 0.5f);
+        u8 *corner = page_pixels + ((y-pad)*page_size + x-pad)*4;
+        u8 *last   = page_pixels + ((y+images[i]->height-1)*page_size + x+images[i]->width-1)*4;
+        assert(corner[0] == (u8)i && corner[1] == (u8)(i >> 8) && corner[2] == 0x55, "Failed: Wrong pixel in the padding of image %llu", i);
+        assert(last[0] == (u8)i && last[1] == (u8)(i >> 8) && last[2] == 0x55, "Failed: Wrong pixel in image %llu", i);
+    }
+    dealloc(allocator, page_pixels);
+
+    // Drawing a sub-image draws its rect of the page
+    Draw_Frame *frame = alloc(allocator, sizeof(Draw_Frame));
+    draw_frame_init(frame);
+    Draw_Quad *q = draw_image_in_frame(images[3], v2(0, 0), v2(10, 10), COLOR_WHITE, frame);
+    assert(q->image == images[3]->atlas_page, "Failed: Sub-image should draw its atlas page");
+    assert(bytes_match(&q->uv, &images[3]->atlas_uv, sizeof(Vector4)), "Failed: Sub-image should draw with its atlas uv");
+    Vector4 half = texture_atlas_map_uv(images[3], v4(0, 0, 0.5, 1));
+    Vector4 full = images[3]->atlas_uv;
+    assert(half.x1 == full.x1 && half.y2 == full.y2 && fabs(half.x2 - (full.x1+full.x2)*0.5f) < 0.0001f, "Failed: texture_atlas_map_uv");
+    draw_frame_destroy(frame);
+    dealloc(allocator, frame);
+
+    // Evicting a page frees its images and the next image goes in the emptied page
+    u64 page0_images = growing_array_get_valid_count(atlas.pages[0].images);
+    texture_atlas_evict_page(&atlas, 0);
+    stats = texture_atlas_get_stats(&atlas);
+    assert(stats.image_count == image_count - page0_images, "Failed: Evicting a page did not remove its images");
+    u8 white[4] = {255, 255, 255, 255};
+    Gfx_Image *after_evict = texture_atlas_add_image(&atlas, 1, 1, white);
+    assert(after_evict->atlas_page == atlas.pages[0].image, "Failed: Evicted page was not reused");
+
+    texture_atlas_destroy(&atlas);
+
+    // Page limit, too big images & reusing a page after its last image is removed
+    Texture_Atlas small;
+    texture_atlas_init(&small, 64, 64, 4, allocator);
+    small.max_pages = 1;
+    u8 *big_pixels = alloc(allocator, 100*100*4);
+    memset(big_pixels, 0xff, 100*100*4);
+    Gfx_Image *a = texture_atlas_add_image(&small, 40, 40, big_pixels);
+    assert(a, "Failed: Image should fit in the atlas");
+    assert(!texture_atlas_add_image(&small, 40, 40, big_pixels), "Failed: Atlas should be full");
+    texture_atlas_remove_image(&small, a);
+    a = texture_atlas_add_image(&small, 40, 40, big_pixels);
+    assert(a, "Failed: Page was not reused after its last image was removed");
+    Gfx_Image *too_big = texture_atlas_add_image(&small, 100, 100, big_pixels);
+    assert(too_big && !too_big->atlas_page && too_big->width == 100, "Failed: Too big image should get its own image");
+    texture_atlas_remove_image(&small, too_big);
+    dealloc(allocator, big_pixels);
+    texture_atlas_destroy(&small);
+}
+
+#if TARGET_OS == WINDOWS
+typedef struct {
+    Matrix4 xform;
+    Vector2 scale;
+    Vector4 color;
+    Draw_Frame *frame;
+} Glyph_Run_Test_Reference_Params;
+// How text used to be drawn: one matrix & one full quad transform per glyph
+bool glyph_run_test_reference_callback(Gfx_Glyph glyph, Gfx_Font_Atlas *atlas, float glyph_x, float glyph_y, void *ud) {
+    Glyph_Run_Test_Reference_Params *p = (Glyph_Run_Test_Reference_Params*)ud;
+    if (glyph.width <= 0 || glyph.height <= 0) return true;
+
+    Vector2 size = v2(glyph.width*p->scale.x, glyph.height*p->scale.y);
+    Matrix4 glyph_xform = m4_translate(p->xform, v3(glyph_x, glyph_y, 0));
+
+    Draw_Quad *q = draw_image_xform_in_frame(atlas->image, glyph_xform, size, p->color, p->frame);
+    q->uv = glyph.uv;
+    q->type = QUAD_TYPE_TEXT;
+    q->image_min_filter = GFX_FILTER_MODE_LINEAR;
+    q->image_mag_filter = GFX_FILTER_MODE_LINEAR;
+    return true;
+}
+void glyph_run_test_draw_reference(Gfx_Font *font, string text, u32 raster_height, Matrix4 xform, Vector2 scale, Vector4 color, Draw_Frame *frame) {
+    Glyph_Run_Test_Reference_Params p = {xform, scale, color, frame};
+    walk_glyphs((Walk_Glyphs_Spec){font, text, raster_height, scale, true, &p}, glyph_run_test_reference_callback);
+}
+
+void test_glyph_run() {
+    Allocator allocator = get_heap_allocator();
+
+    Gfx_Font *font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    if (!font) {
+        print("(arial.ttf not found, skipping) ");
+        return;
+    }
+    const u32 raster_height = 32;
+
+    Draw_Frame *reference = alloc(allocator, sizeof(Draw_Frame));
+    Draw_Frame *frame = alloc(allocator, sizeof(Draw_Frame));
+    draw_frame_init(reference);
+    draw_frame_init(frame);
+    Matrix4 projection = m4_make_orthographic_projection(-(f32)window.width*0.5f, (f32)window.width*0.5f, -(f32)window.height*0.5f, (f32)window.height*0.5f, -1, 10);
+    reference->projection = projection;
+    frame->projection = projection;
+    reference->camera_xform = m4_make_translation(v3(13, -7, 0));
+    frame->camera_xform = reference->camera_xform;
+
+    // Same quads as the per-glyph path, also when rotated & scaled
+    string text = STR("Glyph runs: 1234567890\nSecond line, \xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82!");
+    Matrix4 xforms[] = {
+        m4_make_translation(v3(-200, 50, 0)),
+        m4_rotate_z(m4_make_translation(v3(10, 20, 0)), 0.6f),
+        m4_scale(m4_make_translation(v3(-100, -100, 0)), v3(1.5f, 0.75f, 1)),
+    };
+    Vector2 scales[] = { v2(1, 1), v2(0.5f, 0.5f), v2(2, 1) };
+    push_z_layer_in_frame(3, reference);
+    push_z_layer_in_frame(3, frame);
+    for (u64 i = 0; i < sizeof(xforms)/sizeof(xforms[0]); i++) {
+        reference->quad_count = 0;
+        frame->quad_count = 0;
+        glyph_run_test_draw_reference(font, text, raster_height, xforms[i], scales[i], COLOR_RED, reference);
+        draw_text_xform_in_frame(font, text, raster_height, xforms[i], scales[i], COLOR_RED, frame);
+
+        assert(reference->quad_count > 10, "Failed: Reference text drew no quads");
+        assert(frame->quad_count == reference->quad_count, "Failed: Glyph run drew %llu quads, expected %llu", frame->quad_count, reference->quad_count);
+
+        float32 tolerance_x = 2.0f/(f32)window.width*1.01f;
+        float32 tolerance_y = 2.0f/(f32)window.height*1.01f;
+        for (u64 j = 0; j < frame->quad_count; j++) {
+            Draw_Quad *a = &reference->quad_buffer[j];
+            Draw_Quad *b = &frame->quad_buffer[j];
+            Vector2 *ac = &a->bottom_left;
+            Vector2 *bc = &b->bottom_left;
+            for (u64 c = 0; c < 4; c++) {
+                assert(fabs(ac[c].x-bc[c].x) <= tolerance_x && fabs(ac[c].y-bc[c].y) <= tolerance_y, "Failed: Glyph quad %llu corner %llu is off by more than a pixel", j, c);
+            }
+            assert(a->image == b->image, "Failed: Glyph quad %llu has the wrong image", j);
+            assert(bytes_match(&a->uv, &b->uv, sizeof(Vector4)), "Failed: Glyph quad %llu has the wrong uv", j);
+            assert(bytes_match(&a->color, &b->color, sizeof(Vector4)), "Failed: Glyph quad %llu has the wrong color", j);
+            assert(a->type == b->type && a->z == b->z && b->z == 3, "Failed: Glyph quad %llu has the wrong type or z", j);
+            assert(a->image_min_filter == b->image_min_filter && a->image_mag_filter == b->image_mag_filter, "Failed: Glyph quad %llu has the wrong filter", j);
+        }
+    }
+    pop_z_layer_in_frame(reference);
+    pop_z_layer_in_frame(frame);
+
+    // Glyphs outside of the view are culled
+    frame->quad_count = 0;
+    draw_text_in_frame(font, text, raster_height, v2(100000, 0), v2(1, 1), COLOR_WHITE, frame);
+    assert(frame->quad_count == 0, "Failed: Offscreen glyphs should be culled");
+
+    // Benchmark: lots of damage numbers, like in a busy bullet hell
+    const u64 label_count = 5000;
+    const int num_samples = 5;
+    string *labels = alloc(allocator, label_count*sizeof(string));
+    Vector2 *positions = alloc(allocator, label_count*sizeof(Vector2));
+    Gfx_Glyph_Run *runs = alloc(allocator, label_count*sizeof(Gfx_Glyph_Run));
+    for (u64 i = 0; i < label_count; i++) {
+        labels[i] = sprint(allocator, STR("-%i"), get_random_int_in_range(1, 99999));
+        positions[i] = v2(get_random_float32_in_range(-400, 400), get_random_float32_in_range(-300, 300));
+        glyph_run_init(&runs[i], allocator);
+        glyph_run_layout(&runs[i], font, labels[i], raster_height, v2(1, 1));
+    }
+
+    f64 reference_seconds = 0;
+    f64 text_seconds = 0;
+    f64 run_seconds = 0;
+    for (int s = 0; s < num_samples; s++) {
+        reference->quad_count = 0;
+        float64 start = os_get_elapsed_seconds();
+        for (u64 i = 0; i < label_count; i++) {
+            glyph_run_test_draw_reference(font, labels[i], raster_height, m4_make_translation(v3(positions[i].x, positions[i].y, 0)), v2(1, 1), COLOR_WHITE, reference);
+        }
+        reference_seconds += os_get_elapsed_seconds()-start;
+
+        frame->quad_count = 0;
+        start = os_get_elapsed_seconds();
+        for (u64 i = 0; i < label_count; i++) {
+            draw_text_in_frame(font, labels[i], raster_height, positions[i], v2(1, 1), COLOR_WHITE, frame);
+        }
+        text_seconds += os_get_elapsed_seconds()-start;
+        assert(frame->quad_count == reference->quad_count, "Failed: draw_text drew a different amount of quads than the reference");
+
+        frame->quad_count = 0;
+        start = os_get_elapsed_seconds();
+        for (u64 i = 0; i < label_count; i++) {
+            draw_glyph_run_in_frame(&runs[i], positions[i], COLOR_WHITE, frame);
+        }
+        run_seconds += os_get_elapsed_seconds()-start;
+        assert(frame->quad_count == reference->quad_count, "Failed: Glyph runs drew a different amount of quads than the reference");
+    }
+
+    print("%llu labels (%llu glyphs): per-glyph matrices %.2f ms, draw_text %.2f ms, retained glyph runs %.2f ms\n",
+        label_count, frame->quad_count,
+        (reference_seconds*1000.0)/(f64)num_samples,
+        (text_seconds*1000.0)/(f64)num_samples,
+        (run_seconds*1000.0)/(f64)num_samples);
+
+    for (u64 i = 0; i < label_count; i++) {
+        glyph_run_destroy(&runs[i]);
+        dealloc_string(allocator, labels[i]);
+    }
+    dealloc(allocator, runs);
+    dealloc(allocator, positions);
+    dealloc(allocator, labels);
+
+    draw_frame_destroy(reference);
+    draw_frame_destroy(frame);
+    dealloc(allocator, reference);
+    dealloc(allocator, frame);
+    destroy_font(font);
+}
+
+void test_text_layout_cache() {
+    Allocator allocator = get_heap_allocator();
+
+    Gfx_Font *font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    if (!font) {
+        print("(arial.ttf not found, skipping) ");
+        return;
+    }
+    const u32 raster_height = 24;
+
+    Draw_Frame *frame = alloc(allocator, sizeof(Draw_Frame));
+    draw_frame_init(frame);
+    frame->projection = m4_make_orthographic_projection(-(f32)window.width*0.5f, (f32)window.width*0.5f, -(f32)window.height*0.5f, (f32)window.height*0.5f, -1, 10);
+
+    string hud = STR("fps: 60 health 100/100");
+
+    // Drawing & measuring the same text only lays it out once
+    Text_Layout_Cache_Stats before = text_layout_cache_get_stats();
+    draw_text_in_frame(font, hud, raster_height, v2(0, 0), v2(1, 1), COLOR_WHITE, frame);
+    u64 first_quad_count = frame->quad_count;
+    draw_text_in_frame(font, hud, raster_height, v2(0, 40), v2(1, 1), COLOR_WHITE, frame);
+    Gfx_Text_Metrics cached_metrics = measure_text(font, hud, raster_height, v2(1, 1));
+    Text_Layout_Cache_Stats after = text_layout_cache_get_stats();
+    assert(after.misses-before.misses == 1, "Failed: Expected one text layout cache miss, got %llu", after.misses-before.misses);
+    assert(after.hits-before.hits == 2, "Failed: Expected two text layout cache hits, got %llu", after.hits-before.hits);
+    assert(frame->quad_count == first_quad_count*2, "Failed: Cached text drew a different amount of quads");
+
+    // Cached metrics are the same as measuring from scratch
+    Measure_Text_Walk_Glyphs_Context c = ZERO(Measure_Text_Walk_Glyphs_Context);
+    c.font = font;
+    c.raster_height = raster_height;
+    c.scale = v2(1, 1);
+    walk_glyphs((Walk_Glyphs_Spec){font, hud, raster_height, v2(1, 1), true, &c}, measure_text_glyph_callback);
+    assert(bytes_match(&c.m.functional_pos_min, &cached_metrics.functional_pos_min, sizeof(Vector2)), "Failed: Cached functional_pos_min is wrong");
+    assert(bytes_match(&c.m.visual_pos_max, &cached_metrics.visual_pos_max, sizeof(Vector2)), "Failed: Cached visual_pos_max is wrong");
+
+    // Any part of the key changing is a different layout
+    before = text_layout_cache_get_stats();
+    measure_text(font, hud, raster_height+1, v2(1, 1));
+    measure_text(font, hud, raster_height, v2(2, 1));
+    measure_text(font, STR("fps: 59 health 100/100"), raster_height, v2(1, 1));
+    get_text_layout(font, hud, raster_height, v2(1, 1), 100);
+    after = text_layout_cache_get_stats();
+    assert(after.misses-before.misses == 4 && after.hits == before.hits, "Failed: Text layout cache key mismatch");
+
+    // Wrapped layouts have a line per split line
+    Gfx_Text_Layout *wrapped = get_text_layout(font, hud, raster_height, v2(1, 1), 100);
+    string *lines = split_text_to_lines_with_wrapping(hud, 100, font, raster_height, v2(1, 1), true);
+    assert(wrapped->line_count == growing_array_get_valid_count(lines) && wrapped->line_count > 1, "Failed: Wrong wrapped line count");
+    assert(wrapped->metrics.functional_size.y > cached_metrics.functional_size.y, "Failed: Wrapped text should be taller");
+
+    // Layouts that aren't used for a while are evicted
+    before = text_layout_cache_get_stats();
+    for (u64 i = 0; i < TEXT_LAYOUT_CACHE_MAX_UNUSED_FRAMES+2; i++) {
+        text_layout_cache_end_frame();
+        measure_text(font, STR("Still in use"), raster_height, v2(1, 1));
+    }
+    after = text_layout_cache_get_stats();
+    assert(after.evictions > before.evictions && after.entry_count == 1, "Failed: Unused text layouts were not evicted (%llu left)", after.entry_count);
+
+    // A new font at the same address doesn't get the old font's layouts
+    destroy_font(font);
+    font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    before = text_layout_cache_get_stats();
+    measure_text(font, STR("Still in use"), raster_height, v2(1, 1));
+    after = text_layout_cache_get_stats();
+    assert(after.misses-before.misses == 1, "Failed: Text layout from a destroyed font was reused");
+
+    draw_frame_destroy(frame);
+    dealloc(allocator, frame);
+    destroy_font(font);
+}
+
+typedef struct Text_Layout_Cache_Thread_Data {
+    Gfx_Font *font;
+    Text_Layout_Cache_Entry *entries;
+} Text_Layout_Cache_Thread_Data;
+
+void text_layout_cache_thread_proc(Thread *t) {
+    Text_Layout_Cache_Thread_Data *data = (Text_Layout_Cache_Thread_Data*)t->data;
+    measure_text(data->font, STR("Measured on another thread"), 24, v2(1, 1));
+    data->entries = text_layout_cache.entries;
+}
+
+bool is_pointer_in_heap_free_node(void *p) {
+    bool found = false;
+    spinlock_acquire_or_wait(&heap_lock);
+    for (Heap_Block *block = heap_head; block && !found; block = block->next) {
+        for (Heap_Free_Node *node = block->free_head; node; node = node->next) {
+            if ((u8*)p >= (u8*)node && (u8*)p < (u8*)node+node->size) {
+                found = true;
+                break;
+            }
+        }
+    }
+    spinlock_release(&heap_lock);
+    return found;
+}
+
+void test_text_layout_cache_thread_exit() {
+    Allocator allocator = get_heap_allocator();
+
+    Gfx_Font *font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    if (!font) {
+        print("(arial.ttf not found, skipping) ");
+        return;
+    }
+    
+    // Glyphs are only added on the thread that loaded the font
+    measure_text(font, STR("Measured on another thread"), 24, v2(1, 1));
+
+    Text_Layout_Cache_Thread_Data data = {font, 0};
+    Thread thread;
+    os_thread_init(&thread, text_layout_cache_thread_proc);
+    thread.data = &data;
+    os_thread_start(&thread);
+    os_thread_join(&thread);
+    os_thread_destroy(&thread);
+
+    // The entries are too big for the size classes, so they're freed straight back to a heap block
+    assert(data.entries, "Failed: The thread did not make a text layout cache");
+    assert(TEXT_LAYOUT_CACHE_CAPACITY*sizeof(Text_Layout_Cache_Entry) > HEAP_MAX_SMALL_SIZE, "Failed: Text layout cache entries are not a block heap allocation");
+    assert(is_pointer_in_heap_free_node(data.entries), "Failed: The text layout cache of a thread was not freed when it exited");
+
+    destroy_font(font);
+}
+
+void test_font_atlas() {
+    Allocator allocator = get_heap_allocator();
+
+    Gfx_Font *threaded = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    Gfx_Font *serial = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    if (!threaded || !serial) {
+        print("(arial.ttf not found, skipping) ");
+        return;
+    }
+    serial->rasterize_on_worker_threads = false;
+    const u32 raster_height = 40;
+
+    // Prewarming rasterizes every glyph in the range, and only those
+    font_prewarm(threaded, raster_height, 0, 0x4ff);
+    font_prewarm(serial, raster_height, 0, 0x4ff);
+    Gfx_Font_Variation *variation = &threaded->variations[raster_height];
+    assert(threaded->glyphs_rasterized == 0x500, "Failed: font_prewarm rasterized %llu glyphs, expected %d", threaded->glyphs_rasterized, 0x500);
+    assert(variation->glyph_count == 0x500, "Failed: font_prewarm added %llu glyphs, expected %d", variation->glyph_count, 0x500);
+
+    // Same glyphs & atlases with and without worker threads
+    u64 atlas_count = growing_array_get_valid_count(serial->atlases);
+    assert(growing_array_get_valid_count(threaded->atlases) == atlas_count, "Failed: Different atlas count with and without worker threads");
+    for (u32 c = 0; c <= 0x4ff; c++) {
+        Gfx_Glyph a = font_get_glyph(threaded, raster_height, c, 0);
+        Gfx_Glyph b = font_get_glyph(serial, raster_height, c, 0);
+        assert(bytes_match(&a, &b, sizeof(Gfx_Glyph)), "Failed: Glyph %u differs between threaded and serial rasterization", c);
+    }
+
+    u8 *pixels_a = alloc(allocator, FONT_ATLAS_WIDTH*FONT_ATLAS_HEIGHT);
+    u8 *pixels_b = alloc(allocator, FONT_ATLAS_WIDTH*FONT_ATLAS_HEIGHT);
+    for (u64 i = 0; i < atlas_count; i++) {
+        gfx_read_image_data(threaded->atlases[i]->image, 0, 0, FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, pixels_a);
+        gfx_read_image_data(serial->atlases[i]->image, 0, 0, FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, pixels_b);
+        assert(bytes_match(pixels_a, pixels_b, FONT_ATLAS_WIDTH*FONT_ATLAS_HEIGHT), "Failed: Atlas pixels differ between threaded and serial rasterization");
+    }
+
+    // Glyphs are stored flipped at their uv, with empty spacing around them
+    Gfx_Font_Atlas *atlas;
+    Gfx_Glyph g = font_get_glyph(threaded, raster_height, 'W', &atlas);
+    gfx_read_image_data(atlas->image, 0, 0, FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, pixels_a);
+    int w, h, x, y;
+    third_party_allocator = allocator;
+    u8 *bitmap = stbtt_GetCodepointBitmap(&threaded->stbtt_handle, variation->scale, variation->scale, 'W', &w, &h, &x, &y);
+    assert(bitmap && w == (int)g.width && h == (int)g.height, "Failed: Wrong glyph size in atlas");
+    u32 atlas_x = (u32)(g.uv.x1*FONT_ATLAS_WIDTH + 0.5f);
+    u32 atlas_y = (u32)(g.uv.y1*FONT_ATLAS_HEIGHT + 0.5f);
+    for (int row = 0; row < h; row++) {
+        u8 *atlas_row = pixels_a + (atlas_y + h-1-row)*FONT_ATLAS_WIDTH + atlas_x;
+        assert(bytes_match(atlas_row, bitmap + row*w, w), "Failed: Glyph row %d is wrong in the atlas", row);
+        assert(atlas_row[-1] == 0 && atlas_row[w] == 0, "Failed: Glyph row %d has no spacing", row);
+    }
+    stbtt_FreeBitmap(bitmap, 0);
+    third_party_allocator = ZERO(Allocator);
+
+    // Prewarming again only rasterizes what's new
+    font_prewarm(threaded, raster_height, 0, 0x4ff);
+    font_prewarm_text(threaded, raster_height, STR("\xe4\xb8\xad\xe4\xb8\xad abc"));
+    assert(threaded->glyphs_rasterized == 0x501, "Failed: Prewarming again should only rasterize the new glyph");
+
+    dealloc(allocator, pixels_a);
+    dealloc(allocator, pixels_b);
+    destroy_font(threaded);
+    destroy_font(serial);
+}
+void test_font_disk_cache() {
+    Allocator allocator = get_heap_allocator();
+
+    string directory = STR("font_cache_test");
+    const u32 raster_height = 30;
+
+    Gfx_Font *baked = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    if (!baked) {
+        print("(arial.ttf not found, skipping) ");
+        return;
+    }
+    font_set_disk_cache_directory(baked, directory);
+    font_prewarm(baked, raster_height, 0, 127);
+
+    string path = font_glyph_disk_cache_path(&baked->variations[raster_height], 0, 127);
+    assert(os_is_file(path), "Failed: Font glyph cache file was not written");
+
+    // A new font with the same file loads the glyphs instead of rasterizing them
+    Gfx_Font *loaded = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    font_set_disk_cache_directory(loaded, directory);
+    assert(loaded->data_hash == baked->data_hash, "Failed: Same font file should hash the same");
+    font_prewarm(loaded, raster_height, 0, 127);
+    assert(loaded->glyphs_rasterized == 0, "Failed: Cached glyphs were rasterized again");
+
+    for (u32 c = 0; c <= 127; c++) {
+        Gfx_Glyph a = font_get_glyph(baked, raster_height, c, 0);
+        Gfx_Glyph b = font_get_glyph(loaded, raster_height, c, 0);
+        assert(bytes_match(&a, &b, sizeof(Gfx_Glyph)), "Failed: Cached glyph %u differs", c);
+    }
+
+    u8 *pixels_a = alloc(allocator, FONT_ATLAS_WIDTH*FONT_ATLAS_HEIGHT);
+    u8 *pixels_b = alloc(allocator, FONT_ATLAS_WIDTH*FONT_ATLAS_HEIGHT);
+    gfx_read_image_data(baked->atlases[0]->image, 0, 0, FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, pixels_a);
+    gfx_read_image_data(loaded->atlases[0]->image, 0, 0, FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, pixels_b);
+    assert(bytes_match(pixels_a, pixels_b, FONT_ATLAS_WIDTH*FONT_ATLAS_HEIGHT), "Failed: Cached atlas pixels differ");
+    dealloc(allocator, pixels_a);
+    dealloc(allocator, pixels_b);
+
+    // A changed font file doesn't get the old glyphs
+    Gfx_Font *changed = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    font_set_disk_cache_directory(changed, directory);
+    changed->data_hash += 1;
+    Gfx_Font_Variation *variation = font_get_glyph_variation(changed, raster_height);
+    assert(!font_glyph_disk_cache_load(variation, 0, 127), "Failed: Glyph cache should be invalid for a changed font");
+
+    // Neither does a truncated file
+    string data;
+    bool read_ok = os_read_entire_file(path, &data, allocator);
+    assert(read_ok, "Failed: Could not read the font glyph cache");
+    data.count /= 2;
+    os_write_entire_file(path, data);
+    dealloc_string(allocator, data);
+    changed->data_hash -= 1;
+    assert(!font_glyph_disk_cache_load(variation, 0, 127), "Failed: Truncated glyph cache should be invalid");
+    assert(variation->glyph_count == 0, "Failed: Invalid glyph cache should not add glyphs");
+
+    destroy_font(baked);
+    destroy_font(loaded);
+    destroy_font(changed);
+    os_delete_directory(directory, true);
+}
+void test_font_sdf() {
+    Allocator allocator = get_heap_allocator();
+
+    Gfx_Font *font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    if (!font) {
+        print("(arial.ttf not found, skipping) ");
+        return;
+    }
+    Gfx_Font *normal = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+
+    const u32 reference_height = 48;
+    font_enable_sdf(font, reference_height);
+    assert(font->sdf_variation.initted, "Failed: SDF reference variation should be initted");
+
+    string text = STR("Hello, SDF!");
+    u32 heights[] = {12, 24, 48, 96, 200};
+    u64 height_count = sizeof(heights)/sizeof(heights[0]);
+
+    Gfx_Font_Atlas *reference_atlas;
+    Gfx_Glyph reference_h = font_get_glyph(font, reference_height, 'H', &reference_atlas);
+    for (u64 i = 0; i < height_count; i++) {
+        font_prewarm_text(font, heights[i], text);
+        font_prewarm_text(normal, heights[i], text);
+
+        // Every height uses the glyphs rasterized at the reference height
+        Gfx_Font_Atlas *atlas;
+        Gfx_Glyph g = font_get_glyph(font, heights[i], 'H', &atlas);
+        assert(atlas == reference_atlas && bytes_match(&g.uv, &reference_h.uv, sizeof(Vector4)), "Failed: SDF heights should share the reference glyphs");
+
+        // Glyph boxes scale with the height and roughly match normal rasterization
+        Gfx_Glyph n = font_get_glyph(normal, heights[i], 'H', 0);
+        float32 tolerance = max(2.0f, heights[i]*0.05f);
+        assert(fabs(g.advance-n.advance) <= tolerance, "Failed: SDF advance %f, expected about %f at height %u", g.advance, n.advance, heights[i]);
+        assert(fabs(g.height-n.height) <= tolerance, "Failed: SDF glyph height %f, expected about %f at height %u", g.height, n.height, heights[i]);
+        assert(fabs(g.yoffset-n.yoffset) <= tolerance, "Failed: SDF yoffset %f, expected about %f at height %u", g.yoffset, n.yoffset, heights[i]);
+    }
+    assert(font->glyphs_rasterized == font->sdf_variation.glyph_count, "Failed: SDF glyphs should only be rasterized once for all heights");
+
+    // The middle of a stem is inside the glyph, the padding outside of it
+    Gfx_Font_Atlas *atlas;
+    Gfx_Glyph l = font_get_glyph(font, reference_height, 'l', &atlas);
+    u8 *pixels = alloc(allocator, FONT_ATLAS_WIDTH*FONT_ATLAS_HEIGHT);
+    gfx_read_image_data(atlas->image, 0, 0, FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT, pixels);
+    u32 center_x = (u32)(((l.uv.x1+l.uv.x2)*0.5f)*FONT_ATLAS_WIDTH);
+    u32 center_y = (u32)(((l.uv.y1+l.uv.y2)*0.5f)*FONT_ATLAS_HEIGHT);
+    u32 outside_x = (u32)(l.uv.x1*FONT_ATLAS_WIDTH) - FONT_SDF_PADDING + 1;
+    assert(pixels[center_y*FONT_ATLAS_WIDTH+center_x] > FONT_SDF_ON_EDGE_VALUE, "Failed: SDF should be inside the glyph in the middle of 'l'");
+    assert(pixels[center_y*FONT_ATLAS_WIDTH+outside_x] < FONT_SDF_ON_EDGE_VALUE, "Failed: SDF should be outside the glyph in the padding");
+    dealloc(allocator, pixels);
+
+    // Runs of SDF fonts are drawn as QUAD_TYPE_TEXT_SDF
+    Gfx_Glyph_Run run;
+    glyph_run_init(&run, allocator);
+    glyph_run_layout(&run, font, text, 24, v2(1, 1));
+    assert(run.sdf, "Failed: Glyph run of an SDF font should be marked as sdf");
+    glyph_run_layout(&run, normal, text, 24, v2(1, 1));
+    assert(!run.sdf, "Failed: Glyph run of a normal font should not be marked as sdf");
+    glyph_run_destroy(&run);
+
+    Gfx_Font_Atlas_Stats sdf_stats = font_get_atlas_stats(font);
+    Gfx_Font_Atlas_Stats normal_stats = font_get_atlas_stats(normal);
+    assert(sdf_stats.sdf_bytes_saved > 0, "Failed: SDF font should report saved atlas space");
+    assert(sdf_stats.used_bytes < normal_stats.used_bytes, "Failed: SDF glyphs should take less atlas space than rasterizing each height");
+
+    print("%u heights: %llu KB of glyphs instead of %llu KB (estimated %llu KB saved)... ", (u32)height_count, sdf_stats.used_bytes/1024, normal_stats.used_bytes/1024, sdf_stats.sdf_bytes_saved/1024);
+
+    destroy_font(font);
+    destroy_font(normal);
+}
+void test_font_sparse_atlas() {
+    Allocator allocator = get_heap_allocator();
+
+    Gfx_Font *font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    if (!font) {
+        print("(arial.ttf not found, skipping) ");
+        return;
+    }
+
+    // One glyph costs one rasterization, wherever it is in the unicode range
+    font_get_glyph(font, 32, 0x4e2d, 0);
+    font_get_glyph(font, 32, 'A', 0);
+    assert(font->glyphs_rasterized == 2, "Failed: Expected 2 glyphs rasterized, got %llu", font->glyphs_rasterized);
+    font_get_glyph(font, 32, 0x4e2d, 0);
+    measure_text(font, STR("AAAA"), 32, v2(1, 1));
+    assert(font->glyphs_rasterized == 2, "Failed: Glyphs that are in the atlas should not be rasterized again");
+
+    // Glyphs of all heights share the atlases
+    for (u32 height = 10; height < 60; height += 5) font_prewarm(font, height, 32, 127);
+    Gfx_Font_Atlas_Stats stats = font_get_atlas_stats(font);
+    assert(stats.atlas_count == 1, "Failed: Expected 1 atlas for ascii at 10 heights, got %llu", stats.atlas_count);
+    destroy_font(font);
+
+    // When the atlases are full, the least recently used one is evicted
+    font = load_font_from_disk(STR("C:/windows/fonts/arial.ttf"), allocator);
+    font->max_atlases = 1;
+    const u32 big = 200;
+
+    Gfx_Glyph_Run run;
+    glyph_run_init(&run, allocator);
+    glyph_run_layout(&run, font, STR("Hello"), big, v2(1, 1));
+
+    // A new height each frame, so the run's glyphs aren't used again
+    u32 height = 100;
+    while (font_variation_find_glyph(&font->variations[big], 'H')) {
+        text_layout_cache_end_frame();
+        for (u32 c = 'A'; c <= 'Z'; c++) font_get_glyph(font, height, c, 0);
+        height += 1;
+        assert(height < big, "Failed: Atlas was never evicted");
+    }
+    stats = font_get_atlas_stats(font);
+    assert(stats.evictions >= 1, "Failed: Expected an eviction");
+
+    // The run looks its glyphs up again when it is drawn
+    text_layout_cache_end_frame();
+    glyph_run_prepare_for_drawing(&run);
+    assert(run.atlas_generation == font->atlas_generation, "Failed: Glyph run was not refreshed after an eviction");
+    for (u64 i = 0; i < glyph_run_get_glyph_count(&run); i++) {
+        Gfx_Font_Atlas *atlas;
+        Gfx_Glyph g = font_get_glyph(font, big, run.glyphs[i].codepoint, &atlas);
+        assert(run.glyphs[i].atlas == atlas && bytes_match(&run.glyphs[i].uv, &g.uv, sizeof(Vector4)), "Failed: Refreshed glyph %llu has the wrong uv", i);
+    }
+
+    // Atlases used in this frame are never evicted, a new one is added instead
+    u64 atlas_count = growing_array_get_valid_count(font->atlases);
+    for (height = 300; height < 320; height++) {
+        for (u32 c = 'A'; c <= 'Z'; c++) font_get_glyph(font, height, c, 0);
+    }
+    assert(growing_array_get_valid_count(font->atlases) > atlas_count, "Failed: Expected another atlas over the limit");
+    for (u64 i = 0; i < glyph_run_get_glyph_count(&run); i++) {
+        assert(font_variation_find_glyph(&font->variations[big], run.glyphs[i].codepoint), "Failed: Glyph used in this frame was evicted");
+    }
+
+    glyph_run_destroy(&run);
+    destroy_font(font);
+}
+#endif // TARGET_OS == WINDOWS
+
+#if GFX_RENDERER == GFX_RENDERER_SOFTWARE
+Draw_Quad *software_test_push_quad(Draw_Frame *frame, float32 x0, float32 y0, float32 x1, float32 y1, Vector4 color) {
+	Draw_Quad *q = draw_frame_push_quad(frame);
+	*q = ZERO(Draw_Quad);
+	q->bottom_left  = v2(x0, y0);
+	q->top_left	 = v2(x0, y1);
+	q->top_right	= v2(x1, y1);
+	q->bottom_right = v2(x1, y0);
+	q->color = color;
+	q->uv = v4(0, 0, 1, 1);
+	return q;
+}
+void test_software_renderer() {
+	Allocator allocator = get_heap_allocator();
+
+	const u32 size = 64;
+	Gfx_Image *target = make_image_render_target(size, size, 4, 0, allocator);
+	u8 *pixels = alloc(allocator, size*size*4);
+	#define PIXEL(x, y) (pixels + ((y)*size + (x))*4)
+
+	Draw_Frame *frame = alloc(allocator, sizeof(Draw_Frame));
+	draw_frame_init(frame);
+
+	// Left half. Row 0 is the top.
+	gfx_clear_render_target(target, v4(0, 0, 0, 1));
+	draw_frame_reset(frame);
+	software_test_push_quad(frame, -1, -1, 0, 1, v4(1, 0, 0, 1));
+	gfx_render_draw_frame(frame, target);
+	gfx_read_image_data(target, 0, 0, size, size, pixels);
+	assert(PIXEL(31, 10)[0] == 255 && PIXEL(32, 10)[0] == 0, "Failed: Wrong coverage");
+	assert(gfx_software_get_last_render_stats().pixels == size*size/2, "Failed: Wrong shaded pixel count");
+
+	// Two half transparent quads sharing an edge that's not on a pixel border, no pixel should be blended twice
+	gfx_clear_render_target(target, v4(0, 0, 0, 1));
+	draw_frame_reset(frame);
+	software_test_push_quad(frame, -1, -1, 0.1, 1, v4(1, 1, 1, 0.5));
+	software_test_push_quad(frame, 0.1, -1, 1, 1, v4(1, 1, 1, 0.5));
+	gfx_render_draw_frame(frame, target);
+	gfx_read_image_data(target, 0, 0, size, size, pixels);
+	for (u32 i = 0; i < size*size; i++) {
+		assert(pixels[i*4] == 128, "Failed: Pixel %i blended %s", i, pixels[i*4] > 128 ? STR("twice") : STR("wrong"));
+	}
+
+	// Scissor is in window pixels from the bottom. Rows 10..20 from the top, columns 5..15
+	gfx_clear_render_target(target, v4(0, 0, 0, 1));
+	draw_frame_reset(frame);
+	Draw_Quad *q = software_test_push_quad(frame, -1, -1, 1, 1, v4(0, 1, 0, 1));
+	q->has_scissor = true;
+	q->scissor = v4(5, window.pixel_height-20, 15, window.pixel_height-10);
+	gfx_render_draw_frame(frame, target);
+	gfx_read_image_data(target, 0, 0, size, size, pixels);
+	for (u32 y = 0; y < size; y++) {
+		for (u32 x = 0; x < size; x++) {
+			bool inside = x >= 5 && x < 15 && y >= 10 && y < 20;
+			assert((PIXEL(x, y)[1] == 255) == inside, "Failed: Scissor wrong at %i, %i", x, y);
+		}
+	}
+
+	// Circle
+	gfx_clear_render_target(target, v4(0, 0, 0, 1));
+	draw_frame_reset(frame);
+	q = software_test_push_quad(frame, -1, -1, 1, 1, v4(0, 0, 1, 1));
+	q->type = QUAD_TYPE_CIRCLE;
+	gfx_render_draw_frame(frame, target);
+	gfx_read_image_data(target, 0, 0, size, size, pixels);
+	assert(PIXEL(32, 32)[2] == 255 && PIXEL(0, 0)[2] == 0 && PIXEL(size-1, size-1)[2] == 0, "Failed: Wrong circle");
+
+	// Black & white 2x1 image stretched over the target
+	u8 texels[] = {0, 0, 0, 255, 255, 255, 255, 255};
+	Gfx_Image *image = make_image(2, 1, 4, texels, allocator);
+	gfx_clear_render_target(target, v4(0, 0, 0, 1));
+	draw_frame_reset(frame);
+	q = software_test_push_quad(frame, -1, -1, 1, 1, v4(1, 1, 1, 1));
+	q->image = image;
+	q->image_min_filter = GFX_FILTER_MODE_NEAREST;
+	q->image_mag_filter = GFX_FILTER_MODE_NEAREST;
+	gfx_render_draw_frame(frame, target);
+	gfx_read_image_data(target, 0, 0, size, size, pixels);
+	assert(PIXEL(31, 5)[0] == 0 && PIXEL(32, 5)[0] == 255, "Failed: Wrong nearest filtering");
+	q->image_mag_filter = GFX_FILTER_MODE_LINEAR;
+	gfx_render_draw_frame(frame, target);
+	gfx_read_image_data(target, 0, 0, size, size, pixels);
+	assert(PIXEL(0, 5)[0] == 0 && PIXEL(size-1, 5)[0] == 255, "Failed: Linear filtering should clamp at the edges");
+	assert(PIXEL(31, 5)[0] > 64 && PIXEL(31, 5)[0] < 192, "Failed: Wrong linear filtering");
+
+	// Text uses the first channel as alpha
+	u8 glyph_alpha = 128;
+	Gfx_Image *glyph = make_image(1, 1, 1, &glyph_alpha, allocator);
+	gfx_clear_render_target(target, v4(0, 0, 0, 1));
+	draw_frame_reset(frame);
+	q = software_test_push_quad(frame, -1, -1, 1, 1, v4(1, 0, 0, 1));
+	q->image = glyph;
+	q->type = QUAD_TYPE_TEXT;
+	gfx_render_draw_frame(frame, target);
+	gfx_read_image_data(target, 0, 0, size, size, pixels);
+	assert(PIXEL(3, 3)[0] == 128 && PIXEL(3, 3)[1] == 0, "Failed: Wrong text blending");
+
+	#undef PIXEL
+	delete_image(glyph);
+	delete_image(image);
+	delete_image(target);
+	dealloc(allocator, pixels);
+
+	// Throughput
+	Gfx_Image *big_target = make_image_render_target(1920, 1080, 4, 0, allocator);
+	const u64 quad_count = 150000;
+	draw_frame_reset(frame);
+	for (u64 i = 0; i < quad_count; i++) {
+		float32 x = get_random_float32_in_range(-1, 1);
+		float32 y = get_random_float32_in_range(-1, 1);
+		software_test_push_quad(frame, x, y, x+16.0/960.0, y+16.0/540.0, v4(1, 0.5, 0.2, 0.8));
+	}
+	const int num_samples = 5;
+	Gfx_Software_Render_Stats total = ZERO(Gfx_Software_Render_Stats);
+	for (int a = 0; a < num_samples; a++) {
+		gfx_render_draw_frame(frame, big_target);
+		Gfx_Software_Render_Stats stats = gfx_software_get_last_render_stats();
+		total.pixels += stats.pixels;
+		total.seconds += stats.seconds;
+	}
+	print("Software rendering %llu 16x16 quads at 1920x1080: %.2f ms, %.1f Mpixels/s (%llu threads)\n",
+		quad_count,
+		(total.seconds * 1000.0) / (float64)num_samples,
+		((float64)total.pixels / total.seconds) / 1000000.0,
+		parallel_for_get_thread_count()
+	);
+
+	delete_image(big_target);
+	draw_frame_destroy(frame);
+	dealloc(allocator, frame);
+}
+#endif
+
+#if GFX_RENDERER == GFX_RENDERER_NULL
+void test_null_renderer() {
+	Allocator allocator = get_heap_allocator();
+
+	const u64 image_count = 40;
+	Gfx_Image *images[40];
+	u8 pixel[4] = {255, 255, 255, 255};
+	for (u64 i = 0; i < image_count; i++) images[i] = make_image(1, 1, 4, pixel, allocator);
+
+	// Images of the same size & format share a texture array
+	for (u64 i = 0; i < image_count; i++) {
+		assert(images[i]->gfx_handle->batched.texture_array == images[0]->gfx_handle->batched.texture_array, "Failed: Same size images should be in the same texture array");
+		if (i > 0) assert(images[i]->gfx_handle->batched.texture_array_slice != images[i-1]->gfx_handle->batched.texture_array_slice, "Failed: Images got the same texture array slice");
+	}
+	// Freed slices are reused
+	u32 freed_slice = images[5]->gfx_handle->batched.texture_array_slice;
+	delete_image(images[5]);
+	images[5] = make_image(1, 1, 4, pixel, allocator);
+	assert(images[5]->gfx_handle->batched.texture_array_slice == freed_slice, "Failed: Texture array slice was not reused");
+
+	Draw_Frame *frame = alloc(allocator, sizeof(Draw_Frame));
+	draw_frame_init(frame);
+
+	// 40 different images, but they only take one texture array slot
+	for (u64 i = 0; i < image_count; i++) {
+		draw_image_in_frame(images[i], v2(0, 0), v2(1, 1), COLOR_WHITE, frame);
+	}
+	// Untextured quads don't take a slot
+	draw_rect_in_frame(v2(0, 0), v2(1, 1), COLOR_WHITE, frame);
+
+	Gfx_Null_Frame_Stats before = gfx_null_get_current_frame_stats();
+	gfx_render_draw_frame(frame, 0);
+	Gfx_Null_Frame_Stats after = gfx_null_get_current_frame_stats();
+
+	assert(after.frames_rendered - before.frames_rendered == 1, "Failed: Wrong frame count");
+	assert(after.quads_processed - before.quads_processed == image_count+1, "Failed: Wrong processed quad count");
+	assert(after.quads_drawn - before.quads_drawn == image_count+1, "Failed: Wrong drawn quad count");
+	assert(after.draw_calls - before.draw_calls == 1, "Failed: Expected 1 draw call, got %llu", after.draw_calls - before.draw_calls);
+	assert(after.texture_limit_flushes - before.texture_limit_flushes == 0, "Failed: Expected no flushes from the texture limit");
+	assert(after.texture_binds - before.texture_binds == 1, "Failed: Expected 1 texture bind, got %llu", after.texture_binds - before.texture_binds);
+	u64 vertex_bytes = (image_count+1)*4*sizeof(Gfx_Quad_Vertex);
+	u64 uploaded = after.bytes_uploaded - before.bytes_uploaded;
+	assert(uploaded >= vertex_bytes && uploaded <= vertex_bytes + sizeof(Matrix4), "Failed: Wrong upload size %llu", uploaded);
+
+	// Images too big for texture arrays each take one of the 32 texture slots, and images of
+	// different sizes each take one of the 16 texture array slots.
+	Gfx_Image *big_images[40];
+	Gfx_Image *sized_images[20];
+	for (u64 i = 0; i < 40; i++) {
+		big_images[i] = make_image(NULL_TEXTURE_ARRAY_MAX_IMAGE_SIZE+1, 1, 1, 0, allocator);
+		assert(!big_images[i]->gfx_handle->batched.texture_array, "Failed: Big image should not be in a texture array");
+	}
+	for (u64 i = 0; i < 20; i++) sized_images[i] = make_image(i+2, 3, 4, 0, allocator);
+
+	draw_frame_reset(frame);
+	for (u64 i = 0; i < 40; i++) draw_image_in_frame(big_images[i], v2(0, 0), v2(1, 1), COLOR_WHITE, frame);
+	before = gfx_null_get_current_frame_stats();
+	gfx_render_draw_frame(frame, 0);
+	after = gfx_null_get_current_frame_stats();
+	assert(after.draw_calls - before.draw_calls == 2, "Failed: Expected 2 draw calls, got %llu", after.draw_calls - before.draw_calls);
+	assert(after.texture_limit_flushes - before.texture_limit_flushes == 1, "Failed: Expected 1 flush from the texture limit");
+	assert(after.texture_binds - before.texture_binds == 40, "Failed: Expected 40 texture binds, got %llu", after.texture_binds - before.texture_binds);
+
+	draw_frame_reset(frame);
+	for (u64 i = 0; i < 20; i++) draw_image_in_frame(sized_images[i], v2(0, 0), v2(1, 1), COLOR_WHITE, frame);
+	before = gfx_null_get_current_frame_stats();
+	gfx_render_draw_frame(frame, 0);
+	after = gfx_null_get_current_frame_stats();
+	assert(after.draw_calls - before.draw_calls == 2, "Failed: Expected 2 draw calls, got %llu", after.draw_calls - before.draw_calls);
+	assert(after.texture_limit_flushes - before.texture_limit_flushes == 1, "Failed: Expected 1 flush from the texture array limit");
+	assert(after.texture_binds - before.texture_binds == 20, "Failed: Expected 20 texture array binds, got %llu", after.texture_binds - before.texture_binds);
+
+	// Texture arrays are released with their last image
+	u64 array_count = growing_array_get_valid_count(gfx_texture_arrays);
+	for (u64 i = 0; i < 40; i++) delete_image(big_images[i]);
+	for (u64 i = 0; i < 20; i++) delete_image(sized_images[i]);
+	assert(growing_array_get_valid_count(gfx_texture_arrays) == array_count-20, "Failed: Texture arrays were not released");
+
+	// Cached draw lists only upload when they change
+	Draw_List list;
+	draw_list_init(&list);
+	for (u64 i = 0; i < 10; i++) {
+		draw_list_add_image(&list, images[i], v2(i, 0), v2(1, 1), COLOR_WHITE);
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		draw_frame_reset(frame);
+		draw_rect_in_frame(v2(0, 0), v2(1, 1), COLOR_WHITE, frame);
+		draw_list_in_frame(&list, frame);
+
+		before = gfx_null_get_current_frame_stats();
+		gfx_render_draw_frame(frame, 0);
+		after = gfx_null_get_current_frame_stats();
+
+		u64 expected_list_bytes = pass == 0 ? 10*4*sizeof(Gfx_Quad_Vertex) : 0;
+		u64 list_uploaded = after.bytes_uploaded - before.bytes_uploaded - 4*sizeof(Gfx_Quad_Vertex);
+		assert(after.draw_calls - before.draw_calls == 2, "Failed: Expected a draw call for the quad and one for the list");
+		assert(after.draw_list_cache_rebuilds - before.draw_list_cache_rebuilds == (pass == 0 ? 1 : 0), "Failed: Wrong number of draw list rebuilds");
+		// Transform uploads switch between identity & the list transform
+		assert(list_uploaded >= expected_list_bytes && list_uploaded <= expected_list_bytes + 2*sizeof(Matrix4), "Failed: Wrong draw list upload size %llu", list_uploaded);
+	}
+	draw_list_destroy(&list);
+
+	// gfx_update ends the frame
+	gfx_update();
+	Gfx_Null_Frame_Stats last = gfx_null_get_frame_stats();
+	Gfx_Null_Frame_Stats current = gfx_null_get_current_frame_stats();
+	assert(last.frames_rendered >= 3, "Failed: Frame stats were not kept");
+	assert(current.frames_rendered == 0 && current.draw_calls == 0 && current.bytes_uploaded == 0, "Failed: Frame stats were not reset");
+	assert(last.texture_arrays == array_count-20, "Failed: Wrong texture array count %llu", last.texture_arrays);
+
+	draw_frame_destroy(frame);
+	dealloc(allocator, frame);
+	for (u64 i = 0; i < image_count; i++) delete_image(images[i]);
+}
+#endif
+
 #endif /* OOGABOOGA_HEADLESS */
 
 typedef struct Test_Thing {
@@ -1698,6 +3566,132 @@ void test_os_binary_semaphore() {
 
 }
 
+typedef struct Parallel_For_Test_Data {
+    volatile u64 *hits;
+    volatile u64 sum;
+} Parallel_For_Test_Data;
+void parallel_for_test_job(u64 job_index, void *data) {
+    Parallel_For_Test_Data *d = (Parallel_For_Test_Data*)data;
+    d->hits[job_index] += 1;
+    atomic_add_64(&d->sum, job_index);
+}
+void parallel_for_test_nested_job(u64 job_index, void *data) {
+    // Pool is busy, so this should just run inline
+    parallel_for(4, parallel_for_test_job, data);
+}
+
+void test_parallel_sort() {
+    Allocator allocator = get_heap_allocator();
+
+    {
+        const u64 job_count = 1000;
+        Parallel_For_Test_Data data = ZERO(Parallel_For_Test_Data);
+        data.hits = alloc(allocator, sizeof(u64)*job_count);
+        memset((void*)data.hits, 0, sizeof(u64)*job_count);
+
+        parallel_for(job_count, parallel_for_test_job, &data);
+        for (u64 i = 0; i < job_count; i++) {
+            assert(data.hits[i] == 1, "Failed: parallel_for job %i ran %i times", i, data.hits[i]);
+        }
+        assert(data.sum == (job_count*(job_count-1))/2, "Failed: parallel_for sum");
+
+        data.sum = 0;
+        memset((void*)data.hits, 0, sizeof(u64)*job_count);
+        parallel_for(8, parallel_for_test_nested_job, &data);
+        assert(data.sum == 8*(0+1+2+3), "Failed: nested parallel_for");
+
+        dealloc(allocator, (void*)data.hits);
+    }
+
+    u64 counts[]  = {1000, 100000, 1000000};
+    int samples[] = {100, 10, 3};
+
+    u64 max_count = counts[2];
+
+    u64 *keys      = alloc(allocator, max_count*sizeof(u64));
+    u64 *help_keys = alloc(allocator, max_count*sizeof(u64));
+    u64 *original  = alloc(allocator, max_count*sizeof(u64));
+    u32 *indices      = alloc(allocator, max_count*sizeof(u32));
+    u32 *help_indices = alloc(allocator, max_count*sizeof(u32));
+    Radix_Key_Value_U64 *pairs      = alloc(allocator, max_count*sizeof(Radix_Key_Value_U64));
+    Radix_Key_Value_U64 *help_pairs = alloc(allocator, max_count*sizeof(Radix_Key_Value_U64));
+
+    for (u64 c = 0; c < sizeof(counts)/sizeof(counts[0]); c++) {
+        u64 item_count = counts[c];
+        int num_samples = samples[c];
+
+        f64 serial_seconds = 0;
+        f64 parallel_seconds = 0;
+
+        for (int a = 0; a < num_samples; a++) {
+
+            // Low 32 bits sorted with the old serial radix sort to compare against
+            for (u64 i = 0; i < item_count; i++) {
+                keys[i] = get_random() & 0xFFFFFFFF;
+            }
+            float64 start_seconds = os_get_elapsed_seconds();
+            radix_sort(keys, help_keys, item_count, sizeof(u64), 0, 32);
+            serial_seconds += os_get_elapsed_seconds() - start_seconds;
+
+            for (u64 i = 0; i < item_count; i++) {
+                keys[i] = get_random() & 0xFFFFFFFF;
+                indices[i] = (u32)i;
+                original[i] = keys[i];
+            }
+            start_seconds = os_get_elapsed_seconds();
+            radix_sort_u64_with_indices(keys, indices, help_keys, help_indices, item_count, 0, 32);
+            parallel_seconds += os_get_elapsed_seconds() - start_seconds;
+
+            for (u64 i = 0; i < item_count; i++) {
+                assert(keys[i] == original[indices[i]], "Failed: index payload does not follow its key");
+                if (i == 0) continue;
+                assert(keys[i] >= keys[i-1], "Failed: not correctly sorted");
+                if (keys[i] == keys[i-1]) {
+                    assert(indices[i] > indices[i-1], "Failed: radix sort is not stable");
+                }
+            }
+        }
+
+        // Few distinct keys in high bits, most passes should be skipped
+        for (u64 i = 0; i < item_count; i++) {
+            pairs[i].key = (get_random() % 4) << 40;
+            pairs[i].value = i;
+        }
+        radix_sort_key_values_u64(pairs, help_pairs, item_count, 0, 64);
+        for (u64 i = 1; i < item_count; i++) {
+            assert(pairs[i].key >= pairs[i-1].key, "Failed: key values not correctly sorted");
+            if (pairs[i].key == pairs[i-1].key) {
+                assert(pairs[i].value > pairs[i-1].value, "Failed: key value sort is not stable");
+            }
+        }
+
+        u32 *keys32 = (u32*)keys;
+        u32 *help_keys32 = (u32*)help_keys;
+        for (u64 i = 0; i < item_count; i++) {
+            keys32[i] = (u32)get_random();
+        }
+        radix_sort_u32(keys32, help_keys32, item_count, 0, 32);
+        for (u64 i = 1; i < item_count; i++) {
+            assert(keys32[i] >= keys32[i-1], "Failed: u32 keys not correctly sorted");
+        }
+
+        print("Sorting %llu 32-bit keys: serial radix sort %.2f ms, parallel with indices %.2f ms (%llu threads)\n",
+            item_count,
+            (serial_seconds * 1000.0) / (float64)num_samples,
+            (parallel_seconds * 1000.0) / (float64)num_samples,
+            parallel_for_get_thread_count()
+        );
+    }
+
+    dealloc(allocator, keys);
+    dealloc(allocator, help_keys);
+    dealloc(allocator, original);
+    dealloc(allocator, indices);
+    dealloc(allocator, help_indices);
+    dealloc(allocator, pairs);
+    dealloc(allocator, help_pairs);
+}
+
 void oogabooga_run_tests() {
 	
 	print("Testing growing array... ");
@@ -1708,6 +3702,40 @@ void oogabooga_run_tests() {
 	test_allocator(true);
 	print("OK!\n");
 	
+	print("Testing heap size classes... ");
+	test_heap_size_classes();
+	print("OK!\n");
+	
+	print("Testing heap large allocations... ");
+	test_heap_large_allocations();
+	print("OK!\n");
+	
+	print("Testing heap trim... ");
+	test_heap_trim();
+	print("OK!\n");
+	
+	print("Testing arena... ");
+	test_arena();
+	print("OK!\n");
+	
+	print("Testing scratch arenas... ");
+	test_scratch_arenas();
+	print("OK!\n");
+	
+	print("Testing pool... ");
+	test_pool();
+	print("OK!\n");
+	
+#if ENABLE_HEAP_PROFILING
+	print("Testing heap profiling... ");
+	test_heap_profiling();
+	print("OK!\n");
+#endif
+	
+	print("Testing frame allocation check... ");
+	test_frame_allocation_check();
+	print("OK!\n");
+	
 	print("Testing threads... ");
 	test_threads();
 	print("OK!\n");
@@ -1747,11 +3775,84 @@ void oogabooga_run_tests() {
 	print("Testing binary semaphore... ");
 	test_os_binary_semaphore();
 	print("OK!\n");
+	
+	print("Testing parallel sort... ");
+	test_parallel_sort();
+	print("OK!\n");
 
 #ifndef OOGABOOGA_HEADLESS
 	print("Testing radix sort... ");
 	test_sort();
 	print("OK!\n");
+	
+	print("Testing z sort keys... ");
+	test_z_sort_keys();
+	print("OK!\n");
+	
+	print("Testing draw frame quad arena... ");
+	test_draw_frame_quad_arena();
+	print("OK!\n");
+	
+	print("Testing draw lists... ");
+	test_draw_list();
+	print("OK!\n");
+	
+	print("Testing draw frame group... ");
+	test_draw_frame_group();
+	print("OK!\n");
+	
+	print("Testing frame allocation check on a draw frame... ");
+	test_frame_allocation_check_draw_frame();
+	print("OK!\n");
+	
+	print("Testing draw capture... ");
+	test_draw_capture();
+	print("OK!\n");
+	
+	print("Testing texture atlas... ");
+	test_texture_atlas();
+	print("OK!\n");
+	
+#if TARGET_OS == WINDOWS
+	print("Testing glyph runs... ");
+	test_glyph_run();
+	print("OK!\n");
+	
+	print("Testing text layout cache... ");
+	test_text_layout_cache();
+	print("OK!\n");
+	
+	print("Testing text layout cache thread exit... ");
+	test_text_layout_cache_thread_exit();
+	print("OK!\n");
+	
+	print("Testing font atlas... ");
+	test_font_atlas();
+	print("OK!\n");
+	
+	print("Testing font disk cache... ");
+	test_font_disk_cache();
+	print("OK!\n");
+	
+	print("Testing font SDF... ");
+	test_font_sdf();
+	print("OK!\n");
+	
+	print("Testing sparse font atlas... ");
+	test_font_sparse_atlas();
+	print("OK!\n");
+#endif
+	
+#if GFX_RENDERER == GFX_RENDERER_SOFTWARE
+	print("Testing software renderer... ");
+	test_software_renderer();
+	print("OK!\n");
+#endif
+#if GFX_RENDERER == GFX_RENDERER_NULL
+	print("Testing null renderer... ");
+	test_null_renderer();
+	print("OK!\n");
+#endif
 #endif
 
 	
@@ -0,0 +1,394 @@
+/*
+
+	Texture atlas
+
+	Packs many small images into a few big atlas pages as they are loaded, so drawing a lot of
+	different sprites doesn't switch textures or run out of texture slots in a draw call.
+
+	Example Usage:
+
+		Texture_Atlas atlas;
+		texture_atlas_init(&atlas, 2048, 2048, 4, get_heap_allocator());
+
+		Gfx_Image *player = texture_atlas_load_image_from_disk(&atlas, STR("player.png"));
+		Gfx_Image *tree   = texture_atlas_load_image_from_disk(&atlas, STR("tree.png"));
+
+		while (...) {
+			...
+			// Works like any other image
+			draw_image(player, pos, v2(player->width, player->height), COLOR_WHITE);
+			...
+		}
+
+		texture_atlas_destroy(&atlas);
+
+	The images you get back are sub-images: image->atlas_page is the page they are packed in and
+	image->atlas_uv is where on the page. draw_image* & draw_list_add_image* handle that, but if
+	you set q->uv yourself (like for a sprite sheet) then map it with texture_atlas_map_uv().
+
+	Sub-images are owned by the atlas. Don't pass them to gfx_ functions or delete_image, use
+	texture_atlas_remove_image. Images too big for a page get their own image, so it's fine to
+	load everything through the atlas.
+
+	Packing is skyline bottom-left, one image at a time, so images can be added whenever. Each
+	image gets TEXTURE_ATLAS_PADDING pixels around it where its edge pixels are repeated, so
+	linear filtering doesn't bleed in the neighbours.
+
+	Freeing space:
+		- When the last image on a page is removed, the page is emptied and packed from scratch
+		- texture_atlas_evict_page() removes all images on a page at once, for example when the
+			sprites of a level are not needed anymore. Handles to those images are invalid after.
+		- Set atlas.max_pages to limit the number of pages. Adding an image returns 0 when it
+			doesn't fit anywhere and all pages are used.
+
+*/
+
+#ifndef TEXTURE_ATLAS_PADDING
+	#define TEXTURE_ATLAS_PADDING 1
+#endif
+
+typedef struct Texture_Atlas_Skyline_Node {
+	u32 x, y, width;
+} Texture_Atlas_Skyline_Node;
+
+typedef struct Texture_Atlas_Page {
+	Gfx_Image *image;
+	// Top edge of the packed images, left to right
+	Texture_Atlas_Skyline_Node *skyline; // Growing array
+	Gfx_Image **images; // Growing array, the sub-images on this page
+	u64 used_pixels;
+} Texture_Atlas_Page;
+
+typedef struct Texture_Atlas {
+	u32 page_width, page_height, channels;
+	// 0 for no limit
+	u32 max_pages;
+	Texture_Atlas_Page *pages; // Growing array
+	Allocator allocator;
+} Texture_Atlas;
+
+typedef struct Texture_Atlas_Stats {
+	u64 page_count;
+	u64 image_count;
+	// Used pixels / pixels in all pages, padding not included
+	float32 occupancy;
+} Texture_Atlas_Stats;
+
+void texture_atlas_init(Texture_Atlas *atlas, u32 page_width, u32 page_height, u32 channels, Allocator allocator) {
+	assert(channels > 0 && channels <= 4 && channels != 3, "Only 1, 2 or 4 channels allowed on images. Got %d", channels);
+	assert(page_width > 0 && page_height > 0, "Bad texture atlas page size %dx%d", page_width, page_height);
+
+	*atlas = ZERO(Texture_Atlas);
+	atlas->page_width = page_width;
+	atlas->page_height = page_height;
+	atlas->channels = channels;
+	atlas->allocator = allocator;
+	growing_array_init((void**)&atlas->pages, sizeof(Texture_Atlas_Page), allocator);
+}
+
+void texture_atlas_page_reset(Texture_Atlas *atlas, Texture_Atlas_Page *page) {
+	for (u64 i = 0; i < growing_array_get_valid_count(page->images); i++) {
+		dealloc(atlas->allocator, page->images[i]);
+	}
+	growing_array_clear((void**)&page->images);
+
+	growing_array_clear((void**)&page->skyline);
+	Texture_Atlas_Skyline_Node root = {0, 0, atlas->page_width};
+	growing_array_add((void**)&page->skyline, &root);
+
+	page->used_pixels = 0;
+}
+
+void texture_atlas_destroy(Texture_Atlas *atlas) {
+	for (u64 i = 0; i < growing_array_get_valid_count(atlas->pages); i++) {
+		Texture_Atlas_Page *page = &atlas->pages[i];
+		texture_atlas_page_reset(atlas, page);
+		delete_image(page->image);
+		growing_array_deinit((void**)&page->skyline);
+		growing_array_deinit((void**)&page->images);
+	}
+	growing_array_deinit((void**)&atlas->pages);
+	*atlas = ZERO(Texture_Atlas);
+}
+
+// Where a rect of width w placed at skyline node i would end up, or false if it doesn't fit
+bool texture_atlas_skyline_fit(Texture_Atlas *atlas, Texture_Atlas_Page *page, u64 i, u32 w, u32 h, u32 *out_y) {
+	Texture_Atlas_Skyline_Node *nodes = page->skyline;
+	u64 node_count = growing_array_get_valid_count(nodes);
+
+	u32 x = nodes[i].x;
+	if (x + w > atlas->page_width) return false;
+
+	// The rect rests on the highest node it spans
+	u32 y = 0;
+	s64 width_left = w;
+	while (width_left > 0) {
+		assert(i < node_count, "Skyline does not cover the page width");
+		y = max(y, nodes[i].y);
+		if (y + h > atlas->page_height) return false;
+		width_left -= nodes[i].width;
+		i += 1;
+	}
+
+	*out_y = y;
+	return true;
+}
+
+// Finds the lowest spot for a w*h rect. Ties go to the spot wasting the least width.
+bool texture_atlas_skyline_find(Texture_Atlas *atlas, Texture_Atlas_Page *page, u32 w, u32 h, u64 *out_node, u32 *out_x, u32 *out_y) {
+	u64 node_count = growing_array_get_valid_count(page->skyline);
+
+	bool found = false;
+	u32 best_bottom = UINT32_MAX;
+	u32 best_width = UINT32_MAX;
+	for (u64 i = 0; i < node_count; i++) {
+		u32 y;
+		if (!texture_atlas_skyline_fit(atlas, page, i, w, h, &y)) continue;
+
+		u32 bottom = y + h;
+		u32 width = page->skyline[i].width;
+		if (bottom < best_bottom || (bottom == best_bottom && width < best_width)) {
+			found = true;
+			best_bottom = bottom;
+			best_width = width;
+			*out_node = i;
+			*out_x = page->skyline[i].x;
+			*out_y = y;
+		}
+	}
+
+	return found;
+}
+
+void texture_atlas_skyline_remove(Texture_Atlas_Page *page, u64 index) {
+	u64 node_count = growing_array_get_valid_count(page->skyline);
+	memmove(page->skyline + index, page->skyline + index + 1, (node_count - index - 1)*sizeof(Texture_Atlas_Skyline_Node));
+	growing_array_pop((void**)&page->skyline);
+}
+
+void texture_atlas_skyline_insert(Texture_Atlas_Page *page, u64 index, u32 x, u32 y, u32 w, u32 h) {
+	// Put a new node on top of the rect
+	Texture_Atlas_Skyline_Node node = {x, y + h, w};
+	growing_array_add((void**)&page->skyline, &node);
+	u64 node_count = growing_array_get_valid_count(page->skyline);
+	Texture_Atlas_Skyline_Node *nodes = page->skyline;
+	memmove(nodes + index + 1, nodes + index, (node_count - index - 1)*sizeof(Texture_Atlas_Skyline_Node));
+	nodes[index] = node;
+
+	// Cut away the nodes that are now under the new one
+	u64 i = index + 1;
+	while (i < node_count) {
+		Texture_Atlas_Skyline_Node *prev = &nodes[i-1];
+		Texture_Atlas_Skyline_Node *n = &nodes[i];
+		if (n->x >= prev->x + prev->width) break;
+
+		u32 shrink = prev->x + prev->width - n->x;
+		if (shrink < n->width) {
+			n->x += shrink;
+			n->width -= shrink;
+			break;
+		}
+		texture_atlas_skyline_remove(page, i);
+		node_count -= 1;
+	}
+
+	// Merge neighbours at the same height
+	for (u64 j = 0; j + 1 < node_count;) {
+		if (nodes[j].y == nodes[j+1].y) {
+			nodes[j].width += nodes[j+1].width;
+			texture_atlas_skyline_remove(page, j+1);
+			node_count -= 1;
+		} else {
+			j += 1;
+		}
+	}
+}
+
+// Copies the pixels into a padded bitmap with the edge pixels repeated in the padding
+void texture_atlas_upload_padded(Texture_Atlas *atlas, Gfx_Image *page_image, u32 x, u32 y, u32 w, u32 h, u8 *pixels) {
+	const u32 pad = TEXTURE_ATLAS_PADDING;
+	u32 channels = atlas->channels;
+	u32 padded_w = w + pad*2;
+	u32 padded_h = h + pad*2;
+
+	Scratch scratch = scratch_begin();
+	u8 *padded = alloc(scratch.allocator, (u64)padded_w*padded_h*channels);
+
+	for (u32 row = 0; row < padded_h; row++) {
+		u32 src_row = (u32)clamp((s64)row - pad, 0, (s64)h-1);
+		u8 *src = pixels + (u64)src_row*w*channels;
+		u8 *dst = padded + (u64)row*padded_w*channels;
+
+		for (u32 p = 0; p < pad; p++) {
+			memcpy(dst + p*channels, src, channels);
+			memcpy(dst + (pad + w + p)*channels, src + (w-1)*channels, channels);
+		}
+		memcpy(dst + pad*channels, src, (u64)w*channels);
+	}
+
+	gfx_set_image_data(page_image, x, y, padded_w, padded_h, padded);
+
+	scratch_end(scratch);
+}
+
+Texture_Atlas_Page *texture_atlas_add_page(Texture_Atlas *atlas) {
+	Texture_Atlas_Page *page = growing_array_add_empty((void**)&atlas->pages);
+	*page = ZERO(Texture_Atlas_Page);
+	page->image = make_image(atlas->page_width, atlas->page_height, atlas->channels, 0, atlas->allocator);
+	growing_array_init((void**)&page->skyline, sizeof(Texture_Atlas_Skyline_Node), atlas->allocator);
+	growing_array_init((void**)&page->images, sizeof(Gfx_Image*), atlas->allocator);
+	texture_atlas_page_reset(atlas, page);
+
+	log_verbose("Texture atlas now has %d pages of %dx%d", growing_array_get_valid_count(atlas->pages), atlas->page_width, atlas->page_height);
+
+	return page;
+}
+
+// pixels are width*height*atlas->channels, bottom row first like load_image_from_disk
+Gfx_Image *texture_atlas_add_image(Texture_Atlas *atlas, u32 width, u32 height, void *pixels) {
+	assert(pixels, "Bad parameters passed to texture_atlas_add_image");
+	assert(width > 0 && height > 0, "Bad image size %dx%d passed to texture_atlas_add_image", width, height);
+
+	u32 padded_w = width + TEXTURE_ATLAS_PADDING*2;
+	u32 padded_h = height + TEXTURE_ATLAS_PADDING*2;
+
+	if (padded_w > atlas->page_width || padded_h > atlas->page_height) {
+		log_warning("Image of %dx%d does not fit in a %dx%d texture atlas page, it gets its own image.", width, height, atlas->page_width, atlas->page_height);
+		return make_image(width, height, atlas->channels, pixels, atlas->allocator);
+	}
+
+	Texture_Atlas_Page *page = 0;
+	u64 node;
+	u32 x, y;
+
+	// First page with room
+	u64 page_count = growing_array_get_valid_count(atlas->pages);
+	for (u64 i = 0; i < page_count; i++) {
+		if (texture_atlas_skyline_find(atlas, &atlas->pages[i], padded_w, padded_h, &node, &x, &y)) {
+			page = &atlas->pages[i];
+			break;
+		}
+	}
+
+	if (!page) {
+		if (atlas->max_pages && page_count >= atlas->max_pages) return 0;
+
+		page = texture_atlas_add_page(atlas);
+		bool ok = texture_atlas_skyline_find(atlas, page, padded_w, padded_h, &node, &x, &y);
+		assert(ok, "Image should always fit in an empty texture atlas page");
+	}
+
+	texture_atlas_skyline_insert(page, node, x, y, padded_w, padded_h);
+	page->used_pixels += (u64)width*height;
+
+	texture_atlas_upload_padded(atlas, page->image, x, y, width, height, pixels);
+
+	u32 image_x = x + TEXTURE_ATLAS_PADDING;
+	u32 image_y = y + TEXTURE_ATLAS_PADDING;
+
+	Gfx_Image *image = alloc(atlas->allocator, sizeof(Gfx_Image));
+	*image = ZERO(Gfx_Image);
+	image->width = width;
+	image->height = height;
+	image->channels = atlas->channels;
+	image->allocator = atlas->allocator;
+	image->gfx_handle = GFX_INVALID_HANDLE;
+	image->atlas_page = page->image;
+	image->atlas_uv.x1 = (float32)image_x/(float32)atlas->page_width;
+	image->atlas_uv.y1 = (float32)image_y/(float32)atlas->page_height;
+	image->atlas_uv.x2 = (float32)(image_x+width)/(float32)atlas->page_width;
+	image->atlas_uv.y2 = (float32)(image_y+height)/(float32)atlas->page_height;
+
+	growing_array_add((void**)&page->images, &image);
+
+	return image;
+}
+
+Gfx_Image *texture_atlas_load_image_from_disk(Texture_Atlas *atlas, string path) {
+	assert(atlas->channels == 4, "texture_atlas_load_image_from_disk needs an atlas with 4 channels");
+
+	string png;
+	bool ok = os_read_entire_file(path, &png, atlas->allocator);
+	if (!ok) return 0;
+
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load(1);
+	third_party_allocator = atlas->allocator;
+	unsigned char* stb_data = stbi_load_from_memory(png.data, png.count, &width, &height, &channels, STBI_rgb_alpha);
+
+	dealloc_string(atlas->allocator, png);
+
+	Gfx_Image *image = 0;
+	if (stb_data) {
+		image = texture_atlas_add_image(atlas, (u32)width, (u32)height, stb_data);
+		stbi_image_free(stb_data);
+	}
+
+	third_party_allocator = ZERO(Allocator);
+
+	return image;
+}
+
+s64 texture_atlas_find_page(Texture_Atlas *atlas, Gfx_Image *page_image) {
+	for (u64 i = 0; i < growing_array_get_valid_count(atlas->pages); i++) {
+		if (atlas->pages[i].image == page_image) return (s64)i;
+	}
+	return -1;
+}
+
+void texture_atlas_remove_image(Texture_Atlas *atlas, Gfx_Image *image) {
+	if (!image->atlas_page) {
+		// Was too big for the atlas
+		delete_image(image);
+		return;
+	}
+
+	s64 page_index = texture_atlas_find_page(atlas, image->atlas_page);
+	assert(page_index != -1, "Image is not in this texture atlas");
+	Texture_Atlas_Page *page = &atlas->pages[page_index];
+
+	s32 index = growing_array_find_index_from_left_by_value((void**)&page->images, &image);
+	assert(index != -1, "Image is not in this texture atlas (was its page evicted?)");
+	growing_array_unordered_remove_by_index((void**)&page->images, (u32)index);
+
+	page->used_pixels -= (u64)image->width*image->height;
+	dealloc(atlas->allocator, image);
+
+	// #Incomplete the skyline can't give back space in the middle, so the space is only reused
+	// when the page is empty.
+	if (growing_array_get_valid_count(page->images) == 0) {
+		texture_atlas_page_reset(atlas, page);
+	}
+}
+
+// Removes all images on the page and packs it from scratch. Handles to them are invalid after.
+void texture_atlas_evict_page(Texture_Atlas *atlas, u64 page_index) {
+	assert(page_index < growing_array_get_valid_count(atlas->pages), "Texture atlas page index %d out of range", page_index);
+	texture_atlas_page_reset(atlas, &atlas->pages[page_index]);
+}
+
+// Maps a uv rect in the image to the atlas page. Does nothing for images not in an atlas.
+Vector4 texture_atlas_map_uv(Gfx_Image *image, Vector4 uv) {
+	if (!image->atlas_page) return uv;
+
+	Vector4 r = image->atlas_uv;
+	float32 w = r.x2 - r.x1;
+	float32 h = r.y2 - r.y1;
+	return v4(r.x1 + uv.x1*w, r.y1 + uv.y1*h, r.x1 + uv.x2*w, r.y1 + uv.y2*h);
+}
+
+Texture_Atlas_Stats texture_atlas_get_stats(Texture_Atlas *atlas) {
+	Texture_Atlas_Stats stats = ZERO(Texture_Atlas_Stats);
+	stats.page_count = growing_array_get_valid_count(atlas->pages);
+
+	u64 used_pixels = 0;
+	for (u64 i = 0; i < stats.page_count; i++) {
+		stats.image_count += growing_array_get_valid_count(atlas->pages[i].images);
+		used_pixels += atlas->pages[i].used_pixels;
+	}
+
+	u64 total_pixels = stats.page_count*atlas->page_width*atlas->page_height;
+	stats.occupancy = total_pixels ? (float32)used_pixels/(float32)total_pixels : 0;
+
+	return stats;
+}